@@ -13,6 +13,7 @@
   NSURL* _gogSetupURL;
   uint32_t _filesUnpacked;
   uint32_t _filesToUnpack;
+  BOOL _aggregateProgress;
 }
 
 - (id)initWithGOGSetupURL:(NSURL*)url;
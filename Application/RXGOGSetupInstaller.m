@@ -59,7 +59,11 @@
   release_assert(unpackgogsetupTask);
   [unpackgogsetupTask setLaunchPath:unpackgogsetupPath];
   [unpackgogsetupTask setCurrentDirectoryPath:destination];
-  [unpackgogsetupTask setArguments:[NSArray arrayWithObject:[_gogSetupURL path]]];
+  // the archives are still unpacked in full before the game starts, rather than read out of the setup through MHKKit's Inno data source:
+  // the data archives hold the card movies, which QuickTime can only play out of the archive file itself
+  // -j 0 unpacks as many files at once as there are cores; the tool then reports progress for all the files together
+  // -r skips archives a previous, interrupted install already unpacked and verified
+  [unpackgogsetupTask setArguments:[NSArray arrayWithObjects:@"-j", @"0", @"-r", [_gogSetupURL path], nil]];
 
   NSPipe* pipe = [NSPipe new];
   [unpackgogsetupTask setStandardOutput:pipe];
@@ -85,6 +89,16 @@
         return;
       }
 
+      if ([line hasPrefix:@"<<= "]) {
+        _aggregateProgress = YES;
+
+        [self willChangeValueForKey:@"progress"];
+        progress = [[line substringFromIndex:4] doubleValue];
+        [self didChangeValueForKey:@"progress"];
+
+        return;
+      }
+
       if ([line hasPrefix:@"<< "]) {
         double progressFile = [[line substringFromIndex:3] doubleValue];
 
@@ -98,6 +112,9 @@
       [self setValue:[NSString stringWithFormat:NSLocalizedStringFromTable(@"INSTALLER_FILE_COPY", @"Installer", NULL), line] forKey:@"stage"];
 
       _filesUnpacked++;
+      if (_aggregateProgress)
+        return;
+
       [self willChangeValueForKey:@"progress"];
       progress = (double)(_filesUnpacked - 1) / _filesToUnpack;
       [self didChangeValueForKey:@"progress"];
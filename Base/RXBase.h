@@ -48,13 +48,16 @@
 
 __BEGIN_DECLS
 void __assert_rtn(const char*, const char*, int, const char*) __dead2;
+
+//! Runs the abort handler, then fails like assert(). This is the failure path of release_assert.
+extern void rx_assert_failed(const char* function, const char* file, int line, const char* expression) __dead2;
 __END_DECLS
 
 #if defined(DEBUG)
-#define release_assert(e) (__builtin_expect(!(e), 0) ? __assert_rtn(__PRETTY_FUNCTION__, __FILE__, __LINE__, #e) : (void)0)
+#define release_assert(e) (__builtin_expect(!(e), 0) ? rx_assert_failed(__PRETTY_FUNCTION__, __FILE__, __LINE__, #e) : (void)0)
 #define debug_assert(e) release_assert(e)
 #else
-#define release_assert(e) (__builtin_expect(!(e), 0) ? __assert_rtn(__PRETTY_FUNCTION__, "", 0, #e) : (void)0)
+#define release_assert(e) (__builtin_expect(!(e), 0) ? rx_assert_failed(__PRETTY_FUNCTION__, "", 0, #e) : (void)0)
 #define debug_assert(e) ((void)0)
 #endif
 
@@ -105,6 +108,10 @@ __BEGIN_DECLS
 //! Formats and logs the specified message to stdout and to CrashReporter before calling abort().
 extern void rx_abort(const char* format, ...) __attribute__((noreturn)) __attribute__((format(printf, 1, 2)));
 
+//! Sets a function that rx_abort and failed release_asserts call before the process terminates, e.g. to write out buffered logs.
+//! The handler runs at most once.
+extern void rx_set_abort_handler(void (*handler)(void));
+
 __END_DECLS
 
 // Objective-C specific section
@@ -0,0 +1,227 @@
+//
+//  RXBitfield.h
+//  rivenx
+//
+
+#if !defined(RX_BITFIELD_H)
+#define RX_BITFIELD_H
+
+#include <sys/cdefs.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+__BEGIN_DECLS
+
+// A growable bitfield stored in uintptr_t segments. Every operation works a segment at a time with the compiler's count trailing zeros
+// and population count intrinsics. Bits past the last segment read as clear, and setting one of them grows the bitfield. This is the
+// plain C core of RXDynamicBitfield, for callers that cannot afford a message send per operation.
+
+#define RX_BITFIELD_SEGMENT_BITS (sizeof(uintptr_t) << 3)
+#define RX_BITFIELD_NOT_FOUND UINTPTR_MAX
+
+struct rx_bitfield {
+  uintptr_t* segments;
+  uintptr_t segment_count;
+};
+typedef struct rx_bitfield rx_bitfield_t;
+
+static inline uintptr_t rx_bitfield_segment_ctz(uintptr_t segment) { return (uintptr_t)__builtin_ctzl((unsigned long)segment); }
+static inline uintptr_t rx_bitfield_segment_popcount(uintptr_t segment) { return (uintptr_t)__builtin_popcountl((unsigned long)segment); }
+
+// mask of the bits [first, first + count) of a segment; count must be between 1 and RX_BITFIELD_SEGMENT_BITS - first
+static inline uintptr_t rx_bitfield_segment_mask(uintptr_t first, uintptr_t count)
+{
+  uintptr_t mask = (count == RX_BITFIELD_SEGMENT_BITS) ? UINTPTR_MAX : (((uintptr_t)1 << count) - 1);
+  return mask << first;
+}
+
+static inline void rx_bitfield_init(rx_bitfield_t* bf, uintptr_t segment_count)
+{
+  bf->segment_count = segment_count;
+  bf->segments = (uintptr_t*)calloc(segment_count ? segment_count : 1, sizeof(uintptr_t));
+}
+
+static inline void rx_bitfield_destroy(rx_bitfield_t* bf)
+{
+  free(bf->segments);
+  bf->segments = NULL;
+  bf->segment_count = 0;
+}
+
+static inline void rx_bitfield_grow(rx_bitfield_t* bf, uintptr_t segment_count)
+{
+  if (segment_count <= bf->segment_count)
+    return;
+  bf->segments = (uintptr_t*)realloc(bf->segments, segment_count * sizeof(uintptr_t));
+  memset(bf->segments + bf->segment_count, 0, (segment_count - bf->segment_count) * sizeof(uintptr_t));
+  bf->segment_count = segment_count;
+}
+
+static inline uintptr_t rx_bitfield_capacity(const rx_bitfield_t* bf) { return bf->segment_count * RX_BITFIELD_SEGMENT_BITS; }
+
+static inline bool rx_bitfield_is_set(const rx_bitfield_t* bf, uintptr_t index)
+{
+  uintptr_t segment_index = index / RX_BITFIELD_SEGMENT_BITS;
+  if (segment_index >= bf->segment_count)
+    return false;
+  return (bf->segments[segment_index] >> (index % RX_BITFIELD_SEGMENT_BITS)) & 1;
+}
+
+static inline void rx_bitfield_set(rx_bitfield_t* bf, uintptr_t index)
+{
+  uintptr_t segment_index = index / RX_BITFIELD_SEGMENT_BITS;
+  if (segment_index >= bf->segment_count)
+    rx_bitfield_grow(bf, segment_index + 1);
+  bf->segments[segment_index] |= (uintptr_t)1 << (index % RX_BITFIELD_SEGMENT_BITS);
+}
+
+static inline void rx_bitfield_clear(rx_bitfield_t* bf, uintptr_t index)
+{
+  uintptr_t segment_index = index / RX_BITFIELD_SEGMENT_BITS;
+  if (segment_index >= bf->segment_count)
+    return;
+  bf->segments[segment_index] &= ~((uintptr_t)1 << (index % RX_BITFIELD_SEGMENT_BITS));
+}
+
+// index of the first set bit at or after from, or RX_BITFIELD_NOT_FOUND
+static inline uintptr_t rx_bitfield_find_next_set(const rx_bitfield_t* bf, uintptr_t from)
+{
+  uintptr_t segment_index = from / RX_BITFIELD_SEGMENT_BITS;
+  if (segment_index >= bf->segment_count)
+    return RX_BITFIELD_NOT_FOUND;
+
+  uintptr_t segment = bf->segments[segment_index] & (UINTPTR_MAX << (from % RX_BITFIELD_SEGMENT_BITS));
+  for (;;) {
+    if (segment)
+      return segment_index * RX_BITFIELD_SEGMENT_BITS + rx_bitfield_segment_ctz(segment);
+    if (++segment_index == bf->segment_count)
+      return RX_BITFIELD_NOT_FOUND;
+    segment = bf->segments[segment_index];
+  }
+}
+
+// index of the first clear bit at or after from; this is past the end of the bitfield if every bit from there on is set
+static inline uintptr_t rx_bitfield_find_next_clear(const rx_bitfield_t* bf, uintptr_t from)
+{
+  uintptr_t segment_index = from / RX_BITFIELD_SEGMENT_BITS;
+  if (segment_index >= bf->segment_count)
+    return from;
+
+  uintptr_t segment = ~bf->segments[segment_index] & (UINTPTR_MAX << (from % RX_BITFIELD_SEGMENT_BITS));
+  for (;;) {
+    if (segment)
+      return segment_index * RX_BITFIELD_SEGMENT_BITS + rx_bitfield_segment_ctz(segment);
+    if (++segment_index == bf->segment_count)
+      return segment_index * RX_BITFIELD_SEGMENT_BITS;
+    segment = ~bf->segments[segment_index];
+  }
+}
+
+static inline uintptr_t rx_bitfield_find_first_set(const rx_bitfield_t* bf) { return rx_bitfield_find_next_set(bf, 0); }
+static inline uintptr_t rx_bitfield_find_first_clear(const rx_bitfield_t* bf) { return rx_bitfield_find_next_clear(bf, 0); }
+
+static inline uintptr_t rx_bitfield_popcount(const rx_bitfield_t* bf)
+{
+  uintptr_t count = 0;
+  for (uintptr_t segment_index = 0; segment_index < bf->segment_count; segment_index++)
+    count += rx_bitfield_segment_popcount(bf->segments[segment_index]);
+  return count;
+}
+
+static inline bool rx_bitfield_is_all_set(const rx_bitfield_t* bf)
+{
+  for (uintptr_t segment_index = 0; segment_index < bf->segment_count; segment_index++) {
+    if (bf->segments[segment_index] != UINTPTR_MAX)
+      return false;
+  }
+  return true;
+}
+
+// sets the bits [start, start + length), growing the bitfield as needed
+static inline void rx_bitfield_set_range(rx_bitfield_t* bf, uintptr_t start, uintptr_t length)
+{
+  if (length == 0)
+    return;
+  uintptr_t end = start + length;
+  rx_bitfield_grow(bf, (end + RX_BITFIELD_SEGMENT_BITS - 1) / RX_BITFIELD_SEGMENT_BITS);
+
+  uintptr_t first = start / RX_BITFIELD_SEGMENT_BITS, last = (end - 1) / RX_BITFIELD_SEGMENT_BITS;
+  uintptr_t first_bit = start % RX_BITFIELD_SEGMENT_BITS, last_bit = (end - 1) % RX_BITFIELD_SEGMENT_BITS;
+  if (first == last) {
+    bf->segments[first] |= rx_bitfield_segment_mask(first_bit, last_bit - first_bit + 1);
+    return;
+  }
+
+  bf->segments[first] |= rx_bitfield_segment_mask(first_bit, RX_BITFIELD_SEGMENT_BITS - first_bit);
+  if (last > first + 1)
+    memset(bf->segments + first + 1, 0xFF, (last - first - 1) * sizeof(uintptr_t));
+  bf->segments[last] |= rx_bitfield_segment_mask(0, last_bit + 1);
+}
+
+// clears the bits [start, start + length); bits past the end of the bitfield are already clear
+static inline void rx_bitfield_clear_range(rx_bitfield_t* bf, uintptr_t start, uintptr_t length)
+{
+  uintptr_t end = start + length;
+  if (end > rx_bitfield_capacity(bf))
+    end = rx_bitfield_capacity(bf);
+  if (start >= end)
+    return;
+
+  uintptr_t first = start / RX_BITFIELD_SEGMENT_BITS, last = (end - 1) / RX_BITFIELD_SEGMENT_BITS;
+  uintptr_t first_bit = start % RX_BITFIELD_SEGMENT_BITS, last_bit = (end - 1) % RX_BITFIELD_SEGMENT_BITS;
+  if (first == last) {
+    bf->segments[first] &= ~rx_bitfield_segment_mask(first_bit, last_bit - first_bit + 1);
+    return;
+  }
+
+  bf->segments[first] &= ~rx_bitfield_segment_mask(first_bit, RX_BITFIELD_SEGMENT_BITS - first_bit);
+  if (last > first + 1)
+    memset(bf->segments + first + 1, 0, (last - first - 1) * sizeof(uintptr_t));
+  bf->segments[last] &= ~rx_bitfield_segment_mask(0, last_bit + 1);
+}
+
+// Atomic operations, for bitfields shared between threads. They never grow the bitfield, so the bitfield must be sized up front and
+// must not be grown while other threads use it. Setting a bit is a release operation and exchanging a segment is an acquire-release
+// operation, so data written before setting a bit is visible to a thread that observes the bit in an exchanged segment.
+
+static inline uintptr_t rx_bitfield_segment_clz(uintptr_t segment) { return (uintptr_t)__builtin_clzl((unsigned long)segment); }
+
+// atomically claims the first clear bit; returns RX_BITFIELD_NOT_FOUND if every bit is set
+static inline uintptr_t rx_bitfield_atomic_claim_first_clear(rx_bitfield_t* bf)
+{
+  for (uintptr_t segment_index = 0; segment_index < bf->segment_count; segment_index++) {
+    uintptr_t segment = __atomic_load_n(bf->segments + segment_index, __ATOMIC_RELAXED);
+    while (~segment) {
+      uintptr_t bit = (uintptr_t)1 << rx_bitfield_segment_ctz(~segment);
+      if (__atomic_compare_exchange_n(bf->segments + segment_index, &segment, segment | bit, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return segment_index * RX_BITFIELD_SEGMENT_BITS + rx_bitfield_segment_ctz(bit);
+    }
+  }
+  return RX_BITFIELD_NOT_FOUND;
+}
+
+static inline void rx_bitfield_atomic_set(rx_bitfield_t* bf, uintptr_t index)
+{
+  __atomic_fetch_or(bf->segments + index / RX_BITFIELD_SEGMENT_BITS, (uintptr_t)1 << (index % RX_BITFIELD_SEGMENT_BITS), __ATOMIC_RELEASE);
+}
+
+static inline void rx_bitfield_atomic_clear(rx_bitfield_t* bf, uintptr_t index)
+{
+  __atomic_fetch_and(bf->segments + index / RX_BITFIELD_SEGMENT_BITS, ~((uintptr_t)1 << (index % RX_BITFIELD_SEGMENT_BITS)), __ATOMIC_RELEASE);
+}
+
+static inline uintptr_t rx_bitfield_atomic_exchange_segment(rx_bitfield_t* bf, uintptr_t segment_index, uintptr_t value)
+{
+  return __atomic_exchange_n(bf->segments + segment_index, value, __ATOMIC_ACQ_REL);
+}
+
+// iterates over the indices of the set bits in increasing order; the bitfield may be modified at or before the current index
+#define rx_bitfield_foreach_set(bf, index)                                                                                                       \
+  for (uintptr_t index = rx_bitfield_find_next_set((bf), 0); index != RX_BITFIELD_NOT_FOUND; index = rx_bitfield_find_next_set((bf), index + 1))
+
+__END_DECLS
+
+#endif // RX_BITFIELD_H
@@ -7,10 +7,10 @@
 //
 
 #import "Base/RXBase.h"
+#import "Base/RXBitfield.h"
 
 @interface RXDynamicBitfield : NSObject {
-  uintptr_t* _segments;
-  uintptr_t _segment_count;
+  rx_bitfield_t _bits;
 }
 
 - (BOOL)isSet:(uintptr_t)index;
@@ -21,7 +21,24 @@
 - (void)clearAll;
 - (void)setAll;
 
+// ranges may extend past the end of the bitfield; setting bits there grows it
+- (void)setRange:(NSRange)range;
+- (void)clearRange:(NSRange)range;
+
+// findFirstSet returns NSNotFound if no bit is set; findFirstClear returns the capacity of the bitfield if every bit is set
+- (uintptr_t)findFirstSet;
+- (uintptr_t)findFirstClear;
+- (uintptr_t)findNextSet:(uintptr_t)index;
+- (uintptr_t)findNextClear:(uintptr_t)index;
+
+- (uintptr_t)countSet;
+
+- (void)enumerateSetBitsUsingBlock:(void (^)(uintptr_t index, BOOL* stop))block;
+
 - (uintptr_t)segmentCount;
 - (size_t)segmentBits;
 
+// the underlying bitfield, for use with the RXBitfield.h functions; valid until the next message that may grow the bitfield
+- (rx_bitfield_t*)bitfield;
+
 @end
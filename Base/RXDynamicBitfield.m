@@ -16,69 +16,62 @@
   if (!self)
     return nil;
 
-  _segment_count = 1;
-  _segments = calloc(_segment_count, sizeof(uintptr_t));
+  rx_bitfield_init(&_bits, 1);
 
   return self;
 }
 
 - (void)dealloc
 {
-  free(_segments);
+  rx_bitfield_destroy(&_bits);
   [super dealloc];
 }
 
-- (void)_growTo:(uintptr_t)new_count
-{
-  debug_assert(new_count > _segment_count);
+- (BOOL)isSet:(uintptr_t)index { return rx_bitfield_is_set(&_bits, index) ? YES : NO; }
 
-  register size_t new_size = new_count * sizeof(uintptr_t);
-  register size_t old_size = _segment_count * sizeof(uintptr_t);
+- (void)set:(uintptr_t)index { rx_bitfield_set(&_bits, index); }
 
-  _segments = realloc(_segments, new_size);
-  bzero(BUFFER_OFFSET(_segments, old_size), new_size - old_size);
-  _segment_count = new_count;
-}
+- (void)clear:(uintptr_t)index { rx_bitfield_clear(&_bits, index); }
 
-- (BOOL)isSet:(uintptr_t)index
-{
-  register uintptr_t segment_index = index / (sizeof(uintptr_t) << 3);
-  if (segment_index >= _segment_count)
-    return NO;
-  return (_segments[segment_index] & (1U << (index % (sizeof(uintptr_t) << 3)))) ? YES : NO;
-}
+- (BOOL)isAllSet { return rx_bitfield_is_all_set(&_bits) ? YES : NO; }
 
-- (void)set:(uintptr_t)index
-{
-  register uintptr_t segment_index = index / (sizeof(uintptr_t) << 3);
-  if (segment_index >= _segment_count)
-    [self _growTo:segment_index + 1];
-  _segments[segment_index] |= 1U << (index % (sizeof(uintptr_t) << 3));
-}
+- (void)clearAll { bzero(_bits.segments, _bits.segment_count * sizeof(uintptr_t)); }
+
+- (void)setAll { memset(_bits.segments, 0xFF, _bits.segment_count * sizeof(uintptr_t)); }
 
-- (void)clear:(uintptr_t)index
+- (void)setRange:(NSRange)range { rx_bitfield_set_range(&_bits, range.location, range.length); }
+
+- (void)clearRange:(NSRange)range { rx_bitfield_clear_range(&_bits, range.location, range.length); }
+
+- (uintptr_t)findFirstSet { return [self findNextSet:0]; }
+
+- (uintptr_t)findFirstClear { return rx_bitfield_find_first_clear(&_bits); }
+
+- (uintptr_t)findNextSet:(uintptr_t)index
 {
-  register uintptr_t segment_index = index / (sizeof(uintptr_t) << 3);
-  if (segment_index >= _segment_count)
-    return;
-  _segments[segment_index] &= ~(1U << (index % (sizeof(uintptr_t) << 3)));
+  uintptr_t found = rx_bitfield_find_next_set(&_bits, index);
+  return (found == RX_BITFIELD_NOT_FOUND) ? NSNotFound : found;
 }
 
-- (BOOL)isAllSet
+- (uintptr_t)findNextClear:(uintptr_t)index { return rx_bitfield_find_next_clear(&_bits, index); }
+
+- (uintptr_t)countSet { return rx_bitfield_popcount(&_bits); }
+
+- (void)enumerateSetBitsUsingBlock:(void (^)(uintptr_t index, BOOL* stop))block
 {
-  for (uintptr_t segment_index = 0; segment_index < _segment_count; segment_index++) {
-    if (_segments[segment_index] != UINTPTR_MAX)
-      return NO;
+  BOOL stop = NO;
+  rx_bitfield_foreach_set(&_bits, index)
+  {
+    block(index, &stop);
+    if (stop)
+      break;
   }
-  return YES;
 }
 
-- (void)clearAll { bzero(_segments, _segment_count * sizeof(uintptr_t)); }
-
-- (void)setAll { memset(_segments, 0xFF, _segment_count * sizeof(uintptr_t)); }
+- (uintptr_t)segmentCount { return _bits.segment_count; }
 
-- (uintptr_t)segmentCount { return _segment_count; }
+- (size_t)segmentBits { return RX_BITFIELD_SEGMENT_BITS; }
 
-- (size_t)segmentBits { return sizeof(uintptr_t) << 3; }
+- (rx_bitfield_t*)bitfield { return &_bits; }
 
 @end
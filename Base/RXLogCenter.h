@@ -8,7 +8,17 @@
 
 #import "Base/RXBase.h"
 #import <pthread.h>
+#import <mach/semaphore.h>
 
+#define RX_LOG_FACILITY_COUNT 8
+
+struct rx_log_thread;
+
+// Log messages are appended to a ring owned by the logging thread and written out by a background writer, so that logging from the
+// script or audio threads costs formatting the message and a copy, never a write. Messages that find their thread's ring full are
+// dropped and counted; the writer reports how many. Errors and more serious messages are never dropped: they wait for room in the ring
+// and for the writer to write them out, except on real-time threads and the writer thread, which only wake the writer up. The rings
+// are also flushed when the process exits, aborts or fails a release_assert.
 @interface RXLogCenter : NSObject {
 @private
   BOOL _toreDown;
@@ -17,17 +27,35 @@
   NSString* _logsBase;
 
   int _genericLogFD;
-
-  pthread_mutex_t _facilityFDMapMutex;
-  NSMutableDictionary* _facilityFDMap;
+  int _facilityFDs[RX_LOG_FACILITY_COUNT];
 
   uint32_t _levelFilter;
+
+  // every thread that logged, with its ring; the list only changes when a thread logs for the first time or the writer frees the
+  // ring of a thread that exited
+  pthread_key_t _threadKey;
+  pthread_mutex_t _threadsMutex;
+  struct rx_log_thread* _threads;
+
+  pthread_t _writerThread;
+  semaphore_t _writerSemaphore;
+  BOOL _writerShouldExit;
+
+  pthread_mutex_t _flushMutex;
+  pthread_cond_t _flushCondition;
+  uint64_t _drainGeneration;
 }
 
 + (RXLogCenter*)sharedLogCenter;
 
 - (void)tearDown;
 
-- (void)log:(NSString*)message facility:(NSString*)facility level:(int)level;
+- (BOOL)isLevelEnabled:(int)level;
+
+// message is the bare message; the writer adds the date, thread name and facility
+- (void)log:(NSString*)message facility:(const char*)facility level:(int)level;
+
+// returns once every message logged before the call is written
+- (void)flush;
 
 @end
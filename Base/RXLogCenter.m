@@ -9,27 +9,286 @@
 #import <unistd.h>
 #import <errno.h>
 #import <asl.h>
+#import <time.h>
+#import <sys/time.h>
+#import <mach/mach.h>
 
 #import "Base/RXLogCenter.h"
 
 #import "Base/RXErrors.h"
 #import "Base/RXLogging.h"
+#import "Base/RXLogRing.h"
+#import "Base/RXThreadUtilities.h"
 
 #import "Utilities/BZFSUtilities.h"
 
 #import <CoreServices/CoreServices.h>
 #import <Foundation/NSException.h>
-#import <Foundation/NSFileHandle.h>
 #import <Foundation/NSPathUtilities.h>
 
+// each thread's ring; at about 100 bytes a message, this holds several hundred messages between two writer passes
+#define RX_LOG_RING_CAPACITY 0x10000
+
+// the writer drains the rings at least this often, and sooner when woken up
+#define RX_LOG_WRITER_INTERVAL_NS 50000000
+
+#define RX_LOG_BATCH_SIZE 0x8000
+#define RX_LOG_THREAD_NAME_SIZE 64
+
+static const char** const rx_log_facilities[RX_LOG_FACILITY_COUNT] = {
+    &kRXLoggingBase,     &kRXLoggingEngine, &kRXLoggingRendering, &kRXLoggingScript,
+    &kRXLoggingGraphics, &kRXLoggingAudio,  &kRXLoggingEvents,    &kRXLoggingAnimation,
+};
+
+struct rx_log_thread {
+  rx_log_ring_t ring;
+  struct rx_log_thread* next;
+
+  // incremented by the thread when its ring is full, collected by the writer
+  uint32_t dropped;
+  bool exited;
+
+  // the thread name as last sent by the thread, and as last received by the writer
+  char producer_name[RX_LOG_THREAD_NAME_SIZE];
+  char name[RX_LOG_THREAD_NAME_SIZE];
+};
+
+struct rx_log_batch {
+  int fd;
+  size_t used;
+  char data[RX_LOG_BATCH_SIZE];
+};
+
+static RXLogCenter* g_sharedLogCenter = nil;
+
+static uint8_t rx_log_facility_id(const char* facility)
+{
+  for (uint8_t i = 0; i < RX_LOG_FACILITY_COUNT; i++) {
+    if (*rx_log_facilities[i] == facility)
+      return i;
+  }
+  for (uint8_t i = 0; i < RX_LOG_FACILITY_COUNT; i++) {
+    if (strcmp(*rx_log_facilities[i], facility) == 0)
+      return i;
+  }
+
+  // unknown facilities are logged as base messages
+  return 0;
+}
+
+static uint64_t rx_log_timestamp(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000000ull + (uint64_t)tv.tv_usec;
+}
+
+// the audio and display link threads run under a time constraint policy, and must never wait for the writer
+static bool rx_log_thread_is_realtime(void)
+{
+  thread_time_constraint_policy_data_t policy;
+  mach_msg_type_number_t count = THREAD_TIME_CONSTRAINT_POLICY_COUNT;
+  boolean_t get_default = FALSE;
+  kern_return_t kr = thread_policy_get(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY, (thread_policy_t)&policy, &count,
+                                       &get_default);
+  return kr == KERN_SUCCESS && !get_default;
+}
+
+static void rx_log_thread_exited(void* context)
+{
+  struct rx_log_thread* thread = (struct rx_log_thread*)context;
+  __atomic_store_n(&thread->exited, true, __ATOMIC_RELEASE);
+}
+
+static void rx_log_batch_flush(struct rx_log_batch* batch)
+{
+  const char* data = batch->data;
+  size_t left = batch->used;
+  while (left > 0) {
+    ssize_t written = write(batch->fd, data, left);
+    if (written == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    data += written;
+    left -= (size_t)written;
+  }
+  batch->used = 0;
+}
+
+static void rx_log_batch_append(struct rx_log_batch* batch, const void* bytes, size_t length)
+{
+  if (batch->fd == -1)
+    return;
+  if (batch->used + length > RX_LOG_BATCH_SIZE)
+    rx_log_batch_flush(batch);
+  if (length > RX_LOG_BATCH_SIZE) {
+    write(batch->fd, bytes, length);
+    return;
+  }
+  memcpy(batch->data + batch->used, bytes, length);
+  batch->used += length;
+}
+
+static void rx_log_center_exit(void) { [g_sharedLogCenter tearDown]; }
+
+// rx_abort and failed release_asserts write out what is in the rings before the process goes away
+static void rx_log_center_abort(void) { [g_sharedLogCenter flush]; }
+
 @implementation RXLogCenter
 
 + (RXLogCenter*)sharedLogCenter
 {
-  static RXLogCenter* center = nil;
-  if (center == nil)
-    center = [RXLogCenter new];
-  return center;
+  if (g_sharedLogCenter == nil)
+    g_sharedLogCenter = [RXLogCenter new];
+  return g_sharedLogCenter;
+}
+
+- (int)_openLogFile:(NSString*)name
+{
+  int fd = open([[_logsBase stringByAppendingPathComponent:name] fileSystemRepresentation], O_WRONLY | O_APPEND | O_TRUNC | O_CREAT, 0600);
+  if (fd == -1) {
+    NSError* error = [RXError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+    @throw [NSException exceptionWithName:@"RXFilesystemException"
+                                   reason:@"Riven X was unable to create a log file."
+                                 userInfo:[NSDictionary dictionaryWithObjectsAndKeys:error, NSUnderlyingErrorKey, nil]];
+  }
+  return fd;
+}
+
+- (void)_writerMain
+{
+  RXSetThreadName("org.macstorm.rivenx.log");
+
+  // one batch per log file, shared by the facilities that log to the same file
+  struct rx_log_batch* batches = calloc(RX_LOG_FACILITY_COUNT + 2, sizeof(struct rx_log_batch));
+  struct rx_log_batch* generic_batch = batches;
+  struct rx_log_batch* stderr_batch = batches + 1;
+  struct rx_log_batch* facility_batches[RX_LOG_FACILITY_COUNT];
+
+  generic_batch->fd = _genericLogFD;
+  stderr_batch->fd = STDERR_FILENO;
+  size_t batch_count = 2;
+  for (int i = 0; i < RX_LOG_FACILITY_COUNT; i++) {
+    facility_batches[i] = NULL;
+    for (size_t b = 2; b < batch_count; b++) {
+      if (batches[b].fd == _facilityFDs[i])
+        facility_batches[i] = batches + b;
+    }
+    if (!facility_batches[i]) {
+      facility_batches[i] = batches + batch_count++;
+      facility_batches[i]->fd = _facilityFDs[i];
+    }
+  }
+
+  time_t date_second = 0;
+  char date[32] = "";
+
+  mach_timespec_t interval = {0, RX_LOG_WRITER_INTERVAL_NS};
+  BOOL exiting = NO;
+  while (!exiting) {
+    semaphore_timedwait(_writerSemaphore, interval);
+    exiting = __atomic_load_n(&_writerShouldExit, __ATOMIC_ACQUIRE);
+
+    pthread_mutex_lock(&_threadsMutex);
+
+    // write the records of all threads in timestamp order
+    for (;;) {
+      struct rx_log_thread* oldest = NULL;
+      const rx_log_record_t* oldest_record = NULL;
+      for (struct rx_log_thread* thread = _threads; thread; thread = thread->next) {
+        const rx_log_record_t* record = rx_log_ring_peek(&thread->ring);
+        while (record && record->kind == RX_LOG_RECORD_THREAD_NAME) {
+          size_t length = MIN((size_t)record->length, sizeof(thread->name) - 1);
+          memcpy(thread->name, record->payload, length);
+          thread->name[length] = 0;
+          rx_log_ring_pop(&thread->ring);
+          record = rx_log_ring_peek(&thread->ring);
+        }
+        if (record && (!oldest_record || record->timestamp < oldest_record->timestamp)) {
+          oldest = thread;
+          oldest_record = record;
+        }
+      }
+      if (!oldest)
+        break;
+
+      // same format as NSDate descriptions
+      time_t second = (time_t)(oldest_record->timestamp / 1000000ull);
+      if (second != date_second) {
+        struct tm tm;
+        gmtime_r(&second, &tm);
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S +0000", &tm);
+        date_second = second;
+      }
+
+      char prefix[128 + RX_LOG_THREAD_NAME_SIZE];
+      int prefix_length = snprintf(prefix, sizeof(prefix), "%s [%s] [%s] ", date, oldest->name, *rx_log_facilities[oldest_record->facility]);
+      if (prefix_length < 0 || (size_t)prefix_length >= sizeof(prefix))
+        prefix_length = (int)strlen(prefix);
+
+      struct rx_log_batch* destinations[3] = {facility_batches[oldest_record->facility], generic_batch, NULL};
+      if (oldest_record->facility == 0 || oldest_record->level <= kRXLoggingLevelError)
+        destinations[2] = stderr_batch;
+      for (int d = 0; d < 3; d++) {
+        if (!destinations[d])
+          continue;
+        rx_log_batch_append(destinations[d], prefix, (size_t)prefix_length);
+        rx_log_batch_append(destinations[d], oldest_record->payload, oldest_record->length);
+        rx_log_batch_append(destinations[d], "\n", 1);
+      }
+
+      rx_log_ring_pop(&oldest->ring);
+    }
+
+    // report dropped messages, and free the rings of threads that exited once they are empty
+    struct rx_log_thread** link = &_threads;
+    while (*link) {
+      struct rx_log_thread* thread = *link;
+
+      uint32_t dropped = __atomic_exchange_n(&thread->dropped, 0, __ATOMIC_RELAXED);
+      if (dropped) {
+        char line[128 + RX_LOG_THREAD_NAME_SIZE];
+        int length = snprintf(line, sizeof(line), "%s [%s] [%s] %u log messages were dropped\n", date, thread->name, kRXLoggingBase, dropped);
+        if (length > 0)
+          rx_log_batch_append(generic_batch, line, MIN((size_t)length, sizeof(line) - 1));
+      }
+
+      if (__atomic_load_n(&thread->exited, __ATOMIC_ACQUIRE) && !rx_log_ring_peek(&thread->ring)) {
+        *link = thread->next;
+        rx_log_ring_destroy(&thread->ring);
+        free(thread);
+      } else
+        link = &thread->next;
+    }
+
+    pthread_mutex_unlock(&_threadsMutex);
+
+    for (size_t b = 0; b < batch_count; b++)
+      rx_log_batch_flush(batches + b);
+
+    pthread_mutex_lock(&_flushMutex);
+    _drainGeneration++;
+    pthread_cond_broadcast(&_flushCondition);
+    pthread_mutex_unlock(&_flushMutex);
+  }
+
+  // there will be no more passes; release the threads still waiting for one
+  pthread_mutex_lock(&_flushMutex);
+  _drainGeneration = UINT64_MAX;
+  pthread_cond_broadcast(&_flushCondition);
+  pthread_mutex_unlock(&_flushMutex);
+
+  free(batches);
+}
+
+static void* rx_log_writer_main(void* context)
+{
+  NSAutoreleasePool* pool = [NSAutoreleasePool new];
+  [(RXLogCenter*)context _writerMain];
+  [pool release];
+  return NULL;
 }
 
 - (id)init
@@ -60,55 +319,17 @@
                                    userInfo:[NSDictionary dictionaryWithObjectsAndKeys:error, NSUnderlyingErrorKey, nil]];
   }
 
-  // map facilities to certain log files
-  _facilityFDMap = [NSMutableDictionary new];
-  pthread_mutex_init(&_facilityFDMapMutex, NULL);
-
+  // map facilities to certain log files; facilities without one only go to the generic log
   // FIXME: better way than hardcoding facilities to log files
-  int fd;
-  NSFileHandle* fh;
-
-  fd = open([[_logsBase stringByAppendingPathComponent:@"Rendering.log"] fileSystemRepresentation], O_WRONLY | O_APPEND | O_TRUNC | O_CREAT, 0600);
-  if (fd == -1) {
-    error = [RXError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
-    @throw [NSException exceptionWithName:@"RXFilesystemException"
-                                   reason:@"Riven X was unable to create a log file."
-                                 userInfo:[NSDictionary dictionaryWithObjectsAndKeys:error, NSUnderlyingErrorKey, nil]];
-  }
-  fh = [[[NSFileHandle alloc] initWithFileDescriptor:fd closeOnDealloc:YES] autorelease];
-  [_facilityFDMap setObject:fh forKey:[NSString stringWithCString:kRXLoggingRendering encoding:NSASCIIStringEncoding]];
-  [_facilityFDMap setObject:fh forKey:[NSString stringWithCString:kRXLoggingGraphics encoding:NSASCIIStringEncoding]];
-  [_facilityFDMap setObject:fh forKey:[NSString stringWithCString:kRXLoggingAudio encoding:NSASCIIStringEncoding]];
-
-  fd = open([[_logsBase stringByAppendingPathComponent:@"Script.log"] fileSystemRepresentation], O_WRONLY | O_APPEND | O_TRUNC | O_CREAT, 0600);
-  if (fd == -1) {
-    error = [RXError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
-    @throw [NSException exceptionWithName:@"RXFilesystemException"
-                                   reason:@"Riven X was unable to create a log file."
-                                 userInfo:[NSDictionary dictionaryWithObjectsAndKeys:error, NSUnderlyingErrorKey, nil]];
-  }
-  fh = [[[NSFileHandle alloc] initWithFileDescriptor:fd closeOnDealloc:YES] autorelease];
-  [_facilityFDMap setObject:fh forKey:[NSString stringWithCString:kRXLoggingScript encoding:NSASCIIStringEncoding]];
+  for (int i = 0; i < RX_LOG_FACILITY_COUNT; i++)
+    _facilityFDs[i] = -1;
 
-  fd = open([[_logsBase stringByAppendingPathComponent:@"Base.log"] fileSystemRepresentation], O_WRONLY | O_APPEND | O_TRUNC | O_CREAT, 0600);
-  if (fd == -1) {
-    error = [RXError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
-    @throw [NSException exceptionWithName:@"RXFilesystemException"
-                                   reason:@"Riven X was unable to create a log file."
-                                 userInfo:[NSDictionary dictionaryWithObjectsAndKeys:error, NSUnderlyingErrorKey, nil]];
-  }
-  fh = [[[NSFileHandle alloc] initWithFileDescriptor:fd closeOnDealloc:YES] autorelease];
-  [_facilityFDMap setObject:fh forKey:[NSString stringWithCString:kRXLoggingBase encoding:NSASCIIStringEncoding]];
-
-  fd = open([[_logsBase stringByAppendingPathComponent:@"Audio.log"] fileSystemRepresentation], O_WRONLY | O_APPEND | O_TRUNC | O_CREAT, 0600);
-  if (fd == -1) {
-    error = [RXError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
-    @throw [NSException exceptionWithName:@"RXFilesystemException"
-                                   reason:@"Riven X was unable to create a log file."
-                                 userInfo:[NSDictionary dictionaryWithObjectsAndKeys:error, NSUnderlyingErrorKey, nil]];
-  }
-  fh = [[[NSFileHandle alloc] initWithFileDescriptor:fd closeOnDealloc:YES] autorelease];
-  [_facilityFDMap setObject:fh forKey:[NSString stringWithCString:kRXLoggingAudio encoding:NSASCIIStringEncoding]];
+  int fd = [self _openLogFile:@"Rendering.log"];
+  _facilityFDs[rx_log_facility_id(kRXLoggingRendering)] = fd;
+  _facilityFDs[rx_log_facility_id(kRXLoggingGraphics)] = fd;
+  _facilityFDs[rx_log_facility_id(kRXLoggingScript)] = [self _openLogFile:@"Script.log"];
+  _facilityFDs[rx_log_facility_id(kRXLoggingBase)] = [self _openLogFile:@"Base.log"];
+  _facilityFDs[rx_log_facility_id(kRXLoggingAudio)] = [self _openLogFile:@"Audio.log"];
 
   // open a generic log file
   _genericLogFD = open([[_logsBase stringByAppendingPathComponent:@"Riven X.log"] fileSystemRepresentation], O_WRONLY | O_APPEND | O_TRUNC | O_CREAT, 0600);
@@ -118,6 +339,23 @@
   _levelFilter = ASL_FILTER_MASK_UPTO(ASL_LEVEL_DEBUG);
 #endif
 
+  // start the writer
+  pthread_key_create(&_threadKey, rx_log_thread_exited);
+  pthread_mutex_init(&_threadsMutex, NULL);
+  pthread_mutex_init(&_flushMutex, NULL);
+  pthread_cond_init(&_flushCondition, NULL);
+
+  kern_return_t kerr = semaphore_create(mach_task_self(), &_writerSemaphore, SYNC_POLICY_FIFO, 0);
+  release_assert(kerr == KERN_SUCCESS);
+
+  [self retain];
+  int err = pthread_create(&_writerThread, NULL, rx_log_writer_main, self);
+  release_assert(err == 0);
+
+  // write out what is left in the rings when the process exits normally, and when it aborts
+  atexit(rx_log_center_exit);
+  rx_set_abort_handler(rx_log_center_abort);
+
   _didInit = YES;
   return self;
 }
@@ -128,9 +366,6 @@
 
   [_logsBase release];
 
-  [_facilityFDMap release];
-  pthread_mutex_destroy(&_facilityFDMapMutex);
-
   [super dealloc];
 }
 
@@ -138,15 +373,61 @@
 {
   if (_toreDown)
     return;
+
+  // write out everything logged so far before refusing new messages; the writer drains the rings one last time before it exits for
+  // whatever is logged in between
+  [self flush];
   _toreDown = YES;
 
-  [_facilityFDMap removeAllObjects];
+  __atomic_store_n(&_writerShouldExit, YES, __ATOMIC_RELEASE);
+  semaphore_signal(_writerSemaphore);
+  pthread_join(_writerThread, NULL);
+  semaphore_destroy(mach_task_self(), _writerSemaphore);
+  [self release];
+
+  int closed[RX_LOG_FACILITY_COUNT];
+  int closed_count = 0;
+  for (int i = 0; i < RX_LOG_FACILITY_COUNT; i++) {
+    if (_facilityFDs[i] == -1)
+      continue;
+    BOOL already_closed = NO;
+    for (int c = 0; c < closed_count; c++)
+      already_closed |= (closed[c] == _facilityFDs[i]);
+    if (!already_closed) {
+      close(_facilityFDs[i]);
+      closed[closed_count++] = _facilityFDs[i];
+    }
+    _facilityFDs[i] = -1;
+  }
   close(_genericLogFD);
 }
 
-- (void)_openLogFileForFacility:(NSString*)facility {}
+- (BOOL)isLevelEnabled:(int)level { return (ASL_FILTER_MASK(level) & _levelFilter) != 0; }
+
+- (struct rx_log_thread*)_currentThread
+{
+  struct rx_log_thread* thread = (struct rx_log_thread*)pthread_getspecific(_threadKey);
+  if (thread)
+    return thread;
+
+  if (posix_memalign((void**)&thread, 64, sizeof(struct rx_log_thread)) != 0)
+    return NULL;
+  memset(thread, 0, sizeof(struct rx_log_thread));
+  if (!rx_log_ring_init(&thread->ring, RX_LOG_RING_CAPACITY)) {
+    free(thread);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&_threadsMutex);
+  thread->next = _threads;
+  _threads = thread;
+  pthread_mutex_unlock(&_threadsMutex);
 
-- (void)log:(NSString*)message facility:(NSString*)facility level:(int)level
+  pthread_setspecific(_threadKey, thread);
+  return thread;
+}
+
+- (void)log:(NSString*)message facility:(const char*)facility level:(int)level
 {
   if (_toreDown)
     return;
@@ -155,20 +436,68 @@
   if ((ASL_FILTER_MASK(level) & _levelFilter) == 0)
     return;
 
-  // message data as UTF-8
-  NSData* messageData = [message dataUsingEncoding:NSUTF8StringEncoding];
+  struct rx_log_thread* thread = [self _currentThread];
+  if (!thread)
+    return;
+  uint64_t timestamp = rx_log_timestamp();
+
+  // tell the writer when the thread's name changed
+  char name[RX_LOG_THREAD_NAME_SIZE];
+  name[0] = 0;
+  pthread_getname_np(pthread_self(), name, sizeof(name));
+  if (strcmp(name, thread->producer_name) != 0) {
+    size_t length = strlen(name);
+    uint8_t* payload = rx_log_ring_reserve(&thread->ring, length);
+    if (payload) {
+      memcpy(payload, name, length);
+      rx_log_ring_commit(&thread->ring, timestamp, RX_LOG_RECORD_THREAD_NAME, 0, 0, length);
+      strlcpy(thread->producer_name, name, sizeof(thread->producer_name));
+    }
+  }
 
-  // write to all appropriate log files
-  NSFileHandle* fh = [_facilityFDMap objectForKey:facility];
-  if (fh)
-    write([fh fileDescriptor], [messageData bytes], [messageData length]);
+  // encode the message straight into the ring, truncating messages that are too long for it; errors wait for the writer to make room
+  // rather than being dropped, except on real-time threads and on the writer itself, which would wait forever
+  BOOL is_error = level <= kRXLoggingLevelError;
+  BOOL can_wait = is_error && !pthread_equal(pthread_self(), _writerThread) && !rx_log_thread_is_realtime();
+  CFIndex character_count = CFStringGetLength((CFStringRef)message);
+  size_t max_length = MIN((size_t)CFStringGetMaximumSizeForEncoding(character_count, kCFStringEncodingUTF8), rx_log_ring_max_payload(&thread->ring));
+  uint8_t* payload = rx_log_ring_reserve(&thread->ring, max_length);
+  while (!payload && can_wait && !_toreDown) {
+    [self flush];
+    payload = rx_log_ring_reserve(&thread->ring, max_length);
+  }
+  if (!payload) {
+    __atomic_add_fetch(&thread->dropped, 1, __ATOMIC_RELAXED);
+    semaphore_signal(_writerSemaphore);
+    return;
+  }
 
-  // always write to the generic log
-  write(_genericLogFD, [messageData bytes], [messageData length]);
+  CFIndex length = 0;
+  CFStringGetBytes((CFStringRef)message, CFRangeMake(0, character_count), kCFStringEncodingUTF8, '?', false, payload, (CFIndex)max_length, &length);
+  rx_log_ring_commit(&thread->ring, timestamp, RX_LOG_RECORD_MESSAGE, (uint8_t)level, rx_log_facility_id(facility), (size_t)length);
 
-  // echo base message and error or more serious messages to stderr
-  if ([[NSString stringWithCString:kRXLoggingBase encoding:NSASCIIStringEncoding] isEqualToString:facility] || level <= kRXLoggingLevelError)
-    write(STDERR_FILENO, [messageData bytes], [messageData length]);
+  // errors are written before this returns, so that they make it to the log files even if the process dies right after; threads that
+  // cannot wait only wake the writer up
+  if (can_wait)
+    [self flush];
+  else if (is_error || rx_log_ring_used(&thread->ring) > RX_LOG_RING_CAPACITY / 2)
+    semaphore_signal(_writerSemaphore);
+}
+
+- (void)flush
+{
+  // the writer cannot wait for itself
+  if (_toreDown || pthread_equal(pthread_self(), _writerThread))
+    return;
+
+  // wait for a complete drain pass that started after this call; the pass in progress, if any, may have missed some messages
+  pthread_mutex_lock(&_flushMutex);
+  uint64_t target = _drainGeneration + 2;
+  while (_drainGeneration < target) {
+    semaphore_signal(_writerSemaphore);
+    pthread_cond_wait(&_flushCondition, &_flushMutex);
+  }
+  pthread_mutex_unlock(&_flushMutex);
 }
 
 @end
@@ -0,0 +1,164 @@
+//
+//  RXLogRing.h
+//  rivenx
+//
+
+#if !defined(RX_LOG_RING_H)
+#define RX_LOG_RING_H
+
+#include <sys/cdefs.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+__BEGIN_DECLS
+
+// A single-producer / single-consumer ring of variable-length log records. The producer reserves room for a record, writes the
+// payload in place and commits it; the consumer peeks at the oldest record and pops it once it is done with it. Neither side
+// allocates, locks or blocks: a producer that finds the ring full gets NULL and is expected to count the record as dropped.
+//
+// Records are 16-byte aligned and never straddle the end of the ring; a record that does not fit before the end is preceded by a skip
+// record that the consumer steps over transparently. The free-running head and tail are published with release stores and read with
+// acquire loads, so a record's payload is visible to the consumer once it observes the commit.
+
+#define RX_LOG_RING_ALIGNMENT 16u
+
+enum {
+  RX_LOG_RECORD_SKIP = 0,
+  RX_LOG_RECORD_MESSAGE,
+  RX_LOG_RECORD_THREAD_NAME,
+};
+
+struct rx_log_record {
+  uint64_t timestamp;
+  uint32_t length;
+  uint8_t kind;
+  uint8_t level;
+  uint8_t facility;
+  uint8_t reserved;
+  uint8_t payload[];
+};
+typedef struct rx_log_record rx_log_record_t;
+
+struct rx_log_ring {
+  uint8_t* storage;
+  size_t capacity;
+
+  // producer state; the reservation is where the next committed record goes, and whether it had to wrap
+  size_t reserved_offset;
+  bool reserved_wraps;
+
+  // free-running byte counts, kept on separate cache lines so that the producer and consumer do not false share
+  size_t head __attribute__((aligned(64)));
+  size_t tail __attribute__((aligned(64)));
+};
+typedef struct rx_log_ring rx_log_ring_t;
+
+static inline size_t rx_log_record_size(size_t length)
+{
+  return (sizeof(rx_log_record_t) + length + RX_LOG_RING_ALIGNMENT - 1) & ~(size_t)(RX_LOG_RING_ALIGNMENT - 1);
+}
+
+// capacity must be a power of 2 and a multiple of RX_LOG_RING_ALIGNMENT
+static inline bool rx_log_ring_init(rx_log_ring_t* ring, size_t capacity)
+{
+  memset(ring, 0, sizeof(rx_log_ring_t));
+  if (capacity < RX_LOG_RING_ALIGNMENT || (capacity & (capacity - 1)) != 0)
+    return false;
+  if (posix_memalign((void**)&ring->storage, RX_LOG_RING_ALIGNMENT, capacity) != 0)
+    return false;
+  ring->capacity = capacity;
+  return true;
+}
+
+static inline void rx_log_ring_destroy(rx_log_ring_t* ring)
+{
+  free(ring->storage);
+  ring->storage = NULL;
+}
+
+// the largest payload a reservation can ever succeed for
+static inline size_t rx_log_ring_max_payload(const rx_log_ring_t* ring) { return ring->capacity / 4 - sizeof(rx_log_record_t); }
+
+// producer side: returns where to write up to max_length bytes of payload, or NULL if the ring does not have room for them
+static inline uint8_t* rx_log_ring_reserve(rx_log_ring_t* ring, size_t max_length)
+{
+  if (max_length > rx_log_ring_max_payload(ring))
+    return NULL;
+
+  size_t tail = ring->tail;
+  size_t free_space = ring->capacity - (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE));
+  size_t offset = tail & (ring->capacity - 1);
+  size_t needed = rx_log_record_size(max_length);
+
+  ring->reserved_wraps = offset + needed > ring->capacity;
+  if (ring->reserved_wraps) {
+    // skip to the start of the ring, which costs the space left before the end
+    needed += ring->capacity - offset;
+    offset = 0;
+  }
+  if (needed > free_space)
+    return NULL;
+
+  ring->reserved_offset = offset;
+  return ((rx_log_record_t*)(ring->storage + offset))->payload;
+}
+
+// producer side: publishes the record reserved last with length bytes of payload, which must not exceed the reserved length
+static inline void rx_log_ring_commit(rx_log_ring_t* ring, uint64_t timestamp, uint8_t kind, uint8_t level, uint8_t facility, size_t length)
+{
+  size_t tail = ring->tail;
+  if (ring->reserved_wraps) {
+    size_t offset = tail & (ring->capacity - 1);
+    rx_log_record_t* skip = (rx_log_record_t*)(ring->storage + offset);
+    skip->kind = RX_LOG_RECORD_SKIP;
+    skip->length = (uint32_t)(ring->capacity - offset - sizeof(rx_log_record_t));
+    tail += ring->capacity - offset;
+  }
+
+  rx_log_record_t* record = (rx_log_record_t*)(ring->storage + ring->reserved_offset);
+  record->timestamp = timestamp;
+  record->length = (uint32_t)length;
+  record->kind = kind;
+  record->level = level;
+  record->facility = facility;
+  record->reserved = 0;
+
+  __atomic_store_n(&ring->tail, tail + rx_log_record_size(length), __ATOMIC_RELEASE);
+}
+
+// consumer side: the oldest committed record, or NULL if the ring is empty
+static inline const rx_log_record_t* rx_log_ring_peek(rx_log_ring_t* ring)
+{
+  size_t head = ring->head;
+  for (;;) {
+    if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+      return NULL;
+    const rx_log_record_t* record = (const rx_log_record_t*)(ring->storage + (head & (ring->capacity - 1)));
+    if (record->kind != RX_LOG_RECORD_SKIP)
+      return record;
+
+    // give the skipped space back right away
+    head += rx_log_record_size(record->length);
+    __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+  }
+}
+
+// consumer side: releases the record returned by the last peek
+static inline void rx_log_ring_pop(rx_log_ring_t* ring)
+{
+  const rx_log_record_t* record = (const rx_log_record_t*)(ring->storage + (ring->head & (ring->capacity - 1)));
+  __atomic_store_n(&ring->head, ring->head + rx_log_record_size(record->length), __ATOMIC_RELEASE);
+}
+
+// bytes in use; approximate when called concurrently with the producer
+static inline size_t rx_log_ring_used(rx_log_ring_t* ring)
+{
+  return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+}
+
+__END_DECLS
+
+#endif // RX_LOG_RING_H
@@ -11,7 +11,6 @@
 
 #import "RXLogging.h"
 #import "RXLogCenter.h"
-#import "RXThreadUtilities.h"
 
 /* facilities */
 const char* kRXLoggingBase = "BASE";
@@ -29,26 +28,18 @@ const int kRXLoggingLevelMessage = ASL_LEVEL_NOTICE;
 const int kRXLoggingLevelError = ASL_LEVEL_ERR;
 const int kRXLoggingLevelCritical = ASL_LEVEL_CRIT;
 
-static NSString* const RX_log_format = @"%@ [%s] [%@] %@\n";
-
 void RXCFLog(const char* facility, int level, CFStringRef format, ...)
 {
+  // don't pay for formatting messages that will be filtered out
+  RXLogCenter* center = [RXLogCenter sharedLogCenter];
+  if (![center isLevelEnabled:level])
+    return;
+
   va_list args;
   va_start(args, format);
 
   CFStringRef userString = CFStringCreateWithFormatAndArguments(kCFAllocatorDefault, NULL, format, args);
-  CFStringRef facilityString = CFStringCreateWithCStringNoCopy(kCFAllocatorDefault, facility, NSASCIIStringEncoding, kCFAllocatorNull);
-  CFDateRef now = CFDateCreate(kCFAllocatorDefault, CFAbsoluteTimeGetCurrent());
-
-  char* threadName = RXCopyThreadName();
-
-  CFStringRef logString = CFStringCreateWithFormat(kCFAllocatorDefault, NULL, (CFStringRef)RX_log_format, now, threadName, facilityString, userString);
-  [[RXLogCenter sharedLogCenter] log:(NSString*)logString facility:(NSString*)facilityString level:level];
-
-  free(threadName);
-  CFRelease(logString);
-  CFRelease(now);
-  CFRelease(facilityString);
+  [center log:(NSString*)userString facility:facility level:level];
   CFRelease(userString);
 
   va_end(args);
@@ -64,24 +55,20 @@ void RXLog(const char* facility, int level, NSString* format, ...)
 
 void RXLogv(const char* facility, int level, NSString* format, va_list args)
 {
-  NSString* userString = [[NSString alloc] initWithFormat:format arguments:args];
-  NSString* facilityString = [[NSString alloc] initWithCString:facility encoding:NSASCIIStringEncoding];
-  NSDate* now = [NSDate new];
-
-  char* threadName = RXCopyThreadName();
-
-  NSString* logString = [[NSString alloc] initWithFormat:RX_log_format, now, threadName, facilityString, userString];
-  [[RXLogCenter sharedLogCenter] log:logString facility:facilityString level:level];
+  RXLogCenter* center = [RXLogCenter sharedLogCenter];
+  if (![center isLevelEnabled:level])
+    return;
 
-  free(threadName);
-  [logString release];
-  [now release];
-  [facilityString release];
+  NSString* userString = [[NSString alloc] initWithFormat:format arguments:args];
+  [center log:userString facility:facility level:level];
   [userString release];
 }
 
 void _RXOLog(id object, const char* facility, int level, NSString* format, ...)
 {
+  if (![[RXLogCenter sharedLogCenter] isLevelEnabled:level])
+    return;
+
   va_list args;
   va_start(args, format);
 
@@ -14,6 +14,8 @@
 #include <mach/mach_time.h>
 #include <sys/cdefs.h>
 
+#include "Base/RXBase.h"
+
 __BEGIN_DECLS
 
 extern double g_RXTimebase;
@@ -29,6 +31,17 @@ RX_INLINE double RXTimingTimestampDelta(uint64_t end, uint64_t start)
 }
 RX_INLINE uint64_t RXTimingOffsetTimestamp(uint64_t timestamp, double offset) { return (uint64_t)(g_RX1_Timebase * offset) + timestamp; }
 
+// integer conversions of host time deltas for statistics and real-time threads; unlike RXTimingTimestampDelta, they do not depend on
+// RXTimingUpdateTimebase having been called
+RX_INLINE uint64_t RXTimingHostDeltaToNanoseconds(uint64_t delta)
+{
+  static mach_timebase_info_data_t timebase = {0, 0};
+  if (timebase.denom == 0)
+    mach_timebase_info(&timebase);
+  return delta * timebase.numer / timebase.denom;
+}
+RX_INLINE uint64_t RXTimingHostDeltaToMicroseconds(uint64_t delta) { return RXTimingHostDeltaToNanoseconds(delta) / 1000; }
+
 extern void RXTimingUpdateTimebase(void);
 
 __END_DECLS
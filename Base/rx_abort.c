@@ -10,6 +10,24 @@
 
 __attribute__((__used__)) static char* __crashreporter_info__ = 0;
 
+static void (*volatile g_abort_handler)(void) = NULL;
+
+void rx_set_abort_handler(void (*handler)(void)) { g_abort_handler = handler; }
+
+static void rx_run_abort_handler(void)
+{
+  // the handler may fail an assertion itself
+  void (*handler)(void) = __sync_lock_test_and_set(&g_abort_handler, NULL);
+  if (handler)
+    handler();
+}
+
+void rx_assert_failed(const char* function, const char* file, int line, const char* expression)
+{
+  rx_run_abort_handler();
+  __assert_rtn(function, file, line, expression);
+}
+
 void rx_abort(const char* format, ...)
 {
   va_list args;
@@ -33,6 +51,7 @@ void rx_abort(const char* format, ...)
 
   syslog(LOG_ERR, "aborting: %s\n", str);
 
+  rx_run_abort_handler();
   abort();
   // never reached
 }
@@ -9,9 +9,12 @@
 #import "Base/RXBase.h"
 #import <MHKKit/MHKKit.h>
 
+#import <pthread.h>
+
 @interface RXArchiveManager : NSObject {
   NSString* patches_directory;
   MHKArchive* extras_archive;
+  pthread_mutex_t extras_archive_mutex;
 }
 
 + (RXArchiveManager*)sharedArchiveManager;
@@ -25,6 +28,12 @@
 
 - (NSArray*)dataArchivesForStackKey:(NSString*)stack_key error:(NSError**)error;
 - (NSArray*)soundArchivesForStackKey:(NSString*)stack_key error:(NSError**)error;
+
+// finds the archives without opening them, for callers that open them lazily with archivesWithPaths:error:
+- (NSArray*)soundArchivePathsForStackKey:(NSString*)stack_key error:(NSError**)error;
+- (NSArray*)archivesWithPaths:(NSArray*)paths error:(NSError**)error;
+
+// thread safe; the archive is opened by the first caller, which the engine does on a background queue at startup
 - (MHKArchive*)extrasArchive:(NSError**)error;
 
 @end
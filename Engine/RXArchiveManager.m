@@ -68,6 +68,8 @@
   // cache the path to the Patches directory
   patches_directory = nil;
 
+  pthread_mutex_init(&extras_archive_mutex, NULL);
+
   return self;
 }
 
@@ -75,6 +77,7 @@
 {
   [patches_directory release];
   [extras_archive release];
+  pthread_mutex_destroy(&extras_archive_mutex);
 
   [super dealloc];
 }
@@ -82,7 +85,7 @@
 static NSInteger string_numeric_insensitive_sort(id lhs, id rhs, void* context)
 { return [(NSString*)rhs compare:lhs options:(NSStringCompareOptions)(NSCaseInsensitiveSearch | NSNumericSearch)]; }
 
-- (NSArray*)_archivesForExpression:(NSString*)regex error:(NSError**)error
+- (NSArray*)_archivePathsForExpression:(NSString*)regex error:(NSError**)error
 {
   // create a predicate to match filenames against the provided regular expression, case insensitive
   NSPredicate* predicate = [NSPredicate predicateWithFormat:@"SELF matches[c] %@", regex];
@@ -119,9 +122,21 @@ static NSInteger string_numeric_insensitive_sort(id lhs, id rhs, void* context)
   for (NSString* filename in content)
     [matching_paths addObject:[directory stringByAppendingPathComponent:filename]];
 
-  // load every archive found
+  // emit an error and return nil if no archives was found
+  if ([matching_paths count] == 0) {
+    if (error)
+      *error = [RXError errorWithDomain:RXErrorDomain code:kRXErrArchivesNotFound userInfo:nil];
+    return nil;
+  }
+
+  return matching_paths;
+}
+
+- (NSArray*)archivesWithPaths:(NSArray*)paths error:(NSError**)error
+{
+  // load every archive
   NSMutableArray* archives = [NSMutableArray array];
-  for (NSString* archive_path in matching_paths) {
+  for (NSString* archive_path in paths) {
     MHKArchive* archive = [[MHKArchive alloc] initWithPath:archive_path error:error];
     if (!archive)
       return nil;
@@ -140,14 +155,27 @@ static NSInteger string_numeric_insensitive_sort(id lhs, id rhs, void* context)
   return archives;
 }
 
+- (NSArray*)_archivesForExpression:(NSString*)regex error:(NSError**)error
+{
+  NSArray* paths = [self _archivePathsForExpression:regex error:error];
+  if (!paths)
+    return nil;
+  return [self archivesWithPaths:paths error:error];
+}
+
 - (NSArray*)dataArchivesForStackKey:(NSString*)stack_key error:(NSError**)error
 { return [self _archivesForExpression:[NSString stringWithFormat:@"^%C_Data[0-9]?\\.MHK$", [stack_key characterAtIndex:0]] error:error]; }
 
 - (NSArray*)soundArchivesForStackKey:(NSString*)stack_key error:(NSError**)error
 { return [self _archivesForExpression:[NSString stringWithFormat:@"^%C_Sounds[0-9]?\\.MHK$", [stack_key characterAtIndex:0]] error:error]; }
 
+- (NSArray*)soundArchivePathsForStackKey:(NSString*)stack_key error:(NSError**)error
+{ return [self _archivePathsForExpression:[NSString stringWithFormat:@"^%C_Sounds[0-9]?\\.MHK$", [stack_key characterAtIndex:0]] error:error]; }
+
 - (MHKArchive*)extrasArchive:(NSError**)error
 {
+  // callers that arrive while the archive is being opened wait for it rather than opening it a second time
+  pthread_mutex_lock(&extras_archive_mutex);
   if (!extras_archive) {
     NSArray* archives = [self _archivesForExpression:@"^Extras\\.MHK$" error:error];
     if ([archives count]) {
@@ -157,7 +185,9 @@ static NSInteger string_numeric_insensitive_sort(id lhs, id rhs, void* context)
 #endif
     }
   }
-  return [[extras_archive retain] autorelease];
+  MHKArchive* archive = [[extras_archive retain] autorelease];
+  pthread_mutex_unlock(&extras_archive_mutex);
+  return archive;
 }
 
 @end
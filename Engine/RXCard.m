@@ -92,6 +92,7 @@
   // sfxe
   if (_sfxes) {
     for (uint16_t i = 0; i < _flstCount; i++) {
+      rx_sfxe_free_compiled(_sfxes + i);
       free(_sfxes[i].record);
     }
     free(_sfxes);
@@ -693,7 +694,7 @@
 
   _flstCount = CFSwapInt16BigToHost(*(uint16_t*)list_data);
   release_assert([fh length] >= sizeof(uint16_t) + (_flstCount * sizeof(struct rx_flst_record)));
-  _sfxes = (rx_card_sfxe*)malloc(sizeof(rx_card_sfxe) * _flstCount);
+  _sfxes = (rx_card_sfxe*)calloc(_flstCount, sizeof(rx_card_sfxe));
 
   struct rx_flst_record* flstRecordPointer = (struct rx_flst_record*)BUFFER_OFFSET(list_data, sizeof(uint16_t));
   for (list_index = 0; list_index < _flstCount; ++list_index) {
@@ -723,62 +724,13 @@
                                      reason:@"Could not read a required SFXE resource."
                                    userInfo:[NSDictionary dictionaryWithObjectsAndKeys:error, NSUnderlyingErrorKey, nil]];
 
-#if defined(__LITTLE_ENDIAN__)
-    // byte swap on litle endian architectures
-    sfxe->record->magic = CFSwapInt16(sfxe->record->magic);
-    sfxe->record->frame_count = CFSwapInt16(sfxe->record->frame_count);
-    sfxe->record->offset_table = CFSwapInt32(sfxe->record->offset_table);
-    sfxe->record->rect = rx_swap_core_rect(sfxe->record->rect);
-    sfxe->record->fps = CFSwapInt16(sfxe->record->fps);
-    sfxe->record->u0 = CFSwapInt16(sfxe->record->u0);
-    sfxe->record->alt_rect = rx_swap_core_rect(sfxe->record->alt_rect);
-    sfxe->record->u1 = CFSwapInt16(sfxe->record->u1);
-    sfxe->record->alt_frame_count = CFSwapInt16(sfxe->record->alt_frame_count);
-    sfxe->record->u2 = CFSwapInt32(sfxe->record->u2);
-    sfxe->record->u3 = CFSwapInt32(sfxe->record->u3);
-    sfxe->record->u4 = CFSwapInt32(sfxe->record->u4);
-    sfxe->record->u5 = CFSwapInt32(sfxe->record->u5);
-    sfxe->record->u6 = CFSwapInt32(sfxe->record->u6);
-#endif
-
-    // alias the offset table for convenience
-    union {
-      uint32_t* p_int32;
-      void* p_void;
-    } u;
-    u.p_void = sfxe->record;
-    sfxe->offsets = BUFFER_OFFSET(u.p_int32, sfxe->record->offset_table);
-
-#if defined(__LITTLE_ENDIAN__)
-    // byte swap the offsets and the program
-    for (uint16_t fi = 0; fi < sfxe->record->frame_count; ++fi) {
-      sfxe->offsets[fi] = CFSwapInt32(sfxe->offsets[fi]);
-
-      union {
-        uint16_t* p_int16;
-        void* p_void;
-      } mp;
-      mp.p_void = sfxe->record;
-      mp.p_int16 = BUFFER_OFFSET(mp.p_int16, sfxe->offsets[fi]);
-
-      *mp.p_int16 = CFSwapInt16(*mp.p_int16);
-      while (*mp.p_int16 != 4) {
-        if (*mp.p_int16 == 3) {
-          mp.p_int16[1] = CFSwapInt16(mp.p_int16[1]);
-          mp.p_int16[2] = CFSwapInt16(mp.p_int16[2]);
-          mp.p_int16[3] = CFSwapInt16(mp.p_int16[3]);
-          mp.p_int16[4] = CFSwapInt16(mp.p_int16[4]);
-          mp.p_int16 += 4;
-        } else if (*mp.p_int16 != 1)
-          rx_abort("invalid sfxe record: %s %d", [[_descriptor description] UTF8String], record->sfxe_id);
-
-        mp.p_int16++;
-        *mp.p_int16 = CFSwapInt16(*mp.p_int16);
-      }
+    // byte swap the record and its microprogram
+    if (!rx_sfxe_swap_record(sfxe, sfxe_size))
+      rx_abort("invalid sfxe record: %s %d", [[_descriptor description] UTF8String], record->sfxe_id);
 
-      release_assert(mp.p_void <= (void*)BUFFER_OFFSET(sfxe->record, sfxe_size));
-    }
-#endif
+    // compile the microprogram into span lists so the renderer does not have to interpret it every effect frame
+    if (!rx_sfxe_compile(sfxe, sfxe_size, kRXCardViewportSize.width, kRXCardViewportSize.height))
+      rx_abort("invalid sfxe record: %s %d", [[_descriptor description] UTF8String], record->sfxe_id);
   }
 
   // don't need the FLST data anymore
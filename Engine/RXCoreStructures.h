@@ -94,8 +94,8 @@ struct rx_sfxe_record {
 };
 #pragma pack(pop)
 
-#endif // RX_CORE_STRUCTURES_H
-
+// the structures are also used by plain C code built without the Riven X base header, which does not need to swap them
+#if defined(RX_INLINE)
 RX_INLINE rx_core_rect_t rx_swap_core_rect(rx_core_rect_t r)
 {
   r.left = CFSwapInt16(r.left);
@@ -104,3 +104,6 @@ RX_INLINE rx_core_rect_t rx_swap_core_rect(rx_core_rect_t r)
   r.bottom = CFSwapInt16(r.bottom);
   return r;
 }
+#endif
+
+#endif // RX_CORE_STRUCTURES_H
@@ -0,0 +1,142 @@
+//
+//  RXHotspotEventQueue.c
+//  rivenx
+//
+
+#include "Engine/RXHotspotEventQueue.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RX_HOTSPOT_EVENT_QUEUE_MASK (RX_HOTSPOT_EVENT_QUEUE_CAPACITY - 1)
+
+void rx_hotspot_event_queue_init(rx_hotspot_event_queue_t* queue)
+{
+  memset(queue, 0, sizeof(rx_hotspot_event_queue_t));
+  for (size_t i = 0; i < RX_HOTSPOT_EVENT_QUEUE_CAPACITY; i++)
+    queue->cells[i].sequence = i;
+  pthread_mutex_init(&queue->overflow_lock, NULL);
+}
+
+void rx_hotspot_event_queue_destroy(rx_hotspot_event_queue_t* queue)
+{
+  while (queue->overflow_head) {
+    struct rx_hotspot_event_overflow* node = queue->overflow_head;
+    queue->overflow_head = node->next;
+    free(node);
+  }
+  pthread_mutex_destroy(&queue->overflow_lock);
+}
+
+static void rx_hotspot_event_queue_drop_inside(rx_hotspot_event_queue_t* queue, void* hotspot)
+{
+  void* expected = hotspot;
+  __atomic_compare_exchange_n(&queue->pending_inside, &expected, NULL, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+// appends an event to the overflow list; returns false if the consumer has drained the list since the caller looked at overflowing, in
+// which case the event goes back to the cells
+static bool rx_hotspot_event_queue_overflow(rx_hotspot_event_queue_t* queue, uint32_t type, void* hotspot, bool start)
+{
+  struct rx_hotspot_event_overflow* node = (struct rx_hotspot_event_overflow*)malloc(sizeof(struct rx_hotspot_event_overflow));
+  node->next = NULL;
+  node->event.hotspot = hotspot;
+  node->event.type = type;
+
+  pthread_mutex_lock(&queue->overflow_lock);
+  if (!start && !queue->overflowing) {
+    pthread_mutex_unlock(&queue->overflow_lock);
+    free(node);
+    return false;
+  }
+  if (queue->overflow_tail)
+    queue->overflow_tail->next = node;
+  else
+    queue->overflow_head = node;
+  queue->overflow_tail = node;
+  __atomic_store_n(&queue->overflowing, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&queue->overflow_lock);
+  return true;
+}
+
+int rx_hotspot_event_queue_push(rx_hotspot_event_queue_t* queue, uint32_t type, void* hotspot)
+{
+  // claim the hotspot's pending mouse inside slot before queuing, so that the consumer can only ever clear it after the event is queued
+  if (type == RX_HOTSPOT_EVENT_MOUSE_INSIDE) {
+    if (__atomic_load_n(&queue->pending_inside, __ATOMIC_ACQUIRE) == hotspot)
+      return RX_HOTSPOT_EVENT_COALESCED;
+    __atomic_store_n(&queue->pending_inside, hotspot, __ATOMIC_RELEASE);
+  } else
+    __atomic_store_n(&queue->pending_inside, NULL, __ATOMIC_RELEASE);
+
+  // while events are overflowing, the ones after them have to overflow too
+  if (__atomic_load_n(&queue->overflowing, __ATOMIC_ACQUIRE)) {
+    if (type == RX_HOTSPOT_EVENT_MOUSE_INSIDE) {
+      rx_hotspot_event_queue_drop_inside(queue, hotspot);
+      return RX_HOTSPOT_EVENT_QUEUE_FULL;
+    }
+    if (rx_hotspot_event_queue_overflow(queue, type, hotspot, false))
+      return RX_HOTSPOT_EVENT_QUEUED;
+  }
+
+  // claim a cell; a cell is free for position p when its sequence is p, and still holds the event of the previous lap when it is lower
+  struct rx_hotspot_event_cell* cell;
+  size_t position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+  for (;;) {
+    cell = queue->cells + (position & RX_HOTSPOT_EVENT_QUEUE_MASK);
+    intptr_t difference = (intptr_t)__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (intptr_t)position;
+    if (difference == 0) {
+      if (__atomic_compare_exchange_n(&queue->enqueue_position, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (difference < 0) {
+      if (type == RX_HOTSPOT_EVENT_MOUSE_INSIDE) {
+        rx_hotspot_event_queue_drop_inside(queue, hotspot);
+        return RX_HOTSPOT_EVENT_QUEUE_FULL;
+      }
+      rx_hotspot_event_queue_overflow(queue, type, hotspot, true);
+      return RX_HOTSPOT_EVENT_QUEUED;
+    } else
+      position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+  }
+
+  cell->event.hotspot = hotspot;
+  cell->event.type = type;
+  __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+  return RX_HOTSPOT_EVENT_QUEUED;
+}
+
+int rx_hotspot_event_queue_pop(rx_hotspot_event_queue_t* queue, rx_hotspot_event_t* event)
+{
+  size_t position = queue->dequeue_position;
+  struct rx_hotspot_event_cell* cell = queue->cells + (position & RX_HOTSPOT_EVENT_QUEUE_MASK);
+  if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != position + 1) {
+    // the overflow list only holds events posted after the ones in the cells
+    if (!__atomic_load_n(&queue->overflowing, __ATOMIC_ACQUIRE))
+      return 0;
+
+    pthread_mutex_lock(&queue->overflow_lock);
+    struct rx_hotspot_event_overflow* node = queue->overflow_head;
+    queue->overflow_head = node->next;
+    if (!queue->overflow_head) {
+      queue->overflow_tail = NULL;
+      __atomic_store_n(&queue->overflowing, 0, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&queue->overflow_lock);
+
+    *event = node->event;
+    free(node);
+    return 1;
+  }
+
+  *event = cell->event;
+  queue->dequeue_position = position + 1;
+  __atomic_store_n(&cell->sequence, position + RX_HOTSPOT_EVENT_QUEUE_CAPACITY, __ATOMIC_RELEASE);
+
+  // the next mouse inside event for this hotspot has to be queued again
+  if (event->type == RX_HOTSPOT_EVENT_MOUSE_INSIDE) {
+    void* expected = event->hotspot;
+    __atomic_compare_exchange_n(&queue->pending_inside, &expected, NULL, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+  }
+  return 1;
+}
@@ -0,0 +1,92 @@
+//
+//  RXHotspotEventQueue.h
+//  rivenx
+//
+
+#if !defined(RX_HOTSPOT_EVENT_QUEUE_H)
+#define RX_HOTSPOT_EVENT_QUEUE_H
+
+#include <sys/cdefs.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+__BEGIN_DECLS
+
+// A bounded multiple-producer / single-consumer queue of hotspot mouse events, posted by the main thread and executed by the script
+// thread. Events live in a fixed array of cells, each with a sequence number that tells producers when the cell is free and the consumer
+// when it is filled, so neither side allocates, locks or blocks.
+//
+// Mouse inside events are sent for every mouse move over a hotspot, and only the most recent one matters: a mouse inside event for the
+// hotspot of the last mouse inside event still in the queue, with no other event posted since, is coalesced into that event.
+//
+// When the array is full, mouse inside events are dropped, since the next mouse move sends them again. Other events go to a locked overflow
+// list instead, and so does every event after them until the consumer has drained it, so that events are always popped in the order they
+// were posted.
+//
+// The queue stores hotspot pointers without retaining them; the caller keeps a queued hotspot alive until it is popped.
+
+#define RX_HOTSPOT_EVENT_QUEUE_CAPACITY 64
+
+enum {
+  RX_HOTSPOT_EVENT_MOUSE_INSIDE = 0,
+  RX_HOTSPOT_EVENT_MOUSE_EXITED,
+  RX_HOTSPOT_EVENT_MOUSE_DOWN,
+  RX_HOTSPOT_EVENT_MOUSE_UP,
+};
+
+enum {
+  RX_HOTSPOT_EVENT_QUEUED = 0,
+  RX_HOTSPOT_EVENT_COALESCED,
+  RX_HOTSPOT_EVENT_QUEUE_FULL,
+};
+
+struct rx_hotspot_event {
+  void* hotspot;
+  uint32_t type;
+};
+typedef struct rx_hotspot_event rx_hotspot_event_t;
+
+struct rx_hotspot_event_cell {
+  size_t sequence;
+  rx_hotspot_event_t event;
+};
+
+struct rx_hotspot_event_overflow {
+  struct rx_hotspot_event_overflow* next;
+  rx_hotspot_event_t event;
+};
+
+struct rx_hotspot_event_queue {
+  struct rx_hotspot_event_cell cells[RX_HOTSPOT_EVENT_QUEUE_CAPACITY];
+
+  // the hotspot of the last queued mouse inside event if no other event was posted since, NULL otherwise
+  void* pending_inside;
+
+  // events posted while the cells were full, oldest first; overflowing is set as long as the list is not empty
+  pthread_mutex_t overflow_lock;
+  struct rx_hotspot_event_overflow* overflow_head;
+  struct rx_hotspot_event_overflow* overflow_tail;
+  int overflowing;
+
+  // free-running positions, kept on separate cache lines so that producers and the consumer do not false share
+  size_t enqueue_position __attribute__((aligned(64)));
+  size_t dequeue_position __attribute__((aligned(64)));
+};
+typedef struct rx_hotspot_event_queue rx_hotspot_event_queue_t;
+
+void rx_hotspot_event_queue_init(rx_hotspot_event_queue_t* queue);
+
+// frees the overflow list; pop the remaining events first to release their hotspots
+void rx_hotspot_event_queue_destroy(rx_hotspot_event_queue_t* queue);
+
+// producer side, from any thread: returns RX_HOTSPOT_EVENT_QUEUED, RX_HOTSPOT_EVENT_COALESCED if the event was folded into a queued
+// mouse inside event, or RX_HOTSPOT_EVENT_QUEUE_FULL if the event was a mouse inside event and was dropped
+int rx_hotspot_event_queue_push(rx_hotspot_event_queue_t* queue, uint32_t type, void* hotspot);
+
+// consumer side: pops the oldest event into event and returns 1, or returns 0 if the queue is empty
+int rx_hotspot_event_queue_pop(rx_hotspot_event_queue_t* queue, rx_hotspot_event_t* event);
+
+__END_DECLS
+
+#endif // RX_HOTSPOT_EVENT_QUEUE_H
@@ -0,0 +1,140 @@
+//
+//  RXHotspotIndex.c
+//  rivenx
+//
+
+#include "Engine/RXHotspotIndex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void rx_hotspot_index_init(rx_hotspot_index_t* index) { memset(index, 0, sizeof(rx_hotspot_index_t)); }
+
+void rx_hotspot_index_destroy(rx_hotspot_index_t* index)
+{
+  free(index->items);
+  free(index->rects);
+  free(index->entries);
+  memset(index, 0, sizeof(rx_hotspot_index_t));
+}
+
+void rx_hotspot_index_resize(rx_hotspot_index_t* index, uint32_t item_count)
+{
+  if (item_count > index->item_capacity) {
+    index->item_capacity = item_count;
+    index->items = (void**)realloc(index->items, item_count * sizeof(void*));
+    index->rects = (rx_core_rect_t*)realloc(index->rects, item_count * sizeof(rx_core_rect_t));
+  }
+  index->item_count = item_count;
+  memset(index->cell_starts, 0, sizeof(index->cell_starts));
+}
+
+struct rx_hotspot_index_span {
+  uint32_t first_column, last_column, first_row, last_row;
+  int inside; // the rect overlaps the card
+  int outside; // the rect extends past the card
+};
+
+// the range of cells a rect overlaps once grown by the margin
+static struct rx_hotspot_index_span rx_hotspot_index_cell_span(rx_core_rect_t rect)
+{
+  struct rx_hotspot_index_span span = {0, 0, 0, 0, 0, 0};
+
+  int32_t left = (int32_t)rect.left - RX_HOTSPOT_INDEX_MARGIN, right = (int32_t)rect.right + RX_HOTSPOT_INDEX_MARGIN;
+  int32_t top = (int32_t)rect.top - RX_HOTSPOT_INDEX_MARGIN, bottom = (int32_t)rect.bottom + RX_HOTSPOT_INDEX_MARGIN;
+  if (left >= right || top >= bottom)
+    return span;
+
+  const int32_t grid_width = RX_HOTSPOT_INDEX_COLUMNS * RX_HOTSPOT_INDEX_CELL_SIZE, grid_height = RX_HOTSPOT_INDEX_ROWS * RX_HOTSPOT_INDEX_CELL_SIZE;
+  span.outside = left < 0 || top < 0 || right > grid_width || bottom > grid_height;
+  if (right <= 0 || bottom <= 0 || left >= grid_width || top >= grid_height)
+    return span;
+
+  span.inside = 1;
+  span.first_column = (uint32_t)((left < 0) ? 0 : left) >> RX_HOTSPOT_INDEX_CELL_SHIFT;
+  span.first_row = (uint32_t)((top < 0) ? 0 : top) >> RX_HOTSPOT_INDEX_CELL_SHIFT;
+  span.last_column = (uint32_t)(((right > grid_width) ? grid_width : right) - 1) >> RX_HOTSPOT_INDEX_CELL_SHIFT;
+  span.last_row = (uint32_t)(((bottom > grid_height) ? grid_height : bottom) - 1) >> RX_HOTSPOT_INDEX_CELL_SHIFT;
+  return span;
+}
+
+void rx_hotspot_index_build(rx_hotspot_index_t* index)
+{
+  uint32_t* counts = index->cell_starts + 1;
+  memset(index->cell_starts, 0, sizeof(index->cell_starts));
+
+  // count the entries of every cell
+  for (uint32_t item = 0; item < index->item_count; item++) {
+    struct rx_hotspot_index_span span = rx_hotspot_index_cell_span(index->rects[item]);
+    if (span.outside)
+      counts[RX_HOTSPOT_INDEX_OUTSIDE_CELL]++;
+    if (!span.inside)
+      continue;
+    for (uint32_t row = span.first_row; row <= span.last_row; row++) {
+      for (uint32_t column = span.first_column; column <= span.last_column; column++)
+        counts[row * RX_HOTSPOT_INDEX_COLUMNS + column]++;
+    }
+  }
+
+  // turn the counts into start offsets, shifted by one cell so that the fill pass can use them as write cursors
+  uint32_t total = 0;
+  for (uint32_t cell = 0; cell <= RX_HOTSPOT_INDEX_OUTSIDE_CELL; cell++) {
+    uint32_t count = counts[cell];
+    counts[cell] = total;
+    total += count;
+  }
+
+  if (total > index->entry_capacity) {
+    index->entry_capacity = total;
+    index->entries = (uint16_t*)realloc(index->entries, total * sizeof(uint16_t));
+  }
+
+  // fill the cells in item order, which keeps every cell in priority order; each cursor ends up at the start of the next cell
+  for (uint32_t item = 0; item < index->item_count; item++) {
+    struct rx_hotspot_index_span span = rx_hotspot_index_cell_span(index->rects[item]);
+    if (span.outside)
+      index->entries[counts[RX_HOTSPOT_INDEX_OUTSIDE_CELL]++] = (uint16_t)item;
+    if (!span.inside)
+      continue;
+    for (uint32_t row = span.first_row; row <= span.last_row; row++) {
+      for (uint32_t column = span.first_column; column <= span.last_column; column++)
+        index->entries[counts[row * RX_HOTSPOT_INDEX_COLUMNS + column]++] = (uint16_t)item;
+    }
+  }
+  index->cell_starts[0] = 0;
+}
+
+uint32_t rx_hotspot_index_candidates(const rx_hotspot_index_t* index, float x, float y, const uint16_t** candidates)
+{
+  uint32_t cell;
+  if (x >= 0.0f && y >= 0.0f && x < RX_HOTSPOT_INDEX_COLUMNS * RX_HOTSPOT_INDEX_CELL_SIZE && y < RX_HOTSPOT_INDEX_ROWS * RX_HOTSPOT_INDEX_CELL_SIZE)
+    cell = ((uint32_t)y >> RX_HOTSPOT_INDEX_CELL_SHIFT) * RX_HOTSPOT_INDEX_COLUMNS + ((uint32_t)x >> RX_HOTSPOT_INDEX_CELL_SHIFT);
+  else if (x == x && y == y) // NaNs hit nothing
+    cell = RX_HOTSPOT_INDEX_OUTSIDE_CELL;
+  else
+    return 0;
+
+  *candidates = index->entries + index->cell_starts[cell];
+  return index->cell_starts[cell + 1] - index->cell_starts[cell];
+}
+
+uint32_t rx_hotspot_index_hit_test(const rx_hotspot_index_t* index, float x, float y)
+{
+  const uint16_t* candidates;
+  uint32_t count = rx_hotspot_index_candidates(index, x, y, &candidates);
+  for (uint32_t i = 0; i < count; i++) {
+    rx_core_rect_t rect = index->rects[candidates[i]];
+    if (x >= rect.left && x < rect.right && y >= rect.top && y < rect.bottom)
+      return candidates[i];
+  }
+  return RX_HOTSPOT_INDEX_NOT_FOUND;
+}
+
+uint32_t rx_hotspot_index_find(const rx_hotspot_index_t* index, const void* item)
+{
+  for (uint32_t i = 0; i < index->item_count; i++) {
+    if (index->items[i] == item)
+      return i;
+  }
+  return RX_HOTSPOT_INDEX_NOT_FOUND;
+}
@@ -0,0 +1,70 @@
+//
+//  RXHotspotIndex.h
+//  rivenx
+//
+
+#if !defined(RX_HOTSPOT_INDEX_H)
+#define RX_HOTSPOT_INDEX_H
+
+#include <sys/cdefs.h>
+#include <stdint.h>
+
+#include "Engine/RXCoreStructures.h"
+
+__BEGIN_DECLS
+
+// A uniform grid over the card, in core coordinates, listing in every cell the hotspots whose rect overlaps the cell. Items keep the
+// order they were added in, which is the hit-testing priority order, and every cell lists its items in that order, so the first item
+// of a cell that contains a point is the same item a linear scan would find. Hit-testing is a cell lookup followed by a short scan, and
+// neither lookups nor rebuilds with fewer items than a previous build allocate.
+
+#define RX_HOTSPOT_INDEX_CELL_SHIFT 5
+#define RX_HOTSPOT_INDEX_CELL_SIZE (1 << RX_HOTSPOT_INDEX_CELL_SHIFT)
+#define RX_HOTSPOT_INDEX_COLUMNS ((608 + RX_HOTSPOT_INDEX_CELL_SIZE - 1) >> RX_HOTSPOT_INDEX_CELL_SHIFT)
+#define RX_HOTSPOT_INDEX_ROWS ((392 + RX_HOTSPOT_INDEX_CELL_SIZE - 1) >> RX_HOTSPOT_INDEX_CELL_SHIFT)
+#define RX_HOTSPOT_INDEX_CELL_COUNT (RX_HOTSPOT_INDEX_COLUMNS * RX_HOTSPOT_INDEX_ROWS)
+
+// the last cell holds the items that extend past the card, and serves points outside of the card
+#define RX_HOTSPOT_INDEX_OUTSIDE_CELL RX_HOTSPOT_INDEX_CELL_COUNT
+
+// rects are indexed grown by this many core pixels on every side, so that candidate lists also cover points that only fall inside a
+// rect once it is transformed to world space and rounded
+#define RX_HOTSPOT_INDEX_MARGIN 1
+
+#define RX_HOTSPOT_INDEX_NOT_FOUND UINT32_MAX
+
+struct rx_hotspot_index {
+  // items and their core rects, in priority order; fill them after rx_hotspot_index_resize, then call rx_hotspot_index_build
+  void** items;
+  rx_core_rect_t* rects;
+  uint32_t item_count;
+  uint32_t item_capacity;
+
+  // the entries of cell c are entries[cell_starts[c]] up to entries[cell_starts[c + 1]], as item indices
+  uint32_t cell_starts[RX_HOTSPOT_INDEX_CELL_COUNT + 2];
+  uint16_t* entries;
+  uint32_t entry_capacity;
+};
+typedef struct rx_hotspot_index rx_hotspot_index_t;
+
+void rx_hotspot_index_init(rx_hotspot_index_t* index);
+void rx_hotspot_index_destroy(rx_hotspot_index_t* index);
+
+// sets the number of items, growing the item arrays if needed; the index is empty until the next build
+void rx_hotspot_index_resize(rx_hotspot_index_t* index, uint32_t item_count);
+
+// rebuilds the grid from the items and rects
+void rx_hotspot_index_build(rx_hotspot_index_t* index);
+
+// returns the number of items that may contain the core point and points candidates at their indices, in priority order
+uint32_t rx_hotspot_index_candidates(const rx_hotspot_index_t* index, float x, float y, const uint16_t** candidates);
+
+// returns the index of the first item whose core rect contains the core point, right and bottom exclusive, or RX_HOTSPOT_INDEX_NOT_FOUND
+uint32_t rx_hotspot_index_hit_test(const rx_hotspot_index_t* index, float x, float y);
+
+// returns the index of an item, or RX_HOTSPOT_INDEX_NOT_FOUND if it is not in the index
+uint32_t rx_hotspot_index_find(const rx_hotspot_index_t* index, const void* item);
+
+__END_DECLS
+
+#endif // RX_HOTSPOT_INDEX_H
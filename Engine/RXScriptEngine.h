@@ -11,6 +11,8 @@
 #import "Base/RXBase.h"
 
 #import "Engine/RXCard.h"
+#import "Engine/RXHotspotEventQueue.h"
+#import "Engine/RXHotspotIndex.h"
 #import "Engine/RXScriptEngineProtocols.h"
 
 #import "Rendering/Audio/RXSoundGroup.h"
@@ -36,9 +38,15 @@ typedef struct {
   BOOL _disableScriptLogging;
 
   NSMutableArray* _active_hotspots;
+  rx_hotspot_index_t _active_hotspot_index;
   OSSpinLock _active_hotspots_lock;
   BOOL _did_hide_mouse;
 
+  // hotspot mouse events posted by the main thread, executed by a run loop source on the script thread
+  rx_hotspot_event_queue_t* _hotspot_events;
+  CFRunLoopSourceRef _hotspot_event_source;
+  CFRunLoopRef _script_run_loop;
+
   // rendering support
   NSMutableDictionary* _dynamic_texture_cache;
   NSMutableDictionary* _picture_cache;
@@ -95,4 +103,8 @@ typedef struct {
 
 - (id)initWithController:(id<RXScriptEngineControllerProtocol>)ctlr;
 
+// runs the mouse inside, exited, down or up programs of hotspot on the script thread, in the order events are posted; may be called from
+// any thread, and coalesces a mouse inside event with the previous one if the script thread has not run it yet
+- (void)postHotspotEvent:(uint32_t)type hotspot:(RXHotspot*)hotspot;
+
 @end
@@ -29,8 +29,10 @@
 #import "Rendering/Graphics/RXTextureBroker.h"
 #import "Rendering/Graphics/RXTransition.h"
 #import "Rendering/Graphics/RXDynamicPicture.h"
+#import "Rendering/Graphics/RXTextureUploader.h"
 
 #import "Utilities/random.h"
+#import "Utilities/InterThreadMessaging.h"
 
 #import "Application/RXApplicationDelegate.h"
 
@@ -102,6 +104,8 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
   rx_dispatch_externalv(target, external_name, 1, args);
 }
 
+static void rx_script_engine_hotspot_event_perform(void* info);
+
 @implementation RXScriptEngine
 
 + (void)initialize
@@ -239,6 +243,17 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
 
   _active_hotspots_lock = OS_SPINLOCK_INIT;
   _active_hotspots = [NSMutableArray new];
+  rx_hotspot_index_init(&_active_hotspot_index);
+
+  // the hotspot event queue is drained by a run loop source on the script thread
+  if (posix_memalign((void**)&_hotspot_events, 64, sizeof(rx_hotspot_event_queue_t)) != 0)
+    _hotspot_events = NULL;
+  release_assert(_hotspot_events);
+  rx_hotspot_event_queue_init(_hotspot_events);
+
+  CFRunLoopSourceContext source_context = {0, self, NULL, NULL, NULL, NULL, NULL, NULL, NULL, rx_script_engine_hotspot_event_perform};
+  _hotspot_event_source = CFRunLoopSourceCreate(kCFAllocatorDefault, 0, &source_context);
+  [self performSelector:@selector(_scheduleHotspotEventSource) withObject:nil inThread:[g_world scriptThread] waitUntilDone:NO];
 
   _dynamic_texture_cache = [NSMutableDictionary new];
   _picture_cache = [NSMutableDictionary new];
@@ -289,6 +304,21 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
   [_dynamic_texture_cache release];
 
   [_active_hotspots release];
+  rx_hotspot_index_destroy(&_active_hotspot_index);
+
+  if (_hotspot_event_source) {
+    CFRunLoopSourceInvalidate(_hotspot_event_source);
+    CFRelease(_hotspot_event_source);
+  }
+  if (_script_run_loop)
+    CFRelease(_script_run_loop);
+  if (_hotspot_events) {
+    rx_hotspot_event_t event;
+    while (rx_hotspot_event_queue_pop(_hotspot_events, &event))
+      [(RXHotspot*)event.hotspot release];
+    rx_hotspot_event_queue_destroy(_hotspot_events);
+    free(_hotspot_events);
+  }
 
   [_synthesizedSoundGroup release];
   [_card release];
@@ -325,6 +355,29 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
   }
 }
 
+- (RXDynamicPicture*)_newDynamicPictureWithTexture:(RXTexture*)texture
+                                       samplingRect:(NSRect)sampling_rect
+                                         renderRect:(NSRect)render_rect
+                                             upload:(RXTextureUpload*)upload
+{
+  RXDynamicPicture* picture = [[RXDynamicPicture alloc] initWithTexture:texture samplingRect:sampling_rect renderRect:render_rect owner:self upload:upload];
+  if (picture)
+    return picture;
+
+  // every dynamic picture slot is taken; cached pictures hold on to theirs, so empty the caches (which may own the texture and upload)
+  // and try again
+  [texture retain];
+  [upload retain];
+  [self _emptyPictureCaches];
+  picture = [[RXDynamicPicture alloc] initWithTexture:texture samplingRect:sampling_rect renderRect:render_rect owner:self upload:upload];
+  [upload release];
+  [texture release];
+
+  if (!picture)
+    @throw [NSException exceptionWithName:@"RXPictureLoadException" reason:@"Out of dynamic picture slots." userInfo:nil];
+  return picture;
+}
+
 - (void)_resetMovieProxies
 {
   NSMapEnumerator movie_enum = NSEnumerateMapTable(code_movie_map);
@@ -588,6 +641,7 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
   [_active_hotspots addObjectsFromArray:[_card hotspots]];
   [_active_hotspots makeObjectsPerformSelector:@selector(enable)];
   [_active_hotspots sortUsingSelector:@selector(compareByIndex:)];
+  [self _rebuildActiveHotspotIndex_nolock];
   OSSpinLockUnlock(&_active_hotspots_lock);
 
   // reset auto-activation states
@@ -820,6 +874,7 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
   // clear all active hotspots
   OSSpinLockLock(&_active_hotspots_lock);
   [_active_hotspots removeAllObjects];
+  [self _rebuildActiveHotspotIndex_nolock];
   OSSpinLockUnlock(&_active_hotspots_lock);
 
   // we can show the mouse again (if we hid it) if the execution depth is
@@ -844,6 +899,60 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
   return [hotspots autorelease];
 }
 
+- (void)_rebuildActiveHotspotIndex_nolock
+{
+  // WARNING: the caller must hold the active hotspots lock
+
+  // the index does not retain the hotspots; the active hotspots array keeps them alive for as long as they are in the index
+  uint32_t count = (uint32_t)[_active_hotspots count];
+  rx_hotspot_index_resize(&_active_hotspot_index, count);
+  for (uint32_t i = 0; i < count; i++) {
+    RXHotspot* hotspot = [_active_hotspots objectAtIndex:i];
+    _active_hotspot_index.items[i] = hotspot;
+    _active_hotspot_index.rects[i] = [hotspot coreFrame];
+  }
+  rx_hotspot_index_build(&_active_hotspot_index);
+}
+
+- (void)_updateActiveHotspotFrames
+{
+  // moving a hotspot changes its core frame, which the index caches
+  OSSpinLockLock(&_active_hotspots_lock);
+  [self _rebuildActiveHotspotIndex_nolock];
+  OSSpinLockUnlock(&_active_hotspots_lock);
+}
+
+- (RXHotspot*)activeHotspotAtWorldPoint:(NSPoint)point
+{
+  // WARNING: WILL BE CALLED BY THE MAIN THREAD
+
+  // the grid only narrows the search down; the world frame test is the same one a scan of activeHotspots would do
+  NSPoint core_point = RXTransformPointWorldToCore(point);
+  RXHotspot* hotspot = nil;
+
+  OSSpinLockLock(&_active_hotspots_lock);
+  const uint16_t* candidates;
+  uint32_t count = rx_hotspot_index_candidates(&_active_hotspot_index, core_point.x, core_point.y, &candidates);
+  for (uint32_t i = 0; i < count; i++) {
+    RXHotspot* candidate = (RXHotspot*)_active_hotspot_index.items[candidates[i]];
+    if (NSMouseInRect(point, [candidate worldFrame], NO)) {
+      hotspot = [candidate retain];
+      break;
+    }
+  }
+  OSSpinLockUnlock(&_active_hotspots_lock);
+
+  return [hotspot autorelease];
+}
+
+- (BOOL)isHotspotActive:(RXHotspot*)hotspot
+{
+  OSSpinLockLock(&_active_hotspots_lock);
+  BOOL active = rx_hotspot_index_find(&_active_hotspot_index, hotspot) != RX_HOTSPOT_INDEX_NOT_FOUND;
+  OSSpinLockUnlock(&_active_hotspots_lock);
+  return active;
+}
+
 - (RXHotspot*)activeHotspotWithName:(NSString*)name
 {
   // WARNING: WILL BE CALLED BY THE MAIN THREAD
@@ -1035,6 +1144,64 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
   [controller enableHotspotHandling];
 }
 
+- (void)_scheduleHotspotEventSource
+{
+  // WARNING: MUST RUN ON THE SCRIPT THREAD
+  CFRunLoopRef run_loop = CFRunLoopGetCurrent();
+  CFRunLoopAddSource(run_loop, _hotspot_event_source, kCFRunLoopDefaultMode);
+  CFRetain(run_loop);
+  __atomic_store_n(&_script_run_loop, run_loop, __ATOMIC_RELEASE);
+}
+
+- (void)postHotspotEvent:(uint32_t)type hotspot:(RXHotspot*)hotspot
+{
+  // the queue holds a reference on its hotspots until the script thread is done with them
+  [hotspot retain];
+
+  // only mouse inside events are ever refused, since they will be sent again on the next mouse move; the other events overflow in order
+  int result = rx_hotspot_event_queue_push(_hotspot_events, type, hotspot);
+  if (result != RX_HOTSPOT_EVENT_QUEUED) {
+    [hotspot release];
+    return;
+  }
+
+  // if the source is not scheduled yet, it will fire as soon as it is
+  CFRunLoopSourceSignal(_hotspot_event_source);
+  CFRunLoopRef run_loop = __atomic_load_n(&_script_run_loop, __ATOMIC_ACQUIRE);
+  if (run_loop)
+    CFRunLoopWakeUp(run_loop);
+}
+
+- (void)_performHotspotEvents
+{
+  // WARNING: RUNS ON THE SCRIPT THREAD
+
+  // events are popped one at a time, since hotspot programs can run the run loop and re-enter this method
+  rx_hotspot_event_t event;
+  while (rx_hotspot_event_queue_pop(_hotspot_events, &event)) {
+    RXHotspot* hotspot = (RXHotspot*)event.hotspot;
+    switch (event.type) {
+      // a card switch requested by the main thread is an inter-thread message that may have run ahead of these events; drop inside
+      // and exited events for hotspots that the switch deactivated
+      case RX_HOTSPOT_EVENT_MOUSE_INSIDE:
+        if ([self isHotspotActive:hotspot])
+          [self mouseInsideHotspot:hotspot];
+        break;
+      case RX_HOTSPOT_EVENT_MOUSE_EXITED:
+        if ([self isHotspotActive:hotspot])
+          [self mouseExitedHotspot:hotspot];
+        break;
+      case RX_HOTSPOT_EVENT_MOUSE_DOWN:
+        [self mouseDownInHotspot:hotspot];
+        break;
+      case RX_HOTSPOT_EVENT_MOUSE_UP:
+        [self mouseUpInHotspot:hotspot];
+        break;
+    }
+    [hotspot release];
+  }
+}
+
 #pragma mark -
 #pragma mark movie playback
 
@@ -1195,19 +1362,23 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
     [archive_tex_cache release];
   }
 
+  // the cache maps tBMP IDs to the upload of their texture, which may still be in progress; failed uploads are evicted and retried
   NSNumber* dynamic_texture_key = [NSNumber numberWithUnsignedInt:(unsigned int)tbmp_id << 2];
-  RXTexture* picture_texture = [archive_tex_cache objectForKey:dynamic_texture_key];
-  if (!picture_texture) {
-    picture_texture = [[RXTextureBroker sharedTextureBroker] newTextureWithWidth:picture_width height:picture_height];
-    [picture_texture updateWithBitmap:tbmp_id archive:archive];
-
-    // map the tBMP ID to the texture object
-    [archive_tex_cache setObject:picture_texture forKey:dynamic_texture_key];
+  RXTextureUpload* upload = [archive_tex_cache objectForKey:dynamic_texture_key];
+  if ([upload error]) {
+    RXLog(kRXLoggingScript, kRXLoggingLevelError, @"reloading picture %hu whose previous upload failed: %@", tbmp_id, [upload error]);
+    [archive_tex_cache removeObjectForKey:dynamic_texture_key];
+    upload = nil;
+  }
+  if (!upload) {
+    RXTexture* picture_texture = [[RXTextureBroker sharedTextureBroker] newTextureWithWidth:picture_width height:picture_height];
+    upload = [picture_texture beginUpdateWithBitmap:tbmp_id archive:archive];
+    [archive_tex_cache setObject:upload forKey:dynamic_texture_key];
     [picture_texture release];
   }
 
-  // create a RXDynamicPicture object and queue it for rendering
-  RXDynamicPicture* picture = [[RXDynamicPicture alloc] initWithTexture:picture_texture samplingRect:sampling_rect renderRect:display_rect owner:self];
+  // queue the picture while it uploads; the render thread waits for the upload before drawing the picture
+  RXDynamicPicture* picture = [self _newDynamicPictureWithTexture:[upload texture] samplingRect:sampling_rect renderRect:display_rect upload:upload];
   [controller queuePicture:picture];
   [picture release];
 
@@ -1451,6 +1622,7 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
     OSSpinLockLock(&_active_hotspots_lock);
     [_active_hotspots addObject:hotspot];
     [_active_hotspots sortUsingSelector:@selector(compareByIndex:)];
+    [self _rebuildActiveHotspotIndex_nolock];
     OSSpinLockUnlock(&_active_hotspots_lock);
 
     // instruct the script handler to update the hotspot state
@@ -1478,6 +1650,7 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
     OSSpinLockLock(&_active_hotspots_lock);
     [_active_hotspots removeObject:hotspot];
     [_active_hotspots sortUsingSelector:@selector(compareByIndex:)];
+    [self _rebuildActiveHotspotIndex_nolock];
     OSSpinLockUnlock(&_active_hotspots_lock);
 
     // instruct the script handler to update the hotspot state
@@ -1961,7 +2134,12 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
 
   // lookup the picture in the current card picture cache
   NSNumber* picture_key = [NSNumber numberWithUnsignedInt:index << 2];
-  RXPicture* picture = [_picture_cache objectForKey:picture_key];
+  RXDynamicPicture* picture = [_picture_cache objectForKey:picture_key];
+  if ([picture uploadFailed]) {
+    RXLog(kRXLoggingScript, kRXLoggingLevelError, @"reloading picture for PLST record %u whose previous upload failed", index + 1);
+    [_picture_cache removeObjectForKey:picture_key];
+    picture = nil;
+  }
   if (!picture) {
     // if VRAM gets below 32 MiB, empty the picture cache
     if ([g_worldView currentFreeVRAM] < 32 * 1024 * 1024)
@@ -1981,16 +2159,22 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
     rx_size_t picture_size = RXSizeMake([[picture_descriptor objectForKey:@"Width"] intValue], [[picture_descriptor objectForKey:@"Height"] intValue]);
     RXTexture* picture_texture = [[RXTextureBroker sharedTextureBroker] newTextureWithSize:picture_size];
 
-    // update the texture with the content of the picture
-    [picture_texture updateWithBitmap:picture_record->bitmap_id archive:archive];
+    // start updating the texture with the content of the picture
+    RXTextureUpload* upload = [picture_texture beginUpdateWithBitmap:picture_record->bitmap_id archive:archive];
 
     // create suitable sampling and display rects
     NSRect display_rect = RXMakeCompositeDisplayRectFromCoreRect(picture_record->rect);
     NSRect sampling_rect = NSMakeRect(0.0f, 0.0f, display_rect.size.width, display_rect.size.height);
 
-    // create a dynamic picture around the texture
-    picture = [[RXDynamicPicture alloc] initWithTexture:picture_texture samplingRect:sampling_rect renderRect:display_rect owner:self];
-    [picture_texture release];
+    // create a dynamic picture around the texture while the picture uploads; the render thread waits for the upload before drawing it
+    @try
+    {
+      picture = [self _newDynamicPictureWithTexture:picture_texture samplingRect:sampling_rect renderRect:display_rect upload:upload];
+    }
+    @finally
+    {
+      [picture_texture release];
+    }
 
     // store the picture in the cache
     [_picture_cache setObject:picture forKey:picture_key];
@@ -2076,6 +2260,7 @@ RX_INLINE void rx_dispatch_external1(id target, NSString* external_name, uint16_
 
   OSSpinLockLock(&_active_hotspots_lock);
   [_active_hotspots sortUsingSelector:@selector(compareByIndex:)];
+  [self _rebuildActiveHotspotIndex_nolock];
   OSSpinLockUnlock(&_active_hotspots_lock);
 
   // instruct the script handler to update the hotspot state
@@ -3782,10 +3967,10 @@ static float const marble_size = 13.5f;
   core_display_rect.right = core_display_rect.left + 4;
   core_display_rect.bottom = core_display_rect.top + 2;
 
-  RXDynamicPicture* picture = [[RXDynamicPicture alloc] initWithTexture:tiny_marble_atlas
-                                                           samplingRect:sampling_rect
-                                                             renderRect:RXMakeCompositeDisplayRectFromCoreRect(core_display_rect)
-                                                                  owner:self];
+  RXDynamicPicture* picture = [self _newDynamicPictureWithTexture:tiny_marble_atlas
+                                                     samplingRect:sampling_rect
+                                                       renderRect:RXMakeCompositeDisplayRectFromCoreRect(core_display_rect)
+                                                           upload:nil];
   [controller queuePicture:picture];
   [picture release];
 }
@@ -3884,6 +4069,7 @@ DEFINE_COMMAND(xt7600_setupmarbles)
     core_position.top = marble_offset_matrix[1][marble_y / 5] + marble_size * (marble_y % 5);
     core_position.bottom = core_position.top + marble_size;
     [hotspot setCoreFrame:core_position];
+    [self _updateActiveHotspotFrames];
   }
 }
 
@@ -4076,6 +4262,7 @@ DEFINE_COMMAND(xtakeit)
 
     // reset the marble hotspot's core frame
     [hotspot setCoreFrame:initial_rect];
+    [self _updateActiveHotspotFrames];
   } else {
     // set the new marble's position
     [gs setUnsigned32:new_marble_pos forKey:marble_var];
@@ -4090,6 +4277,7 @@ DEFINE_COMMAND(xtakeit)
     core_position.top = marble_offset_matrix[1][marble_y / 5] + marble_size * (marble_y % 5);
     core_position.bottom = core_position.top + marble_size;
     [hotspot setCoreFrame:core_position];
+    [self _updateActiveHotspotFrames];
   }
 
   // we are no longer dragging a marble
@@ -6023,3 +6211,5 @@ DEFINE_COMMAND(xjlagoon1500_alert)
 DEFINE_COMMAND(xflies) {}
 
 @end
+
+static void rx_script_engine_hotspot_event_perform(void* info) { [(RXScriptEngine*)info _performHotspotEvents]; }
@@ -21,6 +21,8 @@
 
 - (NSArray*)activeHotspots;
 - (RXHotspot*)activeHotspotWithName:(NSString*)name;
+- (RXHotspot*)activeHotspotAtWorldPoint:(NSPoint)point;
+- (BOOL)isHotspotActive:(RXHotspot*)hotspot;
 - (void)mouseInsideHotspot:(RXHotspot*)hotspot;
 - (void)mouseExitedHotspot:(RXHotspot*)hotspot;
 - (void)mouseDownInHotspot:(RXHotspot*)hotspot;
@@ -9,12 +9,18 @@
 #import "Base/RXBase.h"
 #import <MHKKit/MHKKit.h>
 
+#import <pthread.h>
+
 @interface RXStack : NSObject {
 @private
   NSString* _key;
 
   NSMutableArray* _dataArchives;
-  NSMutableArray* _soundArchives;
+
+  // the sound archives are opened by the first sound lookup, or by -prefetchResources
+  NSArray* _soundArchivePaths;
+  NSArray* _soundArchives;
+  pthread_mutex_t _soundArchivesMutex;
 
   // global stack data
   NSArray* _cardNames;
@@ -42,6 +48,9 @@
 - (uint32_t)varIndexForName:(NSString*)name;
 - (NSString*)stackNameAtIndex:(uint32_t)index;
 
+// keys of the stacks this stack's scripts can go to
+- (NSArray*)stackNames;
+
 - (uint16_t)cardIDFromRMAPCode:(uint32_t)code;
 - (uint32_t)cardRMAPCodeFromID:(uint16_t)card_id;
 
@@ -55,4 +64,8 @@
 - (MHKFileHandle*)fileWithResourceType:(NSString*)type ID:(uint16_t)ID;
 - (NSData*)dataWithResourceType:(NSString*)type ID:(uint16_t)ID;
 
+// opens the sound archives and builds the resource tables that loading and running a card needs, so that the first card of the stack
+// does not have to; can be called from any thread
+- (void)prefetchResources;
+
 @end
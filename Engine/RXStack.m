@@ -86,7 +86,7 @@ static NSArray* _loadNAMEResourceWithID(MHKArchive* archive, uint16_t resourceID
   _key = [key copy];
 
   _dataArchives = [[NSMutableArray alloc] initWithCapacity:3];
-  _soundArchives = [[NSMutableArray alloc] initWithCapacity:1];
+  pthread_mutex_init(&_soundArchivesMutex, NULL);
 
   RXArchiveManager* sam = [RXArchiveManager sharedArchiveManager];
 
@@ -102,17 +102,13 @@ static NSArray* _loadNAMEResourceWithID(MHKArchive* archive, uint16_t resourceID
   RXOLog2(kRXLoggingEngine, kRXLoggingLevelDebug, @"data archives: %@", _dataArchives);
 #endif
 
-  // load the sound archives
-  archives = [sam soundArchivesForStackKey:_key error:error];
-  if (!archives || [archives count] == 0) {
+  // find the sound archives; they are only opened when the stack first needs a sound
+  _soundArchivePaths = [[sam soundArchivePathsForStackKey:_key error:error] retain];
+  if (!_soundArchivePaths) {
     RXOLog2(kRXLoggingEngine, kRXLoggingLevelError, @"archive manager provided no sound archives for stack '%@'", _key);
     [self release];
     return nil;
   }
-  [_soundArchives addObjectsFromArray:archives];
-#if defined(DEBUG)
-  RXOLog2(kRXLoggingEngine, kRXLoggingLevelDebug, @"sound archives: %@", _soundArchives);
-#endif
 
   // the master archive is the one that contains the RMAP and NAME data
   NSDictionary* rmapDescriptor = nil;
@@ -126,7 +122,7 @@ static NSArray* _loadNAMEResourceWithID(MHKArchive* archive, uint16_t resourceID
   if (!rmapDescriptor) {
     RXOLog2(kRXLoggingEngine, kRXLoggingLevelError, @"no RMAP data for stack '%@'", _key);
     RXOLog2(kRXLoggingEngine, kRXLoggingLevelMessage, @"data archives: %@", _dataArchives);
-    RXOLog2(kRXLoggingEngine, kRXLoggingLevelMessage, @"sound archives: %@", _soundArchives);
+    RXOLog2(kRXLoggingEngine, kRXLoggingLevelMessage, @"sound archives: %@", _soundArchivePaths);
 
     [self release];
     return nil;
@@ -172,6 +168,8 @@ static NSArray* _loadNAMEResourceWithID(MHKArchive* archive, uint16_t resourceID
 
   [_soundArchives release];
   _soundArchives = nil;
+  [_soundArchivePaths release];
+  _soundArchivePaths = nil;
   [_dataArchives release];
   _dataArchives = nil;
 }
@@ -184,6 +182,7 @@ static NSArray* _loadNAMEResourceWithID(MHKArchive* archive, uint16_t resourceID
 
   // tear done before we deallocate
   [self _tearDown];
+  pthread_mutex_destroy(&_soundArchivesMutex);
 
   [_key release];
 
@@ -230,6 +229,8 @@ static NSArray* _loadNAMEResourceWithID(MHKArchive* archive, uint16_t resourceID
 
 - (NSString*)stackNameAtIndex:(uint32_t)index { return (_stackNames) ? [_stackNames objectAtIndex:index] : nil; }
 
+- (NSArray*)stackNames { return _stackNames; }
+
 - (uint16_t)cardIDFromRMAPCode:(uint32_t)code
 {
   uint32_t* rmap_data = (uint32_t*)[_rmapData bytes];
@@ -251,10 +252,29 @@ static NSArray* _loadNAMEResourceWithID(MHKArchive* archive, uint16_t resourceID
   return CFSwapInt32BigToHost(rmap_data[card_id]);
 }
 
+- (NSArray*)_soundArchives
+{
+  pthread_mutex_lock(&_soundArchivesMutex);
+  if (!_soundArchives) {
+    NSError* error;
+    _soundArchives = [[[RXArchiveManager sharedArchiveManager] archivesWithPaths:_soundArchivePaths error:&error] retain];
+    if (!_soundArchives) {
+      RXOLog2(kRXLoggingEngine, kRXLoggingLevelError, @"failed to open the sound archives of stack '%@': %@", _key, error);
+      _soundArchives = [NSArray new];
+    }
+#if defined(DEBUG)
+    RXOLog2(kRXLoggingEngine, kRXLoggingLevelDebug, @"sound archives: %@", _soundArchives);
+#endif
+  }
+  NSArray* archives = _soundArchives;
+  pthread_mutex_unlock(&_soundArchivesMutex);
+  return archives;
+}
+
 - (id<MHKAudioDecompression>)audioDecompressorWithID:(uint16_t)soundID
 {
   id<MHKAudioDecompression> decompressor = nil;
-  for (MHKArchive* archive in _soundArchives) {
+  for (MHKArchive* archive in [self _soundArchives]) {
     decompressor = [archive decompressorWithSoundID:soundID error:NULL];
     if (decompressor)
       break;
@@ -275,7 +295,7 @@ static NSArray* _loadNAMEResourceWithID(MHKArchive* archive, uint16_t resourceID
 
 - (uint16_t)soundIDForName:(NSString*)sound_name
 {
-  for (MHKArchive* archive in _soundArchives) {
+  for (MHKArchive* archive in [self _soundArchives]) {
     NSDictionary* desc = [archive resourceDescriptorWithResourceType:@"tWAV" name:sound_name];
     if (desc)
       return [[desc objectForKey:@"ID"] unsignedShortValue];
@@ -322,4 +342,17 @@ static NSArray* _loadNAMEResourceWithID(MHKArchive* archive, uint16_t resourceID
   return nil;
 }
 
+- (void)prefetchResources
+{
+  // the resource types read by card loading, hotspots and scripts
+  static NSString* const data_types[] = {@"CARD", @"HSPT", @"PLST", @"BLST", @"FLST", @"MLST", @"SLST", @"SFXE", @"tBMP", @"tMOV", @"tWAV"};
+
+  for (MHKArchive* archive in _dataArchives) {
+    for (size_t type_i = 0; type_i < sizeof(data_types) / sizeof(NSString*); type_i++)
+      [archive valueForKey:data_types[type_i]];
+  }
+  for (MHKArchive* archive in [self _soundArchives])
+    [archive valueForKey:@"tWAV"];
+}
+
 @end
@@ -0,0 +1,51 @@
+//
+//  RXStartupTaskGraph.h
+//  rivenx
+//
+
+#import "Base/RXBase.h"
+
+#import <dispatch/dispatch.h>
+
+// Runs a piece of startup work as a graph of named tasks. Background tasks run on the global high priority queue as soon as every task
+// they depend on has finished, so independent work (plist parsing, image decoding, archive opening) overlaps; work that needs the calling
+// thread (e.g. anything touching a GL context or AppKit windows) is timed inline with performTask:block: while the background tasks run.
+//
+// Every task is timed, and -logTimings logs the duration and start offset of each one so that startup regressions show up in the log.
+// An exception raised by a background task cancels the tasks that have not started yet and is re-raised by -wait on the waiting thread.
+@interface RXStartupTaskGraph : NSObject {
+  NSString* _name;
+  NSMutableArray* _tasks;
+  NSMutableDictionary* _tasks_by_name;
+  dispatch_group_t _group;
+
+  uint64_t _start_timestamp;
+  BOOL _started;
+  id _current_task;
+
+  OSSpinLock _exception_lock;
+  NSException* _exception;
+}
+
+- (id)initWithName:(NSString*)name;
+
+// adds a background task; dependencies must name tasks that were already added, and tasks can only be added before -start
+- (void)addTask:(NSString*)name dependencies:(NSArray*)dependencies block:(void (^)(void))block;
+
+// schedules the tasks that have no dependencies; task start offsets are relative to the creation of the graph
+- (void)start;
+
+// runs block on the calling thread and records its timing with the background tasks; exceptions propagate to the caller
+- (void)performTask:(NSString*)name block:(void (^)(void))block;
+
+// same as performTask:block:, for sections of code that are too long to move into a block; tasks on the calling thread do not nest
+- (void)beginTask:(NSString*)name;
+- (void)endTask;
+
+// waits for every background task to finish and re-raises the first exception a task raised
+- (void)wait;
+
+// logs the duration and start offset of every task that has finished, and the time since the creation of the graph
+- (void)logTimings;
+
+@end
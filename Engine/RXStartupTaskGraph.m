@@ -0,0 +1,197 @@
+//
+//  RXStartupTaskGraph.m
+//  rivenx
+//
+
+#import "Engine/RXStartupTaskGraph.h"
+
+#import "Base/RXTiming.h"
+
+@interface RXStartupTask : NSObject {
+@public
+  NSString* name;
+  void (^block)(void);
+  NSMutableArray* dependents;
+  int32_t pending_dependencies;
+  uint64_t start_timestamp;
+  uint64_t end_timestamp;
+  BOOL background;
+  BOOL cancelled;
+}
+@end
+
+@implementation RXStartupTask
+
+- (void)dealloc
+{
+  [name release];
+  [block release];
+  [dependents release];
+  [super dealloc];
+}
+
+@end
+
+@implementation RXStartupTaskGraph
+
+- (id)init
+{
+  [self doesNotRecognizeSelector:_cmd];
+  [self release];
+  return nil;
+}
+
+- (id)initWithName:(NSString*)name
+{
+  self = [super init];
+  if (!self)
+    return nil;
+
+  _name = [name copy];
+  _tasks = [NSMutableArray new];
+  _tasks_by_name = [NSMutableDictionary new];
+  _group = dispatch_group_create();
+  _exception_lock = OS_SPINLOCK_INIT;
+
+  _start_timestamp = RXTimingNow();
+
+  return self;
+}
+
+- (void)dealloc
+{
+  // the task blocks retain the graph, so it cannot go away while tasks are running
+  [_current_task release];
+  dispatch_release(_group);
+  [_exception release];
+  [_tasks_by_name release];
+  [_tasks release];
+  [_name release];
+
+  [super dealloc];
+}
+
+- (void)addTask:(NSString*)name dependencies:(NSArray*)dependencies block:(void (^)(void))block
+{
+  release_assert(!_started);
+  release_assert(![_tasks_by_name objectForKey:name]);
+
+  RXStartupTask* task = [RXStartupTask new];
+  task->name = [name copy];
+  task->block = [block copy];
+  task->dependents = [NSMutableArray new];
+  task->background = YES;
+
+  for (NSString* dependency_name in dependencies) {
+    RXStartupTask* dependency = [_tasks_by_name objectForKey:dependency_name];
+    release_assert(dependency && dependency->background);
+    [dependency->dependents addObject:task];
+    task->pending_dependencies++;
+  }
+
+  [_tasks addObject:task];
+  [_tasks_by_name setObject:task forKey:name];
+  [task release];
+}
+
+- (void)_submitTask:(RXStartupTask*)task
+{
+  dispatch_group_async(_group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(void) {
+    NSAutoreleasePool* p = [NSAutoreleasePool new];
+
+    OSSpinLockLock(&_exception_lock);
+    task->cancelled = (_exception != nil);
+    OSSpinLockUnlock(&_exception_lock);
+
+    task->start_timestamp = RXTimingNow();
+    if (!task->cancelled) {
+      @try {
+        task->block();
+      }
+      @catch (NSException* e) {
+        OSSpinLockLock(&_exception_lock);
+        if (!_exception)
+          _exception = [e retain];
+        OSSpinLockUnlock(&_exception_lock);
+      }
+    }
+    task->end_timestamp = RXTimingNow();
+
+    // dependents are submitted from within the group, so the group cannot empty out before they are
+    for (RXStartupTask* dependent in task->dependents) {
+      if (__atomic_sub_fetch(&dependent->pending_dependencies, 1, __ATOMIC_ACQ_REL) == 0)
+        [self _submitTask:dependent];
+    }
+
+    [p release];
+  });
+}
+
+- (void)start
+{
+  release_assert(!_started);
+  _started = YES;
+
+  for (RXStartupTask* task in _tasks) {
+    if (task->background && task->pending_dependencies == 0)
+      [self _submitTask:task];
+  }
+}
+
+- (void)beginTask:(NSString*)name
+{
+  release_assert(!_current_task);
+
+  RXStartupTask* task = [RXStartupTask new];
+  task->name = [name copy];
+  task->start_timestamp = RXTimingNow();
+  _current_task = task;
+}
+
+- (void)endTask
+{
+  RXStartupTask* task = (RXStartupTask*)_current_task;
+  release_assert(task);
+
+  task->end_timestamp = RXTimingNow();
+  [_tasks addObject:task];
+  [task release];
+  _current_task = nil;
+}
+
+- (void)performTask:(NSString*)name block:(void (^)(void))block
+{
+  [self beginTask:name];
+  @try {
+    block();
+  }
+  @finally {
+    [self endTask];
+  }
+}
+
+- (void)wait
+{
+  dispatch_group_wait(_group, DISPATCH_TIME_FOREVER);
+  if (_exception)
+    @throw [[_exception retain] autorelease];
+}
+
+- (void)logTimings
+{
+  uint64_t now = RXTimingNow();
+  for (RXStartupTask* task in _tasks) {
+    if (task->end_timestamp == 0)
+      continue;
+    if (task->cancelled) {
+      RXOLog2(kRXLoggingEngine, kRXLoggingLevelMessage, @"%@: %@ cancelled", _name, task->name);
+      continue;
+    }
+    RXOLog2(kRXLoggingEngine, kRXLoggingLevelMessage, @"%@: %@ took %.2f ms (started at +%.2f ms%@)", _name, task->name,
+            RXTimingTimestampDelta(task->end_timestamp, task->start_timestamp) * 1000.0,
+            RXTimingTimestampDelta(task->start_timestamp, _start_timestamp) * 1000.0, (task->background) ? @", background" : @"");
+  }
+  RXOLog2(kRXLoggingEngine, kRXLoggingLevelMessage, @"%@: %.2f ms", _name, RXTimingTimestampDelta(now, _start_timestamp) * 1000.0);
+}
+
+@end
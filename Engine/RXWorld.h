@@ -15,7 +15,12 @@
 
 #import <AppKit/NSApplication.h>
 
+#import <dispatch/dispatch.h>
+#import <pthread.h>
+
 @interface RXWorld : NSObject <RXWorldProtocol> {
+  uint64_t _startupTimestamp;
+
   NSURL* _worldBase;
   NSURL* _worldCacheBase;
   NSURL* _worldSupportBase;
@@ -36,6 +41,16 @@
   NSMutableDictionary* _activeStacks;
   NSDictionary* _stackDescriptors;
 
+  // stacks are loaded by one thread at a time each, either on demand or ahead of time by the stack preload queues
+  pthread_mutex_t _stackLoadMutex;
+  pthread_cond_t _stackLoadCondition;
+  NSMutableSet* _stacksBeingLoaded;
+  NSMutableSet* _stacksScheduledForPreload;
+  dispatch_queue_t _stackPreloadQueue;
+  dispatch_queue_t _idleStackPreloadQueue;
+  dispatch_group_t _stackPreloadGroup;
+  BOOL _idleStackPreloadScheduled;
+
   RXGameState* _gameState;
   RXGameState* _gameStateToLoad;
 
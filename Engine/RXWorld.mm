@@ -18,7 +18,9 @@
 #import "Base/RXLogCenter.h"
 
 #import "Engine/RXWorld.h"
+#import "Engine/RXArchiveManager.h"
 #import "Engine/RXCursors.h"
+#import "Engine/RXStartupTaskGraph.h"
 
 #import "Utilities/BZFSUtilities.h"
 
@@ -153,6 +155,7 @@ NSObject<RXWorldProtocol>* g_world = nil;
 
   // initialize timing
   RXTimingUpdateTimebase();
+  _startupTimestamp = RXTimingNow();
 
   // initialize logging
   [RXLogCenter sharedLogCenter];
@@ -187,10 +190,32 @@ NSObject<RXWorldProtocol>* g_world = nil;
   // the active stacks dictionary maps stack keys (e.g. aspit, etc.) to RXStack objects
   _activeStacks = [NSMutableDictionary new];
 
+  // stacks the player can go to from the current stack are preloaded on one queue, every other stack on a second one once the first has
+  // drained; both run at low priority rather than background, since a transition that needs a stack waits for its preload and must not
+  // wait on throttled I/O
+  pthread_mutex_init(&_stackLoadMutex, NULL);
+  pthread_cond_init(&_stackLoadCondition, NULL);
+  _stacksBeingLoaded = [NSMutableSet new];
+  _stacksScheduledForPreload = [NSMutableSet new];
+  _stackPreloadQueue = dispatch_queue_create("org.macstorm.rivenx.stack-preload", DISPATCH_QUEUE_SERIAL);
+  dispatch_set_target_queue(_stackPreloadQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+  _idleStackPreloadQueue = dispatch_queue_create("org.macstorm.rivenx.stack-preload.idle", DISPATCH_QUEUE_SERIAL);
+  dispatch_set_target_queue(_idleStackPreloadQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+  _stackPreloadGroup = dispatch_group_create();
+
+  // the rest of the initialization is a graph of tasks; the plists are parsed, the cursors decoded and the Extras archive opened on
+  // background queues while this thread starts the script thread
+  RXStartupTaskGraph* startup_tasks = [[RXStartupTaskGraph alloc] initWithName:@"world startup"];
+
+  // set the global to ourselves now, since the archive manager goes through it to find the world bases
+  g_world = self;
+
   // load Extras.plist
-  _extrasDescriptor = [[NSDictionary alloc] initWithContentsOfFile:[[NSBundle mainBundle] pathForResource:@"Extras" ofType:@"plist"]];
-  if (!_extrasDescriptor)
-    @throw [NSException exceptionWithName:@"RXMissingResourceException" reason:@"Failed to load Extras.plist." userInfo:nil];
+  [startup_tasks addTask:@"Extras.plist" dependencies:nil block:^(void) {
+    _extrasDescriptor = [[NSDictionary alloc] initWithContentsOfFile:[[NSBundle mainBundle] pathForResource:@"Extras" ofType:@"plist"]];
+    if (!_extrasDescriptor)
+      @throw [NSException exceptionWithName:@"RXMissingResourceException" reason:@"Failed to load Extras.plist." userInfo:nil];
+  }];
 
   /*  Notes on Extras.MHK
    *
@@ -200,53 +225,114 @@ NSObject<RXWorldProtocol>* g_world = nil;
    */
 
   // load Stacks.plist
-  _stackDescriptors = [[NSDictionary alloc] initWithContentsOfFile:[[NSBundle mainBundle] pathForResource:@"Stacks" ofType:@"plist"]];
-  if (!_stackDescriptors)
-    @throw [NSException exceptionWithName:@"RXMissingResourceException" reason:@"Failed to load Stacks.plist." userInfo:nil];
+  [startup_tasks addTask:@"Stacks.plist" dependencies:nil block:^(void) {
+    _stackDescriptors = [[NSDictionary alloc] initWithContentsOfFile:[[NSBundle mainBundle] pathForResource:@"Stacks" ofType:@"plist"]];
+    if (!_stackDescriptors)
+      @throw [NSException exceptionWithName:@"RXMissingResourceException" reason:@"Failed to load Stacks.plist." userInfo:nil];
+  }];
 
   // load cursors metadata
-  NSDictionary* cursorMetadata = [NSDictionary dictionaryWithContentsOfFile:[[NSBundle mainBundle] pathForResource:@"Cursors" ofType:@"plist"]];
-  if (!cursorMetadata)
-    @throw [NSException exceptionWithName:@"RXMissingResourceException" reason:@"Failed to load Cursors.plist." userInfo:nil];
-
-  // load cursors
-  _cursors = NSCreateMapTable(NSIntegerMapKeyCallBacks, NSObjectMapValueCallBacks, 20);
-
-    [cursorMetadata enumerateKeysAndObjectsUsingBlock:^(NSString* cursorKey, NSString* cursorHotspotPointString, BOOL* stop)
-    {
-      NSPoint cursorHotspot = NSPointFromString(cursorHotspotPointString);
-      NSImage* cursorImage = [[NSImage alloc] initWithContentsOfFile:[[NSBundle mainBundle] pathForResource:cursorKey ofType:@"png" inDirectory:@"cursors"]];
-      if (!cursorImage)
+  __block NSDictionary* cursorMetadata = nil;
+  [startup_tasks addTask:@"Cursors.plist" dependencies:nil block:^(void) {
+    cursorMetadata = [[NSDictionary alloc] initWithContentsOfFile:[[NSBundle mainBundle] pathForResource:@"Cursors" ofType:@"plist"]];
+    if (!cursorMetadata)
+      @throw [NSException exceptionWithName:@"RXMissingResourceException" reason:@"Failed to load Cursors.plist." userInfo:nil];
+  }];
+
+  // decode the cursor images concurrently; the NSCursor objects are created on this thread once the images are ready
+  __block NSArray* cursorKeys = nil;
+  __block NSBitmapImageRep** cursorImages = NULL;
+  [startup_tasks addTask:@"cursor images" dependencies:[NSArray arrayWithObject:@"Cursors.plist"] block:^(void) {
+    cursorKeys = [[cursorMetadata allKeys] retain];
+    cursorImages = (NSBitmapImageRep**)calloc([cursorKeys count], sizeof(NSBitmapImageRep*));
+
+    dispatch_apply([cursorKeys count], dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t cursor_i) {
+      NSAutoreleasePool* p = [NSAutoreleasePool new];
+      NSString* path = [[NSBundle mainBundle] pathForResource:[cursorKeys objectAtIndex:cursor_i] ofType:@"png" inDirectory:@"cursors"];
+      NSBitmapImageRep* image = (path) ? [[NSBitmapImageRep alloc] initWithData:[NSData dataWithContentsOfFile:path]] : nil;
+
+      // asking for the pixels forces the PNG to be decoded now rather than when the cursor is first set
+      [image bitmapData];
+      cursorImages[cursor_i] = image;
+      [p release];
+    });
+
+    for (NSUInteger cursor_i = 0; cursor_i < [cursorKeys count]; cursor_i++) {
+      if (!cursorImages[cursor_i])
         @throw [NSException exceptionWithName:@"RXMissingResourceException"
-                                       reason:[NSString stringWithFormat:@"Unable to find cursor %@.", cursorKey]
+                                       reason:[NSString stringWithFormat:@"Unable to find cursor %@.", [cursorKeys objectAtIndex:cursor_i]]
                                      userInfo:nil];
+    }
+  }];
 
-      NSCursor* cursor = [[NSCursor alloc] initWithImage:cursorImage hotSpot:cursorHotspot];
-      uintptr_t key = [cursorKey intValue];
-      NSMapInsert(_cursors, (const void*)key, (const void*)cursor);
+  // open the Extras archive, which the card renderer needs for the inventory; a missing archive is reported when it is first needed
+  [startup_tasks addTask:@"Extras archive" dependencies:nil block:^(void) { [[RXArchiveManager sharedArchiveManager] extrasArchive:NULL]; }];
 
-      [cursor release];
-      [cursorImage release];
-    }];
+  [startup_tasks start];
 
-    // the semaphore will be signaled when a thread has setup inter-thread messaging
-    kern_return_t kerr = semaphore_create(mach_task_self(), &_threadInitSemaphore, SYNC_POLICY_FIFO, 0);
+  // the semaphore will be signaled when a thread has setup inter-thread messaging; a failure is only raised once the background tasks
+  // are done, since they write to this method's locals
+  __block kern_return_t kerr;
+  [startup_tasks performTask:@"script thread" block:^(void) {
+    kerr = semaphore_create(mach_task_self(), &_threadInitSemaphore, SYNC_POLICY_FIFO, 0);
     if (kerr != 0)
-      @throw [NSException exceptionWithName:NSMachErrorDomain reason:@"Could not allocate stack thread init semaphore." userInfo:nil];
+      return;
 
     // start threads
     [NSThread detachNewThreadSelector:@selector(_RXScriptThreadEntry:) toTarget:self withObject:nil];
 
     // wait for each thread to be running (this needs to be called the same number of times as the number of threads)
     semaphore_wait(_threadInitSemaphore);
+  }];
+
+  @try {
+    [startup_tasks wait];
+    if (kerr != 0)
+      @throw [NSException exceptionWithName:NSMachErrorDomain reason:@"Could not allocate stack thread init semaphore." userInfo:nil];
+
+    // load cursors
+    _cursors = NSCreateMapTable(NSIntegerMapKeyCallBacks, NSObjectMapValueCallBacks, 20);
 
-    // register for card changed notifications
-    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_activeCardDidChange:) name:@"RXActiveCardDidChange" object:nil];
+    [startup_tasks performTask:@"cursors" block:^(void) {
+      for (NSUInteger cursor_i = 0; cursor_i < [cursorKeys count]; cursor_i++) {
+        NSString* cursorKey = [cursorKeys objectAtIndex:cursor_i];
+        NSPoint cursorHotspot = NSPointFromString([cursorMetadata objectForKey:cursorKey]);
+
+        NSImage* cursorImage = [[NSImage alloc] initWithSize:[cursorImages[cursor_i] size]];
+        [cursorImage addRepresentation:cursorImages[cursor_i]];
+
+        NSCursor* cursor = [[NSCursor alloc] initWithImage:cursorImage hotSpot:cursorHotspot];
+        uintptr_t key = [cursorKey intValue];
+        NSMapInsert(_cursors, (const void*)key, (const void*)cursor);
+
+        [cursor release];
+        [cursorImage release];
+      }
+    }];
+
+    [startup_tasks logTimings];
+  }
+  @catch (NSException* e) {
+    // the world failed to initialize, so the global must not keep pointing at it
+    if (g_world == self)
+      g_world = nil;
+    @throw;
+  }
+  @finally {
+    if (cursorImages) {
+      for (NSUInteger cursor_i = 0; cursor_i < [cursorKeys count]; cursor_i++)
+        [cursorImages[cursor_i] release];
+      free(cursorImages);
+    }
+    [cursorKeys release];
+    [cursorMetadata release];
+    [startup_tasks release];
+  }
 
-    // set the global to ourselves
-    g_world = self;
+  // register for card changed notifications
+  [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_activeCardDidChange:) name:@"RXActiveCardDidChange" object:nil];
 
-    return self;
+  return self;
 }
 
 - (void)initializeRendering
@@ -290,6 +376,18 @@ NSObject<RXWorldProtocol>* g_world = nil;
 
   semaphore_destroy(mach_task_self(), _threadInitSemaphore);
 
+  // let the stack preloads finish; the ones that have not started yet see _tornDown and return
+  if (_stackPreloadQueue) {
+    dispatch_sync(_stackPreloadQueue, ^(void) {});
+    dispatch_release(_stackPreloadQueue), _stackPreloadQueue = NULL;
+  }
+  if (_idleStackPreloadQueue) {
+    dispatch_sync(_idleStackPreloadQueue, ^(void) {});
+    dispatch_release(_idleStackPreloadQueue), _idleStackPreloadQueue = NULL;
+  }
+  if (_stackPreloadGroup)
+    dispatch_release(_stackPreloadGroup), _stackPreloadGroup = NULL;
+
   if (_cursors)
     NSFreeMapTable(_cursors);
   _cursors = nil;
@@ -301,6 +399,8 @@ NSObject<RXWorldProtocol>* g_world = nil;
   [_worldSupportBase release], _worldSupportBase = nil;
   [_engineVariables release], _engineVariables = nil;
   [_activeStacks release], _activeStacks = nil;
+  [_stacksBeingLoaded release], _stacksBeingLoaded = nil;
+  [_stacksScheduledForPreload release], _stacksScheduledForPreload = nil;
   [_cachePreferences release], _cachePreferences = nil;
 }
 
@@ -319,6 +419,8 @@ NSObject<RXWorldProtocol>* g_world = nil;
 
 - (NSThread*)scriptThread { return _scriptThread; }
 
+- (uint64_t)startupTimestamp { return _startupTimestamp; }
+
 #pragma mark -
 
 - (NSURL*)worldBase { return _worldBase; }
@@ -440,7 +542,13 @@ NSObject<RXWorldProtocol>* g_world = nil;
 
 - (NSDictionary*)stackDescriptorForKey:(NSString*)stackKey { return [_stackDescriptors objectForKey:stackKey]; }
 
-- (RXStack*)activeStackWithKey:(NSString*)stackKey { return [_activeStacks objectForKey:stackKey]; }
+- (RXStack*)activeStackWithKey:(NSString*)stackKey
+{
+  pthread_mutex_lock(&_stackLoadMutex);
+  RXStack* stack = [[_activeStacks objectForKey:stackKey] retain];
+  pthread_mutex_unlock(&_stackLoadMutex);
+  return [stack autorelease];
+}
 
 - (void)_postStackLoadedNotification:(NSString*)stackKey
 {
@@ -453,15 +561,131 @@ NSObject<RXWorldProtocol>* g_world = nil;
   [[NSNotificationCenter defaultCenter] postNotificationName:@"RXStackDidLoadNotification" object:stackKey userInfo:nil];
 }
 
-- (RXStack*)loadStackWithKey:(NSString*)stackKey
+- (RXStack*)_loadStackWithKey:(NSString*)stackKey error:(NSError**)error
 {
-  RXStack* stack = [self activeStackWithKey:stackKey];
-  if (stack)
-    return stack;
+  // a stack is only ever loaded by one thread; the others wait for it, and use the stack it loaded or try again if it failed
+  pthread_mutex_lock(&_stackLoadMutex);
+  while ([_stacksBeingLoaded containsObject:stackKey])
+    pthread_cond_wait(&_stackLoadCondition, &_stackLoadMutex);
+
+  RXStack* stack = [[_activeStacks objectForKey:stackKey] retain];
+  if (stack) {
+    pthread_mutex_unlock(&_stackLoadMutex);
+    return [stack autorelease];
+  }
+
+  [_stacksBeingLoaded addObject:stackKey];
+  pthread_mutex_unlock(&_stackLoadMutex);
 
   // initialize the stack
-  NSError* error;
-  stack = [[RXStack alloc] initWithKey:stackKey error:&error];
+  uint64_t start = RXTimingNow();
+  @try {
+    stack = [[RXStack alloc] initWithKey:stackKey error:error];
+  }
+  @finally {
+    // store the new stack in the active stacks dictionary
+    pthread_mutex_lock(&_stackLoadMutex);
+    if (stack)
+      [_activeStacks setObject:stack forKey:stackKey];
+    [_stacksBeingLoaded removeObject:stackKey];
+    pthread_cond_broadcast(&_stackLoadCondition);
+    pthread_mutex_unlock(&_stackLoadMutex);
+  }
+
+  if (stack) {
+    RXOLog2(kRXLoggingEngine, kRXLoggingLevelDebug, @"loaded stack %@ in %.2f ms", stackKey, RXTimingTimestampDelta(RXTimingNow(), start) * 1000.0);
+
+    // post the stack loaded notification on the main thread
+    [self _postStackLoadedNotification:stackKey];
+  }
+
+  return [stack autorelease];
+}
+
+- (void)_preloadStackWithKey:(NSString*)stackKey queue:(dispatch_queue_t)queue
+{
+  // WARNING: MUST BE CALLED WITH THE STACK LOAD MUTEX HELD
+  if (![_stackDescriptors objectForKey:stackKey] || [_activeStacks objectForKey:stackKey] || [_stacksBeingLoaded containsObject:stackKey] ||
+      [_stacksScheduledForPreload containsObject:stackKey])
+    return;
+  [_stacksScheduledForPreload addObject:stackKey];
+
+  void (^preload)(void) = ^(void) {
+    if (_tornDown)
+      return;
+
+    NSAutoreleasePool* p = [NSAutoreleasePool new];
+
+    // a stack is only useful ahead of time if its first card does not have to open its archives either
+    uint64_t start = RXTimingNow();
+    NSError* error = nil;
+    RXStack* stack = [self _loadStackWithKey:stackKey error:&error];
+    if (stack) {
+      [stack prefetchResources];
+      RXOLog2(kRXLoggingEngine, kRXLoggingLevelDebug, @"preloaded stack %@ in %.2f ms", stackKey, RXTimingTimestampDelta(RXTimingNow(), start) * 1000.0);
+    } else {
+      RXOLog2(kRXLoggingEngine, kRXLoggingLevelError, @"failed to preload stack %@: %@", stackKey, error);
+    }
+
+    [p release];
+  };
+
+  if (queue == _idleStackPreloadQueue) {
+    // an idle preload lets the stacks linked from wherever the player went in the meantime go first
+    dispatch_async(queue, ^(void) {
+      if (_tornDown)
+        return;
+      dispatch_group_wait(_stackPreloadGroup, DISPATCH_TIME_FOREVER);
+      preload();
+    });
+  } else
+    dispatch_group_async(_stackPreloadGroup, queue, preload);
+}
+
+- (void)_scheduleIdleStackPreload
+{
+  // every other stack is preloaded once the linked preloads have drained and are still drained a few seconds later, so that the pass
+  // does not compete with the stacks around a player who is moving between them
+  dispatch_group_notify(_stackPreloadGroup, _idleStackPreloadQueue, ^(void) {
+    if (_tornDown)
+      return;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC), _idleStackPreloadQueue, ^(void) {
+      if (_tornDown)
+        return;
+      if (dispatch_group_wait(_stackPreloadGroup, DISPATCH_TIME_NOW) != 0) {
+        [self _scheduleIdleStackPreload];
+        return;
+      }
+
+      pthread_mutex_lock(&_stackLoadMutex);
+      for (NSString* stackKey in _stackDescriptors)
+        [self _preloadStackWithKey:stackKey queue:_idleStackPreloadQueue];
+      pthread_mutex_unlock(&_stackLoadMutex);
+    });
+  });
+}
+
+- (void)_preloadStacksLinkedFromStack:(RXStack*)stack
+{
+  pthread_mutex_lock(&_stackLoadMutex);
+
+  // the stacks this stack's scripts can go to come first
+  for (NSString* stackKey in [stack stackNames])
+    [self _preloadStackWithKey:stackKey queue:_stackPreloadQueue];
+
+  // every other stack is loaded when the engine is otherwise idle
+  if (!_idleStackPreloadScheduled) {
+    _idleStackPreloadScheduled = YES;
+    [self _scheduleIdleStackPreload];
+  }
+
+  pthread_mutex_unlock(&_stackLoadMutex);
+}
+
+- (RXStack*)loadStackWithKey:(NSString*)stackKey
+{
+  NSError* error = nil;
+  RXStack* stack = [self _loadStackWithKey:stackKey error:&error];
   if (!stack) {
     error = [RXError
         errorWithDomain:RXErrorDomain
@@ -476,14 +700,8 @@ NSObject<RXWorldProtocol>* g_world = nil;
     return nil;
   }
 
-  // store the new stack in the active stacks dictionary
-  [_activeStacks setObject:stack forKey:stackKey];
-
-  // give up ownership of the new stack
-  [stack release];
-
-  // post the stack loaded notification on the main thread
-  [self _postStackLoadedNotification:stackKey];
+  // warm up the stacks the player can go to next, so that going to one of them is as fast as going to another card
+  [self _preloadStacksLinkedFromStack:stack];
 
   // return the stack
   return stack;
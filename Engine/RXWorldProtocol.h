@@ -25,6 +25,9 @@
 @protocol RXWorldProtocol <NSObject>
 - (NSThread*)scriptThread;
 
+// RXTimingNow() timestamp of the start of the engine, for startup timing
+- (uint64_t)startupTimestamp;
+
 - (NSDictionary*)extraBitmapsDescriptor;
 
 - (void*)audioRenderer;
@@ -12,6 +12,8 @@
 #include <stdint.h>
 #include <vector>
 
+#include <libkern/OSAtomic.h>
+
 #include <CoreFoundation/CoreFoundation.h>
 
 #include <AudioUnit/AudioUnit.h>
@@ -19,15 +21,21 @@
 
 #include "Rendering/Audio/PublicUtility/CAAudioUnit.h"
 #include "Rendering/Audio/PublicUtility/CAGuard.h"
-#include "Rendering/Audio/PublicUtility/CAThreadSafeList.h"
 #include "Rendering/Audio/PublicUtility/CAXException.h"
 
+#include "Rendering/Audio/RXAudioStatistics.h"
+
+#include "Utilities/spsc_queue.h"
+
 namespace RX {
 
 class AudioSourceBase;
 
 class AudioRenderer {
 public:
+  // the bus of virtual sources
+  static const AudioUnitElement kVirtualBus = 0xFFFFFFFFu;
+
   AudioRenderer() noexcept(false);
   ~AudioRenderer() noexcept(false);
 
@@ -53,8 +61,10 @@ public:
   void SetAutomaticGraphUpdates(bool b) noexcept;
 
   inline uint32_t AvailableMixerBusCount() const noexcept { return sourceLimit - sourceCount; }
+  inline uint32_t VirtualSourceCount() const noexcept { return static_cast<uint32_t>(virtualSourceVector->size()); }
 
-  // source management
+  // source management; once every mixer bus is taken, attached sources become virtual: they are not mixed but keep advancing, and
+  // take a bus over when one is freed or when a newly attached source outranks the source on it (see AudioSourceBase::Priority)
   bool AttachSource(AudioSourceBase& source) noexcept(false);
   void DetachSource(AudioSourceBase& source) noexcept(false);
 
@@ -78,6 +88,12 @@ public:
   void RampSourcesGain(CFArrayRef sources, std::vector<Float32> values, std::vector<Float64> durations) noexcept(false);
   void RampSourcesPan(CFArrayRef sources, std::vector<Float32> values, std::vector<Float64> durations) noexcept(false);
 
+  bool IsSourceVirtual(const AudioSourceBase& source) const noexcept;
+
+  // telemetry
+  void GetStatistics(AudioRendererStatistics& statistics) const noexcept;
+  void LogStatistics() const noexcept;
+
 private:
   static OSStatus MixerRenderNotifyCallback(void* inRefCon, AudioUnitRenderActionFlags* ioActionFlags, const AudioTimeStamp* inTimeStamp, UInt32 inBusNumber,
                                             UInt32 inNumberFrames, AudioBufferList* ioData);
@@ -88,27 +104,76 @@ private:
   void RampMixerParameter(CFArrayRef sources, AudioUnitParameterID parameter_id, std::vector<Float32>& values,
                           std::vector<Float64>& durations) noexcept(false);
 
-  OSStatus MixerPreRenderNotify(const AudioTimeStamp* inTimeStamp, UInt32 inBusNumber, AudioBufferList* ioData) noexcept;
-  OSStatus MixerPostRenderNotify(const AudioTimeStamp* inTimeStamp, UInt32 inBusNumber, AudioBufferList* ioData) noexcept;
+  OSStatus MixerPreRenderNotify(const AudioTimeStamp* inTimeStamp, UInt32 inNumberFrames, AudioBufferList* ioData) noexcept;
+  OSStatus MixerPostRenderNotify(const AudioTimeStamp* inTimeStamp, UInt32 inNumberFrames, AudioBufferList* ioData) noexcept;
 
   void CreateGraph();
   void TeardownGraph();
   bool _must_update_graph_predicate() noexcept(false);
 
-  struct ParameterRampDescriptor {
+  // voice management
+  void ConnectSource(AudioSourceBase& source, AudioUnitElement bus, Float64 fadeInDuration) noexcept(false);
+  AUNode DisconnectSource(AudioSourceBase& source) noexcept(false);
+  void RecycleBus(AudioUnitElement bus, AUNode node) noexcept(false);
+  void StealBus(AudioSourceBase& victim) noexcept(false);
+  void AddVirtualSource(AudioSourceBase& source) noexcept(false);
+  void RemoveVirtualSource(AudioSourceBase& source) noexcept(false);
+  void PromoteVirtualSources() noexcept(false);
+  void WaitForRenderCycles(uint64_t count) noexcept;
+  static bool Outranks(const AudioSourceBase& source, const AudioSourceBase& other) noexcept;
+
+  // parameter ramp engine; ramps live in a fixed table indexed by bus and are only touched by the render thread,
+  // other threads talk to it through a single-producer single-consumer command ring
+  enum { kMaxMixerBusCount = 16, kMaxVirtualSourceCount = 64 };
+  enum { kRampParameterGain = 0, kRampParameterPan, kRampParameterCount, kVoiceCommandAddVirtual = 0xFD, kVoiceCommandRemoveVirtual = 0xFE, kRampCommandClear = 0xFF };
+
+  struct ParameterRamp {
     const AudioSourceBase* source;
-    AudioUnitParameterEvent event;
-    AudioTimeStamp start;
-    AudioTimeStamp previous;
-    uint64_t generation;
+    Float32 value;
+    Float32 start_value;
+    Float32 end_value;
+    UInt32 duration;
+    UInt32 elapsed;
+    bool active;
+    bool initialized; // value holds the bus parameter's value
+  };
 
-    bool operator==(const ParameterRampDescriptor& other) const
-    { return this->event.element == other.event.element && this->event.parameter == other.event.parameter && this->generation == other.generation; }
+  struct RampCommand {
+    const AudioSourceBase* source;
+    AudioUnitElement element;
+    UInt32 parameter;
+    Float32 value;
+    UInt32 duration;
   };
 
-  uint64_t pending_ramp_generation;
-  TThreadSafeList<ParameterRampDescriptor> pending_ramps;
-  TThreadSafeList<ParameterRampDescriptor> active_ramps;
+  void EnqueueRampCommand(const RampCommand& command) noexcept(false);
+  void DrainRampCommands() noexcept;
+  OSStatus ApplyRampCommand(const RampCommand& command) noexcept;
+  OSStatus AdvanceRamp(AudioUnitElement element, UInt32 parameter, UInt32 inNumberFrames) noexcept;
+
+  ParameterRamp ramp_table[kMaxMixerBusCount][kRampParameterCount];
+
+  // the virtual sources as seen by the render thread, maintained through the command ring
+  AudioSourceBase* virtual_table[kMaxVirtualSourceCount];
+  UInt32 virtual_table_count;
+
+  rx::spsc_queue<RampCommand, 512> ramp_commands;
+  CAMutex ramp_producer_mutex;
+
+  // held by whichever thread consumes the command ring and touches the ramp and virtual tables: the render thread for each slice, or a
+  // producer that found the ring full; the render thread only ever tries to take it, and skips the slice's ramp work if it is held
+  std::atomic<bool> ramp_consumer_busy;
+  bool ramp_scheduling;
+
+  // mixer render telemetry; only written by the render thread
+  uint64_t render_start;
+  Float64 render_sample_rate;
+  std::atomic<UInt32> render_slice_frames;
+  std::atomic<uint64_t> render_count;
+  std::atomic<uint64_t> deadline_miss_count;
+  std::atomic<uint64_t> voice_steal_count;
+  AudioHistogram render_duration_histogram;
+  AudioHistogram render_load_histogram;
 
   AUGraph graph;
   CAAudioUnit* output;
@@ -121,6 +186,8 @@ private:
 
   std::vector<AUNode>* busNodeVector;
   std::vector<bool>* busAllocationVector;
+  std::vector<AudioSourceBase*>* busSourceVector;
+  std::vector<AudioSourceBase*>* virtualSourceVector;
 };
 }
 
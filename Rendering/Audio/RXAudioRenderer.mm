@@ -7,6 +7,7 @@
 //
 
 #import <algorithm>
+#import <unistd.h>
 
 #import <libkern/OSAtomic.h>
 #import <CoreFoundation/CoreFoundation.h>
@@ -26,8 +27,17 @@
 #import "Rendering/Audio/PublicUtility/CAAUParameter.h"
 #import "Rendering/Audio/PublicUtility/CAStreamBasicDescription.h"
 
+
 namespace RX {
 
+static const AudioUnitParameterID g_rampParameterIDs[] = {kStereoMixerParam_Volume, kStereoMixerParam_Pan};
+
+// sources that take a bus over from being virtual fade in over this duration, so that they don't click in
+static const Float64 kVirtualSourceFadeInDuration = 0.05;
+
+// sources that lose their bus to a higher ranked source fade out over this duration before the bus is handed over, for the same reason
+static const Float64 kStolenSourceFadeOutDuration = 0.005;
+
 static OSStatus RXAudioRendererSilenceRenderCallback(void* inRefCon, AudioUnitRenderActionFlags* ioActionFlags, const AudioTimeStamp* inTimeStamp,
                                                      UInt32 inBusNumber, UInt32 inNumberFrames, AudioBufferList* ioData)
 {
@@ -58,8 +68,10 @@ OSStatus AudioRenderer::MixerRenderNotifyCallback(void* inRefCon, AudioUnitRende
                                                   UInt32 inBusNumber, UInt32 inNumberFrames, AudioBufferList* ioData)
 {
   RX::AudioRenderer* renderer = reinterpret_cast<RX::AudioRenderer*>(inRefCon);
-  if (*ioActionFlags & kAudioUnitRenderAction_PreRender)
+  if (*ioActionFlags & kAudioUnitRenderAction_PreRender) {
+    renderer->render_start = mach_absolute_time();
     return renderer->MixerPreRenderNotify(inTimeStamp, inNumberFrames, ioData);
+  }
   if (*ioActionFlags & kAudioUnitRenderAction_PostRender)
     return renderer->MixerPostRenderNotify(inTimeStamp, inNumberFrames, ioData);
   return noErr;
@@ -68,14 +80,18 @@ OSStatus AudioRenderer::MixerRenderNotifyCallback(void* inRefCon, AudioUnitRende
 #pragma mark -
 
 AudioRenderer::AudioRenderer() noexcept(false)
-    : graph(0), output(0), mixer(0), _automaticGraphUpdates(true), _graphUpdateNeeded(false), sourceLimit(0), sourceCount(0), busNodeVector(0),
-      busAllocationVector(0)
+    : virtual_table_count(0), ramp_producer_mutex("ramp producer mutex"), ramp_consumer_busy(false), ramp_scheduling(false), render_start(0),
+      render_sample_rate(0.0), render_slice_frames(0), render_count(0), deadline_miss_count(0), voice_steal_count(0), render_duration_histogram(0),
+      render_load_histogram(10), graph(0), output(0), mixer(0), _automaticGraphUpdates(true), _graphUpdateNeeded(false), sourceLimit(0), sourceCount(0),
+      busNodeVector(0), busAllocationVector(0), busSourceVector(0), virtualSourceVector(0)
 {
+  bzero(ramp_table, sizeof(ramp_table));
+  bzero(virtual_table, sizeof(virtual_table));
   CreateGraph();
   RXCFLog(kRXLoggingAudio, kRXLoggingLevelMessage, CFSTR("<RX::AudioRenderer: %p> initialized with %u mixer inputs"), this, (uint32_t)sourceLimit);
 }
 
-AudioRenderer::AudioRenderer(const AudioRenderer& c) {}
+AudioRenderer::AudioRenderer(const AudioRenderer& c) : ramp_producer_mutex("ramp producer mutex") {}
 
 AudioRenderer::~AudioRenderer() noexcept(false)
 {
@@ -184,33 +200,23 @@ UInt32 AudioRenderer::AttachSources(CFArrayRef sources) noexcept(false)
     XThrowIf(source->rendererPtr != 0 && source->rendererPtr != this, paramErr,
              "AudioRenderer::AttachSources (source->rendererPtr != 0 && source->rendererPtr != this)");
 
-    // if the mixer cannot accept more connections, bail
-    if (sourceCount >= sourceLimit) {
-      RXCFLog(kRXLoggingAudio, kRXLoggingLevelMessage, CFSTR("AudioRenderer::AttachSources: mixer has no available input busses left, dropping %ld sources"),
-              count - (sourceIndex + 1));
-      break;
-    }
-
-    // find the next available bus, bail if there are no more busses
-    auto busVectorEnd = std::end(*busAllocationVector);
-    auto busIterator = find(std::begin(*busAllocationVector), busVectorEnd, false);
-    if (busIterator == busVectorEnd && busAllocationVector->size() == sourceLimit) {
-      RXCFLog(kRXLoggingAudio, kRXLoggingLevelMessage, CFSTR("AudioRenderer::AttachSources: mixer has no available input busses left, dropping %ld sources"),
-              count - (sourceIndex + 1));
-      break;
-    }
-
     // if the source format is invalid or not mixable, bail for this source
     if (!CAStreamBasicDescription::IsMixable(source->Format())) {
       RXCFLog(kRXLoggingAudio, kRXLoggingLevelMessage, CFSTR("AudioRenderer::AttachSources: skipping source %p because its format is not mixable"), source);
       continue;
     }
 
-    // compute and set the source's bus index
-    source->bus = static_cast<AudioUnitElement>(busIterator - busAllocationVector->begin());
+    // if there is no room left for the source even as a virtual source, bail
+    if (sourceCount >= sourceLimit && virtualSourceVector->size() >= kMaxVirtualSourceCount) {
+      RXCFLog(kRXLoggingAudio, kRXLoggingLevelMessage, CFSTR("AudioRenderer::AttachSources: mixer has no available input busses left, dropping %ld sources"),
+              count - sourceIndex);
+      break;
+    }
 
-    // a non-NULL renderer means the source has been attached properly
+    // a non-NULL renderer means the source has been attached properly; the source is virtual until it gets a bus, so that the gain and pan it
+    // sets up in HandleAttach are known when it is ranked against the sources that have a bus
     source->rendererPtr = this;
+    source->bus = kVirtualBus;
 
     // set nominal gain and pan parameters
     SetSourceGain(*source, 1.0f);
@@ -219,73 +225,28 @@ UInt32 AudioRenderer::AttachSources(CFArrayRef sources) noexcept(false)
     // let the source know it's being attached
     source->HandleAttach();
 
-    // try to set the format of the source as the mixer's input bus format; this will more often than not fail
-    CAStreamBasicDescription source_format = source->Format();
-    OSStatus oserr =
-        (source_format.NumberChannels() == 1) ? kAudioUnitErr_FormatNotSupported : mixer->SetFormat(kAudioUnitScope_Input, source->bus, source->Format());
-    if (oserr == kAudioUnitErr_FormatNotSupported) {
-// we need to create a converter AU and connect it to the mixer, plugging the source as the converter's render callback
+    // if every bus is taken, take over the bus of the lowest ranked source if the new source outranks it, or make the new source virtual
+    if (sourceCount >= sourceLimit) {
+      AudioSourceBase* victim = NULL;
+      for (AudioSourceBase* bus_source : *busSourceVector) {
+        if (bus_source && (!victim || Outranks(*victim, *bus_source)))
+          victim = bus_source;
+      }
 
+      if (victim && Outranks(*source, *victim)) {
+        StealBus(*victim);
+      } else {
+        AddVirtualSource(*source);
 #if defined(DEBUG_AUDIO) && DEBUG_AUDIO > 1
-      RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("<RX::AudioRenderer: 0x%x> creating ancillary converter for source %p on bus %u"), this, source,
-              source->bus);
+        RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("<RX::AudioRenderer: 0x%x> attached source %p as a virtual source"), this, source);
 #endif
-
-      // create a new graph node with the converter AU
-      AudioComponentDescription acd;
-      acd.componentType = kAudioUnitType_FormatConverter;
-      acd.componentSubType = kAudioUnitSubType_AUConverter;
-      acd.componentManufacturer = kAudioUnitManufacturer_Apple;
-      acd.componentFlags = 0;
-      acd.componentFlagsMask = 0;
-
-      // convert to a CAAudioUnit object
-      AUNode converter_node;
-      AudioUnit converter_au;
-      XThrowIfError(AUGraphAddNode(graph, &acd, &converter_node), "AUGraphAddNode kAudioUnitSubType_AUConverter");
-      XThrowIfError(AUGraphNodeInfo(graph, converter_node, NULL, &converter_au), "AUGraphNodeInfo");
-      // XThrowIfError(AUGraphNewNode(graph, &acd, 0, NULL, &converter_node), "AUGraphNewNode kAudioUnitSubType_AUConverter");
-      // XThrowIfError(AUGraphGetNodeInfo(graph, converter_node, NULL, NULL, NULL, &converter_au), "AUGraphGetNodeInfo");
-      CAAudioUnit converter = CAAudioUnit(converter_node, converter_au);
-
-      // set the input and output formats of the converter
-      XThrowIfError(converter.SetFormat(kAudioUnitScope_Input, 0, source_format), "converter->SetFormat kAudioUnitScope_Input");
-      CAStreamBasicDescription mixer_format;
-      XThrowIfError(mixer->GetFormat(kAudioUnitScope_Input, source->bus, mixer_format), "mixer->GetFormat kAudioUnitScope_Input");
-      XThrowIfError(converter.SetFormat(kAudioUnitScope_Output, 0, mixer_format), "converter->SetFormat kAudioUnitScope_Output");
-
-      // set the channel map of the converter if the source format is mono (we need to replicate the mono channel)
-      debug_assert(mixer_format.NumberChannels() == 2);
-      if (source_format.NumberChannels() == 1) {
-        SInt32 channel_map[2] = {0, 0};
-        XThrowIfError(converter.SetProperty(kAudioOutputUnitProperty_ChannelMap, kAudioUnitScope_Global, 0, channel_map, sizeof(SInt32) * 2),
-                      "converter.SetProperty kAudioOutputUnitProperty_ChannelMap");
+        continue;
       }
-
-      // set the render callback on the converter
-      AURenderCallbackStruct render_callbacks = {AudioSourceBase::AudioSourceRenderCallback, source};
-      XThrowIfError(converter.SetProperty(kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, 0, &render_callbacks, sizeof(AURenderCallbackStruct)),
-                    "converter->SetProperty kAudioUnitProperty_SetRenderCallback");
-
-      // and finally plug the converter in
-      XThrowIfError(AUGraphConnectNodeInput(graph, converter_node, 0, *mixer, source->bus), "AUGraphConnectNodeInput");
-      (*busNodeVector)[source->bus] = converter_node;
-    } else {
-      XThrowIfError(oserr, "mixer->SetFormat");
-
-      // set the source's render function as the mixer's render callback
-      AURenderCallbackStruct render_callbacks = {AudioSourceBase::AudioSourceRenderCallback, source};
-      XThrowIfError(
-          mixer->SetProperty(kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, source->bus, &render_callbacks, sizeof(AURenderCallbackStruct)),
-          "mixer->SetProperty kAudioUnitProperty_SetRenderCallback");
-
-      // make sure the node for this bus is 0
-      (*busNodeVector)[source->bus] = static_cast<AUNode>(0);
     }
 
-    // account for the new connection
-    sourceCount++;
-    (*busAllocationVector)[source->bus] = true;
+    auto busIterator = find(std::begin(*busAllocationVector), std::end(*busAllocationVector), false);
+    release_assert(busIterator != std::end(*busAllocationVector));
+    ConnectSource(*source, static_cast<AudioUnitElement>(busIterator - busAllocationVector->begin()), 0.0);
 
 #if defined(DEBUG_AUDIO) && DEBUG_AUDIO > 1
     RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("<RX::AudioRenderer: 0x%x> attached source %p to bus %u"), this, source, source->bus);
@@ -306,7 +267,10 @@ void AudioRenderer::DetachSources(CFArrayRef sources) noexcept(false)
   UInt32 sourceIndex = 0;
 
   AudioUnitElement* busToRecycle = new AudioUnitElement[count];
-  XThrowIf(busToRecycle == 0, mFulErr, "AudioRenderer::DetachSources");
+  AUNode* nodeToRemove = new AUNode[count];
+  XThrowIf(busToRecycle == 0 || nodeToRemove == 0, mFulErr, "AudioRenderer::DetachSources");
+  UInt32 recycleCount = 0;
+  bool removedVirtualSources = false;
 
   for (; sourceIndex < count; sourceIndex++) {
     AudioSourceBase* source = const_cast<AudioSourceBase*>(reinterpret_cast<const AudioSourceBase*>(CFArrayGetValueAtIndex(sources, sourceIndex)));
@@ -316,27 +280,16 @@ void AudioRenderer::DetachSources(CFArrayRef sources) noexcept(false)
     RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("<RX::AudioRenderer: 0x%x> detaching source %p from bus %u"), this, source, source->bus);
 #endif
 
-    // if this source has no node, then it was connected directly to the mixer and we so we need to reset the mixer's render callback to the silence callback
-    if ((*busNodeVector)[source->bus]) {
-      // we have to disconnect the converter node at this time
-      XThrowIfError(AUGraphDisconnectNodeInput(graph, *mixer, source->bus), "AUGraphDisconnectNodeInput");
+    if (source->bus == kVirtualBus) {
+      RemoveVirtualSource(*source);
+      removedVirtualSources = true;
+    } else {
+      // retain the source's bus and node for the code that comes after the required graph update below
+      busToRecycle[recycleCount] = source->bus;
+      nodeToRemove[recycleCount] = DisconnectSource(*source);
+      recycleCount++;
     }
 
-    // set the silence render callback on the mixer bus
-    AURenderCallbackStruct silence_render = {RXAudioRendererSilenceRenderCallback, 0};
-    XThrowIfError(mixer->SetProperty(kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, source->bus, &silence_render, sizeof(AURenderCallbackStruct)),
-                  "mixer->SetProperty kAudioUnitProperty_SetRenderCallback");
-
-    // invalidate any ongoing ramps for this source; a parameter of UINTMAX is a special value which will match all parameters
-    ParameterRampDescriptor descriptor;
-    descriptor.generation = pending_ramp_generation++;
-    descriptor.event.element = source->bus;
-    descriptor.event.parameter = UINT32_MAX;
-    pending_ramps.deferred_add(descriptor);
-
-    // retain the source's bus before we zero it in the source for the code that comes after the required graph update below
-    busToRecycle[sourceIndex] = source->bus;
-
     // invalidate the source's bus and renderer
     source->bus = 0;
     source->rendererPtr = 0;
@@ -349,23 +302,243 @@ void AudioRenderer::DetachSources(CFArrayRef sources) noexcept(false)
   if (_must_update_graph_predicate())
     XThrowIfError(AUGraphUpdate(graph, NULL), "AUGraphUpdate");
 
-  for (sourceIndex = 0; sourceIndex < count; sourceIndex++) {
-    // if the source had a converter node, we can now remove it from the graph
-    if ((*busNodeVector)[busToRecycle[sourceIndex]]) {
-      XThrowIfError(AUGraphRemoveNode(graph, (*busNodeVector)[busToRecycle[sourceIndex]]), "AUGraphRemoveNode");
-      (*busNodeVector)[busToRecycle[sourceIndex]] = static_cast<AUNode>(0);
+  for (UInt32 recycleIndex = 0; recycleIndex < recycleCount; recycleIndex++)
+    RecycleBus(busToRecycle[recycleIndex], nodeToRemove[recycleIndex]);
+
+  delete[] nodeToRemove;
+  delete[] busToRecycle;
+
+  // the render thread may be advancing virtual sources that were just detached until it picks up their removal; the caller is free to
+  // delete detached sources, so wait for the render thread to have done so
+  if (removedVirtualSources)
+    WaitForRenderCycles(2);
+
+  // hand the freed busses to the highest ranked virtual sources
+  PromoteVirtualSources();
+}
+
+bool AudioRenderer::IsSourceVirtual(const AudioSourceBase& source) const noexcept { return source.rendererPtr == this && source.bus == kVirtualBus; }
+
+#pragma mark -
+
+bool AudioRenderer::Outranks(const AudioSourceBase& source, const AudioSourceBase& other) noexcept
+{
+  if (source.priority != other.priority)
+    return source.priority > other.priority;
+  return source.target_gain > other.target_gain;
+}
+
+void AudioRenderer::ConnectSource(AudioSourceBase& source, AudioUnitElement bus, Float64 fadeInDuration) noexcept(false)
+{
+  source.bus = bus;
+
+  // apply the source's gain and pan to the bus, fading the gain in if requested
+  RampCommand command = {&source, bus, kRampParameterGain, 0.0f, 0};
+  if (fadeInDuration > 0.0) {
+    EnqueueRampCommand(command);
+    command.duration = static_cast<UInt32>(ceil(render_sample_rate * fadeInDuration));
+  }
+  command.value = cbrt(source.target_gain);
+  EnqueueRampCommand(command);
+
+  command.parameter = kRampParameterPan;
+  command.value = source.target_pan;
+  command.duration = 0;
+  EnqueueRampCommand(command);
+
+  // try to set the format of the source as the mixer's input bus format; this will more often than not fail
+  CAStreamBasicDescription source_format = source.Format();
+  OSStatus oserr = (source_format.NumberChannels() == 1) ? kAudioUnitErr_FormatNotSupported : mixer->SetFormat(kAudioUnitScope_Input, bus, source_format);
+  if (oserr == kAudioUnitErr_FormatNotSupported) {
+// we need to create a converter AU and connect it to the mixer, plugging the source as the converter's render callback
+
+#if defined(DEBUG_AUDIO) && DEBUG_AUDIO > 1
+    RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("<RX::AudioRenderer: 0x%x> creating ancillary converter for source %p on bus %u"), this, &source, bus);
+#endif
+
+    // create a new graph node with the converter AU
+    AudioComponentDescription acd;
+    acd.componentType = kAudioUnitType_FormatConverter;
+    acd.componentSubType = kAudioUnitSubType_AUConverter;
+    acd.componentManufacturer = kAudioUnitManufacturer_Apple;
+    acd.componentFlags = 0;
+    acd.componentFlagsMask = 0;
+
+    // convert to a CAAudioUnit object
+    AUNode converter_node;
+    AudioUnit converter_au;
+    XThrowIfError(AUGraphAddNode(graph, &acd, &converter_node), "AUGraphAddNode kAudioUnitSubType_AUConverter");
+    XThrowIfError(AUGraphNodeInfo(graph, converter_node, NULL, &converter_au), "AUGraphNodeInfo");
+    // XThrowIfError(AUGraphNewNode(graph, &acd, 0, NULL, &converter_node), "AUGraphNewNode kAudioUnitSubType_AUConverter");
+    // XThrowIfError(AUGraphGetNodeInfo(graph, converter_node, NULL, NULL, NULL, &converter_au), "AUGraphGetNodeInfo");
+    CAAudioUnit converter = CAAudioUnit(converter_node, converter_au);
+
+    // set the input and output formats of the converter
+    XThrowIfError(converter.SetFormat(kAudioUnitScope_Input, 0, source_format), "converter->SetFormat kAudioUnitScope_Input");
+    CAStreamBasicDescription mixer_format;
+    XThrowIfError(mixer->GetFormat(kAudioUnitScope_Input, bus, mixer_format), "mixer->GetFormat kAudioUnitScope_Input");
+    XThrowIfError(converter.SetFormat(kAudioUnitScope_Output, 0, mixer_format), "converter->SetFormat kAudioUnitScope_Output");
+
+    // set the channel map of the converter if the source format is mono (we need to replicate the mono channel)
+    debug_assert(mixer_format.NumberChannels() == 2);
+    if (source_format.NumberChannels() == 1) {
+      SInt32 channel_map[2] = {0, 0};
+      XThrowIfError(converter.SetProperty(kAudioOutputUnitProperty_ChannelMap, kAudioUnitScope_Global, 0, channel_map, sizeof(SInt32) * 2),
+                    "converter.SetProperty kAudioOutputUnitProperty_ChannelMap");
     }
 
-    // account for the lost connection
-    sourceCount--;
-    (*busAllocationVector)[busToRecycle[sourceIndex]] = false;
+    // set the render callback on the converter
+    AURenderCallbackStruct render_callbacks = {AudioSourceBase::AudioSourceRenderCallback, &source};
+    XThrowIfError(converter.SetProperty(kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, 0, &render_callbacks, sizeof(AURenderCallbackStruct)),
+                  "converter->SetProperty kAudioUnitProperty_SetRenderCallback");
+
+    // and finally plug the converter in
+    XThrowIfError(AUGraphConnectNodeInput(graph, converter_node, 0, *mixer, bus), "AUGraphConnectNodeInput");
+    (*busNodeVector)[bus] = converter_node;
+  } else {
+    XThrowIfError(oserr, "mixer->SetFormat");
+
+    // set the source's render function as the mixer's render callback
+    AURenderCallbackStruct render_callbacks = {AudioSourceBase::AudioSourceRenderCallback, &source};
+    XThrowIfError(mixer->SetProperty(kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, bus, &render_callbacks, sizeof(AURenderCallbackStruct)),
+                  "mixer->SetProperty kAudioUnitProperty_SetRenderCallback");
+
+    // make sure the node for this bus is 0
+    (*busNodeVector)[bus] = static_cast<AUNode>(0);
   }
 
-  delete[] busToRecycle;
+  // account for the new connection
+  sourceCount++;
+  (*busAllocationVector)[bus] = true;
+  (*busSourceVector)[bus] = &source;
+}
+
+AUNode AudioRenderer::DisconnectSource(AudioSourceBase& source) noexcept(false)
+{
+  AudioUnitElement bus = source.bus;
+
+  // if this source has no node, then it was connected directly to the mixer and we so we need to reset the mixer's render callback to the silence callback
+  if ((*busNodeVector)[bus]) {
+    // we have to disconnect the converter node at this time
+    XThrowIfError(AUGraphDisconnectNodeInput(graph, *mixer, bus), "AUGraphDisconnectNodeInput");
+  }
+
+  // set the silence render callback on the mixer bus
+  AURenderCallbackStruct silence_render = {RXAudioRendererSilenceRenderCallback, 0};
+  XThrowIfError(mixer->SetProperty(kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, bus, &silence_render, sizeof(AURenderCallbackStruct)),
+                "mixer->SetProperty kAudioUnitProperty_SetRenderCallback");
+
+  // invalidate any ongoing ramps for this source's bus
+  RampCommand command = {&source, bus, kRampCommandClear, 0.0f, 0};
+  EnqueueRampCommand(command);
+
+  (*busSourceVector)[bus] = NULL;
+  source.bus = kVirtualBus;
+  return (*busNodeVector)[bus];
+}
+
+void AudioRenderer::RecycleBus(AudioUnitElement bus, AUNode node) noexcept(false)
+{
+  // if the source had a converter node, we can now remove it from the graph
+  if (node) {
+    XThrowIfError(AUGraphRemoveNode(graph, node), "AUGraphRemoveNode");
+    (*busNodeVector)[bus] = static_cast<AUNode>(0);
+  }
+
+  // account for the lost connection
+  sourceCount--;
+  (*busAllocationVector)[bus] = false;
+}
+
+void AudioRenderer::StealBus(AudioSourceBase& victim) noexcept(false)
+{
+#if defined(DEBUG_AUDIO) && DEBUG_AUDIO > 1
+  RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("<RX::AudioRenderer: 0x%x> making source %p on bus %u virtual"), this, &victim, victim.bus);
+#endif
+
+  // fade the victim out first; the ramp may span several slices, and the slice underway when the command is queued does not pick it up,
+  // so wait for one more; WaitForRenderCycles returns at once if the graph is not running, in which case there is nothing to hear
+  RampCommand command = {&victim, victim.bus, kRampParameterGain, 0.0f, static_cast<UInt32>(ceil(render_sample_rate * kStolenSourceFadeOutDuration))};
+  EnqueueRampCommand(command);
+  UInt32 slice_frames = render_slice_frames.load(std::memory_order_relaxed);
+  WaitForRenderCycles(((slice_frames) ? (command.duration + slice_frames - 1) / slice_frames : 1) + 1);
+
+  AudioUnitElement bus = victim.bus;
+  AUNode node = DisconnectSource(victim);
+  if (_must_update_graph_predicate())
+    XThrowIfError(AUGraphUpdate(graph, NULL), "AUGraphUpdate");
+  RecycleBus(bus, node);
+
+  // the victim always fits, since it frees its bus
+  AddVirtualSource(victim);
+  voice_steal_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioRenderer::AddVirtualSource(AudioSourceBase& source) noexcept(false)
+{
+  source.bus = kVirtualBus;
+  virtualSourceVector->push_back(&source);
+
+  RampCommand command = {&source, 0, kVoiceCommandAddVirtual, 0.0f, 0};
+  EnqueueRampCommand(command);
+}
+
+void AudioRenderer::RemoveVirtualSource(AudioSourceBase& source) noexcept(false)
+{
+  auto iterator = std::find(std::begin(*virtualSourceVector), std::end(*virtualSourceVector), &source);
+  if (iterator == std::end(*virtualSourceVector))
+    return;
+  virtualSourceVector->erase(iterator);
+
+  RampCommand command = {&source, 0, kVoiceCommandRemoveVirtual, 0.0f, 0};
+  EnqueueRampCommand(command);
+}
+
+void AudioRenderer::PromoteVirtualSources() noexcept(false)
+{
+  bool promoted = false;
+  while (sourceCount < sourceLimit && !virtualSourceVector->empty()) {
+    auto best = std::begin(*virtualSourceVector);
+    for (auto iterator = best + 1; iterator != std::end(*virtualSourceVector); ++iterator) {
+      if (Outranks(**iterator, **best))
+        best = iterator;
+    }
+    AudioSourceBase* source = *best;
+    RemoveVirtualSource(*source);
+
+    auto busIterator = find(std::begin(*busAllocationVector), std::end(*busAllocationVector), false);
+    release_assert(busIterator != std::end(*busAllocationVector));
+    ConnectSource(*source, static_cast<AudioUnitElement>(busIterator - busAllocationVector->begin()), kVirtualSourceFadeInDuration);
+    promoted = true;
+
+#if defined(DEBUG_AUDIO) && DEBUG_AUDIO > 1
+    RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("<RX::AudioRenderer: 0x%x> promoted virtual source %p to bus %u"), this, source, source->bus);
+#endif
+  }
+
+  if (promoted && _must_update_graph_predicate())
+    XThrowIfError(AUGraphUpdate(graph, NULL), "AUGraphUpdate");
+}
+
+void AudioRenderer::WaitForRenderCycles(uint64_t count) noexcept
+{
+  // nothing renders while the graph is stopped; otherwise a render cycle is a few milliseconds, so give up after a generous delay in case
+  // the output device stalls
+  uint64_t target = render_count.load(std::memory_order_acquire) + count;
+  for (int attempt = 0; attempt < 200 && render_count.load(std::memory_order_acquire) < target; attempt++) {
+    Boolean running = false;
+    if (AUGraphIsRunning(graph, &running) != noErr || !running)
+      return;
+    usleep(1000);
+  }
 }
 
 Float32 AudioRenderer::SourceGain(AudioSourceBase& source) const noexcept(false)
 {
+  // virtual sources have no mixer bus, only the gain they will get when they get one
+  if (source.bus == kVirtualBus)
+    return source.target_gain;
+
   Float32 value;
   XThrowIfError(mixer->GetParameter(kStereoMixerParam_Volume, kAudioUnitScope_Input, source.bus, value), "mixer->GetParameter kStereoMixerParam_Volume");
   return powf(value, 3.0f);
@@ -373,6 +546,9 @@ Float32 AudioRenderer::SourceGain(AudioSourceBase& source) const noexcept(false)
 
 Float32 AudioRenderer::SourcePan(AudioSourceBase& source) const noexcept(false)
 {
+  if (source.bus == kVirtualBus)
+    return source.target_pan;
+
   // get the raw value
   Float32 value;
   XThrowIfError(mixer->GetParameter(kStereoMixerParam_Pan, kAudioUnitScope_Input, source.bus, value), "mixer->GetParameter kStereoMixerParam_Pan");
@@ -438,6 +614,13 @@ void AudioRenderer::RampMixerParameter(CFArrayRef sources, AudioUnitParameterID
   ramps_are_enabled = static_cast<bool>(RXEngineGetBool(@"rendering.audio_ramps"));
 #endif
 
+  UInt32 ramp_parameter = (parameter_id == kStereoMixerParam_Volume) ? kRampParameterGain : kRampParameterPan;
+  XThrowIf(g_rampParameterIDs[ramp_parameter] != parameter_id, paramErr, "AudioRenderer::RampMixerParameter (unsupported parameter)");
+
+  // we need to use the mixer output element's sampling rate to compute the duration (since the pre-render callback is on that unit)
+  Float64 sr;
+  mixer->GetSampleRate(kAudioUnitScope_Output, 0, sr);
+
   UInt32 count = CFArrayGetCount(sources);
   UInt32 sourceIndex = 0;
 
@@ -449,192 +632,271 @@ void AudioRenderer::RampMixerParameter(CFArrayRef sources, AudioUnitParameterID
     XThrowIf(source->rendererPtr != this, paramErr, "AudioRenderer::RampMixerParameter (source->rendererPtr != this)");
     XThrowIf(duration < 0.0, paramErr, "AudioRenderer::RampMixerParameter (duration < 0.0)");
 
-    // get the parameter information structure
-    CAAUParameter parameter = CAAUParameter(*mixer, parameter_id, kAudioUnitScope_Input, source->bus);
+    // get the parameter information structure; every input bus has the same, so use the first one for virtual sources
+    bool is_virtual = source->bus == kVirtualBus;
+    CAAUParameter parameter = CAAUParameter(*mixer, parameter_id, kAudioUnitScope_Input, is_virtual ? 0 : source->bus);
     AudioUnitParameterInfo parameter_info = parameter.ParamInfo();
 
     // clamp the value to the valid range for the parameter
     value = std::max(std::min(value, parameter_info.maxValue), parameter_info.minValue);
 
-    // prepare a new ramp descriptor
-    ParameterRampDescriptor descriptor;
-    descriptor.generation = pending_ramp_generation++;
-    descriptor.source = source;
-
-    // an invalid start timestamp indicates it's a new ramp
-    descriptor.start.mFlags = 0;
-    descriptor.previous.mFlags = 0;
-
-    // setup the parameter event structure
-    descriptor.event.scope = kAudioUnitScope_Input;
-    descriptor.event.element = source->bus;
-    descriptor.event.parameter = parameter_id;
-    descriptor.event.eventType = (fabs(duration) < 1.0e-3 || !ramps_are_enabled) ? kParameterEvent_Immediate : kParameterEvent_Ramped;
+    // remember the final value, which ranks the source against others and is applied to the bus the source gets if it is virtual
+    if (parameter_id == kStereoMixerParam_Volume)
+      source->target_gain = value;
+    else
+      source->target_pan = value;
+    if (is_virtual)
+      continue;
 
     // we need to take the cube root of the value if the parameter is volume
     if (parameter_id == kStereoMixerParam_Volume)
       value = cbrt(value);
 
-    if (descriptor.event.eventType == kParameterEvent_Ramped) {
-      // we need to use the mixer output element's sampling rate to compute the duration (since the pre-render callback is on that unit)
-      Float64 sr;
-      mixer->GetSampleRate(kAudioUnitScope_Output, 0, sr);
-
-      // set up the ramp parameters
-      descriptor.event.eventValues.ramp.durationInFrames = static_cast<UInt32>(ceil(sr * duration));
-      descriptor.event.eventValues.ramp.startBufferOffset = 0;
-      descriptor.event.eventValues.ramp.endValue = value;
-    } else {
-      // set up the immediate parameters
-      descriptor.event.eventValues.immediate.bufferOffset = 0;
-      descriptor.event.eventValues.immediate.value = value;
-    }
+    // a duration of 0 frames indicates an immediate change
+    RampCommand command;
+    command.source = source;
+    command.element = source->bus;
+    command.parameter = ramp_parameter;
+    command.value = value;
+    command.duration = (fabs(duration) < 1.0e-3 || !ramps_are_enabled) ? 0 : static_cast<UInt32>(ceil(sr * duration));
 
-    // add the descriptor to the pending list
-    pending_ramps.deferred_add(descriptor);
+    EnqueueRampCommand(command);
   }
 }
 
-OSStatus AudioRenderer::MixerPreRenderNotify(const AudioTimeStamp* inTimeStamp, UInt32 inBusNumber, AudioBufferList* ioData) noexcept
+void AudioRenderer::EnqueueRampCommand(const RampCommand& command) noexcept(false)
 {
-  OSStatus err = noErr;
-
-  // first, update the list of pending ramp descriptors
-  pending_ramps.update();
-
-  // now iterate over the pending descriptors and remove/add into the list of active descriptors
-  for (ParameterRampDescriptor& descriptor : pending_ramps) {
-    // enqueue a remove from the pending list
-    pending_ramps.deferred_remove(descriptor);
-
-    // set the descriptor's generation to 0 (there cannot be more than one descriptor for each element-parameter pair)
-    descriptor.generation = 0;
+  // the command ring has a single producer, so serialize the threads which can schedule ramps; they block on a mutex rather than spin,
+  // since the producer may sleep below
+  CAMutex::Locker lock(ramp_producer_mutex);
+
+  // the ring is drained by the mixer's pre-render notification; if it is full, give the render thread a chance to catch up
+  while (!ramp_commands.push(command)) {
+    if (IsRunning()) {
+      usleep(1000);
+      continue;
+    }
 
-    // if the descriptor has the parameter set to UINT32_MAX, it means to remove all ramps for the descriptor's element
-    if (descriptor.event.parameter == UINT32_MAX) {
-      for (ParameterRampDescriptor& active_descriptor : active_ramps) {
-        if (active_descriptor.event.element == descriptor.event.element)
-          active_ramps.deferred_remove(active_descriptor);
-      }
+    // there is no render thread to drain the ring while the graph is stopped, so apply the queued commands on this thread; the consumer
+    // flag keeps the render thread out should the graph start in the meantime
+    if (ramp_consumer_busy.exchange(true, std::memory_order_acquire)) {
+      usleep(1000);
+      continue;
+    }
+    DrainRampCommands();
+    ramp_consumer_busy.store(false, std::memory_order_release);
+  }
+}
 
-#if defined(DEBUG_AUDIO) && DEBUG_AUDIO > 1
-      RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("%f - removed all ramps for element %lu"), CFAbsoluteTimeGetCurrent(), descriptor.event.element);
-#endif
-    } else {
-      // if the descriptor indicates an immediate change, apply it now and move on to the next descriptor
-      if (descriptor.event.eventType == kParameterEvent_Immediate) {
-        err = mixer->SetParameter(descriptor.event.parameter, descriptor.event.scope, descriptor.event.element, descriptor.event.eventValues.immediate.value);
-        if (err != noErr) {
+void AudioRenderer::DrainRampCommands() noexcept
+{
+  RampCommand command;
+  while (ramp_commands.pop(command)) {
+    OSStatus err = ApplyRampCommand(command);
+    if (err != noErr) {
 #if defined(DEBUG_AUDIO)
-          RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("mixer->SetParameter failed with error %ld"), err);
+      RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("AudioRenderer::ApplyRampCommand failed with error %ld"), err);
 #endif
-          return err;
-        }
-      } else {
-        // otherwise remove-add the descriptor from-to the active list
-        active_ramps.deferred_remove(descriptor);
-        active_ramps.deferred_add(descriptor);
+    }
+  }
+}
+
+OSStatus AudioRenderer::ApplyRampCommand(const RampCommand& command) noexcept
+{
+  // virtual source commands maintain the table of sources advanced without a bus
+  if (command.parameter == kVoiceCommandAddVirtual) {
+    if (virtual_table_count >= kMaxVirtualSourceCount)
+      return paramErr;
+    virtual_table[virtual_table_count++] = command.source;
+    return noErr;
+  } else if (command.parameter == kVoiceCommandRemoveVirtual) {
+    for (UInt32 index = 0; index < virtual_table_count; index++) {
+      if (virtual_table[index] == command.source) {
+        virtual_table[index] = virtual_table[--virtual_table_count];
+        virtual_table[virtual_table_count] = NULL;
+        break;
       }
     }
+    return noErr;
   }
 
-  // update the active ramps list
-  active_ramps.update();
+  if (command.element >= kMaxMixerBusCount)
+    return paramErr;
 
-  // finally iterate over the active ramps
-  for (ParameterRampDescriptor& descriptor : active_ramps) {
-    // if the associated source is no longer attached to us, remove the descriptor and move on to the next
-    if (descriptor.source->rendererPtr != this) {
-      active_ramps.deferred_remove(descriptor);
-      continue;
+  // a clear command invalidates all the ramps for the command's element; the next source on the bus does not start from the values of
+  // the previous one
+  if (command.parameter == kRampCommandClear) {
+    for (UInt32 parameter = 0; parameter < kRampParameterCount; parameter++) {
+      ramp_table[command.element][parameter].active = false;
+      ramp_table[command.element][parameter].initialized = false;
+      ramp_table[command.element][parameter].source = NULL;
     }
 
-    if (!(descriptor.start.mFlags & kAudioTimeStampSampleTimeValid)) {
-      // if the source is disabled, skip over the descriptor and leave it as-is
-      if (!descriptor.source->enabled)
-        continue;
+#if defined(DEBUG_AUDIO) && DEBUG_AUDIO > 1
+    RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("%f - removed all ramps for element %lu"), CFAbsoluteTimeGetCurrent(), command.element);
+#endif
+    return noErr;
+  }
 
-      // this is a new ramp parameter descriptor
+  ParameterRamp& ramp = ramp_table[command.element][command.parameter];
+  ramp.source = command.source;
 
-      // set the start and previous timestamps to the pre-render notification timestamp (e.g. now)
-      descriptor.start = *inTimeStamp;
-      descriptor.previous = *inTimeStamp;
+  // immediate changes are applied now and cancel any ongoing ramp for the parameter
+  if (command.duration == 0) {
+    ramp.active = false;
+    ramp.value = command.value;
+    ramp.initialized = true;
+    return mixer->SetParameter(g_rampParameterIDs[command.parameter], kAudioUnitScope_Input, command.element, command.value);
+  }
 
-      // get the start value for the ramp's parameter
-      err = mixer->GetParameter(descriptor.event.parameter, kAudioUnitScope_Input, descriptor.event.element, descriptor.event.eventValues.ramp.startValue);
-      if (err != noErr) {
-#if defined(DEBUG_AUDIO)
-        RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("mixer->GetParameter for %ld, %d, %ld failed with error %ld"), descriptor.event.parameter,
-                (unsigned int)kAudioUnitScope_Input, descriptor.event.element, err);
-#endif
-        return err;
-      }
+  // a new ramp replaces any ongoing ramp and starts from wherever the parameter currently is
+  if (!ramp.initialized) {
+    OSStatus err = mixer->GetParameter(g_rampParameterIDs[command.parameter], kAudioUnitScope_Input, command.element, ramp.value);
+    if (err != noErr)
+      return err;
+    ramp.initialized = true;
+  }
+  ramp.start_value = ramp.value;
+  ramp.end_value = command.value;
+  ramp.duration = command.duration;
+  ramp.elapsed = 0;
+  ramp.active = true;
 
 #if defined(DEBUG_AUDIO) && DEBUG_AUDIO > 1
-      RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("%f - new ramp: {element=%lu, parameter=%lu, start=%f, end=%f, duration=%lu}"),
-              CFAbsoluteTimeGetCurrent(), descriptor.event.element, descriptor.event.parameter, descriptor.event.eventValues.ramp.startValue,
-              descriptor.event.eventValues.ramp.endValue, descriptor.event.eventValues.ramp.durationInFrames);
+  RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("%f - new ramp: {element=%lu, parameter=%lu, start=%f, end=%f, duration=%lu}"),
+          CFAbsoluteTimeGetCurrent(), command.element, command.parameter, ramp.start_value, ramp.end_value, ramp.duration);
 #endif
-    } else {
-      if (!descriptor.source->enabled) {
-        // if the source is disabled, bump the start time so that the ramp will resume when the source is enabled
-        descriptor.start.mSampleTime += inTimeStamp->mSampleTime - descriptor.previous.mSampleTime;
+  return noErr;
+}
 
-        // update the previous timestamp
-        descriptor.previous = *inTimeStamp;
+OSStatus AudioRenderer::AdvanceRamp(AudioUnitElement element, UInt32 parameter, UInt32 inNumberFrames) noexcept
+{
+  ParameterRamp& ramp = ramp_table[element][parameter];
 
-        // move on to the next ramp
-        continue;
-      }
+  // if the source is disabled, leave the ramp as-is so that it resumes where it left off when the source is enabled
+  if (!ramp.source || !ramp.source->enabled)
+    return noErr;
 
-      // update the start buffer offset
-      descriptor.event.eventValues.ramp.startBufferOffset = static_cast<SInt32>(round(descriptor.start.mSampleTime - inTimeStamp->mSampleTime));
-      if (static_cast<SInt32>(descriptor.event.eventValues.ramp.durationInFrames) > abs(descriptor.event.eventValues.ramp.startBufferOffset)) {
-// this is an ongoing ramp
-#if defined(DEBUG_AUDIO) && DEBUG_AUDIO > 2
-        RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("       %f - ongoing ramp: {element=%lu, parameter=%lu, start=%f, end=%f, bufferOffset=%ld}"),
-                CFAbsoluteTimeGetCurrent(), descriptor.event.element, descriptor.event.parameter, descriptor.event.eventValues.ramp.startValue,
-                descriptor.event.eventValues.ramp.endValue, descriptor.event.eventValues.ramp.startBufferOffset);
-#endif
+  // compute the parameter value at the end of this slice (use linear parameter value interpolation with time being the sole interpolation parameter)
+  UInt32 frames = std::min(ramp.duration - ramp.elapsed, inNumberFrames);
+  ramp.elapsed += frames;
 
-        // apply the ramp (use linear parameter value interpolation with time being the sole interpolation parameter)
-        float t = static_cast<float>(abs(descriptor.event.eventValues.ramp.startBufferOffset)) / descriptor.event.eventValues.ramp.durationInFrames;
-        float v = (t * descriptor.event.eventValues.ramp.endValue) + ((1.0f - t) * descriptor.event.eventValues.ramp.startValue);
-        if (isnan(v) || !isnormal(v))
-          v = 0.0f;
-        else if (isinf(v))
-          v = 1.0f;
-        err = mixer->SetParameter(descriptor.event.parameter, descriptor.event.scope, descriptor.event.element, v);
-        if (err != noErr) {
-#if defined(DEBUG_AUDIO)
-          RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("mixer->SetParameter failed with error %ld"), err);
-#endif
-          return err;
-        }
+  Float32 from = ramp.value;
+  Float32 to;
+  if (ramp.elapsed >= ramp.duration) {
+    to = ramp.end_value;
+    ramp.active = false;
 
-        // update the previous timestamp
-        descriptor.previous = *inTimeStamp;
-      } else {
-// this ramp is over
 #if defined(DEBUG_AUDIO) && DEBUG_AUDIO > 1
-        RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("%f - completed ramp: {element=%lu, parameter=%lu, start=%f, end=%f, bufferOffset=%ld}"),
-                CFAbsoluteTimeGetCurrent(), descriptor.event.element, descriptor.event.parameter, descriptor.event.eventValues.ramp.startValue,
-                descriptor.event.eventValues.ramp.endValue, descriptor.event.eventValues.ramp.startBufferOffset);
+    RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("%f - completed ramp: {element=%lu, parameter=%lu, start=%f, end=%f}"), CFAbsoluteTimeGetCurrent(),
+            element, parameter, ramp.start_value, ramp.end_value);
 #endif
+  } else {
+    float t = static_cast<float>(ramp.elapsed) / ramp.duration;
+    to = (t * ramp.end_value) + ((1.0f - t) * ramp.start_value);
+    if (isnan(to) || !isnormal(to))
+      to = 0.0f;
+    else if (isinf(to))
+      to = 1.0f;
+  }
+  ramp.value = to;
+
+  // if the mixer can ramp the parameter, schedule a ramp over the slice so that the parameter is interpolated on every sample;
+  // otherwise we have to settle for one step per slice
+  if (ramp_scheduling) {
+    AudioUnitParameterEvent event;
+    event.scope = kAudioUnitScope_Input;
+    event.element = element;
+    event.parameter = g_rampParameterIDs[parameter];
+    event.eventType = kParameterEvent_Ramped;
+    event.eventValues.ramp.startBufferOffset = 0;
+    event.eventValues.ramp.durationInFrames = frames;
+    event.eventValues.ramp.startValue = from;
+    event.eventValues.ramp.endValue = to;
+    return AudioUnitScheduleParameters(*mixer, &event, 1);
+  }
+
+  return mixer->SetParameter(g_rampParameterIDs[parameter], kAudioUnitScope_Input, element, to);
+}
 
-        // apply the final ramp parameter value (without interpolation)
-        err = mixer->SetParameter(descriptor.event.parameter, descriptor.event.scope, descriptor.event.element, descriptor.event.eventValues.ramp.endValue);
+OSStatus AudioRenderer::MixerPreRenderNotify(const AudioTimeStamp* inTimeStamp, UInt32 inNumberFrames, AudioBufferList* ioData) noexcept
+{
+  OSStatus err = noErr;
 
-        // remove the ramp from the active list
-        active_ramps.deferred_remove(descriptor);
+  // a producer is applying the commands itself, which only happens around a graph start; the ramps resume with the next slice
+  if (ramp_consumer_busy.exchange(true, std::memory_order_acquire))
+    return noErr;
+
+  // drain the command ring into the ramp table; this never allocates nor blocks
+  DrainRampCommands();
+
+  // advance the active ramps
+  for (AudioUnitElement element = 0; element < kMaxMixerBusCount; element++) {
+    for (UInt32 parameter = 0; parameter < kRampParameterCount; parameter++) {
+      if (!ramp_table[element][parameter].active)
+        continue;
+
+      err = AdvanceRamp(element, parameter, inNumberFrames);
+      if (err != noErr) {
+#if defined(DEBUG_AUDIO)
+        RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("AudioRenderer::AdvanceRamp failed with error %ld"), err);
+#endif
+        ramp_consumer_busy.store(false, std::memory_order_release);
+        return err;
       }
     }
   }
 
+  // advance the virtual sources so that they are in the right place when they get a bus back
+  for (UInt32 index = 0; index < virtual_table_count; index++) {
+    AudioSourceBase* source = virtual_table[index];
+    if (source->enabled)
+      source->RenderVirtual(inNumberFrames, render_sample_rate);
+  }
+
+  ramp_consumer_busy.store(false, std::memory_order_release);
   return noErr;
 }
 
-OSStatus AudioRenderer::MixerPostRenderNotify(const AudioTimeStamp* inTimeStamp, UInt32 inBusNumber, AudioBufferList* ioData) noexcept { return noErr; }
+OSStatus AudioRenderer::MixerPostRenderNotify(const AudioTimeStamp* inTimeStamp, UInt32 inNumberFrames, AudioBufferList* ioData) noexcept
+{
+  // measure how long the mixer took to render the slice (pre-render notification included) against the time the slice represents
+  uint64_t duration = RXTimingHostDeltaToMicroseconds(mach_absolute_time() - render_start);
+  uint64_t deadline = static_cast<uint64_t>(inNumberFrames * 1.0e6 / render_sample_rate);
+
+  render_slice_frames.store(inNumberFrames, std::memory_order_relaxed);
+  render_count.fetch_add(1, std::memory_order_relaxed);
+  render_duration_histogram.Record(duration);
+  if (deadline) {
+    render_load_histogram.Record((duration * 100) / deadline);
+    if (duration > deadline)
+      deadline_miss_count.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  return noErr;
+}
+
+void AudioRenderer::GetStatistics(AudioRendererStatistics& statistics) const noexcept
+{
+  statistics.render_count = render_count.load(std::memory_order_relaxed);
+  statistics.deadline_miss_count = deadline_miss_count.load(std::memory_order_relaxed);
+  statistics.voice_steal_count = voice_steal_count.load(std::memory_order_relaxed);
+  statistics.virtual_source_count = (virtualSourceVector) ? static_cast<uint32_t>(virtualSourceVector->size()) : 0;
+  render_duration_histogram.Snapshot(statistics.render_duration);
+  render_load_histogram.Snapshot(statistics.render_load);
+}
+
+void AudioRenderer::LogStatistics() const noexcept
+{
+  AudioRendererStatistics statistics;
+  GetStatistics(statistics);
+  RXCFLog(kRXLoggingAudio, kRXLoggingLevelMessage,
+          CFSTR("<RX::AudioRenderer: %p> %llu renders, %llu missed deadlines, duration mean %.0f us p99 %llu us max %llu us, load p50 %llu%% p99 %llu%%, "
+                "%llu voice steals, %u virtual sources"),
+          this, statistics.render_count, statistics.deadline_miss_count, statistics.render_duration.Mean(), statistics.render_duration.Percentile(0.99),
+          statistics.render_duration.max, statistics.render_load.Percentile(0.5), statistics.render_load.Percentile(0.99), statistics.voice_steal_count,
+          statistics.virtual_source_count);
+}
 
 void AudioRenderer::CreateGraph()
 {
@@ -689,6 +951,7 @@ void AudioRenderer::CreateGraph()
   // set the format as the output unit's input format and th mixer unit's output format
   XThrowIfError(output->SetFormat(kAudioUnitScope_Input, 0, format), "output->SetFormat");
   XThrowIfError(mixer->SetFormat(kAudioUnitScope_Output, 0, format), "mixer->SetFormat");
+  render_sample_rate = format.mSampleRate;
 
   // add a pre-render callback on the mixer so we can schedule gain and pan ramps
   XThrowIfError(mixer->AddRenderNotify(AudioRenderer::MixerRenderNotifyCallback, this), "CAAudioUnit::AddRenderNotify");
@@ -696,21 +959,31 @@ void AudioRenderer::CreateGraph()
   // connect the output unit and the mixer
   XThrowIfError(AUGraphConnectNodeInput(graph, *mixer, 0, output_node, 0), "AUGraphConnectNodeInput");
 
-  // set the maximum number of mixer inputs to 16
-  sourceLimit = 16;
+  // set the maximum number of mixer inputs to the size of the ramp table
+  sourceLimit = kMaxMixerBusCount;
   XThrowIfError(mixer->SetProperty(kAudioUnitProperty_BusCount, kAudioUnitScope_Input, 0, &sourceLimit, sizeof(UInt32)),
                 "mixer->SetProperty kAudioUnitProperty_BusCount");
   sourceCount = 0;
 
+  // check if the mixer can ramp volume and pan on its own, in which case ramps will be interpolated per-sample by the mixer
+  ramp_scheduling = true;
+  for (UInt32 parameter = 0; parameter < kRampParameterCount; parameter++) {
+    CAAUParameter parameter_info = CAAUParameter(*mixer, g_rampParameterIDs[parameter], kAudioUnitScope_Input, 0);
+    if (!(parameter_info.ParamInfo().flags & kAudioUnitParameterFlag_CanRamp))
+      ramp_scheduling = false;
+  }
+
   // set a silence render callback on the mixer input busses
   AURenderCallbackStruct silence_render = {RXAudioRendererSilenceRenderCallback, 0};
-  for (AudioUnitElement element = 0; element < 16; element++)
+  for (AudioUnitElement element = 0; element < kMaxMixerBusCount; element++)
     XThrowIfError(mixer->SetProperty(kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, element, &silence_render, sizeof(AURenderCallbackStruct)),
                   "mixer->SetProperty kAudioUnitProperty_SetRenderCallback");
 
-  // create the bus node and allocation vectors
+  // create the bus node, allocation and source vectors, and the list of virtual sources
   busNodeVector = new std::vector<AUNode>(sourceLimit);
   busAllocationVector = new std::vector<bool>(sourceLimit);
+  busSourceVector = new std::vector<AudioSourceBase*>(sourceLimit);
+  virtualSourceVector = new std::vector<AudioSourceBase*>();
 }
 
 void AudioRenderer::TeardownGraph()
@@ -731,5 +1004,9 @@ void AudioRenderer::TeardownGraph()
   busNodeVector = 0;
   delete busAllocationVector;
   busAllocationVector = 0;
+  delete busSourceVector;
+  busSourceVector = 0;
+  delete virtualSourceVector;
+  virtualSourceVector = 0;
 }
 }
@@ -21,7 +21,8 @@ OSStatus AudioSourceBase::AudioSourceRenderCallback(void* inRefCon, AudioUnitRen
   return source->Render(ioActionFlags, inTimeStamp, inNumberFrames, ioData);
 }
 
-AudioSourceBase::AudioSourceBase() noexcept(false) : enabled(true), rendererPtr(0) { pthread_mutex_init(&transitionMutex, NULL); }
+AudioSourceBase::AudioSourceBase() noexcept(false) : enabled(true), bus(0), rendererPtr(0), priority(0), target_gain(1.0f), target_pan(0.5f)
+{ pthread_mutex_init(&transitionMutex, NULL); }
 
 AudioSourceBase::~AudioSourceBase() noexcept(false)
 {
@@ -63,4 +64,6 @@ OSStatus AudioSourceBase::Render(AudioUnitRenderActionFlags* ioActionFlags, cons
   *ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
   return noErr;
 }
+
+void AudioSourceBase::RenderVirtual(UInt32 inNumberFrames, Float64 inSampleRate) noexcept {}
 }
@@ -35,6 +35,11 @@ public:
   inline bool Enabled() const noexcept { return enabled; }
   void SetEnabled(bool enable) noexcept(false);
 
+  // voice priority; when there are more sources than mixer busses, sources with a higher priority, then with a higher gain, get the
+  // busses; a change takes effect the next time the renderer attaches a source or frees a bus
+  inline int32_t Priority() const noexcept { return priority; }
+  inline void SetPriority(int32_t p) noexcept { priority = p; }
+
 protected:
   static OSStatus AudioSourceRenderCallback(void* inRefCon, AudioUnitRenderActionFlags* ioActionFlags, const AudioTimeStamp* inTimeStamp, UInt32 inBusNumber,
                                             UInt32 inNumberFrames, AudioBufferList* ioData);
@@ -51,13 +56,26 @@ protected:
 
   virtual OSStatus Render(AudioUnitRenderActionFlags* ioActionFlags, const AudioTimeStamp* inTimeStamp, UInt32 inNumberFrames, AudioBufferList* ioData) noexcept;
 
+  // called on the render thread instead of Render while the source is virtual, with the number of frames the mixer renders at
+  // inSampleRate; sources that play in real time should drop what they would have rendered, so that they are at the right place when
+  // they get a bus again
+  virtual void RenderVirtual(UInt32 inNumberFrames, Float64 inSampleRate) noexcept;
+
   CAStreamBasicDescription format;
+
+  // the mixer bus of the source, or AudioRenderer::kVirtualBus if the source is virtual
   AudioUnitElement bus;
 
   // WARNING: a NULL renderer is the convention for indicating a source is not attached
   AudioRenderer* rendererPtr;
 
 private:
+  int32_t priority;
+
+  // the last gain and pan requested for the source, which rank the source and are applied when it gets a bus
+  Float32 target_gain;
+  Float32 target_pan;
+
   AudioSourceBase(const AudioSourceBase& c) {}
   AudioSourceBase& operator=(const AudioSourceBase& c) { return *this; }
 };
@@ -0,0 +1,124 @@
+//
+//  RXAudioStatistics.h
+//  rivenx
+//
+
+#if !defined(RX_AUDIO_STATISTICS_H)
+#define RX_AUDIO_STATISTICS_H
+
+#if !defined(__cplusplus)
+#error C++ is required to include RXAudioStatistics.h
+#endif
+
+#include <stdint.h>
+#include <atomic>
+
+#include "Base/RXTiming.h"
+
+namespace RX {
+
+// Snapshot of an AudioHistogram. Bucket bounds depend on the histogram's mode (see AudioHistogram).
+struct AudioHistogramSnapshot {
+  enum { kBucketCount = 16 };
+
+  uint64_t buckets[kBucketCount];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t bucket_width;
+
+  inline double Mean() const noexcept { return (count) ? (double)sum / (double)count : 0.0; }
+
+  // upper bound of the bucket containing the given percentile (0.0 - 1.0)
+  uint64_t Percentile(double p) const noexcept
+  {
+    uint64_t target = (uint64_t)(p * count);
+    uint64_t accumulated = 0;
+    for (uint32_t i = 0; i < kBucketCount; i++) {
+      accumulated += buckets[i];
+      if (accumulated > target)
+        return (i == kBucketCount - 1) ? max : BucketUpperBound(i);
+    }
+    return max;
+  }
+
+  inline uint64_t BucketUpperBound(uint32_t i) const noexcept { return (bucket_width) ? (i + 1) * bucket_width : (1ull << i); }
+};
+
+// Lock-free histogram. Every histogram has exactly one writer (the render thread or the audio task thread) and any number of readers,
+// so relaxed atomics are sufficient and Record never blocks. A bucket width of 0 selects power-of-2 buckets (bucket i holds [2^(i-1), 2^i)),
+// otherwise buckets are linear. The last bucket collects everything above the range.
+class AudioHistogram {
+public:
+  explicit AudioHistogram(uint64_t bucket_width = 0) noexcept : _bucket_width(bucket_width) { Clear(); }
+
+  void Record(uint64_t value) noexcept
+  {
+    uint32_t bucket;
+    if (_bucket_width)
+      bucket = (uint32_t)(value / _bucket_width);
+    else
+      bucket = (value) ? 64 - __builtin_clzll(value) : 0;
+    if (bucket >= AudioHistogramSnapshot::kBucketCount)
+      bucket = AudioHistogramSnapshot::kBucketCount - 1;
+
+    _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+    if (value > _max.load(std::memory_order_relaxed))
+      _max.store(value, std::memory_order_relaxed);
+  }
+
+  void Snapshot(AudioHistogramSnapshot& snapshot) const noexcept
+  {
+    for (uint32_t i = 0; i < AudioHistogramSnapshot::kBucketCount; i++)
+      snapshot.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+    snapshot.count = _count.load(std::memory_order_relaxed);
+    snapshot.sum = _sum.load(std::memory_order_relaxed);
+    snapshot.max = _max.load(std::memory_order_relaxed);
+    snapshot.bucket_width = _bucket_width;
+  }
+
+  // not safe to call concurrently with Record
+  void Clear() noexcept
+  {
+    for (uint32_t i = 0; i < AudioHistogramSnapshot::kBucketCount; i++)
+      _buckets[i].store(0, std::memory_order_relaxed);
+    _count.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  AudioHistogram(const AudioHistogram&) = delete;
+  AudioHistogram& operator=(const AudioHistogram&) = delete;
+
+  std::atomic<uint64_t> _buckets[AudioHistogramSnapshot::kBucketCount];
+  std::atomic<uint64_t> _count;
+  std::atomic<uint64_t> _sum;
+  std::atomic<uint64_t> _max;
+  uint64_t _bucket_width;
+};
+
+// per-source statistics (see CardAudioSource::GetStatistics)
+struct CardAudioSourceStatistics {
+  uint64_t render_count;
+  uint64_t underrun_count;
+  uint64_t partial_underrun_count;
+  AudioHistogramSnapshot fill_level;    // percent of the ring buffer, 10% buckets
+  AudioHistogramSnapshot task_duration; // microseconds, power-of-2 buckets
+  uint32_t ring_buffer_length;
+};
+
+// mixer statistics (see AudioRenderer::GetStatistics)
+struct AudioRendererStatistics {
+  uint64_t render_count;
+  uint64_t deadline_miss_count;
+  uint64_t voice_steal_count;
+  uint32_t virtual_source_count;
+  AudioHistogramSnapshot render_duration; // microseconds, power-of-2 buckets
+  AudioHistogramSnapshot render_load;     // percent of the buffer deadline, 10% buckets
+};
+}
+
+#endif // RX_AUDIO_STATISTICS_H
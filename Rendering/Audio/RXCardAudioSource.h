@@ -18,9 +18,10 @@
 #include <MHKKit/MHKAudioDecompression.h>
 
 #include "Rendering/Audio/RXAudioSourceBase.h"
+#include "Rendering/Audio/RXAudioStatistics.h"
 
 #include "Base/RXAtomic.h"
-#include "Utilities/VirtualRingBuffer.h"
+#include "Utilities/mirrored_ring_buffer.h"
 
 namespace RX {
 
@@ -36,6 +37,11 @@ public:
   void RenderTask() noexcept;
   void Reset() noexcept;
 
+  // rewinds the source and fills its buffer ahead of attaching it, so that HandleAttach does no decoding and the first render callbacks
+  // have samples; safe to call from any thread, does nothing once the source is attached
+  void Preroll() noexcept;
+  inline bool IsPrerolled() const noexcept { return _prerolled; }
+
   // info
   inline int64_t FrameCount() const noexcept { return [_decompressor frameCount]; }
   inline double Duration() const noexcept { return [_decompressor frameCount] / format.mSampleRate; }
@@ -52,6 +58,13 @@ public:
   inline bool Looping() const noexcept { return _loop; }
   inline void SetLooping(bool loop) noexcept { _loop = loop; }
 
+  // telemetry
+  void GetStatistics(CardAudioSourceStatistics& statistics) const noexcept;
+  void LogStatistics() const noexcept;
+
+  // logs statistics taken earlier with GetStatistics; source only identifies the source in the log and is not dereferenced
+  static void LogStatistics(const void* source, const CardAudioSourceStatistics& statistics) noexcept;
+
 protected:
   virtual void HandleAttach() noexcept(false);
   virtual void HandleDetach() noexcept(false);
@@ -60,21 +73,30 @@ protected:
   virtual bool Disable() noexcept(false);
 
   virtual OSStatus Render(AudioUnitRenderActionFlags* ioActionFlags, const AudioTimeStamp* inTimeStamp, UInt32 inNumberFrames, AudioBufferList* ioData) noexcept;
+  virtual void RenderVirtual(UInt32 inNumberFrames, Float64 inSampleRate) noexcept;
 
 private:
   void task(uint32_t byte_limit) noexcept;
+  void rewind() noexcept;
 
   id<MHKAudioDecompression> _decompressor;
   float _gain;
   float _pan;
   bool _loop;
 
-  VirtualRingBuffer* _decompressionBuffer;
-  VirtualRingBuffer* volatile _render_buffer;
+  // the render thread holds the swap lock while it reads from the render buffer, so a buffer can be deleted once it has been swapped out
+  rx::mirrored_ring_buffer<uint8_t>* _decompressionBuffer;
+  rx::mirrored_ring_buffer<uint8_t>* volatile _render_buffer;
   OSSpinLock _buffer_swap_lock;
 
+  // fraction of a source frame left over by the last virtual render slice, when the source and mixer sampling rates differ
+  double _virtual_frame_remainder;
+
   int64_t _bufferedFrames;
   uint32_t _bytesPerTask;
+  uint32_t _ringBufferLength;
+  volatile bool _exhausted;
+  volatile bool _prerolled;
 
   uint8_t* _loopBuffer;
   uint8_t* _loopBufferEnd;
@@ -82,6 +104,13 @@ private:
   uint64_t _loopBufferLength;
 
   OSSpinLock _task_lock;
+
+  // telemetry; the render counters and fill level are written by the render thread, task duration by the tasking thread
+  std::atomic<uint64_t> _render_count;
+  std::atomic<uint64_t> _underrun_count;
+  std::atomic<uint64_t> _partial_underrun_count;
+  AudioHistogram _fill_level_histogram;
+  AudioHistogram _task_duration_histogram;
 };
 }
 
@@ -7,14 +7,29 @@
  *
  */
 
+#import <algorithm>
+
 #import "Base/RXLogging.h"
 
 #import "RXCardAudioSource.h"
 
 namespace RX {
 
+// number of tasking rounds the ring buffer can hold
+static const uint32_t RX_CARD_AUDIO_SOURCE_RING_TASK_COUNT = 5;
+
+// number of idle ring buffers kept around for new sources; a sound group rarely has more sounds than this
+static const size_t RX_CARD_AUDIO_SOURCE_IDLE_RING_BUFFER_COUNT = 8;
+
+static rx::mirrored_ring_buffer_pool<uint8_t>& ring_buffer_pool() noexcept
+{
+  static rx::mirrored_ring_buffer_pool<uint8_t>* pool = new rx::mirrored_ring_buffer_pool<uint8_t>(RX_CARD_AUDIO_SOURCE_IDLE_RING_BUFFER_COUNT);
+  return *pool;
+}
+
 CardAudioSource::CardAudioSource(id<MHKAudioDecompression> decompressor, float gain, float pan, bool loop) noexcept(false)
-    : _decompressor(decompressor), _gain(gain), _pan(pan), _loop(loop)
+    : _decompressor(decompressor), _gain(gain), _pan(pan), _loop(loop), _render_count(0), _underrun_count(0), _partial_underrun_count(0),
+      _fill_level_histogram(10), _task_duration_histogram(0)
 {
   _task_lock = OS_SPINLOCK_INIT;
 
@@ -32,10 +47,14 @@ CardAudioSource::CardAudioSource(id<MHKAudioDecompression> decompressor, float g
   // 2 seconds per tasking round
   size_t framesPerTask = static_cast<size_t>(2.0 * format.mSampleRate);
   _bytesPerTask = framesPerTask * format.mBytesPerFrame;
+  _ringBufferLength = _bytesPerTask * RX_CARD_AUDIO_SOURCE_RING_TASK_COUNT;
+  _exhausted = false;
+  _prerolled = false;
 
-  _render_buffer = nil;
-  _decompressionBuffer = nil;
+  _render_buffer = NULL;
+  _decompressionBuffer = NULL;
   _buffer_swap_lock = OS_SPINLOCK_INIT;
+  _virtual_frame_remainder = 0.0;
 
   _bufferedFrames = 0;
 
@@ -57,7 +76,7 @@ CardAudioSource::~CardAudioSource() noexcept(false)
   Finalize();
 
   [_decompressor release];
-  [_decompressionBuffer release];
+  ring_buffer_pool().recycle(_decompressionBuffer);
 
   if (_loopBuffer)
     free(_loopBuffer);
@@ -68,10 +87,10 @@ CardAudioSource::~CardAudioSource() noexcept(false)
 OSStatus CardAudioSource::Render(AudioUnitRenderActionFlags* ioActionFlags, const AudioTimeStamp* inTimeStamp, UInt32 inNumberFrames,
                                  AudioBufferList* ioData) noexcept
 {
-  OSSpinLockLock(&_buffer_swap_lock);
-  VirtualRingBuffer* volatile render_buffer = _render_buffer;
-  [render_buffer retain];
-  OSSpinLockUnlock(&_buffer_swap_lock);
+  // never wait on the swap lock on the render thread; Reset only holds it to exchange two pointers, so render silence on the rare
+  // collision
+  bool locked = OSSpinLockTry(&_buffer_swap_lock);
+  rx::mirrored_ring_buffer<uint8_t>* render_buffer = (locked) ? _render_buffer : NULL;
 
   // if we're disable, have no renderer, no decompressor or no render buffer, render silence
   if (!Enabled() || !rendererPtr || !_decompressor || !render_buffer) {
@@ -84,7 +103,8 @@ OSStatus CardAudioSource::Render(AudioUnitRenderActionFlags* ioActionFlags, cons
             CFSTR("<RX::CardAudioSource: 0x%x> rendering silence because disabled, no renderer, no decompressor or no decompression buffer"), this);
 #endif
 
-    [render_buffer release];
+    if (locked)
+      OSSpinLockUnlock(&_buffer_swap_lock);
     return noErr;
   }
 
@@ -92,11 +112,18 @@ OSStatus CardAudioSource::Render(AudioUnitRenderActionFlags* ioActionFlags, cons
   UInt32 optimalBytesToRead = inNumberFrames * format.mBytesPerFrame;
   debug_assert(ioData->mBuffers[0].mDataByteSize == optimalBytesToRead);
 
-  void* readBuffer = 0;
-  UInt32 availableBytes = [render_buffer lengthAvailableToReadReturningPointer:&readBuffer];
+  const uint8_t* readBuffer = 0;
+  UInt32 availableBytes = (UInt32)render_buffer->read_available(&readBuffer);
+
+  // telemetry
+  _render_count.fetch_add(1, std::memory_order_relaxed);
+  _fill_level_histogram.Record(std::min<uint64_t>((availableBytes * 100ull) / _ringBufferLength, 100));
 
-  // if there are no samples available, render silence
+  // if there are no samples available, render silence; this is an underrun unless the sound has played out
   if (availableBytes == 0) {
+    if (!_exhausted)
+      _underrun_count.fetch_add(1, std::memory_order_relaxed);
+
     for (UInt32 bufferIndex = 0; bufferIndex < ioData->mNumberBuffers; bufferIndex++)
       bzero(ioData->mBuffers[bufferIndex].mData, ioData->mBuffers[bufferIndex].mDataByteSize);
     *ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
@@ -105,27 +132,54 @@ OSStatus CardAudioSource::Render(AudioUnitRenderActionFlags* ioActionFlags, cons
     RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("<RX::CardAudioSource: 0x%x> rendering silence because of sample starvation"), this);
 #endif
 
-    [render_buffer release];
+    OSSpinLockUnlock(&_buffer_swap_lock);
     return noErr;
   }
 
   // handle either the normal or the overload case
   if (availableBytes >= optimalBytesToRead) {
     memcpy(ioData->mBuffers[0].mData, readBuffer, optimalBytesToRead);
-    [render_buffer didReadLength:optimalBytesToRead];
+    render_buffer->did_read(optimalBytesToRead);
   } else {
 #if defined(DEBUG_AUDIO) && DEBUG_AUDIO > 2
     RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("<RX::CardAudioSource: 0x%x> rendering silence because of partial sample starvation"), this);
 #endif
+    if (!_exhausted)
+      _partial_underrun_count.fetch_add(1, std::memory_order_relaxed);
     memcpy(ioData->mBuffers[0].mData, readBuffer, availableBytes);
-    [render_buffer didReadLength:availableBytes];
+    render_buffer->did_read(availableBytes);
     bzero(reinterpret_cast<unsigned char*>(ioData->mBuffers[0].mData) + availableBytes, optimalBytesToRead - availableBytes);
   }
 
-  [render_buffer release];
+  OSSpinLockUnlock(&_buffer_swap_lock);
   return noErr;
 }
 
+void CardAudioSource::RenderVirtual(UInt32 inNumberFrames, Float64 inSampleRate) noexcept
+{
+  // same locking rules as Render; a skipped slice only leaves the source a few milliseconds behind
+  if (!OSSpinLockTry(&_buffer_swap_lock))
+    return;
+
+  rx::mirrored_ring_buffer<uint8_t>* render_buffer = _render_buffer;
+  if (!Enabled() || !rendererPtr || !_decompressor || !render_buffer) {
+    OSSpinLockUnlock(&_buffer_swap_lock);
+    return;
+  }
+
+  // consume the samples the slice would have played, without copying them anywhere, so that the decompression task keeps the source
+  // going and it resumes in the right place when it gets a mixer bus back
+  double frames = inNumberFrames * format.mSampleRate / inSampleRate + _virtual_frame_remainder;
+  UInt32 wholeFrames = static_cast<UInt32>(frames);
+  _virtual_frame_remainder = frames - wholeFrames;
+
+  const uint8_t* readBuffer = 0;
+  UInt32 availableBytes = (UInt32)render_buffer->read_available(&readBuffer);
+  render_buffer->did_read(std::min<UInt32>(availableBytes, wholeFrames * format.mBytesPerFrame));
+
+  OSSpinLockUnlock(&_buffer_swap_lock);
+}
+
 void CardAudioSource::RenderTask() noexcept
 {
   if (!_decompressor || !_decompressionBuffer)
@@ -137,7 +191,9 @@ void CardAudioSource::RenderTask() noexcept
     return;
   }
 
+  uint64_t start = mach_absolute_time();
   task(_bytesPerTask);
+  _task_duration_histogram.Record(RXTimingHostDeltaToMicroseconds(mach_absolute_time() - start));
 
   OSSpinLockUnlock(&_task_lock);
 }
@@ -149,8 +205,8 @@ void CardAudioSource::task(uint32_t byte_limit) noexcept
 #endif
 
   // get how many bytes are available in the decompression ring buffer and a suitable write pointer
-  void* write_ptr = NULL;
-  UInt32 available_bytes = [_decompressionBuffer lengthAvailableToWriteReturningPointer:&write_ptr];
+  uint8_t* write_ptr = NULL;
+  UInt32 available_bytes = (UInt32)_decompressionBuffer->write_available(&write_ptr);
 
   // we want to fill as many bytes as are available in the decompression buffer up to the specified byte limit
   UInt32 bytes_to_fill = (available_bytes < byte_limit) ? available_bytes : byte_limit;
@@ -186,6 +242,7 @@ void CardAudioSource::task(uint32_t byte_limit) noexcept
 #if defined(DEBUG_AUDIO) && DEBUG_AUDIO > 1
       RXCFLog(kRXLoggingAudio, kRXLoggingLevelDebug, CFSTR("<RX::CardAudioSource: 0x%x> no frames left to decode, bailing out"), this);
 #endif
+      _exhausted = true;
       return;
     }
   }
@@ -211,8 +268,12 @@ void CardAudioSource::task(uint32_t byte_limit) noexcept
   _bufferedFrames += available_frames;
   frames_to_fill -= available_frames;
 
+  // once every frame of a non-looping sound is buffered, running out of samples at render time is no longer an underrun
+  if (!_loop && _bufferedFrames >= [_decompressor frameCount])
+    _exhausted = true;
+
   // update the ring buffer
-  [_decompressionBuffer didWriteLength:bytes_to_fill];
+  _decompressionBuffer->did_write(bytes_to_fill);
 
   // if we're looping and we're missing frames from the ideal number, reset the decompressor and go for another round
   if (_loop && frames_to_fill > 0) {
@@ -237,26 +298,72 @@ void CardAudioSource::Reset() noexcept
   rendererPtr->SetSourceGain(*this, _gain);
   rendererPtr->SetSourcePan(*this, _pan);
 
+  // a pre-rolled source is already rewound with a filled buffer; the pre-roll only covers one attachment
+  if (!_prerolled)
+    rewind();
+  _prerolled = false;
+
+  OSSpinLockUnlock(&_task_lock);
+}
+
+void CardAudioSource::Preroll() noexcept
+{
+  OSSpinLockLock(&_task_lock);
+  if (!_prerolled && !rendererPtr) {
+    rewind();
+    _prerolled = true;
+  }
+  OSSpinLockUnlock(&_task_lock);
+}
+
+void CardAudioSource::rewind() noexcept
+{
   // reset the decompressor
   [_decompressor reset];
 
-  // create a new decompression buffer that's 10 seconds long (2 seconds per task)
-  _decompressionBuffer = [[VirtualRingBuffer alloc] initWithLength:_bytesPerTask * 5];
+  // get a decompression buffer that's 10 seconds long (2 seconds per task)
+  _decompressionBuffer = ring_buffer_pool().acquire(_ringBufferLength);
   _bufferedFrames = 0;
+  _exhausted = false;
 
   // go for 1 round of tasking so we don't starve the first few callbacks
   task(_bytesPerTask);
 
-  // swap the render buffer; this will also take care of releasing any previous decompression buffer
-  VirtualRingBuffer* render_buffer = _render_buffer;
+  // swap the render buffer; once the swap lock is released the render thread can no longer be using the previous buffer
+  rx::mirrored_ring_buffer<uint8_t>* render_buffer = _render_buffer;
   OSSpinLockLock(&_buffer_swap_lock);
   _render_buffer = _decompressionBuffer;
   OSSpinLockUnlock(&_buffer_swap_lock);
-  [render_buffer release];
+  ring_buffer_pool().recycle(render_buffer);
+}
 
-  OSSpinLockUnlock(&_task_lock);
+void CardAudioSource::GetStatistics(CardAudioSourceStatistics& statistics) const noexcept
+{
+  statistics.render_count = _render_count.load(std::memory_order_relaxed);
+  statistics.underrun_count = _underrun_count.load(std::memory_order_relaxed);
+  statistics.partial_underrun_count = _partial_underrun_count.load(std::memory_order_relaxed);
+  _fill_level_histogram.Snapshot(statistics.fill_level);
+  _task_duration_histogram.Snapshot(statistics.task_duration);
+  statistics.ring_buffer_length = _ringBufferLength;
+}
+
+void CardAudioSource::LogStatistics() const noexcept
+{
+  CardAudioSourceStatistics statistics;
+  GetStatistics(statistics);
+  LogStatistics(this, statistics);
 }
 
+void CardAudioSource::LogStatistics(const void* source, const CardAudioSourceStatistics& statistics) noexcept
+{
+  RXCFLog(kRXLoggingAudio, kRXLoggingLevelMessage,
+          CFSTR("<RX::CardAudioSource: %p> %llu renders, %llu underruns (%llu partial), fill p1 %llu%% p50 %llu%% of %u bytes, task mean %.0f us max %llu us"),
+          source, statistics.render_count, statistics.underrun_count, statistics.partial_underrun_count, statistics.fill_level.Percentile(0.01),
+          statistics.fill_level.Percentile(0.5), statistics.ring_buffer_length, statistics.task_duration.Mean(), statistics.task_duration.max);
+}
+
+#pragma mark -
+
 void CardAudioSource::HandleAttach() noexcept(false) { Reset(); }
 
 void CardAudioSource::HandleDetach() noexcept(false) {}
@@ -14,9 +14,16 @@
 extern NSString* const GLShaderCompileErrorDomain;
 extern NSString* const GLShaderLinkErrorDomain;
 
+// Linked programs are cached as program binaries (ARB_get_program_binary) in the world cache directory, keyed by the renderer and by the
+// program's sources and attribute bindings, so that later launches skip compiling and linking. Programs are compiled as usual whenever
+// the renderer has no program binary formats or a cached binary is missing or rejected.
 @interface GLShaderProgramManager : NSObject {
   NSURL* _shaders_root;
+  NSString* _1texcoord_vs_source;
   GLuint _1texcoord_vs;
+
+  NSString* _binary_cache_path;
+  NSString* _renderer_key;
 }
 
 + (GLShaderProgramManager*)sharedManager;
@@ -6,18 +6,47 @@
 //  Copyright 2005-2012 MacStorm. All rights reserved.
 //
 
+#import <CommonCrypto/CommonDigest.h>
 #import <OpenGL/CGLMacro.h>
+#import <OpenGL/glu.h>
 
 #import "GL_debug.h"
 
 #import "GLShaderProgramManager.h"
 
+#import "Engine/RXWorld.h"
+#import "Utilities/BZFSUtilities.h"
+
 // ignore bad function cast errors in this file because of the shader API functions (which cast from handle to uint on OS X inside the CGL macros)
 #pragma clang diagnostic ignored "-Wbad-function-cast"
 
 NSString* const GLShaderCompileErrorDomain = @"GLShaderCompileErrorDomain";
 NSString* const GLShaderLinkErrorDomain = @"GLShaderLinkErrorDomain";
 
+// the program binary entry points are only declared by SDKs that know about ARB_get_program_binary
+#if defined(GL_ARB_get_program_binary) && GL_ARB_get_program_binary
+#define RX_PROGRAM_BINARY_CACHE 1
+#else
+#define RX_PROGRAM_BINARY_CACHE 0
+#endif
+
+// a cached program binary file is this header followed by the binary
+struct rx_program_binary_header {
+  uint32_t magic;
+  uint32_t format;
+};
+
+static const uint32_t kProgramBinaryMagic = 'RXPB';
+
+@interface GLShaderProgramManager (GLShaderProgramManagerPrivate)
+- (void)_initializeProgramBinaryCache:(CGLContextObj)cgl_ctx;
+- (NSString*)_programCacheKeyWithSources:(NSArray*)sources attributeBindings:(NSDictionary*)bindings;
+- (GLuint)_newProgramWithCacheKey:(NSString*)key context:(CGLContextObj)cgl_ctx;
+- (void)_prepareProgramForCaching:(GLuint)program context:(CGLContextObj)cgl_ctx;
+- (void)_storeProgram:(GLuint)program cacheKey:(NSString*)key context:(CGLContextObj)cgl_ctx;
+- (GLuint)_standardVertexShader:(CGLContextObj)cgl_ctx;
+@end
+
 @implementation GLShaderProgramManager
 
 + (GLShaderProgramManager*)sharedManager
@@ -53,15 +82,161 @@ NSString* const GLShaderLinkErrorDomain = @"GLShaderLinkErrorDomain";
   _shaders_root =
       (NSURL*)CFURLCreateWithFileSystemPath(NULL, (CFStringRef)[[NSBundle mainBundle] pathForResource : @"Shaders" ofType : nil], kCFURLPOSIXPathStyle, true);
 
-  // get the source of the standard one texture coordinates vertex shader
+  // get the source of the standard one texture coordinates vertex shader; it is compiled the first time a standard program is not in the
+  // program binary cache
   NSURL* source_url = [NSURL URLWithString:[@"1texcoord" stringByAppendingPathExtension:@"vsh"] relativeToURL:_shaders_root];
-  NSString* source = [NSString stringWithContentsOfURL:source_url encoding:NSASCIIStringEncoding error:NULL];
-  if (!source)
+  _1texcoord_vs_source = [[NSString alloc] initWithContentsOfURL:source_url encoding:NSASCIIStringEncoding error:NULL];
+  if (!_1texcoord_vs_source)
     @throw
         [NSException exceptionWithName:@"RXShaderException" reason:@"Riven X was unable to load the standard texturing vertex shader's source." userInfo:nil];
 
+  [self _initializeProgramBinaryCache:cgl_ctx];
+
+  CGLUnlockContext(cgl_ctx);
+  return self;
+}
+
+- (id)copyWithZone:(NSZone*)zone { return [self retain]; }
+
+- (void)_initializeProgramBinaryCache:(CGLContextObj)cgl_ctx
+{
+#if RX_PROGRAM_BINARY_CACHE
+  if (!gluCheckExtension((const GLubyte*)"GL_ARB_get_program_binary", glGetString(GL_EXTENSIONS)))
+    return;
+
+  // the extension may be exposed without any binary format to retrieve programs in
+  GLint format_count = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+  glReportError();
+  if (format_count == 0)
+    return;
+
+  // binaries are only valid for the driver that produced them
+  _renderer_key = [[NSString alloc] initWithFormat:@"%s|%s|%s", glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION)];
+
+  NSString* cache_path = [[[(RXWorld*)g_world worldCacheBase] path] stringByAppendingPathComponent:@"Shader Programs"];
+  if (!BZFSDirectoryExists(cache_path) && !BZFSCreateDirectory(cache_path, NULL)) {
+    RXOLog2(kRXLoggingGraphics, kRXLoggingLevelMessage, @"could not create the shader program cache directory, programs will not be cached");
+    return;
+  }
+  _binary_cache_path = [cache_path retain];
+
+  RXOLog2(kRXLoggingGraphics, kRXLoggingLevelMessage, @"caching shader program binaries in %@", _binary_cache_path);
+#endif
+}
+
+- (NSString*)_programCacheKeyWithSources:(NSArray*)sources attributeBindings:(NSDictionary*)bindings
+{
+  if (!_binary_cache_path)
+    return nil;
+
+  CC_SHA1_CTX context;
+  CC_SHA1_Init(&context);
+
+  // every component is NUL-terminated so that moving text from one source to the next changes the key
+  NSMutableArray* components = [NSMutableArray arrayWithObject:_renderer_key];
+  [components addObjectsFromArray:sources];
+  for (NSString* attribute in [[bindings allKeys] sortedArrayUsingSelector:@selector(compare:)])
+    [components addObject:[NSString stringWithFormat:@"%@=%@", attribute, [bindings objectForKey:attribute]]];
+  for (NSString* component in components) {
+    const char* bytes = [component UTF8String];
+    CC_SHA1_Update(&context, bytes, (CC_LONG)strlen(bytes) + 1);
+  }
+
+  uint8_t digest[CC_SHA1_DIGEST_LENGTH];
+  CC_SHA1_Final(digest, &context);
+
+  NSMutableString* key = [NSMutableString stringWithCapacity:CC_SHA1_DIGEST_LENGTH * 2];
+  for (int i = 0; i < CC_SHA1_DIGEST_LENGTH; i++)
+    [key appendFormat:@"%02x", digest[i]];
+  return key;
+}
+
+- (GLuint)_newProgramWithCacheKey:(NSString*)key context:(CGLContextObj)cgl_ctx
+{
+#if RX_PROGRAM_BINARY_CACHE
+  if (!key)
+    return 0;
+
+  NSString* path = [_binary_cache_path stringByAppendingPathComponent:[key stringByAppendingPathExtension:@"bin"]];
+  NSData* data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:NULL];
+  if (!data)
+    return 0;
+
+  const struct rx_program_binary_header* header = (const struct rx_program_binary_header*)[data bytes];
+  if ([data length] <= sizeof(struct rx_program_binary_header) || header->magic != kProgramBinaryMagic) {
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+    return 0;
+  }
+
+  GLuint program = glCreateProgram();
+  glReportError();
+  glProgramBinary(program, header->format, header + 1, (GLsizei)([data length] - sizeof(struct rx_program_binary_header)));
+
+  // the driver may reject a binary it produced, e.g. after a driver update that did not change the version string
+  GLint status;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status != GL_TRUE) {
+    while (glGetError() != GL_NO_ERROR)
+      ;
+    glDeleteProgram(program);
+    glReportError();
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+
+    RXOLog2(kRXLoggingGraphics, kRXLoggingLevelMessage, @"discarded a stale shader program binary");
+    return 0;
+  }
+
+  return program;
+#else
+  return 0;
+#endif
+}
+
+- (void)_prepareProgramForCaching:(GLuint)program context:(CGLContextObj)cgl_ctx
+{
+#if RX_PROGRAM_BINARY_CACHE
+  if (!_binary_cache_path)
+    return;
+  glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  glReportError();
+#endif
+}
+
+- (void)_storeProgram:(GLuint)program cacheKey:(NSString*)key context:(CGLContextObj)cgl_ctx
+{
+#if RX_PROGRAM_BINARY_CACHE
+  if (!key)
+    return;
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  glReportError();
+  if (length <= 0)
+    return;
+
+  NSMutableData* data = [NSMutableData dataWithLength:sizeof(struct rx_program_binary_header) + length];
+  struct rx_program_binary_header* header = (struct rx_program_binary_header*)[data mutableBytes];
+  GLenum format = 0;
+  glGetProgramBinary(program, length, NULL, &format, header + 1);
+  glReportError();
+  header->magic = kProgramBinaryMagic;
+  header->format = format;
+
+  NSString* path = [_binary_cache_path stringByAppendingPathComponent:[key stringByAppendingPathExtension:@"bin"]];
+  if (![data writeToFile:path atomically:YES])
+    RXOLog2(kRXLoggingGraphics, kRXLoggingLevelMessage, @"failed to write shader program binary %@", path);
+#endif
+}
+
+- (GLuint)_standardVertexShader:(CGLContextObj)cgl_ctx
+{
+  // WARNING: ASSUMES THE CALLER HAS LOCKED THE CONTEXT
+  if (_1texcoord_vs)
+    return _1texcoord_vs;
+
   // convert the source to an ASCII C string
-  GLchar* source_cstr = (GLchar*)[source cStringUsingEncoding:NSASCIIStringEncoding];
+  GLchar* source_cstr = (GLchar*)[_1texcoord_vs_source cStringUsingEncoding:NSASCIIStringEncoding];
   if (!source_cstr)
     @throw [NSException exceptionWithName:@"RXShaderException"
                                    reason:@"Riven X was unable to convert the encoding of the standard texturing vertex shader's source."
@@ -104,17 +279,17 @@ NSString* const GLShaderLinkErrorDomain = @"GLShaderLinkErrorDomain";
     free(source_cstr);
     free(log);
 
+    glDeleteShader(_1texcoord_vs);
+    _1texcoord_vs = 0;
+
     @throw [NSException exceptionWithName:@"RXShaderCompileException"
                                    reason:@"Riven X was unable to compile the standard texturing vertex shader."
                                  userInfo:[NSDictionary dictionaryWithObjectsAndKeys:error, NSUnderlyingErrorKey, nil]];
   }
 
-  CGLUnlockContext(cgl_ctx);
-  return self;
+  return _1texcoord_vs;
 }
 
-- (id)copyWithZone:(NSZone*)zone { return [self retain]; }
-
 - (GLuint)standardProgramWithFragmentShaderName:(NSString*)name
                                    extraSources:(NSArray*)extraSources
                                   epilogueIndex:(NSUInteger)epilogueIndex
@@ -131,9 +306,6 @@ NSString* const GLShaderLinkErrorDomain = @"GLShaderLinkErrorDomain";
   GLint status;
   GLuint program;
 
-  // epilogueIndex needs to be increased by one in order to represent the epilogue index in the overall shader source array
-  epilogueIndex++;
-
   // shader source URLs
   NSURL* fs_url = [NSURL URLWithString:[name stringByAppendingPathExtension:@"fsh"] relativeToURL:_shaders_root];
 
@@ -142,6 +314,21 @@ NSString* const GLShaderLinkErrorDomain = @"GLShaderLinkErrorDomain";
   if (!fshader_source)
     return 0;
 
+  // try the program binary cache
+  NSMutableArray* key_sources = [NSMutableArray arrayWithObject:_1texcoord_vs_source];
+  if (extraSources)
+    [key_sources addObjectsFromArray:extraSources];
+  [key_sources insertObject:fshader_source atIndex:1 + epilogueIndex];
+  NSDictionary* bindings = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithInt:RX_ATTRIB_POSITION], @"position",
+                                                                      [NSNumber numberWithInt:RX_ATTRIB_TEXCOORD0], @"tex_coord0", nil];
+  NSString* cache_key = [self _programCacheKeyWithSources:key_sources attributeBindings:bindings];
+  program = [self _newProgramWithCacheKey:cache_key context:cgl_ctx];
+  if (program)
+    return program;
+
+  // epilogueIndex needs to be increased by one in order to represent the epilogue index in the overall shader source array
+  epilogueIndex++;
+
   // shader source array
   GLchar** shader_sources = malloc(sizeof(GLchar*) * (1 + [extraSources count]));
 
@@ -206,7 +393,7 @@ NSString* const GLShaderLinkErrorDomain = @"GLShaderLinkErrorDomain";
   glReportError();
 
   // attach the vertex and fragment shaders
-  glAttachShader(program, _1texcoord_vs);
+  glAttachShader(program, [self _standardVertexShader:cgl_ctx]);
   glReportError();
   glAttachShader(program, fs);
   glReportError();
@@ -218,6 +405,7 @@ NSString* const GLShaderLinkErrorDomain = @"GLShaderLinkErrorDomain";
   glReportError();
 
   // link
+  [self _prepareProgramForCaching:program context:cgl_ctx];
   glLinkProgram(program);
   glReportError();
   glGetProgramiv(program, GL_LINK_STATUS, &status);
@@ -242,6 +430,8 @@ NSString* const GLShaderLinkErrorDomain = @"GLShaderLinkErrorDomain";
   glDeleteShader(fs);
   glReportError();
 
+  [self _storeProgram:program cacheKey:cache_key context:cgl_ctx];
+
   free(shader_sources);
   return program;
 
@@ -283,6 +473,12 @@ failure_delete_shader_sources:
   if (!fshader_source)
     return 0;
 
+  // try the program binary cache
+  NSString* cache_key = [self _programCacheKeyWithSources:[NSArray arrayWithObjects:vshader_source, fshader_source, nil] attributeBindings:bindings];
+  program = [self _newProgramWithCacheKey:cache_key context:cgl_ctx];
+  if (program)
+    return program;
+
   // vertex shader source
   vs = glCreateShader(GL_VERTEX_SHADER);
   glReportError();
@@ -376,6 +572,7 @@ failure_delete_shader_sources:
   }
 
   // link
+  [self _prepareProgramForCaching:program context:cgl_ctx];
   glLinkProgram(program);
   glReportError();
   glGetProgramiv(program, GL_LINK_STATUS, &status);
@@ -402,6 +599,8 @@ failure_delete_shader_sources:
   glDeleteShader(fs);
   glReportError();
 
+  [self _storeProgram:program cacheKey:cache_key context:cgl_ctx];
+
   return program;
 
 failure_delete_program:
@@ -9,12 +9,30 @@
 #import "Base/RXBase.h"
 
 #import "Rendering/Graphics/RXPicture.h"
+#import "Rendering/Graphics/RXTextureUploader.h"
 
 @interface RXDynamicPicture : RXPicture {
+  RXTextureUpload* _upload;
 }
 
-+ (GLuint)sharedDynamicPictureUnpackBuffer;
+// uploads the vertices of the dynamic pictures created since the last call; must be called in the render thread before rendering any
+// dynamic picture
++ (void)flushVertexStagingInContext:(CGLContextObj)cgl_ctx;
 
 - (id)initWithTexture:(RXTexture*)texture samplingRect:(NSRect)sampling_rect renderRect:(NSRect)render_rect owner:(id)owner;
 
+// upload is the pending upload of the texture's content, or nil; the picture can be queued for display right away, and the render thread
+// defers the static refresh that draws it until the upload has completed, then skips the picture if the upload failed
+- (id)initWithTexture:(RXTexture*)texture
+         samplingRect:(NSRect)sampling_rect
+           renderRect:(NSRect)render_rect
+                owner:(id)owner
+               upload:(RXTextureUpload*)upload;
+
+// YES if the picture has no pending upload; never blocks
+- (BOOL)isReadyToRender;
+
+// YES if the upload of the picture's texture has completed and failed
+- (BOOL)uploadFailed;
+
 @end
@@ -6,31 +6,31 @@
 //  Copyright 2005-2012 MacStorm. All rights reserved.
 //
 
-#import <libkern/OSAtomic.h>
-
 #import "Rendering/Graphics/RXDynamicPicture.h"
-#import "Base/RXDynamicBitfield.h"
+#import "Base/RXBitfield.h"
 
-static BOOL dynamic_picture_system_initialized = NO;
+// maximum number of live dynamic pictures; the vertex buffer is allocated for all of them up front so that it never has to be resized
+// while the render thread draws from it
+#define RX_DYNAMIC_PICTURE_CAPACITY 1024
 
-static int32_t dynamic_picture_vertex_bo_picture_capacity = 0;
-static int32_t volatile active_dynamic_pictures = 0;
-static RXDynamicBitfield* dynamic_picture_allocation_bitmap;
+// 4 vertices per picture [<position.x position.y> <texcoord0.s texcoord0.t>]
+#define RX_DYNAMIC_PICTURE_FLOATS 16
 
 static GLuint dynamic_picture_vao = UINT32_MAX;
 static GLuint dynamic_picture_vertex_bo = UINT32_MAX;
 
-static OSSpinLock dynamic_picture_lock = OS_SPINLOCK_INIT;
+// pictures write their vertices in the staging array and mark their index dirty; the render thread uploads the dirty range of the
+// staging array to the vertex buffer once per frame, before drawing any picture
+static GLfloat* dynamic_picture_vertex_staging;
+static rx_bitfield_t dynamic_picture_allocation_bitmap;
+static rx_bitfield_t dynamic_picture_dirty_bitmap;
 
 static void initialize_dynamic_picture_system()
 {
-  if (dynamic_picture_system_initialized)
-    return;
-
   CGLContextObj cgl_ctx = [g_worldView loadContext];
-  NSObject<RXOpenGLStateProtocol>* gl_state = RXGetContextState(cgl_ctx);
+  CGLLockContext(cgl_ctx);
 
-  dynamic_picture_vertex_bo_picture_capacity = 20;
+  NSObject<RXOpenGLStateProtocol>* gl_state = RXGetContextState(cgl_ctx);
 
   glGenBuffers(1, &dynamic_picture_vertex_bo);
   glGenVertexArraysAPPLE(1, &dynamic_picture_vao);
@@ -39,8 +39,7 @@ static void initialize_dynamic_picture_system()
 
   glBindBuffer(GL_ARRAY_BUFFER, dynamic_picture_vertex_bo);
   glReportError();
-  glBufferParameteriAPPLE(GL_ARRAY_BUFFER, GL_BUFFER_FLUSHING_UNMAP_APPLE, GL_FALSE);
-  glBufferData(GL_ARRAY_BUFFER, dynamic_picture_vertex_bo_picture_capacity * 16 * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, RX_DYNAMIC_PICTURE_CAPACITY * RX_DYNAMIC_PICTURE_FLOATS * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
   glReportError();
 
   glEnableVertexAttribArray(RX_ATTRIB_POSITION);
@@ -58,152 +57,72 @@ static void initialize_dynamic_picture_system()
   // we created a new buffer object, so flush
   glFlush();
 
-  active_dynamic_pictures = 0;
-  dynamic_picture_allocation_bitmap = [RXDynamicBitfield new];
-
-  dynamic_picture_system_initialized = YES;
-}
-
-static void grow_dynamic_picture_vertex_bo()
-{
-  CGLContextObj cgl_ctx = [g_worldView loadContext];
-  NSObject<RXOpenGLStateProtocol>* gl_state = RXGetContextState(cgl_ctx);
-
-  // bump capacity by 20
-  dynamic_picture_vertex_bo_picture_capacity += 20;
-
-  GLuint alternate_bo;
-  glGenBuffers(1, &alternate_bo);
-
-  // bind the dynamic picture VAO and reconfigure it to use the alternate buffer object
-  [gl_state bindVertexArrayObject:dynamic_picture_vao];
-
-  // bind the vertex buffer in the alternate slot and re-allocate it to the new capacity
-  glBindBuffer(GL_ARRAY_BUFFER, alternate_bo);
-  glReportError();
-  glBufferParameteriAPPLE(GL_ARRAY_BUFFER, GL_BUFFER_FLUSHING_UNMAP_APPLE, GL_FALSE);
-  glBufferData(GL_ARRAY_BUFFER, dynamic_picture_vertex_bo_picture_capacity * 16 * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
-  glReportError();
-
-  glEnableVertexAttribArray(RX_ATTRIB_POSITION);
-  glReportError();
-  glVertexAttribPointer(RX_ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
-  glReportError();
-
-  glEnableVertexAttribArray(RX_ATTRIB_TEXCOORD0);
-  glReportError();
-  glVertexAttribPointer(RX_ATTRIB_TEXCOORD0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)(2 * sizeof(GLfloat)));
-  glReportError();
-
-  // map the alternate buffer object write-only
-  GLfloat* destination = (GLfloat*)glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-  glReportError();
-
-  // bind the primary buffer object and map it read-only
-  glBindBuffer(GL_ARRAY_BUFFER, dynamic_picture_vertex_bo);
-  glReportError();
-  GLfloat* source = (GLfloat*)glMapBuffer(GL_ARRAY_BUFFER, GL_READ_ONLY);
-  glReportError();
-
-  // copy the content of the primary buffer object into the alternate buffer object
-  memcpy(destination, source, active_dynamic_pictures * 16 * sizeof(GLfloat));
-
-  // unmap the primary buffer object
-  glUnmapBuffer(GL_ARRAY_BUFFER);
-  glReportError();
-
-  // bind the alternate buffer object again, then flush and unmap it
-  glBindBuffer(GL_ARRAY_BUFFER, alternate_bo);
-  glReportError();
-  glFlushMappedBufferRangeAPPLE(GL_ARRAY_BUFFER, 0, active_dynamic_pictures * 16 * sizeof(GLfloat));
-  glUnmapBuffer(GL_ARRAY_BUFFER);
-  glReportError();
-
-  // reset the current vao to 0 (Riven X assumption)
-  [gl_state bindVertexArrayObject:0];
-
-  // scrap the primary buffer object
-  glDeleteBuffers(1, &dynamic_picture_vertex_bo);
-
-  // we created a new buffer object, so flush
-  glFlush();
+  CGLUnlockContext(cgl_ctx);
 
-  // the alternate buffer object is now the primary buffer object
-  dynamic_picture_vertex_bo = alternate_bo;
+  dynamic_picture_vertex_staging = calloc(RX_DYNAMIC_PICTURE_CAPACITY * RX_DYNAMIC_PICTURE_FLOATS, sizeof(GLfloat));
+  rx_bitfield_init(&dynamic_picture_allocation_bitmap, RX_DYNAMIC_PICTURE_CAPACITY / RX_BITFIELD_SEGMENT_BITS);
+  rx_bitfield_init(&dynamic_picture_dirty_bitmap, RX_DYNAMIC_PICTURE_CAPACITY / RX_BITFIELD_SEGMENT_BITS);
 }
 
-static GLuint allocate_dynamic_picture_index()
-{
-  if ((active_dynamic_pictures + 1) == dynamic_picture_vertex_bo_picture_capacity)
-    grow_dynamic_picture_vertex_bo();
-
-  size_t max_picture = [dynamic_picture_allocation_bitmap segmentCount] * [dynamic_picture_allocation_bitmap segmentBits];
-  for (uint32_t picture_index = 0; picture_index < max_picture; picture_index++) {
-    if (![dynamic_picture_allocation_bitmap isSet:picture_index]) {
-      [dynamic_picture_allocation_bitmap set:picture_index];
-      active_dynamic_pictures++;
-      return picture_index;
-    }
-  }
-
-  // fell off the current end of the dynamic bitfield, so use max_picture
-  // which is the next bit in line (this will grow the bitfield)
-  [dynamic_picture_allocation_bitmap set:max_picture];
-  active_dynamic_pictures++;
-  return max_picture;
-}
+@implementation RXDynamicPicture
 
-static void free_dynamic_picture_index(GLuint index)
++ (void)initialize
 {
-  [dynamic_picture_allocation_bitmap clear:index];
-  active_dynamic_pictures--;
+  if (self == [RXDynamicPicture class])
+    initialize_dynamic_picture_system();
 }
 
-@implementation RXDynamicPicture
-
-+ (GLuint)sharedDynamicPictureUnpackBuffer
++ (void)flushVertexStagingInContext:(CGLContextObj)cgl_ctx
 {
-  static GLuint dynamic_picture_unpack_buffer = 0;
-  if (dynamic_picture_unpack_buffer)
-    return dynamic_picture_unpack_buffer;
+  // WARNING: MUST RUN IN THE CORE VIDEO RENDER THREAD
+
+  // collect the dirty pictures, clearing their dirty bits; the exchange makes their staged vertices visible to this thread
+  uintptr_t first = RX_BITFIELD_NOT_FOUND, last = 0;
+  for (uintptr_t segment_index = 0; segment_index < dynamic_picture_dirty_bitmap.segment_count; segment_index++) {
+    if (!dynamic_picture_dirty_bitmap.segments[segment_index])
+      continue;
+    uintptr_t dirty = rx_bitfield_atomic_exchange_segment(&dynamic_picture_dirty_bitmap, segment_index, 0);
+    if (!dirty)
+      continue;
+
+    if (first == RX_BITFIELD_NOT_FOUND)
+      first = segment_index * RX_BITFIELD_SEGMENT_BITS + rx_bitfield_segment_ctz(dirty);
+    last = segment_index * RX_BITFIELD_SEGMENT_BITS + (RX_BITFIELD_SEGMENT_BITS - 1 - rx_bitfield_segment_clz(dirty));
+  }
 
-  CGLContextObj cgl_ctx = [g_worldView loadContext];
-  CGLLockContext(cgl_ctx);
+  if (first == RX_BITFIELD_NOT_FOUND)
+    return;
 
-  // create a buffer object in which to decompress dynamic pictures, which at most can be the size of the card viewport
-  glGenBuffers(1, &dynamic_picture_unpack_buffer);
-  glReportError();
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, dynamic_picture_unpack_buffer);
+  // upload the dirty range with a single call; it may include clean pictures, whose staged vertices are still current
+  size_t picture_size = RX_DYNAMIC_PICTURE_FLOATS * sizeof(GLfloat);
+  glBindBuffer(GL_ARRAY_BUFFER, dynamic_picture_vertex_bo);
   glReportError();
-  glBufferParameteriAPPLE(GL_PIXEL_UNPACK_BUFFER, GL_BUFFER_FLUSHING_UNMAP_APPLE, GL_FALSE);
-  glBufferData(GL_PIXEL_UNPACK_BUFFER, 1024 * 1024 * 4, NULL, GL_DYNAMIC_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, first * picture_size, (last - first + 1) * picture_size,
+                  dynamic_picture_vertex_staging + first * RX_DYNAMIC_PICTURE_FLOATS);
   glReportError();
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-
-  // we created a new buffer object, so flush
-  glFlush();
-
-  CGLUnlockContext(cgl_ctx);
-
-  return dynamic_picture_unpack_buffer;
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 - (id)initWithTexture:(RXTexture*)texture samplingRect:(NSRect)sampling_rect renderRect:(NSRect)render_rect owner:(id)owner
 {
-  CGLContextObj cgl_ctx = [g_worldView loadContext];
-  CGLLockContext(cgl_ctx);
-
-  if (!dynamic_picture_system_initialized)
-    initialize_dynamic_picture_system();
-
-  OSSpinLockLock(&dynamic_picture_lock);
+  return [self initWithTexture:texture samplingRect:sampling_rect renderRect:render_rect owner:owner upload:nil];
+}
 
-  GLuint index = allocate_dynamic_picture_index();
+- (id)initWithTexture:(RXTexture*)texture
+         samplingRect:(NSRect)sampling_rect
+           renderRect:(NSRect)render_rect
+                owner:(id)owner
+               upload:(RXTextureUpload*)upload
+{
+  uintptr_t index = rx_bitfield_atomic_claim_first_clear(&dynamic_picture_allocation_bitmap);
+  if (index == RX_BITFIELD_NOT_FOUND) {
+    RXOLog2(kRXLoggingGraphics, kRXLoggingLevelError, @"out of dynamic picture slots (%d pictures alive)", RX_DYNAMIC_PICTURE_CAPACITY);
+    _index = UINT32_MAX;
+    [self release];
+    return nil;
+  }
 
-  glBindBuffer(GL_ARRAY_BUFFER, dynamic_picture_vertex_bo);
-  glReportError();
-  GLfloat* vertex_attributes = (GLfloat*)BUFFER_OFFSET(glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY), index * 16 * sizeof(GLfloat));
-  glReportError();
+  GLfloat* vertex_attributes = dynamic_picture_vertex_staging + index * RX_DYNAMIC_PICTURE_FLOATS;
 
   // 4 vertices per picture [<position.x position.y> <texcoord0.s texcoord0.t>], floats, triangle strip primitives
   // vertex 1
@@ -234,18 +153,16 @@ static void free_dynamic_picture_index(GLuint index)
   vertex_attributes[14] = sampling_rect.origin.x + sampling_rect.size.width;
   vertex_attributes[15] = sampling_rect.origin.y;
 
-  glFlushMappedBufferRangeAPPLE(GL_ARRAY_BUFFER, index * 16 * sizeof(GLfloat), 16);
-  glUnmapBuffer(GL_ARRAY_BUFFER);
-  glReportError();
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-  OSSpinLockUnlock(&dynamic_picture_lock);
-  CGLUnlockContext(cgl_ctx);
+  // publish the vertices to the render thread
+  rx_bitfield_atomic_set(&dynamic_picture_dirty_bitmap, index);
 
-  self = [super initWithTexture:texture vao:dynamic_picture_vao index:index << 2 owner:owner];
-  if (!self)
+  self = [super initWithTexture:texture vao:dynamic_picture_vao index:(GLuint)index << 2 owner:owner];
+  if (!self) {
+    rx_bitfield_atomic_clear(&dynamic_picture_allocation_bitmap, index);
     return nil;
+  }
+
+  _upload = [upload retain];
 
   return self;
 }
@@ -256,20 +173,29 @@ static void free_dynamic_picture_index(GLuint index)
   RXOLog2(kRXLoggingGraphics, kRXLoggingLevelDebug, @"deallocating");
 #endif
 
-  if (_index != UINT32_MAX) {
-    OSSpinLockLock(&dynamic_picture_lock);
-    free_dynamic_picture_index(_index >> 2);
-    OSSpinLockUnlock(&dynamic_picture_lock);
-  }
+  if (_index != UINT32_MAX)
+    rx_bitfield_atomic_clear(&dynamic_picture_allocation_bitmap, _index >> 2);
+
+  [_upload release];
 
   [super dealloc];
 }
 
+- (BOOL)isReadyToRender { return !_upload || [_upload isComplete]; }
+
+- (BOOL)uploadFailed { return [_upload error] != nil; }
+
 - (void)render:(const CVTimeStamp*)output_time inContext:(CGLContextObj)cgl_ctx framebuffer:(GLuint)fbo
 {
-  OSSpinLockLock(&dynamic_picture_lock);
+  // WARNING: MUST RUN IN THE CORE VIDEO RENDER THREAD
+
+  // the card state only renders pictures that are ready, so the upload has completed by now
+  if ([self uploadFailed]) {
+    RXOLog2(kRXLoggingGraphics, kRXLoggingLevelError, @"not rendering picture because its upload failed: %@", [_upload error]);
+    return;
+  }
+
   [super render:output_time inContext:cgl_ctx framebuffer:fbo];
-  OSSpinLockUnlock(&dynamic_picture_lock);
 }
 
 @end
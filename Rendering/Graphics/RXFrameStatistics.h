@@ -0,0 +1,133 @@
+//
+//  RXFrameStatistics.h
+//  rivenx
+//
+
+#if !defined(RX_FRAME_STATISTICS_H)
+#define RX_FRAME_STATISTICS_H
+
+#if !defined(__cplusplus)
+#error C++ is required to include RXFrameStatistics.h
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+
+#include <mach/mach_time.h>
+
+#include <CoreVideo/CVBase.h>
+#include <OpenGL/OpenGL.h>
+#include <OpenGL/gl.h>
+
+namespace RX {
+
+// Phases of a card frame. A frame starts in the card renderer's render method, continues in its main render target method, and ends
+// with its post-flush tasks after the world view has swapped buffers.
+enum FramePhase {
+  kFramePhaseStaticPictures = 0,
+  kFramePhaseWater,
+  kFramePhaseMovies,
+  kFramePhaseComposite, // transition priming and the final composite, with or without a transition
+  kFramePhaseInventory,
+  kFramePhaseDebug,     // hotspot and text debug overlays, and the frame statistics graph
+  kFramePhaseSwap,      // everything the world view does between the main render target and the post-flush tasks, mostly the buffer swap
+  kFramePhasePostFlush,
+  kFramePhaseCount
+};
+
+// frame flags, to correlate slow frames with what was on screen
+enum {
+  kFrameFlagTransition = 1 << 0,
+  kFrameFlagMovie = 1 << 1,
+  kFrameFlagWater = 1 << 2,
+  kFrameFlagCredits = 1 << 3,
+  kFrameFlagStaticRefresh = 1 << 4,
+};
+
+struct FrameRecord {
+  enum { kGPUTimeUnavailable = UINT32_MAX };
+
+  uint64_t index;
+  uint64_t host_time;                   // output host time of the frame
+  uint32_t phase_us[kFramePhaseCount];  // CPU time of each phase, in microseconds
+  uint32_t cpu_us;                      // CPU time from the start of the frame to the end of its post-flush tasks
+  uint32_t gpu_us;                      // GPU time of the frame; filled in a few frames later, once the timer query result is available
+  uint32_t missed_vsyncs;               // refresh periods skipped between the previous frame and this one
+  uint32_t flags;
+};
+
+// Per-frame timing for the card renderer. Records live in a fixed ring with exactly one writer, the Core Video render thread, which
+// publishes a frame by bumping an atomic frame counter. Readers on any thread copy records out of the ring and discard the ones the
+// writer may have overwritten during the copy, so neither side ever blocks. GPU time comes from GL_EXT_timer_query queries that are read
+// back without stalling when their results become available.
+class FrameStatistics {
+public:
+  enum { kRecordCapacity = 1024, kQueryCount = 6, kGraphFrameCount = 240 };
+
+  FrameStatistics() noexcept;
+  ~FrameStatistics() noexcept;
+
+  // render thread only; the context is the render context and must be locked
+  void BeginFrame(const CVTimeStamp* output_time, CGLContextObj cgl_ctx, bool gpu_timing) noexcept;
+  void EndGPUTiming(CGLContextObj cgl_ctx) noexcept;
+  void EndFrame() noexcept;
+
+  // a phase can run several times in a frame; ending a phase that was not begun in the current frame does nothing
+  inline void BeginPhase(FramePhase phase) noexcept { _phase_start[phase] = mach_absolute_time(); }
+  void EndPhase(FramePhase phase) noexcept;
+  inline void SetFlags(uint32_t flags) noexcept { _current.flags |= flags; }
+
+  inline bool InFrame() const noexcept { return _in_frame; }
+
+  // draws a graph of the most recent frames with its top left corner at the given point, in main render target coordinates
+  void RenderGraph(CGLContextObj cgl_ctx, float left, float top) noexcept;
+
+  // any thread; copies up to count of the most recent records, oldest first, and returns the number of records copied
+  size_t CopyRecords(FrameRecord* records, size_t count) const noexcept;
+
+  // any thread; writes every record in the ring as CSV
+  bool WriteCSV(FILE* file) const noexcept;
+
+  static const char* PhaseName(FramePhase phase) noexcept;
+
+private:
+  FrameStatistics(const FrameStatistics&) = delete;
+  FrameStatistics& operator=(const FrameStatistics&) = delete;
+
+  void CreateQueries(CGLContextObj cgl_ctx) noexcept;
+  void PollQueries(CGLContextObj cgl_ctx) noexcept;
+
+  FrameRecord _records[kRecordCapacity];
+  std::atomic<uint64_t> _published;
+
+  // render thread state
+  FrameRecord _current;
+  uint64_t _frame_start;
+  uint64_t _phase_start[kFramePhaseCount];
+  int64_t _previous_video_time;
+  int64_t _refresh_period;
+  int32_t _video_time_scale;
+  bool _in_frame;
+
+  // timer queries, in a ring; _query_frames holds the index of the frame each pending query measures
+  GLuint _queries[kQueryCount];
+  uint64_t _query_frames[kQueryCount];
+  uint32_t _query_head;
+  uint32_t _query_pending;
+  bool _queries_initialized;
+  bool _timer_query_supported;
+  bool _query_active;
+
+  // graph scratch space, so that drawing the graph does not allocate
+  struct GraphVertex {
+    GLfloat x, y;
+    GLubyte color[4];
+  };
+  FrameRecord* _graph_records;
+  GraphVertex* _graph_vertices;
+  GLuint _graph_vao;
+};
+}
+
+#endif // RX_FRAME_STATISTICS_H
@@ -0,0 +1,363 @@
+//
+//  RXFrameStatistics.mm
+//  rivenx
+//
+
+#import "Rendering/Graphics/RXFrameStatistics.h"
+
+#import <math.h>
+#import <string.h>
+
+#import <GLUT/glut.h>
+
+#import "Base/RXLogging.h"
+#import "Base/RXTiming.h"
+#import "Rendering/RXRendering.h"
+
+namespace RX {
+
+// graph geometry, in pixels; 4 pixels per millisecond puts a 60 Hz refresh period at two thirds of the graph
+static const float kGraphHeight = 100.0f;
+static const float kGraphPixelsPerMicrosecond = 4.0f / 1000.0f;
+static const float kGraphMissedVsyncMarkerHeight = 6.0f;
+
+// one color per phase, plus one for the untracked remainder of a frame
+static const GLubyte kGraphPhaseColors[kFramePhaseCount + 1][4] = {
+    {64, 128, 255, 255},  // static pictures
+    {0, 200, 200, 255},   // water
+    {255, 160, 0, 255},   // movies
+    {200, 64, 255, 255},  // composite
+    {255, 255, 0, 255},   // inventory
+    {128, 128, 128, 255}, // debug
+    {0, 160, 64, 255},    // swap
+    {255, 96, 160, 255},  // post-flush
+    {64, 64, 64, 255},    // untracked
+};
+
+static const size_t kGraphVertexCount = FrameStatistics::kGraphFrameCount * ((kFramePhaseCount + 1) * 2 + 2 + 1) + 6;
+
+// frame records store durations as 32-bit microsecond counts
+static inline uint32_t HostDeltaToRecordMicroseconds(uint64_t delta) noexcept
+{
+  uint64_t us = RXTimingHostDeltaToMicroseconds(delta);
+  return (us > UINT32_MAX - 1) ? UINT32_MAX - 1 : (uint32_t)us;
+}
+
+FrameStatistics::FrameStatistics() noexcept
+    : _published(0), _frame_start(0), _previous_video_time(0), _refresh_period(0), _video_time_scale(0), _in_frame(false), _query_head(0),
+      _query_pending(0), _queries_initialized(false), _timer_query_supported(false), _query_active(false), _graph_vao(0)
+{
+  memset(_records, 0, sizeof(_records));
+  memset(&_current, 0, sizeof(_current));
+  memset(_phase_start, 0, sizeof(_phase_start));
+  memset(_queries, 0, sizeof(_queries));
+  memset(_query_frames, 0, sizeof(_query_frames));
+
+  _graph_records = new FrameRecord[kGraphFrameCount];
+  _graph_vertices = new GraphVertex[kGraphVertexCount];
+}
+
+// the query objects and graph VAO belong to the render context and go away with it
+FrameStatistics::~FrameStatistics() noexcept
+{
+  delete[] _graph_records;
+  delete[] _graph_vertices;
+}
+
+const char* FrameStatistics::PhaseName(FramePhase phase) noexcept
+{
+  static const char* names[kFramePhaseCount] = {"static_pictures", "water", "movies", "composite", "inventory", "debug", "swap", "post_flush"};
+  return (phase < kFramePhaseCount) ? names[phase] : "unknown";
+}
+
+#pragma mark -
+
+void FrameStatistics::CreateQueries(CGLContextObj cgl_ctx) noexcept
+{
+  _queries_initialized = true;
+  _timer_query_supported = gluCheckExtension((const GLubyte*)"GL_EXT_timer_query", glGetString(GL_EXTENSIONS));
+  if (!_timer_query_supported) {
+    RXCFLog(kRXLoggingGraphics, kRXLoggingLevelMessage, CFSTR("GL_EXT_timer_query is not supported, frame statistics will not include GPU time"));
+    return;
+  }
+
+  glGenQueries(kQueryCount, _queries);
+  glReportError();
+}
+
+void FrameStatistics::PollQueries(CGLContextObj cgl_ctx) noexcept
+{
+  // read back the oldest pending queries, in order, and stop at the first one that is not done
+  while (_query_pending > 0) {
+    uint32_t query_i = (_query_head + kQueryCount - _query_pending) % kQueryCount;
+
+    GLint available = 0;
+    glGetQueryObjectiv(_queries[query_i], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      break;
+
+    GLuint64EXT elapsed_ns = 0;
+    glGetQueryObjectui64vEXT(_queries[query_i], GL_QUERY_RESULT, &elapsed_ns);
+    _query_pending--;
+
+    // the record may already have been overwritten if the ring wrapped around
+    FrameRecord* record = _records + (_query_frames[query_i] % kRecordCapacity);
+    if (record->index == _query_frames[query_i])
+      __atomic_store_n(&record->gpu_us, (uint32_t)(elapsed_ns / 1000), __ATOMIC_RELAXED);
+  }
+  glReportError();
+}
+
+void FrameStatistics::BeginFrame(const CVTimeStamp* output_time, CGLContextObj cgl_ctx, bool gpu_timing) noexcept
+{
+  _frame_start = mach_absolute_time();
+
+  memset(&_current, 0, sizeof(_current));
+  memset(_phase_start, 0, sizeof(_phase_start));
+  _current.index = _published.load(std::memory_order_relaxed);
+  _current.host_time = output_time->hostTime;
+  _current.gpu_us = FrameRecord::kGPUTimeUnavailable;
+
+  // count the refresh periods skipped since the previous frame
+  if (output_time->flags & kCVTimeStampVideoTimeValid) {
+    if (output_time->flags & kCVTimeStampVideoRefreshPeriodValid) {
+      _refresh_period = output_time->videoRefreshPeriod;
+      _video_time_scale = output_time->videoTimeScale;
+    }
+
+    if (_previous_video_time != 0 && _refresh_period > 0) {
+      int64_t periods = (output_time->videoTime - _previous_video_time + _refresh_period / 2) / _refresh_period;
+      _current.missed_vsyncs = (periods > 1) ? (uint32_t)(periods - 1) : 0;
+    }
+    _previous_video_time = output_time->videoTime;
+  }
+
+  if (!_queries_initialized)
+    CreateQueries(cgl_ctx);
+
+  if (_timer_query_supported) {
+    // a frame that did not reach its main render target leaves its query open
+    if (_query_active)
+      EndGPUTiming(cgl_ctx);
+
+    PollQueries(cgl_ctx);
+
+    // skip GPU timing for this frame if every query is still in flight rather than waiting on one
+    if (gpu_timing && _query_pending < kQueryCount) {
+      _query_frames[_query_head] = _current.index;
+      glBeginQuery(GL_TIME_ELAPSED_EXT, _queries[_query_head]);
+      glReportError();
+      _query_active = true;
+    }
+  }
+
+  _in_frame = true;
+}
+
+void FrameStatistics::EndGPUTiming(CGLContextObj cgl_ctx) noexcept
+{
+  if (!_query_active)
+    return;
+
+  glEndQuery(GL_TIME_ELAPSED_EXT);
+  glReportError();
+  _query_active = false;
+
+  _query_head = (_query_head + 1) % kQueryCount;
+  _query_pending++;
+}
+
+void FrameStatistics::EndPhase(FramePhase phase) noexcept
+{
+  if (!_phase_start[phase])
+    return;
+  _current.phase_us[phase] += HostDeltaToRecordMicroseconds(mach_absolute_time() - _phase_start[phase]);
+  _phase_start[phase] = 0;
+}
+
+void FrameStatistics::EndFrame() noexcept
+{
+  if (!_in_frame)
+    return;
+  _in_frame = false;
+
+  _current.cpu_us = HostDeltaToRecordMicroseconds(mach_absolute_time() - _frame_start);
+
+  // publish the record; readers discard records the counter says may be torn
+  _records[_current.index % kRecordCapacity] = _current;
+  _published.store(_current.index + 1, std::memory_order_release);
+}
+
+#pragma mark -
+
+size_t FrameStatistics::CopyRecords(FrameRecord* records, size_t count) const noexcept
+{
+  uint64_t end = _published.load(std::memory_order_acquire);
+  uint64_t start = (end > count) ? end - count : 0;
+  if (end - start > kRecordCapacity)
+    start = end - kRecordCapacity;
+
+  for (uint64_t i = start; i < end; i++)
+    records[i - start] = _records[i % kRecordCapacity];
+  std::atomic_thread_fence(std::memory_order_acquire);
+
+  // the writer may have overwritten the oldest records while we were copying them; the slot of the next frame is always unsafe
+  uint64_t published = _published.load(std::memory_order_relaxed);
+  uint64_t first_valid = (published + 1 > kRecordCapacity) ? published + 1 - kRecordCapacity : 0;
+  if (first_valid <= start)
+    return (size_t)(end - start);
+  if (first_valid >= end)
+    return 0;
+
+  memmove(records, records + (first_valid - start), (size_t)(end - first_valid) * sizeof(FrameRecord));
+  return (size_t)(end - first_valid);
+}
+
+bool FrameStatistics::WriteCSV(FILE* file) const noexcept
+{
+  FrameRecord* records = new FrameRecord[kRecordCapacity];
+  size_t count = CopyRecords(records, kRecordCapacity);
+
+  fprintf(file, "frame,host_time");
+  for (uint32_t phase = 0; phase < kFramePhaseCount; phase++)
+    fprintf(file, ",%s_us", PhaseName((FramePhase)phase));
+  fprintf(file, ",cpu_us,gpu_us,missed_vsyncs,transition,movie,water,credits,static_refresh\n");
+
+  for (size_t i = 0; i < count; i++) {
+    const FrameRecord& record = records[i];
+    fprintf(file, "%llu,%llu", record.index, record.host_time);
+    for (uint32_t phase = 0; phase < kFramePhaseCount; phase++)
+      fprintf(file, ",%u", record.phase_us[phase]);
+
+    if (record.gpu_us == FrameRecord::kGPUTimeUnavailable)
+      fprintf(file, ",%u,", record.cpu_us);
+    else
+      fprintf(file, ",%u,%u", record.cpu_us, record.gpu_us);
+
+    fprintf(file, ",%u,%d,%d,%d,%d,%d\n", record.missed_vsyncs, (record.flags & kFrameFlagTransition) != 0, (record.flags & kFrameFlagMovie) != 0,
+            (record.flags & kFrameFlagWater) != 0, (record.flags & kFrameFlagCredits) != 0, (record.flags & kFrameFlagStaticRefresh) != 0);
+  }
+
+  delete[] records;
+  return ferror(file) == 0;
+}
+
+#pragma mark -
+
+void FrameStatistics::RenderGraph(CGLContextObj cgl_ctx, float left, float top) noexcept
+{
+  NSObject<RXOpenGLStateProtocol>* gl_state = RXGetContextState(cgl_ctx);
+
+  if (!_graph_vao) {
+    glGenVertexArraysAPPLE(1, &_graph_vao);
+    [gl_state bindVertexArrayObject:_graph_vao];
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glReportError();
+  } else {
+    [gl_state bindVertexArrayObject:_graph_vao];
+  }
+
+  size_t frame_count = CopyRecords(_graph_records, kGraphFrameCount);
+  float bottom = top - kGraphHeight;
+  float right = left + kGraphFrameCount;
+
+  static const GLubyte background_color[4] = {0, 0, 0, 255};
+  static const GLubyte refresh_color[4] = {0, 255, 0, 255};
+  static const GLubyte missed_color[4] = {255, 0, 0, 255};
+  static const GLubyte gpu_color[4] = {255, 255, 255, 255};
+
+  // background quad, then the refresh period line, then one stacked column per frame, then the GPU time points
+  GraphVertex* v = _graph_vertices;
+  auto add_vertex = [&v](float x, float y, const GLubyte* color) {
+    v->x = x;
+    v->y = y;
+    memcpy(v->color, color, 4);
+    v++;
+  };
+
+  add_vertex(left, bottom, background_color);
+  add_vertex(right, bottom, background_color);
+  add_vertex(right, top, background_color);
+  add_vertex(left, top, background_color);
+
+  float refresh_us = (_refresh_period > 0 && _video_time_scale > 0) ? 1.0e6f * (float)_refresh_period / (float)_video_time_scale : 1.0e6f / 60.0f;
+  float refresh_y = fminf(bottom + refresh_us * kGraphPixelsPerMicrosecond, top);
+  add_vertex(left, refresh_y, refresh_color);
+  add_vertex(right, refresh_y, refresh_color);
+
+  uint64_t cpu_sum = 0, gpu_sum = 0;
+  uint32_t cpu_max = 0, gpu_count = 0, missed_sum = 0;
+  for (size_t i = 0; i < frame_count; i++) {
+    const FrameRecord& record = _graph_records[i];
+    float x = left + i + 0.5f;
+    float y = bottom;
+
+    uint32_t tracked_us = 0;
+    for (uint32_t phase = 0; phase <= kFramePhaseCount; phase++) {
+      uint32_t us;
+      if (phase < kFramePhaseCount) {
+        us = record.phase_us[phase];
+        tracked_us += us;
+      } else {
+        us = (record.cpu_us > tracked_us) ? record.cpu_us - tracked_us : 0;
+      }
+
+      float next_y = fminf(y + us * kGraphPixelsPerMicrosecond, top);
+      add_vertex(x, y, kGraphPhaseColors[phase]);
+      add_vertex(x, next_y, kGraphPhaseColors[phase]);
+      y = next_y;
+    }
+
+    if (record.missed_vsyncs) {
+      add_vertex(x, top - kGraphMissedVsyncMarkerHeight, missed_color);
+      add_vertex(x, top, missed_color);
+    }
+
+    cpu_sum += record.cpu_us;
+    cpu_max = (record.cpu_us > cpu_max) ? record.cpu_us : cpu_max;
+    missed_sum += record.missed_vsyncs;
+  }
+  GLsizei line_vertex_count = (GLsizei)(v - _graph_vertices) - 4;
+
+  GraphVertex* points = v;
+  for (size_t i = 0; i < frame_count; i++) {
+    const FrameRecord& record = _graph_records[i];
+    if (record.gpu_us == FrameRecord::kGPUTimeUnavailable)
+      continue;
+    add_vertex(left + i + 0.5f, fminf(bottom + record.gpu_us * kGraphPixelsPerMicrosecond, top), gpu_color);
+    gpu_sum += record.gpu_us;
+    gpu_count++;
+  }
+  GLsizei point_vertex_count = (GLsizei)(v - points);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glVertexPointer(2, GL_FLOAT, sizeof(GraphVertex), &_graph_vertices->x);
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(GraphVertex), _graph_vertices->color);
+  glReportError();
+
+  glDrawArrays(GL_QUADS, 0, 4);
+  glDrawArrays(GL_LINES, 4, line_vertex_count);
+  if (point_vertex_count)
+    glDrawArrays(GL_POINTS, (GLint)(points - _graph_vertices), point_vertex_count);
+  glReportError();
+
+  [gl_state bindVertexArrayObject:0];
+
+  // summary line under the graph
+  char summary[100];
+  if (gpu_count)
+    snprintf(summary, sizeof(summary), "cpu %.2f ms (max %.2f)  gpu %.2f ms  missed vsyncs %u", (frame_count) ? cpu_sum / (1000.0 * frame_count) : 0.0,
+             cpu_max / 1000.0, gpu_sum / (1000.0 * gpu_count), missed_sum);
+  else
+    snprintf(summary, sizeof(summary), "cpu %.2f ms (max %.2f)  missed vsyncs %u", (frame_count) ? cpu_sum / (1000.0 * frame_count) : 0.0,
+             cpu_max / 1000.0, missed_sum);
+
+  glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+  glRasterPos3d(left, bottom - 13.0f, 0.0f);
+  size_t l = strlen(summary);
+  for (size_t i = 0; i < l; i++)
+    glutBitmapCharacter(GLUT_BITMAP_8_BY_13, summary[i]);
+  glReportError();
+}
+}
@@ -0,0 +1,219 @@
+//
+//  RXSoftwareCompositor.c
+//  rivenx
+//
+
+#include "Rendering/Graphics/RXSoftwareCompositor.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static bool rx_soft_surface_alloc(rx_soft_surface_t* surface, uint32_t width, uint32_t height)
+{
+  surface->pixels = (uint32_t*)calloc((size_t)width * height, sizeof(uint32_t));
+  surface->width = width;
+  surface->height = height;
+  surface->stride = width;
+  return surface->pixels != NULL;
+}
+
+bool rx_soft_compositor_init(rx_soft_compositor_t* compositor)
+{
+  memset(compositor, 0, sizeof(rx_soft_compositor_t));
+  if (!rx_soft_surface_alloc(&compositor->static_card, RX_SOFT_CARD_WIDTH, RX_SOFT_CARD_HEIGHT) ||
+      !rx_soft_surface_alloc(&compositor->water_card, RX_SOFT_CARD_WIDTH, RX_SOFT_CARD_HEIGHT) ||
+      !rx_soft_surface_alloc(&compositor->card, RX_SOFT_CARD_WIDTH, RX_SOFT_CARD_HEIGHT)) {
+    rx_soft_compositor_destroy(compositor);
+    return false;
+  }
+  return true;
+}
+
+void rx_soft_compositor_destroy(rx_soft_compositor_t* compositor)
+{
+  free(compositor->static_card.pixels);
+  free(compositor->water_card.pixels);
+  free(compositor->card.pixels);
+  memset(compositor, 0, sizeof(rx_soft_compositor_t));
+}
+
+void rx_soft_fill(rx_soft_surface_t* dst, uint32_t pixel)
+{
+  for (uint32_t y = 0; y < dst->height; y++) {
+    uint32_t* row = dst->pixels + (size_t)y * dst->stride;
+    for (uint32_t x = 0; x < dst->width; x++)
+      row[x] = pixel;
+  }
+}
+
+static void rx_soft_copy(rx_soft_surface_t* dst, const rx_soft_surface_t* src)
+{
+  uint32_t width = (dst->width < src->width) ? dst->width : src->width;
+  uint32_t height = (dst->height < src->height) ? dst->height : src->height;
+  for (uint32_t y = 0; y < height; y++)
+    memcpy(dst->pixels + (size_t)y * dst->stride, src->pixels + (size_t)y * src->stride, width << 2);
+}
+
+void rx_soft_blit(rx_soft_surface_t* dst, rx_core_rect_t dst_rect, const rx_soft_surface_t* src, rx_core_rect_t src_rect)
+{
+  int32_t dst_width = (int32_t)dst_rect.right - dst_rect.left, dst_height = (int32_t)dst_rect.bottom - dst_rect.top;
+  int32_t src_width = (int32_t)src_rect.right - src_rect.left, src_height = (int32_t)src_rect.bottom - src_rect.top;
+  if (dst_width <= 0 || dst_height <= 0 || src_width <= 0 || src_height <= 0)
+    return;
+
+  // clip the destination to the surface; the source is clipped per pixel below, so that clipping never shifts the sampling
+  int32_t x0 = dst_rect.left, y0 = dst_rect.top;
+  int32_t x1 = ((uint32_t)dst_rect.right > dst->width) ? (int32_t)dst->width : dst_rect.right;
+  int32_t y1 = ((uint32_t)dst_rect.bottom > dst->height) ? (int32_t)dst->height : dst_rect.bottom;
+  if (x0 >= x1 || y0 >= y1)
+    return;
+
+  if (dst_width == src_width && dst_height == src_height) {
+    // unscaled: straight row copies
+    int32_t sx = src_rect.left, sy = src_rect.top;
+    int32_t copy_width = x1 - x0;
+    if (sx + copy_width > (int32_t)src->width)
+      copy_width = (int32_t)src->width - sx;
+    if (copy_width <= 0)
+      return;
+    for (int32_t y = y0; y < y1 && sy + (y - y0) < (int32_t)src->height; y++)
+      memcpy(dst->pixels + (size_t)y * dst->stride + x0, src->pixels + (size_t)(sy + y - y0) * src->stride + sx, (size_t)copy_width << 2);
+    return;
+  }
+
+  // scaled: nearest neighbor at pixel centers, in 16.16 fixed point so that every platform samples the same pixels
+  uint32_t step_x = ((uint32_t)src_width << 16) / (uint32_t)dst_width;
+  uint32_t step_y = ((uint32_t)src_height << 16) / (uint32_t)dst_height;
+  for (int32_t y = y0; y < y1; y++) {
+    uint32_t sy = src_rect.top + (uint32_t)((((uint64_t)(y - y0) * step_y) + (step_y >> 1)) >> 16);
+    if (sy >= src->height)
+      break;
+    const uint32_t* src_row = src->pixels + (size_t)sy * src->stride;
+    uint32_t* dst_row = dst->pixels + (size_t)y * dst->stride;
+    uint64_t fx = (step_x >> 1);
+    for (int32_t x = x0; x < x1; x++, fx += step_x) {
+      uint32_t sx = src_rect.left + (uint32_t)(fx >> 16);
+      if (sx < src->width)
+        dst_row[x] = src_row[sx];
+    }
+  }
+}
+
+// dst = (src * a + dst * (256 - a)) / 256 per channel, with a in [0, 256]
+static inline uint32_t rx_soft_blend_pixel(uint32_t src, uint32_t dst, uint32_t a)
+{
+  uint32_t ia = 256 - a;
+  uint32_t rb = (((src & 0x00ff00ff) * a + (dst & 0x00ff00ff) * ia) >> 8) & 0x00ff00ff;
+  uint32_t ag = ((((src >> 8) & 0x00ff00ff) * a + ((dst >> 8) & 0x00ff00ff) * ia) >> 8) & 0x00ff00ff;
+  return rb | (ag << 8);
+}
+
+static void rx_soft_blend_row(uint32_t* dst, const uint32_t* src, uint32_t count, uint32_t a)
+{
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  // same arithmetic as rx_soft_blend_pixel, four pixels at a time on 16-bit lanes
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi16((short)a);
+  const __m128i inverse_alpha = _mm_set1_epi16((short)(256 - a));
+  for (; i + 4 <= count; i += 4) {
+    __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), alpha), _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inverse_alpha));
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), alpha), _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inverse_alpha));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+  }
+#endif
+  for (; i < count; i++)
+    dst[i] = rx_soft_blend_pixel(src[i], dst[i], a);
+}
+
+void rx_soft_blend(rx_soft_surface_t* dst, int32_t x, int32_t y, int32_t width, int32_t height, const rx_soft_surface_t* src, float alpha)
+{
+  if (width <= 0 || height <= 0 || src->width == 0 || src->height == 0 || !(alpha > 0.0f))
+    return;
+  uint32_t a = (alpha >= 1.0f) ? 256 : (uint32_t)(alpha * 256.0f + 0.5f);
+
+  int32_t x0 = (x < 0) ? 0 : x, y0 = (y < 0) ? 0 : y;
+  int32_t x1 = (x + width > (int32_t)dst->width) ? (int32_t)dst->width : x + width;
+  int32_t y1 = (y + height > (int32_t)dst->height) ? (int32_t)dst->height : y + height;
+  if (x0 >= x1 || y0 >= y1)
+    return;
+
+  uint32_t step_x = (src->width << 16) / (uint32_t)width;
+  uint32_t step_y = (src->height << 16) / (uint32_t)height;
+  uint32_t span = (uint32_t)(x1 - x0);
+
+  bool scaled = (uint32_t)width != src->width;
+
+  for (int32_t row = y0; row < y1; row++) {
+    uint32_t sy = (uint32_t)((((uint64_t)(row - y) * step_y) + (step_y >> 1)) >> 16);
+    if (sy >= src->height)
+      sy = src->height - 1;
+    const uint32_t* src_row = src->pixels + (size_t)sy * src->stride;
+    uint32_t* dst_row = dst->pixels + (size_t)row * dst->stride + x0;
+
+    if (!scaled) {
+      rx_soft_blend_row(dst_row, src_row + (x0 - x), span, a);
+      continue;
+    }
+
+    // scaled items are sampled into a stack buffer and blended a chunk of the row at a time
+    uint32_t scratch[256];
+    uint64_t fx = (uint64_t)(x0 - x) * step_x + (step_x >> 1);
+    for (uint32_t chunk_start = 0; chunk_start < span; chunk_start += 256) {
+      uint32_t chunk = (span - chunk_start < 256) ? span - chunk_start : 256;
+      for (uint32_t i = 0; i < chunk; i++, fx += step_x) {
+        uint32_t sx = (uint32_t)(fx >> 16);
+        scratch[i] = src_row[(sx < src->width) ? sx : src->width - 1];
+      }
+      rx_soft_blend_row(dst_row + chunk_start, scratch, chunk, a);
+    }
+  }
+}
+
+void rx_soft_compose_card_frame(rx_soft_compositor_t* compositor, const rx_soft_card_frame_t* card_frame, rx_soft_surface_t* frame)
+{
+  // static card: the pictures over black, in order
+  if (card_frame->refresh_static) {
+    rx_soft_fill(&compositor->static_card, 0xff000000);
+    for (uint32_t i = 0; i < card_frame->picture_count; i++) {
+      const rx_soft_picture_t* picture = card_frame->pictures + i;
+      rx_soft_blit(&compositor->static_card, picture->render_rect, picture->source, picture->sampling_rect);
+    }
+    compositor->water_primed = false;
+  }
+
+  // water: the effect surface starts as a copy of the static card and every SFXE frame rewrites some of its spans from the static card
+  const rx_soft_surface_t* card_source = &compositor->static_card;
+  if (card_frame->water) {
+    if (!compositor->water_primed) {
+      rx_soft_copy(&compositor->water_card, &compositor->static_card);
+      compositor->water_primed = true;
+    }
+    rx_sfxe_execute_frame(card_frame->water, card_frame->water_frame, compositor->water_card.pixels, compositor->static_card.pixels);
+    card_source = &compositor->water_card;
+  }
+
+  // overlays go over a copy, so that movies never leak into the static or water surfaces
+  rx_soft_surface_t* card = &compositor->card;
+  rx_soft_copy(card, card_source);
+  for (uint32_t i = 0; i < card_frame->overlay_count; i++) {
+    const rx_soft_picture_t* overlay = card_frame->overlays + i;
+    rx_soft_blit(card, overlay->render_rect, overlay->source, overlay->sampling_rect);
+  }
+
+  // the card goes at the top of the frame, above the black inventory band
+  rx_soft_copy(frame, card);
+  rx_soft_surface_t band = {frame->pixels + (size_t)card->height * frame->stride, frame->width, frame->height - card->height, frame->stride};
+  rx_soft_fill(&band, 0xff000000);
+
+  for (uint32_t i = 0; i < card_frame->inventory_count; i++) {
+    const rx_soft_inventory_item_t* item = card_frame->inventory + i;
+    rx_soft_blend(frame, item->x, item->y, item->width, item->height, item->source, item->alpha);
+  }
+}
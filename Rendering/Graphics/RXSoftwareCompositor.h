@@ -0,0 +1,100 @@
+//
+//  RXSoftwareCompositor.h
+//  rivenx
+//
+
+#if !defined(RX_SOFTWARE_COMPOSITOR_H)
+#define RX_SOFTWARE_COMPOSITOR_H
+
+#include <sys/cdefs.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "Rendering/Graphics/RXWaterEffect.h"
+
+__BEGIN_DECLS
+
+// A CPU reference for the card renderer. It composites what the card state renders with OpenGL into a BGRA frame the size of the
+// renderer viewport: the static card pictures, the water effect over them, movie frames and other overlays, then the inventory band
+// below the card with its items blended in with their current alpha. It only depends on the C runtime, so it runs headless on any
+// platform, and it is what golden-image tests and compositing benchmarks run against.
+
+#define RX_SOFT_FRAME_WIDTH 608
+#define RX_SOFT_FRAME_HEIGHT 458
+#define RX_SOFT_CARD_WIDTH 608
+#define RX_SOFT_CARD_HEIGHT 392
+
+// 32-bit BGRA pixels, top row first; stride is in pixels
+struct rx_soft_surface {
+  uint32_t* pixels;
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;
+};
+typedef struct rx_soft_surface rx_soft_surface_t;
+
+// a picture samples a rect of its source, in source pixels, and draws it over a rect of the card; the rects only differ in size for
+// scaled pictures, which are sampled with nearest neighbor filtering
+struct rx_soft_picture {
+  const rx_soft_surface_t* source;
+  rx_core_rect_t sampling_rect;
+  rx_core_rect_t render_rect;
+};
+typedef struct rx_soft_picture rx_soft_picture_t;
+
+// an inventory item draws its whole source scaled over a rect of the frame, blended with a constant alpha
+struct rx_soft_inventory_item {
+  const rx_soft_surface_t* source;
+  int32_t x;
+  int32_t y;
+  int32_t width;
+  int32_t height;
+  float alpha;
+};
+typedef struct rx_soft_inventory_item rx_soft_inventory_item_t;
+
+struct rx_soft_card_frame {
+  // static pictures, in drawing order; the static card is only recomposed when refresh_static is set
+  const rx_soft_picture_t* pictures;
+  uint32_t picture_count;
+  bool refresh_static;
+
+  // water effect, or NULL; water_frame is the SFXE frame to run this frame
+  const rx_card_sfxe* water;
+  uint32_t water_frame;
+
+  // movie frames and other opaque overlays drawn over the card, in drawing order
+  const rx_soft_picture_t* overlays;
+  uint32_t overlay_count;
+
+  const rx_soft_inventory_item_t* inventory;
+  uint32_t inventory_count;
+};
+typedef struct rx_soft_card_frame rx_soft_card_frame_t;
+
+// card-sized surfaces the compositor keeps between frames, like the card renderer's static and water textures
+struct rx_soft_compositor {
+  rx_soft_surface_t static_card;
+  rx_soft_surface_t water_card;
+  rx_soft_surface_t card;
+  bool water_primed;
+};
+typedef struct rx_soft_compositor rx_soft_compositor_t;
+
+bool rx_soft_compositor_init(rx_soft_compositor_t* compositor);
+void rx_soft_compositor_destroy(rx_soft_compositor_t* compositor);
+
+// composites a card frame into a surface of at least RX_SOFT_FRAME_WIDTH by RX_SOFT_FRAME_HEIGHT pixels
+void rx_soft_compose_card_frame(rx_soft_compositor_t* compositor, const rx_soft_card_frame_t* card_frame, rx_soft_surface_t* frame);
+
+// blits (with scaling if needed) a rect of a source over a rect of a destination, clipping both to their surfaces
+void rx_soft_blit(rx_soft_surface_t* dst, rx_core_rect_t dst_rect, const rx_soft_surface_t* src, rx_core_rect_t src_rect);
+
+// blends a whole source scaled over a rect of a destination with a constant alpha
+void rx_soft_blend(rx_soft_surface_t* dst, int32_t x, int32_t y, int32_t width, int32_t height, const rx_soft_surface_t* src, float alpha);
+
+void rx_soft_fill(rx_soft_surface_t* dst, uint32_t pixel);
+
+__END_DECLS
+
+#endif // RX_SOFTWARE_COMPOSITOR_H
@@ -11,6 +11,8 @@
 #import "Rendering/RXRendering.h"
 #import "Engine/RXStack.h"
 
+@class RXTextureUpload;
+
 @interface RXTexture : NSObject {
 @public
   GLuint texture;
@@ -27,6 +29,10 @@
 
 - (void)bindWithContext:(CGLContextObj)cgl_ctx lock:(BOOL)lock;
 
+// starts decoding and uploading a picture into the texture on the texture uploader; the texture must not be used before the upload completes
+- (RXTextureUpload*)beginUpdateWithBitmap:(uint16_t)tbmp_id archive:(MHKArchive*)archive;
+
+// synchronous variants; they block until the upload is complete
 - (void)updateWithBitmap:(uint16_t)tbmp_id archive:(MHKArchive*)archive;
 - (void)updateWithBitmap:(uint16_t)tbmp_id stack:(RXStack*)stack;
 
@@ -8,37 +8,53 @@
 
 #import "Base/RXBase.h"
 
+#import <libkern/OSAtomic.h>
+
+#import "Base/RXBitfield.h"
 #import "Rendering/RXRendering.h"
 #import "Rendering/Graphics/RXTexture.h"
-#import "Base/RXDynamicBitfield.h"
 
+// A bucket of textures of a given size. Every slot is either empty, idle (it has a texture that is not in use) or in use. Empty slots
+// are found with a segment-level scan of the allocated bitfield, and idle slots are kept on a free list ordered from least to most recently
+// recycled, so that allocating a texture never scans more than one bit per word and trimming releases the coldest textures first.
 struct _rx_texture_bucket {
   GLsizei width;
   GLsizei height;
   GLuint* tex_ids;
-  RXDynamicBitfield* in_use;
+  rx_bitfield_t allocated;
+  uint32_t slot_capacity;
+
+  uint32_t* free_slots;
+  uint32_t free_count;
+  uint64_t* idle_since; // recycle tick of each slot
+
+  uint32_t texture_count;
+  uint32_t request_count;
 };
 
-#if defined(DEBUG)
-struct _bucket_stat {
-  GLsizei width;
-  GLsizei height;
-  GLuint count;
+struct rx_texture_broker_statistics {
+  uint64_t request_count;
+  uint64_t reuse_count;
+  uint64_t creation_count;
+  uint64_t trim_count;
+  uint32_t texture_count;
+  uint32_t idle_texture_count;
+  size_t vram;
+  size_t peak_vram;
+  size_t vram_budget;
 };
-#endif
 
 @interface RXTextureBroker : NSObject {
   CGLContextObj cgl_ctx;
   BOOL _toreDown;
 
+  OSSpinLock _lock;
   struct _rx_texture_bucket* _buckets;
   uint32_t _bucket_capacity;
   uint32_t _bucket_count;
 
-#if defined(DEBUG)
-  struct _bucket_stat* _bucket_stats;
-  uint32_t _bucket_stat_count;
-#endif
+  uint64_t _recycle_tick;
+  struct rx_texture_broker_statistics _statistics;
 }
 
 + (RXTextureBroker*)sharedTextureBroker;
@@ -46,6 +62,10 @@ struct _bucket_stat {
 - (RXTexture*)newTextureWithSize:(rx_size_t)size;
 - (RXTexture*)newTextureWithWidth:(GLsizei)width height:(GLsizei)height;
 
+// deletes idle textures, least recently recycled first, until the textures held by the broker fit in the given number of bytes
+- (void)trimToSize:(size_t)bytes;
+
+- (void)getStatistics:(struct rx_texture_broker_statistics*)statistics;
 - (void)_printDebugStats;
 
 @end
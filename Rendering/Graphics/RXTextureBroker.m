@@ -8,9 +8,11 @@
 
 #import "Rendering/Graphics/RXTextureBroker.h"
 
+#import "Engine/RXWorldProtocol.h"
+
 @interface RXBrokeredTexture : RXTexture {
 @public
-  struct _rx_texture_bucket* _bucket;
+  uint32_t _bucket_i;
   uint32_t _bucket_index;
 }
 @end
@@ -32,13 +34,15 @@
 
 @implementation RXTextureBroker
 
-static void allocate_texture_bucket(CGLContextObj cgl_ctx, struct _rx_texture_bucket* bucket, GLsizei width, GLsizei height)
+RX_INLINE size_t texture_bucket_texture_size(struct _rx_texture_bucket* bucket) { return (size_t)bucket->width * bucket->height * 4; }
+
+static void allocate_texture_bucket(struct _rx_texture_bucket* bucket, GLsizei width, GLsizei height)
 {
   release_assert(bucket);
 
   // initial bucket state
-  bucket->in_use = [RXDynamicBitfield new];
-  bucket->tex_ids = calloc([bucket->in_use segmentCount] * [bucket->in_use segmentBits], sizeof(GLuint));
+  bzero(bucket, sizeof(struct _rx_texture_bucket));
+  rx_bitfield_init(&bucket->allocated, 0);
   bucket->width = width;
   bucket->height = height;
 }
@@ -47,13 +51,23 @@ static void grow_texture_bucket(struct _rx_texture_bucket* bucket)
 {
   release_assert(bucket);
 
-  size_t old_size = [bucket->in_use segmentCount] * [bucket->in_use segmentBits] * sizeof(GLuint);
-  size_t new_size = ([bucket->in_use segmentCount] + 1) * [bucket->in_use segmentBits] * sizeof(GLuint);
-  bucket->tex_ids = realloc(bucket->tex_ids, new_size);
-  bzero(BUFFER_OFFSET(bucket->tex_ids, old_size), new_size - old_size);
+  // grow by one segment of slots
+  uint32_t old_capacity = bucket->slot_capacity;
+  uint32_t new_capacity = old_capacity + RX_BITFIELD_SEGMENT_BITS;
+
+  bucket->tex_ids = realloc(bucket->tex_ids, new_capacity * sizeof(GLuint));
+  bzero(bucket->tex_ids + old_capacity, (new_capacity - old_capacity) * sizeof(GLuint));
+
+  rx_bitfield_grow(&bucket->allocated, new_capacity / RX_BITFIELD_SEGMENT_BITS);
+
+  bucket->free_slots = realloc(bucket->free_slots, new_capacity * sizeof(uint32_t));
+  bucket->idle_since = realloc(bucket->idle_since, new_capacity * sizeof(uint64_t));
+
+  bucket->slot_capacity = new_capacity;
 
 #if defined(DEBUG)
-  RXLog(kRXLoggingGraphics, kRXLoggingLevelDebug, @"grew texture bucket (%ux%u)", bucket->width, bucket->height);
+  if (old_capacity)
+    RXLog(kRXLoggingGraphics, kRXLoggingLevelDebug, @"grew texture bucket (%ux%u)", bucket->width, bucket->height);
 #endif
 }
 
@@ -62,85 +76,78 @@ static inline void free_texture_bucket(CGLContextObj cgl_ctx, struct _rx_texture
   release_assert(bucket);
 
   CGLLockContext(cgl_ctx);
-  size_t max_tex = [bucket->in_use segmentCount] * [bucket->in_use segmentBits];
-  for (uintptr_t tex_index = 0; tex_index < max_tex; ++tex_index) {
+  for (uint32_t tex_index = 0; tex_index < bucket->slot_capacity; ++tex_index) {
     if (bucket->tex_ids[tex_index])
       glDeleteTextures(1, bucket->tex_ids + tex_index);
   }
   CGLUnlockContext(cgl_ctx);
 
   free(bucket->tex_ids);
-  [bucket->in_use release];
+  rx_bitfield_destroy(&bucket->allocated);
+  free(bucket->free_slots);
+  free(bucket->idle_since);
 }
 
-static inline GLuint find_texture(CGLContextObj cgl_ctx, struct _rx_texture_bucket* bucket, uint32_t* out_index)
+// returns the index of an empty slot, growing the bucket if every slot has a texture
+static inline uint32_t find_empty_slot(struct _rx_texture_bucket* bucket)
 {
-  release_assert(bucket);
-
-  // if all the bits are set, we need to grow the bucket
-  if ([bucket->in_use isAllSet])
+  uintptr_t slot = rx_bitfield_find_first_clear(&bucket->allocated);
+  if (slot >= bucket->slot_capacity)
     grow_texture_bucket(bucket);
+  return (uint32_t)slot;
+}
 
-  // find the first available texture
-  size_t max_tex = [bucket->in_use segmentCount] * [bucket->in_use segmentBits];
-  uint32_t tex_index = 0;
-  for (; tex_index < max_tex; ++tex_index) {
-    if (![bucket->in_use isSet:tex_index])
-      break;
-  }
+static GLuint create_texture(CGLContextObj cgl_ctx, GLsizei width, GLsizei height)
+{
+  GLuint texid = 0;
 
-  if (!bucket->tex_ids[tex_index]) {
-    CGLLockContext(cgl_ctx);
+  CGLLockContext(cgl_ctx);
 
-    // allocate the texture
-    glGenTextures(1, bucket->tex_ids + tex_index);
-    glReportError();
-    if (!bucket->tex_ids[tex_index]) {
-      CGLUnlockContext(cgl_ctx);
-      return 0;
-    }
+  // allocate the texture
+  glGenTextures(1, &texid);
+  glReportError();
+  if (!texid) {
+    CGLUnlockContext(cgl_ctx);
+    return 0;
+  }
 
-    // get the current TEXTURE_RECTANGLE_ARB texture
-    GLuint rect_tex;
-    glGetIntegerv(GL_TEXTURE_BINDING_RECTANGLE_ARB, (GLint*)&rect_tex);
-    glReportError();
+  // get the current TEXTURE_RECTANGLE_ARB texture
+  GLuint rect_tex;
+  glGetIntegerv(GL_TEXTURE_BINDING_RECTANGLE_ARB, (GLint*)&rect_tex);
+  glReportError();
 
-    // bind it to texture rectangle
-    glBindTexture(GL_TEXTURE_RECTANGLE_ARB, bucket->tex_ids[tex_index]);
-    glReportError();
+  // bind it to texture rectangle
+  glBindTexture(GL_TEXTURE_RECTANGLE_ARB, texid);
+  glReportError();
 
-    // texture parameters
-    glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glReportError();
+  // texture parameters
+  glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glReportError();
 
-    // disable client storage
-    GLenum client_storage = [RXGetContextState(cgl_ctx) setUnpackClientStorage:GL_FALSE];
+  // disable client storage
+  GLenum client_storage = [RXGetContextState(cgl_ctx) setUnpackClientStorage:GL_FALSE];
 
-    glTexImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, GL_RGBA8, bucket->width, bucket->height, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
-    glReportError();
+  glTexImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, GL_RGBA8, width, height, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
+  glReportError();
 
-    // restore the texture binding and unpack client storage
-    glBindTexture(GL_TEXTURE_RECTANGLE_ARB, rect_tex);
-    glReportError();
-    [RXGetContextState(cgl_ctx) setUnpackClientStorage:client_storage];
+  // restore the texture binding and unpack client storage
+  glBindTexture(GL_TEXTURE_RECTANGLE_ARB, rect_tex);
+  glReportError();
+  [RXGetContextState(cgl_ctx) setUnpackClientStorage:client_storage];
 
-    // flush to synchronize the new texture object with the render context
-    glFlush();
+  // flush to synchronize the new texture object with the render context
+  glFlush();
 
-    CGLUnlockContext(cgl_ctx);
+  CGLUnlockContext(cgl_ctx);
 
 #if defined(DEBUG)
-    RXLog(kRXLoggingGraphics, kRXLoggingLevelDebug, @"allocated brokered texture %u (%ux%u)", bucket->tex_ids[tex_index], bucket->width, bucket->height);
+  RXLog(kRXLoggingGraphics, kRXLoggingLevelDebug, @"allocated brokered texture %u (%ux%u)", texid, width, height);
 #endif
-  }
 
-  [bucket->in_use set:tex_index];
-  if (out_index)
-    *out_index = tex_index;
-  return bucket->tex_ids[tex_index];
+  return texid;
 }
 
 + (RXTextureBroker*)sharedTextureBroker
@@ -154,12 +161,13 @@ static inline GLuint find_texture(CGLContextObj cgl_ctx, struct _rx_texture_buck
 
 - (void)_createBucketWithSize:(rx_size_t)size
 {
+  // textures refer to their bucket by index, so the bucket array can move
   if (_bucket_count == _bucket_capacity) {
     _bucket_capacity += 0x10;
     _buckets = realloc(_buckets, _bucket_capacity * sizeof(struct _rx_texture_bucket));
   }
 
-  allocate_texture_bucket(cgl_ctx, _buckets + _bucket_count, size.width, size.height);
+  allocate_texture_bucket(_buckets + _bucket_count, size.width, size.height);
   _bucket_count++;
 }
 
@@ -168,7 +176,16 @@ static inline GLuint find_texture(CGLContextObj cgl_ctx, struct _rx_texture_buck
 #if defined(DEBUG)
   RXOLog2(kRXLoggingGraphics, kRXLoggingLevelDebug, @"recycled texture: %u", texture->texture);
 #endif
-  [texture->_bucket->in_use clear:texture->_bucket_index];
+
+  OSSpinLockLock(&_lock);
+  if (!_toreDown) {
+    // the most recently recycled texture goes at the end of the free list
+    struct _rx_texture_bucket* bucket = _buckets + texture->_bucket_i;
+    bucket->free_slots[bucket->free_count++] = texture->_bucket_index;
+    bucket->idle_since[texture->_bucket_index] = ++_recycle_tick;
+    _statistics.idle_texture_count++;
+  }
+  OSSpinLockUnlock(&_lock);
 }
 
 - (id)init
@@ -178,6 +195,7 @@ static inline GLuint find_texture(CGLContextObj cgl_ctx, struct _rx_texture_buck
     return nil;
 
   cgl_ctx = [g_worldView loadContext];
+  _lock = OS_SPINLOCK_INIT;
 
   _buckets = calloc(8, sizeof(struct _rx_texture_bucket));
   _bucket_capacity = 8;
@@ -197,16 +215,19 @@ static inline GLuint find_texture(CGLContextObj cgl_ctx, struct _rx_texture_buck
 {
   if (_toreDown)
     return;
-  _toreDown = YES;
 #if defined(DEBUG)
   RXOLog(@"tearing down");
 #endif
 
+  [self _printDebugStats];
+
+  OSSpinLockLock(&_lock);
+  _toreDown = YES;
+  OSSpinLockUnlock(&_lock);
+
   for (uint32_t bucket_i = 0; bucket_i < _bucket_count; ++bucket_i)
     free_texture_bucket(cgl_ctx, _buckets + bucket_i);
   _bucket_count = 0;
-
-  [self _printDebugStats];
 }
 
 - (void)dealloc
@@ -214,22 +235,84 @@ static inline GLuint find_texture(CGLContextObj cgl_ctx, struct _rx_texture_buck
   [self teardown];
 
   free(_buckets);
-#if defined(DEBUG)
-  free(_bucket_stats);
-#endif
 
   [super dealloc];
 }
 
+- (void)getStatistics:(struct rx_texture_broker_statistics*)statistics
+{
+  OSSpinLockLock(&_lock);
+  *statistics = _statistics;
+  OSSpinLockUnlock(&_lock);
+}
+
 - (void)_printDebugStats
 {
-#if defined(DEBUG)
   NSMutableString* statsString = [NSMutableString new];
-  for (GLuint i = 0; i < _bucket_stat_count; ++i)
-    [statsString appendFormat:@"\t%dx%d: %u\n", (int)_bucket_stats[i].width, (int)_bucket_stats[i].height, (unsigned int)_bucket_stats[i].count];
-  RXOLog2(kRXLoggingGraphics, kRXLoggingLevelDebug, @"texture bucket statistics\n%@", statsString);
+
+  OSSpinLockLock(&_lock);
+  struct rx_texture_broker_statistics statistics = _statistics;
+  for (uint32_t i = 0; i < _bucket_count; ++i) {
+    struct _rx_texture_bucket* bucket = _buckets + i;
+    if (bucket->request_count == 0)
+      continue;
+    [statsString appendFormat:@"\t%dx%d: %u requests, %u textures (%u idle), %zu KiB\n", (int)bucket->width, (int)bucket->height, bucket->request_count,
+                              bucket->texture_count, bucket->free_count, bucket->texture_count * texture_bucket_texture_size(bucket) / 1024];
+  }
+  OSSpinLockUnlock(&_lock);
+
+  RXOLog2(kRXLoggingGraphics, kRXLoggingLevelMessage,
+          @"%llu requests, %llu reused, %llu created, %llu trimmed, %u textures (%u idle), %zu KiB (peak %zu KiB, budget %zu KiB)\n%@",
+          statistics.request_count, statistics.reuse_count, statistics.creation_count, statistics.trim_count, statistics.texture_count,
+          statistics.idle_texture_count, statistics.vram / 1024, statistics.peak_vram / 1024, statistics.vram_budget / 1024, statsString);
   [statsString release];
+}
+
+- (void)trimToSize:(size_t)bytes
+{
+  GLuint* trimmed = NULL;
+  uint32_t trimmed_count = 0;
+
+  OSSpinLockLock(&_lock);
+  if (_statistics.vram > bytes && _statistics.idle_texture_count > 0)
+    trimmed = malloc(_statistics.idle_texture_count * sizeof(GLuint));
+
+  while (_statistics.vram > bytes && _statistics.idle_texture_count > 0) {
+    // the least recently recycled texture is at the head of some bucket's free list
+    struct _rx_texture_bucket* coldest = NULL;
+    for (uint32_t i = 0; i < _bucket_count; ++i) {
+      struct _rx_texture_bucket* bucket = _buckets + i;
+      if (bucket->free_count && (!coldest || bucket->idle_since[bucket->free_slots[0]] < coldest->idle_since[coldest->free_slots[0]]))
+        coldest = bucket;
+    }
+
+    uint32_t slot = coldest->free_slots[0];
+    memmove(coldest->free_slots, coldest->free_slots + 1, (coldest->free_count - 1) * sizeof(uint32_t));
+    coldest->free_count--;
+
+    trimmed[trimmed_count++] = coldest->tex_ids[slot];
+    coldest->tex_ids[slot] = 0;
+    rx_bitfield_clear(&coldest->allocated, slot);
+    coldest->texture_count--;
+
+    _statistics.texture_count--;
+    _statistics.idle_texture_count--;
+    _statistics.trim_count++;
+    _statistics.vram -= texture_bucket_texture_size(coldest);
+  }
+  OSSpinLockUnlock(&_lock);
+
+  if (trimmed_count) {
+    CGLLockContext(cgl_ctx);
+    glDeleteTextures(trimmed_count, trimmed);
+    glFlush();
+    CGLUnlockContext(cgl_ctx);
+
+#if defined(DEBUG)
+    RXOLog2(kRXLoggingGraphics, kRXLoggingLevelDebug, @"trimmed %u idle textures", trimmed_count);
 #endif
+  }
+  free(trimmed);
 }
 
 - (RXTexture*)newTextureWithSize:(rx_size_t)size
@@ -240,6 +323,13 @@ static inline GLuint find_texture(CGLContextObj cgl_ctx, struct _rx_texture_buck
   if (_toreDown)
     return nil;
 
+  // trim idle textures if we are over budget before possibly creating a new one; a budget of 0 means unlimited
+  size_t vram_budget = (size_t)RXEngineGetUInt32(@"rendering.texture_budget_mb") * 1024 * 1024;
+  if (vram_budget)
+    [self trimToSize:vram_budget];
+
+  OSSpinLockLock(&_lock);
+
   // find the right bucket
   struct _rx_texture_bucket* bucket = NULL;
 
@@ -261,51 +351,55 @@ static inline GLuint find_texture(CGLContextObj cgl_ctx, struct _rx_texture_buck
     bucket = &_buckets[_bucket_count - 1];
   }
 
-  // if we don't have a bucket at this point, give up
-  if (!bucket)
-    return nil;
+  bucket->request_count++;
+  _statistics.request_count++;
+  _statistics.vram_budget = vram_budget;
 
-  // try to allocate a texture out of the bucket
+  GLsizei bucket_width = bucket->width;
+  GLsizei bucket_height = bucket->height;
+
+  // reuse the most recently recycled texture of the bucket if there is one, otherwise claim an empty slot
   uint32_t bucket_index;
-  GLuint texid = find_texture(cgl_ctx, bucket, &bucket_index);
-  if (texid == 0) {
-    // texture allocation failed, return nil
-    return nil;
+  GLuint texid;
+  if (bucket->free_count) {
+    bucket_index = bucket->free_slots[--bucket->free_count];
+    texid = bucket->tex_ids[bucket_index];
+    _statistics.idle_texture_count--;
+    _statistics.reuse_count++;
+    OSSpinLockUnlock(&_lock);
+  } else {
+    bucket_index = find_empty_slot(bucket);
+    rx_bitfield_set(&bucket->allocated, bucket_index);
+    OSSpinLockUnlock(&_lock);
+
+    // create the texture outside of the lock, since recycling may happen on the render thread
+    texid = create_texture(cgl_ctx, bucket_width, bucket_height);
+
+    OSSpinLockLock(&_lock);
+    bucket = _buckets + bucket_i;
+    if (texid == 0) {
+      rx_bitfield_clear(&bucket->allocated, bucket_index);
+      OSSpinLockUnlock(&_lock);
+      return nil;
+    }
+
+    bucket->tex_ids[bucket_index] = texid;
+    bucket->texture_count++;
+    _statistics.texture_count++;
+    _statistics.creation_count++;
+    _statistics.vram += texture_bucket_texture_size(bucket);
+    if (_statistics.vram > _statistics.peak_vram)
+      _statistics.peak_vram = _statistics.vram;
+    OSSpinLockUnlock(&_lock);
   }
 
   RXBrokeredTexture* texture = [[RXBrokeredTexture alloc] initWithID:texid target:GL_TEXTURE_RECTANGLE_ARB size:size deleteWhenDone:NO];
-  texture->_bucket = bucket;
+  texture->_bucket_i = (uint32_t)bucket_i;
   texture->_bucket_index = bucket_index;
 
-#if defined(DEBUG)
-  if (_bucket_stat_count == 0) {
-    _bucket_stats = malloc(sizeof(struct _bucket_stat));
-    _bucket_stat_count = 1;
-    _bucket_stats[0].width = bucket->width;
-    _bucket_stats[0].height = bucket->height;
-    _bucket_stats[0].count = 0;
-  }
-
-  uint32_t stat_i = 0;
-  for (; stat_i < _bucket_stat_count; ++stat_i) {
-    if (_bucket_stats[stat_i].width == bucket->width && _bucket_stats[stat_i].height == bucket->height) {
-      _bucket_stats[stat_i].count++;
-      break;
-    }
-  }
-
-  if (stat_i == _bucket_stat_count) {
-    _bucket_stat_count++;
-    _bucket_stats = realloc(_bucket_stats, _bucket_stat_count * sizeof(struct _bucket_stat));
-    _bucket_stats[stat_i].width = bucket->width;
-    _bucket_stats[stat_i].height = bucket->height;
-    _bucket_stats[stat_i].count = 1;
-  }
-#endif
-
 #if defined(DEBUG)
   RXOLog2(kRXLoggingGraphics, kRXLoggingLevelDebug, @"reserved texture: %u [size=%ux%u] from <%ux%u> bucket [index=%u]", texid, size.width, size.height,
-          bucket->width, bucket->height, bucket_index);
+          bucket_width, bucket_height, bucket_index);
 #endif
   return texture;
 }
@@ -0,0 +1,77 @@
+//
+//  RXTextureUploader.h
+//  rivenx
+//
+
+#import "Base/RXBase.h"
+
+#import <dispatch/dispatch.h>
+#import <libkern/OSAtomic.h>
+
+#import <MHKKit/MHKArchive.h>
+
+#import "Rendering/RXRendering.h"
+#import "Rendering/Graphics/RXTexture.h"
+
+// number of pixel unpack buffers in the transfer ring
+#define RX_TEXTURE_UPLOAD_BUFFER_COUNT 3
+
+// number of staging buffers pictures can be decoded into concurrently
+#define RX_TEXTURE_UPLOAD_STAGING_COUNT 4
+
+// An upload of a tBMP picture into a texture. The upload completes once the picture has been decoded and its transfer into the texture
+// has been submitted and flushed on the load context, at which point the texture can be used by the render context.
+@interface RXTextureUpload : NSObject {
+@package
+  RXTexture* _texture;
+  MHKArchive* _archive;
+  uint16_t _tbmp_id;
+  GLsizei _width;
+  GLsizei _height;
+  void* _staging;
+  NSError* _error;
+  dispatch_group_t _group;
+}
+
+- (RXTexture*)texture;
+
+- (BOOL)isComplete;
+
+// blocks until the upload is complete; throws a RXPictureLoadException if the picture could not be loaded
+- (void)wait;
+
+// the reason the picture could not be loaded; nil while the upload is in progress and once it has succeeded
+- (NSError*)error;
+
+@end
+
+// Decodes pictures on worker threads into malloc'ed staging buffers, then copies them into a ring of pixel unpack buffers on the load
+// context from a serial transfer queue. Each unpack buffer is guarded by a fence set after the texture update that sources it, so the
+// transfer queue only waits on the GPU when it wraps around the ring, and never while a picture is being decoded. Several pictures can
+// decode in parallel, and neither decoding nor transfers ever hold the render context.
+@interface RXTextureUploader : NSObject {
+  CGLContextObj cgl_ctx;
+
+  dispatch_queue_t _decode_queue;
+  dispatch_queue_t _transfer_queue;
+
+  dispatch_semaphore_t _staging_semaphore;
+  OSSpinLock _staging_lock;
+  void* _staging_buffers[RX_TEXTURE_UPLOAD_STAGING_COUNT];
+  uint32_t _staging_buffer_count;
+
+  GLuint _unpack_buffers[RX_TEXTURE_UPLOAD_BUFFER_COUNT];
+  GLuint _unpack_fences[RX_TEXTURE_UPLOAD_BUFFER_COUNT];
+  BOOL _unpack_fence_pending[RX_TEXTURE_UPLOAD_BUFFER_COUNT];
+  uint32_t _unpack_index;
+}
+
++ (RXTextureUploader*)sharedTextureUploader;
+
+// size in bytes of the largest picture that can be uploaded through the unpack buffer ring; larger pictures are unpacked from their
+// staging buffer directly
++ (GLsizeiptr)unpackBufferSize;
+
+- (RXTextureUpload*)uploadBitmap:(uint16_t)tbmp_id archive:(MHKArchive*)archive toTexture:(RXTexture*)texture;
+
+@end
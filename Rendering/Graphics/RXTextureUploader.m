@@ -0,0 +1,283 @@
+//
+//  RXTextureUploader.m
+//  rivenx
+//
+
+#import "Rendering/Graphics/RXTextureUploader.h"
+
+@interface RXTextureUpload ()
+- (id)initWithBitmap:(uint16_t)tbmp_id archive:(MHKArchive*)archive texture:(RXTexture*)texture;
+- (void)_completeWithError:(NSError*)error;
+@end
+
+@implementation RXTextureUpload
+
+- (id)initWithBitmap:(uint16_t)tbmp_id archive:(MHKArchive*)archive texture:(RXTexture*)texture
+{
+  self = [super init];
+  if (!self)
+    return nil;
+
+  _texture = [texture retain];
+  _archive = [archive retain];
+  _tbmp_id = tbmp_id;
+
+  _group = dispatch_group_create();
+  dispatch_group_enter(_group);
+
+  return self;
+}
+
+- (void)dealloc
+{
+  [_texture release];
+  [_archive release];
+  [_error release];
+  dispatch_release(_group);
+
+  [super dealloc];
+}
+
+- (NSString*)description { return [NSString stringWithFormat:@"%@ {tBMP=%hu, texture=%@}", [super description], _tbmp_id, _texture]; }
+
+- (RXTexture*)texture { return _texture; }
+
+- (BOOL)isComplete { return dispatch_group_wait(_group, DISPATCH_TIME_NOW) == 0; }
+
+- (void)wait
+{
+  dispatch_group_wait(_group, DISPATCH_TIME_FOREVER);
+  if (_error)
+    @throw [NSException exceptionWithName:@"RXPictureLoadException"
+                                   reason:@"Could not load a picture resource."
+                                 userInfo:[NSDictionary dictionaryWithObjectsAndKeys:_error, NSUnderlyingErrorKey, nil]];
+}
+
+- (NSError*)error { return ([self isComplete]) ? _error : nil; }
+
+- (void)_completeWithError:(NSError*)error
+{
+  _error = [error retain];
+  dispatch_group_leave(_group);
+}
+
+@end
+
+@implementation RXTextureUploader
+
++ (RXTextureUploader*)sharedTextureUploader
+{
+  static RXTextureUploader* shared = nil;
+  static dispatch_once_t once;
+  dispatch_once(&once, ^(void) { shared = [RXTextureUploader new]; });
+  return shared;
+}
+
+// pictures are at most the size of the card viewport, which fits in a 1024x1024 BGRA picture
++ (GLsizeiptr)unpackBufferSize { return 1024 * 1024 * 4; }
+
+- (id)init
+{
+  self = [super init];
+  if (!self)
+    return nil;
+
+  _decode_queue = dispatch_queue_create("org.macstorm.rivenx.texture-upload.decode", DISPATCH_QUEUE_CONCURRENT);
+  _transfer_queue = dispatch_queue_create("org.macstorm.rivenx.texture-upload.transfer", DISPATCH_QUEUE_SERIAL);
+
+  _staging_semaphore = dispatch_semaphore_create(RX_TEXTURE_UPLOAD_STAGING_COUNT);
+  _staging_lock = OS_SPINLOCK_INIT;
+
+  cgl_ctx = [g_worldView loadContext];
+  CGLLockContext(cgl_ctx);
+
+  // create the unpack buffer ring; the fences make serialized modifies unnecessary, and the transfers flush explicit ranges
+  glGenBuffers(RX_TEXTURE_UPLOAD_BUFFER_COUNT, _unpack_buffers);
+  glGenFencesAPPLE(RX_TEXTURE_UPLOAD_BUFFER_COUNT, _unpack_fences);
+  glReportError();
+  for (uint32_t i = 0; i < RX_TEXTURE_UPLOAD_BUFFER_COUNT; i++) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _unpack_buffers[i]);
+    glBufferParameteriAPPLE(GL_PIXEL_UNPACK_BUFFER, GL_BUFFER_SERIALIZED_MODIFY_APPLE, GL_FALSE);
+    glBufferParameteriAPPLE(GL_PIXEL_UNPACK_BUFFER, GL_BUFFER_FLUSHING_UNMAP_APPLE, GL_FALSE);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, [RXTextureUploader unpackBufferSize], NULL, GL_STREAM_DRAW);
+    glReportError();
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  // we created new buffer objects, so flush
+  glFlush();
+
+  CGLUnlockContext(cgl_ctx);
+
+  return self;
+}
+
+- (void)dealloc
+{
+  CGLLockContext(cgl_ctx);
+  glDeleteFencesAPPLE(RX_TEXTURE_UPLOAD_BUFFER_COUNT, _unpack_fences);
+  glDeleteBuffers(RX_TEXTURE_UPLOAD_BUFFER_COUNT, _unpack_buffers);
+  CGLUnlockContext(cgl_ctx);
+
+  for (uint32_t i = 0; i < _staging_buffer_count; i++)
+    free(_staging_buffers[i]);
+
+  dispatch_release(_decode_queue);
+  dispatch_release(_transfer_queue);
+  dispatch_release(_staging_semaphore);
+
+  [super dealloc];
+}
+
+#pragma mark -
+
+- (void*)_acquireStagingBufferWithSize:(size_t)size
+{
+  // pictures that do not fit in the unpack buffers get a dedicated staging buffer
+  if (size > (size_t)[RXTextureUploader unpackBufferSize])
+    return malloc(size);
+
+  dispatch_semaphore_wait(_staging_semaphore, DISPATCH_TIME_FOREVER);
+
+  OSSpinLockLock(&_staging_lock);
+  void* buffer = (_staging_buffer_count > 0) ? _staging_buffers[--_staging_buffer_count] : NULL;
+  OSSpinLockUnlock(&_staging_lock);
+
+  return (buffer) ? buffer : malloc([RXTextureUploader unpackBufferSize]);
+}
+
+- (void)_releaseStagingBuffer:(void*)buffer size:(size_t)size
+{
+  if (size > (size_t)[RXTextureUploader unpackBufferSize]) {
+    free(buffer);
+    return;
+  }
+
+  OSSpinLockLock(&_staging_lock);
+  _staging_buffers[_staging_buffer_count++] = buffer;
+  OSSpinLockUnlock(&_staging_lock);
+  dispatch_semaphore_signal(_staging_semaphore);
+}
+
+// runs on the transfer queue
+- (void)_transferUpload:(RXTextureUpload*)upload
+{
+  size_t picture_size = (size_t)upload->_width * upload->_height * 4;
+  BOOL use_unpack_buffer = picture_size <= (size_t)[RXTextureUploader unpackBufferSize];
+
+  CGLLockContext(cgl_ctx);
+
+  uint32_t slot = _unpack_index;
+  const GLvoid* pixels = upload->_staging;
+  if (use_unpack_buffer) {
+    // wait for the GPU to be done with the previous texture update out of this buffer
+    if (_unpack_fence_pending[slot]) {
+      glFinishFenceAPPLE(_unpack_fences[slot]);
+      _unpack_fence_pending[slot] = NO;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _unpack_buffers[slot]);
+    glReportError();
+    GLvoid* buffer = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+    glReportError();
+    memcpy(buffer, upload->_staging, picture_size);
+    glFlushMappedBufferRangeAPPLE(GL_PIXEL_UNPACK_BUFFER, 0, picture_size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glReportError();
+
+    pixels = (GLvoid*)0;
+  }
+
+  RXTexture* texture = upload->_texture;
+  [texture bindWithContext:cgl_ctx lock:NO];
+
+  // texture parameters
+  glTexParameteri(texture->target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(texture->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(texture->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glReportError();
+
+  // client storage is not compatible with PBO texture unpacking, and staging buffers are recycled right after the update
+  GLenum client_storage = [RXGetContextState(cgl_ctx) setUnpackClientStorage:GL_FALSE];
+
+  // unpack the texture
+  glTexSubImage2D(texture->target, 0, 0, 0, upload->_width, upload->_height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, pixels);
+  glReportError();
+
+  if (use_unpack_buffer) {
+    // fence the unpack buffer and move on to the next one in the ring
+    glSetFenceAPPLE(_unpack_fences[slot]);
+    _unpack_fence_pending[slot] = YES;
+    _unpack_index = (slot + 1) % RX_TEXTURE_UPLOAD_BUFFER_COUNT;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glReportError();
+  }
+
+  [RXGetContextState(cgl_ctx) setUnpackClientStorage:client_storage];
+
+  // flush the update to synchronize it with the render context
+  glFlush();
+
+  CGLUnlockContext(cgl_ctx);
+
+  [self _releaseStagingBuffer:upload->_staging size:picture_size];
+  upload->_staging = NULL;
+
+  [upload _completeWithError:nil];
+}
+
+// runs on the decode queue; consumes a reference to the upload
+- (void)_decodeUpload:(RXTextureUpload*)upload
+{
+  NSError* error;
+  NSDictionary* picture_descriptor = [upload->_archive bitmapDescriptorWithID:upload->_tbmp_id error:&error];
+  if (!picture_descriptor) {
+    [upload _completeWithError:error];
+    [upload release];
+    return;
+  }
+
+  upload->_width = [[picture_descriptor objectForKey:@"Width"] intValue];
+  upload->_height = [[picture_descriptor objectForKey:@"Height"] intValue];
+
+  // we'll be using MHK_BGRA_UNSIGNED_INT_8_8_8_8_REV_PACKED as the texture format, which is 4 bytes per pixel
+  size_t picture_size = (size_t)upload->_width * upload->_height * 4;
+  upload->_staging = [self _acquireStagingBufferWithSize:picture_size];
+
+  if (![upload->_archive loadBitmapWithID:upload->_tbmp_id buffer:upload->_staging format:MHK_BGRA_UNSIGNED_INT_8_8_8_8_REV_PACKED error:&error]) {
+    [self _releaseStagingBuffer:upload->_staging size:picture_size];
+    upload->_staging = NULL;
+    [upload _completeWithError:error];
+    [upload release];
+    return;
+  }
+
+  dispatch_async(_transfer_queue, ^(void) {
+    [self _transferUpload:upload];
+    [upload release];
+  });
+}
+
+- (RXTextureUpload*)uploadBitmap:(uint16_t)tbmp_id archive:(MHKArchive*)archive toTexture:(RXTexture*)texture
+{
+#if defined(DEBUG)
+  NSString* archive_key = [[[[archive url] path] lastPathComponent] stringByDeletingPathExtension];
+  RXLog(kRXLoggingGraphics, kRXLoggingLevelDebug, @"uploading picture %@:%hu into %@", archive_key, tbmp_id, texture);
+#endif
+
+  RXTextureUpload* upload = [[RXTextureUpload alloc] initWithBitmap:tbmp_id archive:archive texture:texture];
+
+  // the pipeline owns one reference until the upload completes; the other one is returned to the caller
+  [upload retain];
+  dispatch_async(_decode_queue, ^(void) {
+    NSAutoreleasePool* pool = [NSAutoreleasePool new];
+    [self _decodeUpload:upload];
+    [pool release];
+  });
+
+  return [upload autorelease];
+}
+
+@end
@@ -0,0 +1,253 @@
+//
+//  RXWaterEffect.c
+//  rivenx
+//
+
+#include "Rendering/Graphics/RXWaterEffect.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// microprogram opcodes
+enum {
+  RX_SFXE_OP_NEXT_ROW = 1,
+  RX_SFXE_OP_COPY = 3,
+  RX_SFXE_OP_END = 4,
+};
+
+static const uint16_t* rx_sfxe_program(const rx_card_sfxe* sfxe, uint32_t frame)
+{ return (const uint16_t*)((const uint8_t*)sfxe->record + sfxe->offsets[frame]); }
+
+// walks the program of a frame; counts the spans if spans is NULL, otherwise emits them and the frame's dirty rect
+static bool rx_sfxe_compile_frame(const rx_card_sfxe* sfxe, uint32_t frame, const uint16_t* program_end, uint32_t surface_width,
+                                  uint32_t surface_height, struct rx_sfxe_span* spans, struct rx_sfxe_frame* compiled, uint32_t* span_count)
+{
+  const uint16_t* mp = rx_sfxe_program(sfxe, frame);
+  uint32_t draw_row = sfxe->record->rect.top;
+  uint32_t count = 0;
+
+  uint32_t left = surface_width, top = surface_height, right = 0, bottom = 0;
+
+  while (mp < program_end && *mp != RX_SFXE_OP_END) {
+    if (*mp == RX_SFXE_OP_NEXT_ROW) {
+      draw_row++;
+      mp++;
+      continue;
+    }
+
+    if (*mp != RX_SFXE_OP_COPY || mp + 5 > program_end)
+      return false;
+
+    uint32_t dst_x = mp[1], src_x = mp[2], src_y = mp[3], length = mp[4];
+    if (draw_row >= surface_height || src_y >= surface_height || dst_x + length > surface_width || src_x + length > surface_width)
+      return false;
+
+    if (spans && length > 0) {
+      spans[count].dst_offset = draw_row * surface_width + dst_x;
+      spans[count].src_offset = src_y * surface_width + src_x;
+      spans[count].length = length;
+
+      if (dst_x < left)
+        left = dst_x;
+      if (dst_x + length > right)
+        right = dst_x + length;
+      if (draw_row < top)
+        top = draw_row;
+      if (draw_row + 1 > bottom)
+        bottom = draw_row + 1;
+    }
+    if (length > 0)
+      count++;
+
+    mp += 5;
+  }
+
+  if (mp >= program_end)
+    return false;
+
+  if (compiled) {
+    compiled->span_count = count;
+    if (count > 0) {
+      compiled->dirty_rect.left = (uint16_t)left;
+      compiled->dirty_rect.top = (uint16_t)top;
+      compiled->dirty_rect.right = (uint16_t)right;
+      compiled->dirty_rect.bottom = (uint16_t)bottom;
+    } else
+      memset(&compiled->dirty_rect, 0, sizeof(rx_core_rect_t));
+  }
+
+  *span_count = count;
+  return true;
+}
+
+// the fields are read a byte at a time, so that the conversion is right on any host and never does an unaligned load
+static void rx_sfxe_swap16(void* field)
+{
+  const uint8_t* b = (const uint8_t*)field;
+  uint16_t value = (uint16_t)((b[0] << 8) | b[1]);
+  memcpy(field, &value, sizeof(value));
+}
+
+static void rx_sfxe_swap32(void* field)
+{
+  const uint8_t* b = (const uint8_t*)field;
+  uint32_t value = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+  memcpy(field, &value, sizeof(value));
+}
+
+static void rx_sfxe_swap_rect(rx_core_rect_t* rect)
+{
+  rx_sfxe_swap16(&rect->left);
+  rx_sfxe_swap16(&rect->top);
+  rx_sfxe_swap16(&rect->right);
+  rx_sfxe_swap16(&rect->bottom);
+}
+
+bool rx_sfxe_swap_record(rx_card_sfxe* sfxe, size_t record_size)
+{
+  struct rx_sfxe_record* record = sfxe->record;
+  if (record_size < sizeof(struct rx_sfxe_record))
+    return false;
+
+  rx_sfxe_swap16(&record->magic);
+  rx_sfxe_swap16(&record->frame_count);
+  rx_sfxe_swap32(&record->offset_table);
+  rx_sfxe_swap_rect(&record->rect);
+  rx_sfxe_swap16(&record->fps);
+  rx_sfxe_swap16(&record->u0);
+  rx_sfxe_swap_rect(&record->alt_rect);
+  rx_sfxe_swap16(&record->u1);
+  rx_sfxe_swap16(&record->alt_frame_count);
+  rx_sfxe_swap32(&record->u2);
+  rx_sfxe_swap32(&record->u3);
+  rx_sfxe_swap32(&record->u4);
+  rx_sfxe_swap32(&record->u5);
+  rx_sfxe_swap32(&record->u6);
+
+  if (record->offset_table > record_size || (record_size - record->offset_table) / sizeof(uint32_t) < record->frame_count)
+    return false;
+  sfxe->offsets = (uint32_t*)((uint8_t*)record + record->offset_table);
+
+  uint16_t* program_end = (uint16_t*)((uint8_t*)record + (record_size & ~(size_t)1));
+  for (uint32_t frame = 0; frame < record->frame_count; frame++) {
+    rx_sfxe_swap32(sfxe->offsets + frame);
+    if (sfxe->offsets[frame] >= record_size)
+      return false;
+
+    // every word of the program is swapped once
+    uint16_t* mp = (uint16_t*)rx_sfxe_program(sfxe, frame);
+    for (;;) {
+      if (mp >= program_end)
+        return false;
+      rx_sfxe_swap16(mp);
+      if (*mp == RX_SFXE_OP_END)
+        break;
+
+      if (*mp == RX_SFXE_OP_COPY) {
+        if (program_end - mp < 5)
+          return false;
+        for (int i = 1; i < 5; i++)
+          rx_sfxe_swap16(mp + i);
+        mp += 5;
+      } else if (*mp == RX_SFXE_OP_NEXT_ROW)
+        mp++;
+      else
+        return false;
+    }
+  }
+
+  return true;
+}
+
+bool rx_sfxe_compile(rx_card_sfxe* sfxe, size_t record_size, uint32_t surface_width, uint32_t surface_height)
+{
+  sfxe->frames = NULL;
+  sfxe->spans = NULL;
+  sfxe->span_count = 0;
+
+  uint32_t frame_count = sfxe->record->frame_count;
+  const uint16_t* program_end = (const uint16_t*)((const uint8_t*)sfxe->record + (record_size & ~(size_t)1));
+
+  // first pass to size the span list, so that all the frames share a single allocation
+  uint32_t total_spans = 0;
+  for (uint32_t frame = 0; frame < frame_count; frame++) {
+    if (sfxe->offsets[frame] >= record_size)
+      return false;
+
+    uint32_t span_count;
+    if (!rx_sfxe_compile_frame(sfxe, frame, program_end, surface_width, surface_height, NULL, NULL, &span_count))
+      return false;
+    total_spans += span_count;
+  }
+
+  sfxe->frames = (struct rx_sfxe_frame*)malloc(sizeof(struct rx_sfxe_frame) * (frame_count ? frame_count : 1));
+  sfxe->spans = (struct rx_sfxe_span*)malloc(sizeof(struct rx_sfxe_span) * (total_spans ? total_spans : 1));
+
+  uint32_t first_span = 0;
+  for (uint32_t frame = 0; frame < frame_count; frame++) {
+    uint32_t span_count;
+    sfxe->frames[frame].first_span = first_span;
+    rx_sfxe_compile_frame(sfxe, frame, program_end, surface_width, surface_height, sfxe->spans + first_span, sfxe->frames + frame, &span_count);
+    first_span += span_count;
+  }
+  sfxe->span_count = total_spans;
+
+  return true;
+}
+
+void rx_sfxe_free_compiled(rx_card_sfxe* sfxe)
+{
+  free(sfxe->frames);
+  free(sfxe->spans);
+  sfxe->frames = NULL;
+  sfxe->spans = NULL;
+  sfxe->span_count = 0;
+}
+
+void rx_sfxe_execute_frame(const rx_card_sfxe* sfxe, uint32_t frame, uint32_t* dst, const uint32_t* src)
+{
+  const struct rx_sfxe_span* span = sfxe->spans + sfxe->frames[frame].first_span;
+  const struct rx_sfxe_span* end = span + sfxe->frames[frame].span_count;
+  for (; span < end; span++)
+    memcpy(dst + span->dst_offset, src + span->src_offset, span->length << 2);
+}
+
+void rx_sfxe_build_quads(const rx_card_sfxe* sfxe, uint32_t surface_width, uint32_t surface_height, struct rx_sfxe_quad_vertex* vertices)
+{
+  for (uint32_t span_i = 0; span_i < sfxe->span_count; span_i++, vertices += 4) {
+    const struct rx_sfxe_span* span = sfxe->spans + span_i;
+    int16_t dst_x = (int16_t)(span->dst_offset % surface_width);
+    int16_t dst_y = (int16_t)(surface_height - span->dst_offset / surface_width);
+    int16_t src_x = (int16_t)(span->src_offset % surface_width);
+    int16_t src_y = (int16_t)(span->src_offset / surface_width);
+    int16_t length = (int16_t)span->length;
+
+    // surface row r covers [height - r - 1, height - r] in the flipped space and texel row src_y covers [src_y, src_y + 1]
+    struct rx_sfxe_quad_vertex quad[4] = {
+      {dst_x, dst_y, src_x, src_y},
+      {(int16_t)(dst_x + length), dst_y, (int16_t)(src_x + length), src_y},
+      {(int16_t)(dst_x + length), (int16_t)(dst_y - 1), (int16_t)(src_x + length), (int16_t)(src_y + 1)},
+      {dst_x, (int16_t)(dst_y - 1), src_x, (int16_t)(src_y + 1)},
+    };
+    memcpy(vertices, quad, sizeof(quad));
+  }
+}
+
+void rx_sfxe_interpret_frame(const rx_card_sfxe* sfxe, uint32_t frame, uint32_t* dst, const uint32_t* src, uint32_t surface_width)
+{
+  const uint16_t* mp = rx_sfxe_program(sfxe, frame);
+
+  uint32_t draw_row = sfxe->record->rect.top;
+  while (*mp != RX_SFXE_OP_END) {
+    if (*mp == RX_SFXE_OP_NEXT_ROW) {
+      draw_row++;
+    } else if (*mp == RX_SFXE_OP_COPY) {
+      memcpy(dst + draw_row * surface_width + mp[1], src + mp[3] * surface_width + mp[2], mp[4] << 2);
+      mp += 4;
+    } else {
+      abort();
+    }
+
+    mp++;
+  }
+}
@@ -0,0 +1,77 @@
+//
+//  RXWaterEffect.h
+//  rivenx
+//
+
+#if !defined(RX_WATER_EFFECT_H)
+#define RX_WATER_EFFECT_H
+
+#include <sys/cdefs.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Engine/RXCoreStructures.h"
+
+__BEGIN_DECLS
+
+// A water special effect (SFXE) frame is a microprogram of row advances and horizontal copies from the static card surface into the
+// water surface. At card load time, every frame is compiled into a packed list of spans expressed as pixel offsets into the surfaces,
+// along with the bounding rect of the pixels it writes, so that rendering a frame is a flat loop of memcpys and only the dirty rect
+// has to be uploaded.
+
+struct rx_sfxe_span {
+  uint32_t dst_offset;
+  uint32_t src_offset;
+  uint32_t length;
+};
+
+struct rx_sfxe_frame {
+  uint32_t first_span;
+  uint32_t span_count;
+  rx_core_rect_t dirty_rect; // right and bottom are exclusive; empty if the frame has no spans
+};
+
+struct rx_card_sfxe {
+  struct rx_sfxe_record* record;
+  uint32_t* offsets;
+
+  // compiled microprogram; frames has record->frame_count entries
+  struct rx_sfxe_frame* frames;
+  struct rx_sfxe_span* spans;
+  uint32_t span_count;
+};
+typedef struct rx_card_sfxe rx_card_sfxe;
+
+// converts an SFXE record as stored in the archives, big-endian, to host byte order in place and points sfxe->offsets at its offset table;
+// returns false if the record is truncated or a frame has an invalid opcode
+bool rx_sfxe_swap_record(rx_card_sfxe* sfxe, size_t record_size);
+
+// compiles every frame of a host-endian SFXE record for surfaces of the given size; returns false if the record has an invalid opcode,
+// runs past record_size or copies outside of the surfaces
+bool rx_sfxe_compile(rx_card_sfxe* sfxe, size_t record_size, uint32_t surface_width, uint32_t surface_height);
+void rx_sfxe_free_compiled(rx_card_sfxe* sfxe);
+
+// renders a compiled frame from the src surface into the dst surface
+void rx_sfxe_execute_frame(const rx_card_sfxe* sfxe, uint32_t frame, uint32_t* dst, const uint32_t* src);
+
+// Vertex of a span quad. To render the effect on the GPU, every span becomes a one row high quad whose texture coordinates remap it
+// onto its source in the static card texture, so that frame i is drawn with a single GL_QUADS call over vertices
+// [frames[i].first_span * 4, (frames[i].first_span + frames[i].span_count) * 4). Positions are in the y-flipped card space the card
+// renderer draws in, texture coordinates are in texels for rectangle textures.
+struct rx_sfxe_quad_vertex {
+  int16_t x;
+  int16_t y;
+  int16_t s;
+  int16_t t;
+};
+
+// writes span_count * 4 vertices
+void rx_sfxe_build_quads(const rx_card_sfxe* sfxe, uint32_t surface_width, uint32_t surface_height, struct rx_sfxe_quad_vertex* vertices);
+
+// reference interpreter for the microprogram of a frame; this is what the renderer used to run every effect frame
+void rx_sfxe_interpret_frame(const rx_card_sfxe* sfxe, uint32_t frame, uint32_t* dst, const uint32_t* src, uint32_t surface_width);
+
+__END_DECLS
+
+#endif // RX_WATER_EFFECT_H
@@ -22,6 +22,7 @@
 #import <AppKit/NSView.h>
 
 #import "Engine/RXCoreStructures.h"
+#import "Rendering/Graphics/RXWaterEffect.h"
 
 __BEGIN_DECLS
 
@@ -73,12 +74,6 @@ struct rx_event {
 };
 typedef struct rx_event rx_event_t;
 
-struct rx_card_sfxe {
-  struct rx_sfxe_record* record;
-  uint32_t* offsets;
-};
-typedef struct rx_card_sfxe rx_card_sfxe;
-
 #pragma mark -
 #pragma mark rendering constants
 
@@ -234,6 +229,13 @@ RX_INLINE rx_core_rect_t RXTransformRectWorldToCore(NSRect rect)
   return RXMakeCoreRectFromCompositeDisplayRect(composite_rect);
 }
 
+RX_INLINE NSPoint RXTransformPointWorldToCore(NSPoint point)
+{
+  NSRect scale_rect = RXRenderScaleRect();
+  return NSMakePoint((point.x - scale_rect.origin.x) / scale_rect.size.width,
+                     kRXCardViewportSize.height - (point.y - scale_rect.origin.y) / scale_rect.size.height);
+}
+
 #pragma mark -
 
 __END_DECLS
@@ -245,6 +247,7 @@ __END_DECLS
 @optional
 - (void)renderInMainRT:(CGLContextObj)cgl_ctx;
 - (void)exportCompositeFramebuffer;
+- (void)exportFrameStatistics;
 @end
 
 __BEGIN_DECLS
@@ -9,9 +9,9 @@
 #import "Engine/RXWorld.h"
 
 #import "Rendering/Audio/RXAudioRenderer.h"
-#import "Rendering/Graphics/RXDynamicPicture.h"
 #import "Rendering/Graphics/RXWorldView.h"
 #import "Rendering/Graphics/RXWindow.h"
+#import "Rendering/Graphics/RXTextureUploader.h"
 #import "Rendering/Graphics/GL/GLShaderProgramManager.h"
 
 #import "States/RXCardState.h"
@@ -344,8 +344,8 @@ completionHandler:
   // initialize the shader manager
   [GLShaderProgramManager sharedManager];
 
-  // initialize the dynamic picture unpack buffer
-  [RXDynamicPicture sharedDynamicPictureUnpackBuffer];
+  // initialize the texture uploader
+  [RXTextureUploader sharedTextureUploader];
 
   // initialize the card renderer
   _cardRenderer = [[RXCardState alloc] init];
@@ -13,6 +13,7 @@
 #import <mach/thread_act.h>
 #import <mach/thread_policy.h>
 
+#import "States/RXCreditsPrefetcher.h"
 #import "States/RXRenderState.h"
 
 #import "Engine/RXCard.h"
@@ -84,6 +85,9 @@ struct rx_transition_program {
 
   BOOL _forceFadeInOnNextSoundGroup;
 
+  // sounds activated while switching cards, which start when the new card's picture is swapped in
+  NSMutableSet* _soundsAwaitingCardSwap;
+
   // transitions
   semaphore_t _transitionSemaphore;
   NSMutableArray* _transitionQueue;
@@ -104,6 +108,16 @@ struct rx_transition_program {
   GLuint _textures[1];
   void* _water_draw_buffer;
   void* _water_readback_buffer;
+  GLuint _water_unpack_buffers[3];
+  GLuint _water_unpack_fences[3];
+  BOOL _water_unpack_fence_pending[3];
+  uint32_t _water_unpack_index;
+  GLuint _water_static_texture;
+  GLuint _water_vao;
+  GLuint _water_vbo;
+  rx_card_sfxe* _water_vbo_sfxe;
+  id _water_vbo_owner;
+  BOOL _water_gpu;
   BOOL _water_sfx_disabled;
 
   GLuint _card_program;
@@ -111,6 +125,9 @@ struct rx_transition_program {
 
   GLuint _debugRenderVAO;
 
+  // frame statistics (RX::FrameStatistics)
+  void* _frame_statistics;
+
   GLuint _hotspotDebugRenderVBO;
   GLint* _hotspotDebugRenderFirstElementArray;
   GLint* _hotspotDebugRenderElementCountArray;
@@ -132,12 +149,13 @@ struct rx_transition_program {
 
   // credits
   uint64_t _credits_start_time;
-  void* _credits_texture_buffer;
+  RXCreditsPrefetcher* _credits_prefetcher;
   int _credits_state;
   GLuint _credits_texture;
   BOOL _render_credits;
 
   BOOL _initialized;
+  BOOL _first_frame_presented;
 }
 
 - (RXScriptEngine*)scriptEngine;
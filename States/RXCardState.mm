@@ -6,6 +6,8 @@
 //  Copyright 2005-2012 MacStorm. All rights reserved.
 //
 
+#import <vector>
+
 #import <MHKKit/MHKAudioDecompression.h>
 
 #import "States/RXCardState.h"
@@ -16,10 +18,13 @@
 #import "Engine/RXHardwareProfiler.h"
 #import "Engine/RXHotspot.h"
 #import "Engine/RXArchiveManager.h"
+#import "Engine/RXStartupTaskGraph.h"
 
 #import "Rendering/Audio/RXCardAudioSource.h"
 #import "Rendering/Audio/PublicUtility/CAMath.h"
 #import "Rendering/Graphics/GL/GLShaderProgramManager.h"
+#import "Rendering/Graphics/RXDynamicPicture.h"
+#import "Rendering/Graphics/RXFrameStatistics.h"
 #import "Rendering/Graphics/RXMovieProxy.h"
 
 #import "Application/RXApplicationDelegate.h"
@@ -38,9 +43,14 @@ static rx_post_flush_tasks_dispatch_t _movieFlushTasksDispatch;
 
 static const double RX_AUDIO_GAIN_RAMP_DURATION = 2.0;
 static const double RX_AUDIO_PAN_RAMP_DURATION = 0.5;
+static const uint32_t RX_AUDIO_STATISTICS_LOG_INTERVAL = 10;
 
 static const unsigned int RX_CARD_DYNAMIC_RENDER_INDEX = 0;
 
+// number of pixel unpack buffers the water effect cycles through; a buffer is only rewritten once the GPU has consumed the two uploads
+// that followed it
+static const unsigned int RX_WATER_UNPACK_BUFFER_COUNT = 3;
+
 static const unsigned int RX_MAX_RENDER_HOTSPOT = 30;
 
 static const unsigned int RX_MAX_INVENTORY_ITEMS = 3;
@@ -107,6 +117,19 @@ static void RXCardAudioSourceTaskApplier(const void* value, void* context)
   source->RenderTask();
 }
 
+struct RXCardAudioSourceStatisticsEntry {
+  const void* source;
+  RX::CardAudioSourceStatistics statistics;
+};
+
+static void RXCardAudioSourceStatisticsApplier(const void* value, void* context)
+{
+  RXCardAudioSourceStatisticsEntry entry;
+  entry.source = value;
+  reinterpret_cast<const RX::CardAudioSource*>(value)->GetStatistics(entry.statistics);
+  reinterpret_cast<std::vector<RXCardAudioSourceStatisticsEntry>*>(context)->push_back(entry);
+}
+
 #pragma mark -
 #pragma mark render object release - owner array applier function
 
@@ -117,9 +140,14 @@ static void rx_release_owner_applier(const void* value, void* context) { [[(id)v
 @interface RXCardState (RXCardStatePrivate)
 - (void)_initializeRendering;
 - (void)_updateActiveSources;
+- (void)_startSoundsAwaitingCardSwap;
+- (struct rx_transition_program*)_transitionProgramForTransition:(RXTransition*)transition shaderName:(NSString**)name;
+- (void)_loadTransitionProgramForTransition:(RXTransition*)transition;
 - (void)_clearActiveCard;
 - (void)_renderCardWithTimestamp:(const CVTimeStamp*)outputTime inContext:(CGLContextObj)cgl_ctx;
+- (void)_uploadWaterSpanQuads:(rx_card_sfxe*)sfxe owner:(id)owner inContext:(CGLContextObj)cgl_ctx;
 - (void)_postFlushCard:(const CVTimeStamp*)outputTime;
+- (void)_renderDebugInMainRT:(CGLContextObj)cgl_ctx;
 @end
 
 typedef void (*RenderCardImp_t)(id, SEL, const CVTimeStamp*, CGLContextObj);
@@ -189,6 +217,7 @@ static SEL post_flush_card_sel = @selector(_postFlushCard:);
   _active_movies = [NSMutableArray new];
   _activeSounds = [NSMutableSet new];
   _activeDataSounds = [NSMutableSet new];
+  _soundsAwaitingCardSwap = [NSMutableSet new];
   _activeSources = CFArrayCreateMutable(NULL, 0, &g_weakAudioSourceArrayCallbacks);
 
   _transitionQueue = [NSMutableArray new];
@@ -203,6 +232,8 @@ static SEL post_flush_card_sel = @selector(_postFlushCard:);
   _state_swap_lock = OS_SPINLOCK_INIT;
   _inventory_update_lock = OS_SPINLOCK_INIT;
 
+  _frame_statistics = new RX::FrameStatistics();
+
   // initialize all the rendering stuff (shaders, textures, buffers, VAOs)
   [self _initializeRendering];
   if (!_initialized) {
@@ -241,8 +272,8 @@ init_failure:
   [_inventory_position_interpolators[1] release];
   [_inventory_position_interpolators[2] release];
 
-  if (_credits_texture_buffer)
-    free(_credits_texture_buffer);
+  [_credits_prefetcher cancel];
+  [_credits_prefetcher release];
 
   if (_transitionSemaphore)
     semaphore_destroy(mach_task_self(), _transitionSemaphore);
@@ -250,6 +281,7 @@ init_failure:
   [_transitionQueue release];
 
   CFRelease(_activeSources);
+  [_soundsAwaitingCardSwap release];
   [_activeDataSounds release];
   [_activeSounds release];
   [_active_movies release];
@@ -263,6 +295,9 @@ init_failure:
 
   if (_water_draw_buffer)
     free(_water_draw_buffer);
+  [_water_vbo_owner release];
+
+  delete reinterpret_cast<RX::FrameStatistics*>(_frame_statistics);
 
   [sengine release];
 
@@ -336,12 +371,113 @@ init_failure:
   return program;
 }
 
+- (struct rx_transition_program*)_transitionProgramForTransition:(RXTransition*)transition shaderName:(NSString**)name
+{
+  switch (transition->type) {
+  case RXTransitionDissolve:
+    *name = @"transition_crossfade";
+    return &_dissolve;
+
+  case RXTransitionSlide:
+    if (transition->pushOld && transition->pushNew) {
+      *name = @"transition_push";
+      return _push + transition->direction;
+    } else if (transition->pushOld) {
+      *name = @"transition_slide_out";
+      return _slide_out + transition->direction;
+    } else if (transition->pushNew) {
+      *name = @"transition_slide_in";
+      return _slide_in + transition->direction;
+    } else {
+      *name = @"transition_swipe";
+      return _swipe + transition->direction;
+    }
+  }
+
+  *name = nil;
+  return NULL;
+}
+
+- (void)_loadTransitionProgramForTransition:(RXTransition*)transition
+{
+  // WARNING: MUST RUN ON THE SCRIPT THREAD
+  NSString* name;
+  struct rx_transition_program* program = [self _transitionProgramForTransition:transition shaderName:&name];
+  if (!program || program->program)
+    return;
+
+  // the program is written before the transition reaches the front render state, so the render thread never sees it half loaded
+  CGLContextObj cgl_ctx = [g_worldView loadContext];
+  CGLLockContext(cgl_ctx);
+  *program = [self _loadTransitionShaderWithName:name direction:transition->direction context:cgl_ctx];
+  glUseProgram(0);
+  glReportError();
+
+  // flush so that the render context sees the complete program
+  glFlush();
+  CGLUnlockContext(cgl_ctx);
+}
+
 - (void)_initializeRendering
 {
   // WARNING: WILL BE RUNNING ON THE MAIN THREAD
   NSError* error;
 
+  // the inventory bitmaps are decoded on a background queue while this thread creates the GL objects and compiles the shaders
+  RXStartupTaskGraph* startup_tasks = [[RXStartupTaskGraph alloc] initWithName:@"rendering startup"];
+
+  // inventory textures and interpolators
+  __block void* inventory_pixels = NULL;
+  [startup_tasks addTask:@"inventory bitmaps" dependencies:nil block:^(void) {
+    // get a reference to the extra bitmaps archive, and get the inventory texture descriptors; the archive is usually open already,
+    // since the world opens it in the background when it starts up
+    NSError* decode_error;
+    MHKArchive* extras_archive = [[RXArchiveManager sharedArchiveManager] extrasArchive:&decode_error];
+    if (!extras_archive) {
+      RXOLog2(kRXLoggingGraphics, kRXLoggingLevelError, @"failed to get the Extras archive: %@", [decode_error localizedDescription]);
+      return;
+    }
+    NSDictionary* journal_descriptors = [[g_world extraBitmapsDescriptor] objectForKey:@"Journals"];
+
+    // get the texture descriptors for the inventory textures and compute the total byte size of those textures (packed BGRA format)
+    // also compute the maximum inventory width
+    uint32_t inventory_total_size = 0;
+    _inventory_max_width = 0.0f;
+    for (GLuint inventory_i = 0; inventory_i < RX_MAX_INVENTORY_ITEMS; inventory_i++) {
+      uint16_t bitmap_id = [[journal_descriptors objectForKey:RX_INVENTORY_KEYS[inventory_i]] unsignedShortValue];
+      NSDictionary* descriptor = [extras_archive bitmapDescriptorWithID:bitmap_id error:&decode_error];
+      if (!descriptor) {
+        RXOLog2(kRXLoggingGraphics, kRXLoggingLevelError, @"failed to get inventory texture descriptor for item \"%@\": %@", RX_INVENTORY_KEYS[inventory_i],
+                decode_error);
+        continue;
+      }
+
+      _inventory_sizes[inventory_i] =
+          RXSizeMake([[descriptor objectForKey:@"Width"] unsignedIntValue], [[descriptor objectForKey:@"Height"] unsignedIntValue]);
+
+      _inventory_max_width += _inventory_sizes[inventory_i].width;
+      inventory_total_size += (_inventory_sizes[inventory_i].width * _inventory_sizes[inventory_i].height) << 2;
+    }
+
+    // decompress the textures into a client buffer, which is uploaded once the GL context is free
+    void* pixels = calloc(1, inventory_total_size);
+    void* item_pixels = pixels;
+    for (GLuint inventory_i = 0; inventory_i < RX_MAX_INVENTORY_ITEMS; inventory_i++) {
+      uint16_t bitmap_id = [[journal_descriptors objectForKey:RX_INVENTORY_KEYS[inventory_i]] unsignedShortValue];
+      if (![extras_archive loadBitmapWithID:bitmap_id buffer:item_pixels format:MHK_BGRA_UNSIGNED_INT_8_8_8_8_REV_PACKED error:&decode_error]) {
+        RXOLog2(kRXLoggingGraphics, kRXLoggingLevelError, @"failed to load inventory texture for item \"%@\": %@", RX_INVENTORY_KEYS[inventory_i],
+                decode_error);
+        continue;
+      }
+
+      item_pixels = BUFFER_OFFSET(item_pixels, (uint32_t)(_inventory_sizes[inventory_i].width * _inventory_sizes[inventory_i].height) << 2);
+    }
+    inventory_pixels = pixels;
+  }];
+  [startup_tasks start];
+
   // use the load context to prepare our GL objects
+  [startup_tasks beginTask:@"GL objects"];
   CGLContextObj cgl_ctx = [g_worldView loadContext];
   CGLLockContext(cgl_ctx);
   NSObject<RXOpenGLStateProtocol>* gl_state = RXGetContextState(cgl_ctx);
@@ -359,71 +495,23 @@ init_failure:
   _water_draw_buffer = malloc((kRXCardViewportSize.width * kRXCardViewportSize.height) << 3);
   _water_readback_buffer = BUFFER_OFFSET(_water_draw_buffer, (kRXCardViewportSize.width * kRXCardViewportSize.height) << 2);
 
-  // inventory textures and interpolators
-
-  // get a reference to the extra bitmaps archive, and get the inventory texture descriptors
-  MHKArchive* extras_archive = [[RXArchiveManager sharedArchiveManager] extrasArchive:&error];
-  if (!extras_archive) {
-    RXOLog2(kRXLoggingGraphics, kRXLoggingLevelError, @"failed to get the Extras archive: %@", [error localizedDescription]);
-    return;
-  }
-  NSDictionary* journal_descriptors = [[g_world extraBitmapsDescriptor] objectForKey:@"Journals"];
-
-  // get the texture descriptors for the inventory textures and compute the total byte size of those textures (packed BGRA format)
-  // also compute the maximum inventory width
-  NSDictionary* inventoryTextureDescriptors[3];
-  uint32_t inventoryTotalTextureSize = 0;
-  _inventory_max_width = 0.0f;
-  for (GLuint inventory_i = 0; inventory_i < RX_MAX_INVENTORY_ITEMS; inventory_i++) {
-    uint16_t bitmapID = [[journal_descriptors objectForKey:RX_INVENTORY_KEYS[inventory_i]] unsignedShortValue];
-    inventoryTextureDescriptors[inventory_i] = [extras_archive bitmapDescriptorWithID:bitmapID error:&error];
-    if (!inventoryTextureDescriptors[inventory_i]) {
-      RXOLog2(kRXLoggingGraphics, kRXLoggingLevelError, @"failed to get inventory texture descriptor for item \"%@\": %@", RX_INVENTORY_KEYS[inventory_i],
-              error);
-      continue;
-    }
-
-    _inventory_sizes[inventory_i] = RXSizeMake([[inventoryTextureDescriptors[inventory_i] objectForKey:@"Width"] unsignedIntValue],
-                                               [[inventoryTextureDescriptors[inventory_i] objectForKey:@"Height"] unsignedIntValue]);
-
-    _inventory_max_width += _inventory_sizes[inventory_i].width;
-    inventoryTotalTextureSize += (_inventory_sizes[inventory_i].width * _inventory_sizes[inventory_i].height) << 2;
-  }
-
-  // load the journal inventory textures in an unpack buffer object
-  GLuint inventory_unpack_buffer;
-  glGenBuffers(1, &inventory_unpack_buffer);
-  glReportError();
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, inventory_unpack_buffer);
-  glReportError();
-
-  // allocate the texture buffer (aligned to 128 bytes)
-  inventoryTotalTextureSize = (inventoryTotalTextureSize & ~0x7f) + 0x80;
-  glBufferData(GL_PIXEL_UNPACK_BUFFER, inventoryTotalTextureSize, NULL, GL_STATIC_DRAW);
-  glReportError();
-
-  // map the buffer in
-  void* inventoryBuffer = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+  // create the water unpack buffer ring; the buffers are mapped without serializing against the GPU and flushed explicitly, so mapping
+  // one only waits for the fence set after the last upload it sourced; fences are not shared between contexts, so the render thread
+  // creates them on first use
+  glGenBuffers(RX_WATER_UNPACK_BUFFER_COUNT, _water_unpack_buffers);
   glReportError();
-
-  // decompress the textures into the buffer
-  for (GLuint inventory_i = 0; inventory_i < RX_MAX_INVENTORY_ITEMS; inventory_i++) {
-    uint16_t bitmapID = [[journal_descriptors objectForKey:RX_INVENTORY_KEYS[inventory_i]] unsignedShortValue];
-    if (![extras_archive loadBitmapWithID:bitmapID buffer:inventoryBuffer format:MHK_BGRA_UNSIGNED_INT_8_8_8_8_REV_PACKED error:&error]) {
-      RXOLog2(kRXLoggingGraphics, kRXLoggingLevelError, @"failed to load inventory texture for item \"%@\": %@", RX_INVENTORY_KEYS[inventory_i], error);
-      continue;
-    }
-
-    inventoryBuffer = BUFFER_OFFSET(inventoryBuffer, (uint32_t)(_inventory_sizes[inventory_i].width * _inventory_sizes[inventory_i].height) << 2);
+  for (GLuint buffer_i = 0; buffer_i < RX_WATER_UNPACK_BUFFER_COUNT; buffer_i++) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _water_unpack_buffers[buffer_i]);
+    glReportError();
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, (kRXCardViewportSize.width * kRXCardViewportSize.height) << 2, NULL, GL_STREAM_DRAW);
+    glReportError();
+    glBufferParameteriAPPLE(GL_PIXEL_UNPACK_BUFFER, GL_BUFFER_SERIALIZED_MODIFY_APPLE, GL_FALSE);
+    glBufferParameteriAPPLE(GL_PIXEL_UNPACK_BUFFER, GL_BUFFER_FLUSHING_MAPPING_APPLE, GL_FALSE);
+    glReportError();
   }
-
-  // unmap the pixel unpack buffer to begin the DMA transfer
-  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-  glReportError();
   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
   glReportError();
-
-  // while we DMA the inventory textures, let's do some more work
+  _water_unpack_index = 0;
 
   // card compositing
 
@@ -514,12 +602,48 @@ init_failure:
   glVertexAttribPointer(RX_ATTRIB_TEXCOORD0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), BUFFER_OFFSET(_card_composite_va, 2 * sizeof(GLfloat)));
   glReportError();
 
+  // GPU water effect; the static card content is copied into a texture which the span quads of the current effect frame sample from
+
+  glGenTextures(1, &_water_static_texture);
+  glBindTexture(GL_TEXTURE_RECTANGLE_ARB, _water_static_texture);
+  glReportError();
+  glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glReportError();
+  glTexImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, GL_RGBA8, kRXCardViewportSize.width, kRXCardViewportSize.height, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
+  glReportError();
+
+  // the span quads VBO is filled when a water effect is first rendered (see _uploadWaterSpanQuads:owner:inContext:)
+  glGenVertexArraysAPPLE(1, &_water_vao);
+  glReportError();
+  [gl_state bindVertexArrayObject:_water_vao];
+
+  glGenBuffers(1, &_water_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, _water_vbo);
+  glReportError();
+
+  glEnableVertexAttribArray(RX_ATTRIB_POSITION);
+  glVertexAttribPointer(RX_ATTRIB_POSITION, 2, GL_SHORT, GL_FALSE, sizeof(struct rx_sfxe_quad_vertex), (GLvoid*)0);
+  glReportError();
+
+  glEnableVertexAttribArray(RX_ATTRIB_TEXCOORD0);
+  glVertexAttribPointer(RX_ATTRIB_TEXCOORD0, 2, GL_SHORT, GL_FALSE, sizeof(struct rx_sfxe_quad_vertex), (GLvoid*)(2 * sizeof(int16_t)));
+  glReportError();
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glReportError();
+
   // transitions
 
   // create the transition source texture
   _transition_source_texture = [RXTexture newStandardTextureWithTarget:GL_TEXTURE_RECTANGLE_ARB size:kRXCardViewportSize context:cgl_ctx lock:NO];
 
+  [startup_tasks endTask];
+
   // shaders
+  [startup_tasks beginTask:@"shaders"];
 
   // card shader
   _card_program =
@@ -540,28 +664,11 @@ init_failure:
   glUniform4f(_modulate_color_uniform, 1.f, 1.f, 1.f, 1.f);
   glReportError();
 
-  // transition shaders
+  // transition shaders; only the dissolve is common enough to load up front, the directional transitions are loaded by -update when one
+  // is first dequeued
   _dissolve = [self _loadTransitionShaderWithName:@"transition_crossfade" direction:0 context:cgl_ctx];
 
-  _push[RXTransitionLeft] = [self _loadTransitionShaderWithName:@"transition_push" direction:RXTransitionLeft context:cgl_ctx];
-  _push[RXTransitionRight] = [self _loadTransitionShaderWithName:@"transition_push" direction:RXTransitionRight context:cgl_ctx];
-  _push[RXTransitionTop] = [self _loadTransitionShaderWithName:@"transition_push" direction:RXTransitionTop context:cgl_ctx];
-  _push[RXTransitionBottom] = [self _loadTransitionShaderWithName:@"transition_push" direction:RXTransitionBottom context:cgl_ctx];
-
-  _slide_out[RXTransitionLeft] = [self _loadTransitionShaderWithName:@"transition_slide_out" direction:RXTransitionLeft context:cgl_ctx];
-  _slide_out[RXTransitionRight] = [self _loadTransitionShaderWithName:@"transition_slide_out" direction:RXTransitionRight context:cgl_ctx];
-  _slide_out[RXTransitionTop] = [self _loadTransitionShaderWithName:@"transition_slide_out" direction:RXTransitionTop context:cgl_ctx];
-  _slide_out[RXTransitionBottom] = [self _loadTransitionShaderWithName:@"transition_slide_out" direction:RXTransitionBottom context:cgl_ctx];
-
-  _slide_in[RXTransitionLeft] = [self _loadTransitionShaderWithName:@"transition_slide_in" direction:RXTransitionLeft context:cgl_ctx];
-  _slide_in[RXTransitionRight] = [self _loadTransitionShaderWithName:@"transition_slide_in" direction:RXTransitionRight context:cgl_ctx];
-  _slide_in[RXTransitionTop] = [self _loadTransitionShaderWithName:@"transition_slide_in" direction:RXTransitionTop context:cgl_ctx];
-  _slide_in[RXTransitionBottom] = [self _loadTransitionShaderWithName:@"transition_slide_in" direction:RXTransitionBottom context:cgl_ctx];
-
-  _swipe[RXTransitionLeft] = [self _loadTransitionShaderWithName:@"transition_swipe" direction:RXTransitionLeft context:cgl_ctx];
-  _swipe[RXTransitionRight] = [self _loadTransitionShaderWithName:@"transition_swipe" direction:RXTransitionRight context:cgl_ctx];
-  _swipe[RXTransitionTop] = [self _loadTransitionShaderWithName:@"transition_swipe" direction:RXTransitionTop context:cgl_ctx];
-  _swipe[RXTransitionBottom] = [self _loadTransitionShaderWithName:@"transition_swipe" direction:RXTransitionBottom context:cgl_ctx];
+  [startup_tasks endTask];
 
 #if defined(DEBUG)
   // debug rendering
@@ -596,58 +703,62 @@ init_failure:
 #endif
 
   // alright, we've done all the work we could, let's now make those inventory textures
+  // without them, the state fails to initialize, but the context still has to be restored, flushed and unlocked for the objects created above;
+  // -wait rethrows an exception raised by the bitmaps task, so the tail runs in a @finally
+  BOOL loaded_inventory = NO;
+  @try {
+    [startup_tasks wait];
+    loaded_inventory = (inventory_pixels != NULL);
+    if (loaded_inventory) {
+      [startup_tasks beginTask:@"inventory textures"];
+
+      // create the textures and upload the decoded pixels
+      glGenTextures(RX_MAX_INVENTORY_ITEMS, _inventory_textures);
+      for (GLuint inventory_i = 0, offset = 0; inventory_i < RX_MAX_INVENTORY_ITEMS; inventory_i++) {
+        glBindTexture(GL_TEXTURE_RECTANGLE_ARB, _inventory_textures[inventory_i]);
+        glReportError();
+
+        glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glReportError();
+
+        // client storage is disabled, so the pixels are copied before glTexImage2D returns
+        glTexImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, GL_RGBA8, _inventory_sizes[inventory_i].width, _inventory_sizes[inventory_i].height, 0, GL_BGRA,
+                     GL_UNSIGNED_INT_8_8_8_8_REV, BUFFER_OFFSET(inventory_pixels, offset));
+        glReportError();
+
+        offset += (uint32_t)(_inventory_sizes[inventory_i].width * _inventory_sizes[inventory_i].height) << 2;
+      }
+      free(inventory_pixels);
 
-  // re-bind the inventory unpack buffer
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, inventory_unpack_buffer);
-  glReportError();
-
-  // create the textures and reset inventoryBuffer which we'll use as a buffer offset
-  glGenTextures(RX_MAX_INVENTORY_ITEMS, _inventory_textures);
-  inventoryBuffer = 0;
-
-  // decompress the textures into the buffer
-  for (GLuint inventory_i = 0; inventory_i < RX_MAX_INVENTORY_ITEMS; inventory_i++) {
-    glBindTexture(GL_TEXTURE_RECTANGLE_ARB, _inventory_textures[inventory_i]);
-    glReportError();
-
-    glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glReportError();
-
-    glTexImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, GL_RGBA8, _inventory_sizes[inventory_i].width, _inventory_sizes[inventory_i].height, 0, GL_BGRA,
-                 GL_UNSIGNED_INT_8_8_8_8_REV, inventoryBuffer);
-    glReportError();
-
-    inventoryBuffer = BUFFER_OFFSET(inventoryBuffer, (uint32_t)(_inventory_sizes[inventory_i].width * _inventory_sizes[inventory_i].height) << 2);
+      [startup_tasks endTask];
+    }
   }
+  @finally {
+    // restore state to Riven X assumptions
 
-  // restore state to Riven X assumptions
-
-  // bind program 0 back (Riven X assumption)
-  glUseProgram(0);
-
-  // reset the current VAO to 0
-  [gl_state bindVertexArrayObject:0];
+    // bind program 0 back (Riven X assumption)
+    glUseProgram(0);
 
-  // bind 0 to the unpack buffer (e.g. client memory unpacking)
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-  glReportError();
+    // reset the current VAO to 0
+    [gl_state bindVertexArrayObject:0];
 
-  // restore client storage
-  [gl_state setUnpackClientStorage:client_storage];
+    // restore client storage
+    [gl_state setUnpackClientStorage:client_storage];
 
-  // we're done with the inventory unpack buffer
-  glDeleteBuffers(1, &inventory_unpack_buffer);
+    // new texture, buffer and program objects
+    glFlush();
 
-  // new texture, buffer and program objects
-  glFlush();
+    // done with OpenGL
+    CGLUnlockContext(cgl_ctx);
 
-  // done with OpenGL
-  CGLUnlockContext(cgl_ctx);
+    [startup_tasks logTimings];
+    [startup_tasks release];
+  }
 
-  _initialized = YES;
+  _initialized = loaded_inventory;
 }
 
 #pragma mark -
@@ -837,6 +948,18 @@ init_failure:
     }
   }
 
+  // decode the start of every new sound on worker threads, so that attaching them below does no decoding and they all have samples
+  // for their first render callbacks
+  CFArrayRef sourcesToPreroll = sourcesToAdd;
+  dispatch_apply(CFArrayGetCount(sourcesToPreroll), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t index) {
+    const void* value = CFArrayGetValueAtIndex(sourcesToPreroll, index);
+    RX::CardAudioSource* source = const_cast<RX::CardAudioSource*>(reinterpret_cast<const RX::CardAudioSource*>(value));
+    source->Preroll();
+  });
+
+  // if a new card is about to be shown, the new sounds stay silent until -update swaps the card's picture in
+  BOOL startOnCardSwap = _back_render_state->new_card;
+
   // if no fade out is requested, set the detach timestamp of sounds not already scheduled for detach to now
   if (!soundGroup->fadeOutRemovedSounds) {
     for (RXSound* sound in soundsToRemove) {
@@ -853,10 +976,7 @@ init_failure:
   // disable automatic graph updates on the audio renderer (e.g. begin a transaction)
   renderer->SetAutomaticGraphUpdates(false);
 
-  // FIXME: handle situation where there are not enough busses (in which case
-  // we would probably have to do a graph update to really release the busses)
-  release_assert(renderer->AvailableMixerBusCount() >= (uint32_t)CFArrayGetCount(sourcesToAdd));
-
+  // sources that do not get a mixer bus are attached as virtual sources, and get a bus as soon as one frees up
   // update active sources immediately
   [self _updateActiveSources];
 
@@ -864,13 +984,16 @@ init_failure:
   [soundsToRemove intersectSet:_activeSounds];
 
   // now that any sources bound to be detached has been, go ahead and attach as many of the new sources as possible
+  CFRange everything = CFRangeMake(0, CFArrayGetCount(sourcesToAdd));
   if (soundGroup->fadeInNewSounds || _forceFadeInOnNextSoundGroup) {
     // disabling the sources will prevent the fade in from starting before we update the graph
-    CFRange everything = CFRangeMake(0, CFArrayGetCount(sourcesToAdd));
     CFArrayApplyFunction(sourcesToAdd, everything, RXCardAudioSourceDisableApplier, [g_world audioRenderer]);
     renderer->AttachSources(sourcesToAdd);
     CFArrayApplyFunction(sourcesToAdd, everything, RXCardAudioSourceFadeInApplier, [g_world audioRenderer]);
   } else {
+    // a disabled source renders silence without consuming its samples
+    if (startOnCardSwap)
+      CFArrayApplyFunction(sourcesToAdd, everything, RXCardAudioSourceDisableApplier, [g_world audioRenderer]);
     renderer->AttachSources(sourcesToAdd);
   }
 
@@ -883,9 +1006,13 @@ init_failure:
     _sourcesToDelete = NULL;
   }
 
-  // enable all the new audio sources
-  if (soundGroup->fadeInNewSounds || _forceFadeInOnNextSoundGroup) {
-    CFRange everything = CFRangeMake(0, CFArrayGetCount(sourcesToAdd));
+  // enable all the new audio sources, or leave that to -update if the new card is not on screen yet
+  if (startOnCardSwap) {
+    for (RXSound* sound in soundGroupSounds) {
+      if (sound->source && !sound->source->Enabled())
+        [_soundsAwaitingCardSwap addObject:sound];
+    }
+  } else if (soundGroup->fadeInNewSounds || _forceFadeInOnNextSoundGroup) {
     CFArrayApplyFunction(sourcesToAdd, everything, RXCardAudioSourceEnableApplier, [g_world audioRenderer]);
   }
 
@@ -940,6 +1067,9 @@ init_failure:
     sound->source = new RX::CardAudioSource(decompressor, sound->gain, sound->pan, false);
     release_assert(sound->source);
 
+    // data sounds are one-shot effects tied to script actions and must be heard, so they outrank ambient sounds for mixer busses
+    sound->source->SetPriority(1);
+
     // make sure the sound doesn't have a valid detach timestamp
     sound->detach_timestamp = 0;
 
@@ -1022,14 +1152,34 @@ init_failure:
   thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_PRECEDENCE_POLICY, (thread_policy_t) & precedencePolicy, THREAD_PRECEDENCE_POLICY_COUNT);
 
   uint32_t cycles = 0;
+  uint32_t statistics_cycles = 0;
+  std::vector<RXCardAudioSourceStatisticsEntry> source_statistics;
   while (1) {
+    // log audio telemetry every few cycles if requested
+    bool log_statistics = false;
+    statistics_cycles++;
+    if (statistics_cycles >= RX_AUDIO_STATISTICS_LOG_INTERVAL) {
+      statistics_cycles = 0;
+      log_statistics = RXEngineGetBool(@"rendering.audio_stats");
+    }
+
     OSSpinLockLock(&_audioTaskThreadStatusLock);
 
     everything.length = CFArrayGetCount(_activeSources);
     CFArrayApplyFunction(_activeSources, everything, RXCardAudioSourceTaskApplier, renderer);
+    // only copy the statistics under the lock; logging can block, and the main thread takes the lock to update the active sources
+    source_statistics.clear();
+    if (log_statistics)
+      CFArrayApplyFunction(_activeSources, everything, RXCardAudioSourceStatisticsApplier, &source_statistics);
 
     OSSpinLockUnlock(&_audioTaskThreadStatusLock);
 
+    if (log_statistics) {
+      for (const RXCardAudioSourceStatisticsEntry& entry : source_statistics)
+        RX::CardAudioSource::LogStatistics(entry.source, entry.statistics);
+      reinterpret_cast<RX::AudioRenderer*>(renderer)->LogStatistics();
+    }
+
     // recycle the pool every 500 cycles
     cycles++;
     if (cycles > 500) {
@@ -1200,6 +1350,7 @@ init_failure:
   if ([_transitionQueue count] > 0 && !_disable_transition_dequeueing) {
     _back_render_state->transition = [[_transitionQueue objectAtIndex:0] retain];
     [_transitionQueue removeAllObjects];
+    [self _loadTransitionProgramForTransition:_back_render_state->transition];
 
 #if defined(DEBUG)
     RXOLog2(kRXLoggingGraphics, kRXLoggingLevelDebug, @"dequeued transition %@ [queue depth=%u]", _back_render_state->transition, [_transitionQueue count]);
@@ -1270,16 +1421,39 @@ init_failure:
 
     // show the mouse cursor again (matches the hideMousrCursor in setActiveCardWithSimpleDescriptor
     [self showMouseCursor];
+
+    // the new card's picture is up on the next frame, start its sounds with it
+    [self _startSoundsAwaitingCardSwap];
+  }
+}
+
+- (void)_startSoundsAwaitingCardSwap
+{
+  // WARNING: MUST RUN ON THE SCRIPT THREAD
+  // sounds removed since they were activated no longer have a source
+  for (RXSound* sound in _soundsAwaitingCardSwap) {
+    if (sound->source)
+      sound->source->SetEnabled(true);
   }
+  [_soundsAwaitingCardSwap removeAllObjects];
 }
 
 - (void)beginEndCredits
 {
+  // start decoding the credits pages now, so that they are ready by the time the render thread needs them
+  MHKArchive* archive = [[RXArchiveManager sharedArchiveManager] extrasArchive:NULL];
+  RXCreditsPrefetcher* prefetcher = [[RXCreditsPrefetcher alloc] initWithArchive:archive];
+
   OSSpinLockLock(&_render_lock);
+  RXCreditsPrefetcher* old_prefetcher = _credits_prefetcher;
+  _credits_prefetcher = prefetcher;
   _render_credits = YES;
   _credits_state = 0;
   OSSpinLockUnlock(&_render_lock);
 
+  [old_prefetcher cancel];
+  [old_prefetcher release];
+
   [self hideMouseCursor];
 }
 
@@ -1491,6 +1665,16 @@ init_failure:
 
   // read the front render state pointer once and alias it for this method
   struct rx_card_state_render_state* r = _front_render_state;
+  RX::FrameStatistics* frame_stats = reinterpret_cast<RX::FrameStatistics*>(_frame_statistics);
+
+  // the static refresh waits for the textures of the new pictures without blocking this thread; until they are uploaded, the dynamic RT
+  // keeps showing the previous frame and the refresh stays pending
+  if (r->refresh_static) {
+    for (id<RXRenderingProtocol> renderObject in r->pictures) {
+      if ([renderObject isKindOfClass:[RXDynamicPicture class]] && ![(RXDynamicPicture*)renderObject isReadyToRender])
+        return;
+    }
+  }
 
   // draw in the dynamic RT
   glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, _fbos[RX_CARD_DYNAMIC_RENDER_INDEX]);
@@ -1507,66 +1691,127 @@ init_failure:
 
   // render static card pictures only when necessary
   if (r->refresh_static) {
+    frame_stats->SetFlags(RX::kFrameFlagStaticRefresh);
+    frame_stats->BeginPhase(RX::kFramePhaseStaticPictures);
+
+    // upload the vertices of new dynamic pictures in one go
+    [RXDynamicPicture flushVertexStagingInContext:cgl_ctx];
+
     // render each picture
     for (id<RXRenderingProtocol> renderObject in r->pictures)
       [renderObject render:outputTime inContext:cgl_ctx framebuffer:_fbos[RX_CARD_DYNAMIC_RENDER_INDEX]];
+
+    frame_stats->EndPhase(RX::kFramePhaseStaticPictures);
   }
 
   if (r->water_fx.sfxe && !_water_sfx_disabled) {
-    // if we refreshed pictures, we need to reset the special effect and copy the RT back to main memory
+    frame_stats->SetFlags(RX::kFrameFlagWater);
+    frame_stats->BeginPhase(RX::kFramePhaseWater);
+
+    // if we refreshed pictures, we need to reset the special effect and capture the static content of the RT
     if (r->refresh_static) {
       r->water_fx.current_frame = 0;
       r->water_fx.frame_timestamp = 0;
 
-      // we need to immediately readback the dynamic RT into the water readback buffer and copy the content into the water draw buffer
-      glFlush();
-      glReadPixels(0, 0, kRXCardViewportSize.width, kRXCardViewportSize.height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, _water_readback_buffer);
-      glReportError();
+      // the rendering mode can only change here, since each mode captures the static content differently
+      _water_gpu = RXEngineGetBool(@"rendering.water_gpu");
 
-      memcpy(_water_draw_buffer, _water_readback_buffer, kRXCardViewportSize.width * kRXCardViewportSize.height << 2);
+      if (_water_gpu) {
+        // copy the dynamic RT into the water static texture; this stays on the GPU
+        glBindTexture(GL_TEXTURE_RECTANGLE_ARB, _water_static_texture);
+        glReportError();
+        glCopyTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, 0, 0, 0, 0, kRXCardViewportSize.width, kRXCardViewportSize.height);
+        glReportError();
+      } else {
+        // we need to immediately readback the dynamic RT into the water readback buffer and copy the content into the water draw buffer
+        glFlush();
+        glReadPixels(0, 0, kRXCardViewportSize.width, kRXCardViewportSize.height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, _water_readback_buffer);
+        glReportError();
+
+        memcpy(_water_draw_buffer, _water_readback_buffer, kRXCardViewportSize.width * kRXCardViewportSize.height << 2);
+      }
     }
 
     // if the special effect frame timestamp is 0 or expired, update the special effect texture
     double fps_inverse = 1.0 / r->water_fx.sfxe->record->fps;
     if (r->water_fx.frame_timestamp == 0 || RXTimingTimestampDelta(outputTime->hostTime, r->water_fx.frame_timestamp) >= fps_inverse) {
-      // run the water microprogram for the current sfxe frame
-      union {
-        uint16_t* p_int16;
-        void* p_void;
-      } mp;
-      mp.p_void = BUFFER_OFFSET(r->water_fx.sfxe->record, r->water_fx.sfxe->offsets[r->water_fx.current_frame]);
-
-      uint16_t draw_row = r->water_fx.sfxe->record->rect.top;
-      while (*mp.p_int16 != 4) {
-        if (*mp.p_int16 == 1) {
-          draw_row++;
-        } else if (*mp.p_int16 == 3) {
-          memcpy(BUFFER_OFFSET(_water_draw_buffer, (draw_row * kRXCardViewportSize.width + mp.p_int16[1]) << 2),
-                 BUFFER_OFFSET(_water_readback_buffer, (mp.p_int16[3] * kRXCardViewportSize.width + mp.p_int16[2]) << 2), mp.p_int16[4] << 2);
-          mp.p_int16 += 4;
-        } else {
-          abort();
+      rx_card_sfxe* sfxe = r->water_fx.sfxe;
+      const struct rx_sfxe_frame* frame = sfxe->frames + r->water_fx.current_frame;
+
+      if (_water_gpu) {
+        if (sfxe != _water_vbo_sfxe)
+          [self _uploadWaterSpanQuads:sfxe owner:r->water_fx.owner inContext:cgl_ctx];
+
+        // draw the span quads of the current sfxe frame straight into the dynamic RT, sampling the static texture
+        if (frame->span_count > 0) {
+          [RXGetContextState(cgl_ctx) bindVertexArrayObject:_water_vao];
+          glBindTexture(GL_TEXTURE_RECTANGLE_ARB, _water_static_texture);
+          glReportError();
+          glDrawArrays(GL_QUADS, frame->first_span * 4, frame->span_count * 4);
+          glReportError();
+        }
+      } else {
+        // run the compiled water program for the current sfxe frame
+        rx_sfxe_execute_frame(sfxe, r->water_fx.current_frame, (uint32_t*)_water_draw_buffer, (const uint32_t*)_water_readback_buffer);
+
+        // upload the frame's dirty rect into the dynamic RT texture through the next unpack buffer of the ring; pixels outside of the
+        // dirty rect have not changed since the previous upload
+        if (frame->span_count > 0) {
+          GLsizei dirty_width = frame->dirty_rect.right - frame->dirty_rect.left;
+          GLsizei dirty_height = frame->dirty_rect.bottom - frame->dirty_rect.top;
+          size_t row_bytes = dirty_width << 2;
+
+          // the GPU may still be reading this buffer if it is a whole ring behind
+          if (!_water_unpack_fences[0]) {
+            glGenFencesAPPLE(RX_WATER_UNPACK_BUFFER_COUNT, _water_unpack_fences);
+            glReportError();
+          } else if (_water_unpack_fence_pending[_water_unpack_index]) {
+            glFinishFenceAPPLE(_water_unpack_fences[_water_unpack_index]);
+            _water_unpack_fence_pending[_water_unpack_index] = NO;
+          }
+
+          glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _water_unpack_buffers[_water_unpack_index]);
+          glReportError();
+          void* unpack_buffer = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+          glReportError();
+
+          const uint32_t* dirty_source = (const uint32_t*)_water_draw_buffer + frame->dirty_rect.top * kRXCardViewportSize.width + frame->dirty_rect.left;
+          for (GLsizei row = 0; row < dirty_height; row++)
+            memcpy(BUFFER_OFFSET(unpack_buffer, row * row_bytes), dirty_source + row * kRXCardViewportSize.width, row_bytes);
+
+          glFlushMappedBufferRangeAPPLE(GL_PIXEL_UNPACK_BUFFER, 0, row_bytes * dirty_height);
+          glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+          glReportError();
+
+          glBindTexture(GL_TEXTURE_RECTANGLE_ARB, _textures[RX_CARD_DYNAMIC_RENDER_INDEX]);
+          glReportError();
+          glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, frame->dirty_rect.left, frame->dirty_rect.top, dirty_width, dirty_height, GL_BGRA,
+                          GL_UNSIGNED_INT_8_8_8_8_REV, (GLvoid*)0);
+          glReportError();
+          glSetFenceAPPLE(_water_unpack_fences[_water_unpack_index]);
+          _water_unpack_fence_pending[_water_unpack_index] = YES;
+
+          glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+          glReportError();
+          _water_unpack_index = (_water_unpack_index + 1) % RX_WATER_UNPACK_BUFFER_COUNT;
         }
-
-        mp.p_int16++;
       }
 
-      // update the dynamic RT texture from the water draw buffer
-      glBindTexture(GL_TEXTURE_RECTANGLE_ARB, _textures[RX_CARD_DYNAMIC_RENDER_INDEX]);
-      glReportError();
-      glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, 0, 0, kRXCardViewportSize.width, kRXCardViewportSize.height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV,
-                      _water_draw_buffer);
-      glReportError();
-
       // increment the special effect frame counter
       r->water_fx.current_frame = (r->water_fx.current_frame + 1) % r->water_fx.sfxe->record->frame_count;
       r->water_fx.frame_timestamp = outputTime->hostTime;
     }
+
+    frame_stats->EndPhase(RX::kFramePhaseWater);
   }
 
   // render movies at the very end
+  if ([_active_movies count])
+    frame_stats->SetFlags(RX::kFrameFlagMovie);
+  frame_stats->BeginPhase(RX::kFramePhaseMovies);
   for (id<RXRenderingProtocol> renderObject in _active_movies)
     _movieRenderDispatch.imp(renderObject, _movieRenderDispatch.sel, outputTime, cgl_ctx, _fbos[RX_CARD_DYNAMIC_RENDER_INDEX]);
+  frame_stats->EndPhase(RX::kFramePhaseMovies);
 
   // un-flip the y axis
   glLoadIdentity();
@@ -1575,6 +1820,30 @@ init_failure:
   r->refresh_static = NO;
 }
 
+- (void)_uploadWaterSpanQuads:(rx_card_sfxe*)sfxe owner:(id)owner inContext:(CGLContextObj)cgl_ctx
+{
+  // WARNING: MUST RUN IN THE CORE VIDEO RENDER THREAD
+
+  // keep the owner of the effect alive for as long as the VBO caches its spans, so that the sfxe pointer cannot be reused
+  [owner retain];
+  [_water_vbo_owner release];
+  _water_vbo_owner = owner;
+  _water_vbo_sfxe = sfxe;
+
+  size_t vbo_size = sizeof(struct rx_sfxe_quad_vertex) * 4 * sfxe->span_count;
+  struct rx_sfxe_quad_vertex* vertices = (struct rx_sfxe_quad_vertex*)malloc(vbo_size);
+  rx_sfxe_build_quads(sfxe, kRXCardViewportSize.width, kRXCardViewportSize.height, vertices);
+
+  glBindBuffer(GL_ARRAY_BUFFER, _water_vbo);
+  glReportError();
+  glBufferData(GL_ARRAY_BUFFER, vbo_size, vertices, GL_STATIC_DRAW);
+  glReportError();
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glReportError();
+
+  free(vertices);
+}
+
 - (void)_postFlushCard:(const CVTimeStamp*)outputTime
 {
   for (RXMovie* movie in _active_movies)
@@ -1916,24 +2185,37 @@ init_failure:
   }
 }
 
+// the spread a credits state loads when it ends, or -1 if the state does not load one
+static int rx_credits_spread_for_state_end(int credits_state)
+{
+  if (credits_state == 3)
+    return 1;
+  else if (credits_state == 6)
+    return 2;
+  else if (credits_state >= 7 && credits_state < 23)
+    return credits_state - 4;
+  return -1;
+}
+
 - (void)_renderCredits:(CGLContextObj)cgl_ctx
 {
   NSObject<RXOpenGLStateProtocol>* gl_state = RXGetContextState(cgl_ctx);
   uint64_t now = RXTimingNow();
 
+  // the credits spreads are decoded by the credits prefetcher; this method only ever uploads spreads that are ready, and holds the
+  // credits on their current state for as long as the next spread is not
+  const void* spread_pixels = NULL;
+
   if (_credits_state == 0) {
-    // initialize the credits
+    // initialize the credits once the first credits picture has been decoded
+    spread_pixels = [_credits_prefetcher acquireSpread:0];
+    if (!spread_pixels)
+      return;
 
     // start time is now
     _credits_start_time = now;
 
-    // allocate the credit texture buffer
-    _credits_texture_buffer = malloc(360 * 784 * 4);
-
     // create the credits texture and load the first credits picture in it
-    MHKArchive* archive = [[RXArchiveManager sharedArchiveManager] extrasArchive:NULL];
-    [archive loadBitmapWithID:302 buffer:_credits_texture_buffer format:MHK_BGRA_UNSIGNED_INT_8_8_8_8_REV_PACKED error:NULL];
-
     glGenTextures(1, &_credits_texture);
 
     glActiveTexture(GL_TEXTURE0);
@@ -1948,8 +2230,11 @@ init_failure:
     glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glReportError();
 
-    glTexImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, GL_RGBA8, 360, 784, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, _credits_texture_buffer);
+    glTexImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, GL_RGBA8, RX_CREDITS_PAGE_WIDTH, RX_CREDITS_PAGE_HEIGHT * 2, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV,
+                 spread_pixels);
     glReportError();
+    [_credits_prefetcher relinquishSpread:0];
+    spread_pixels = NULL;
 
     // set credits state to 1 (first fade-in picture)
     _credits_state = 1;
@@ -1989,6 +2274,14 @@ init_failure:
     // add a negative 1/3 offset to t to delay the beginning of the fade-ins
     t -= 0.33333333f;
 
+  // if the current state is over and the next one needs a spread that has not been decoded yet, hold the current state on its last frame
+  int spread = rx_credits_spread_for_state_end(_credits_state);
+  if (t > 1.0f && spread >= 0) {
+    spread_pixels = [_credits_prefetcher acquireSpread:spread];
+    if (!spread_pixels)
+      t = 1.0f;
+  }
+
   // clamp t to [0.0, 1.0], run state transition code on t > 1.0
   if (t < 0.0f) {
     t = 0.0f;
@@ -2008,11 +2301,8 @@ init_failure:
     } else if (_credits_state == 3) {
       // next: load 303 and fade-in
 
-      // load 303
-      MHKArchive* archive = [[RXArchiveManager sharedArchiveManager] extrasArchive:NULL];
-      [archive loadBitmapWithID:303 buffer:_credits_texture_buffer format:MHK_BGRA_UNSIGNED_INT_8_8_8_8_REV_PACKED error:NULL];
-
-      glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, 0, 0, 360, 392, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, _credits_texture_buffer);
+      // upload 303
+      glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, 0, 0, RX_CREDITS_PAGE_WIDTH, RX_CREDITS_PAGE_HEIGHT, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, spread_pixels);
       glReportError();
     } else if (_credits_state == 4) {
       // next: display 303
@@ -2025,12 +2315,8 @@ init_failure:
     } else if (_credits_state == 6) {
       // next: load 304 and 305 and beging scrolling credits
 
-      // load 304 and 305
-      MHKArchive* archive = [[RXArchiveManager sharedArchiveManager] extrasArchive:NULL];
-      [archive loadBitmapWithID:304 buffer:_credits_texture_buffer format:MHK_BGRA_UNSIGNED_INT_8_8_8_8_REV_PACKED error:NULL];
-      [archive loadBitmapWithID:305 buffer:BUFFER_OFFSET(_credits_texture_buffer, 360 * 392 * 4) format:MHK_BGRA_UNSIGNED_INT_8_8_8_8_REV_PACKED error:NULL];
-
-      glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, 0, 0, 360, 784, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, _credits_texture_buffer);
+      // upload 304 and 305
+      glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, 0, 0, RX_CREDITS_PAGE_WIDTH, RX_CREDITS_PAGE_HEIGHT * 2, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, spread_pixels);
       glReportError();
 
       // reset the modulate color on the card program to white
@@ -2042,26 +2328,20 @@ init_failure:
       // we need to set t to 0.5 (see the comment on if (_credit_state > 7) above)
       t = 0.5f;
 
-      // copy the previous bottom page to the top page
-      memcpy(_credits_texture_buffer, BUFFER_OFFSET(_credits_texture_buffer, 360 * 392 * 4), 360 * 392 * 4);
-
-      // load the new bottom page
-      if (_credits_state < 22) {
-        MHKArchive* archive = [[RXArchiveManager sharedArchiveManager] extrasArchive:NULL];
-        [archive loadBitmapWithID:299 + _credits_state
-                           buffer:BUFFER_OFFSET(_credits_texture_buffer, 360 * 392 * 4)
-                           format:MHK_BGRA_UNSIGNED_INT_8_8_8_8_REV_PACKED
-                            error:NULL];
-      } else {
-        memset(BUFFER_OFFSET(_credits_texture_buffer, 360 * 392 * 4), 0, 360 * 392 * 4);
+      // upload the spread with the previous bottom page on top of the new bottom page; the last state has nothing left to show
+      if (spread_pixels) {
+        glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, 0, 0, RX_CREDITS_PAGE_WIDTH, RX_CREDITS_PAGE_HEIGHT * 2, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV,
+                        spread_pixels);
+        glReportError();
       }
-
-      glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, 0, 0, 360, 784, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, _credits_texture_buffer);
-      glReportError();
     } else {
       abort();
     }
 
+    // hand the spread back to the prefetcher so that it can decode the next one
+    if (spread_pixels)
+      [_credits_prefetcher relinquishSpread:spread];
+
     // increment the credit state
     _credits_state++;
 
@@ -2070,7 +2350,9 @@ init_failure:
     if (_credits_state == 24) {
       // delete credits resources
       glDeleteTextures(1, &_credits_texture);
-      free(_credits_texture_buffer), _credits_texture_buffer = nil;
+      [_credits_prefetcher cancel];
+      [_credits_prefetcher release];
+      _credits_prefetcher = nil;
 
       // end the credits and begin a new game; note that we'll remain in credit rendering mode
       // until the active card has been cleared but we won't be rendering anything by checking
@@ -2147,6 +2429,10 @@ init_failure:
   // alias the render context state object pointer
   NSObject<RXOpenGLStateProtocol>* gl_state = RXGetContextState(cgl_ctx);
 
+  // a frame starts here and ends with the post-flush tasks; GPU time is only measured while the graph is visible
+  RX::FrameStatistics* frame_stats = reinterpret_cast<RX::FrameStatistics*>(_frame_statistics);
+  frame_stats->BeginFrame(output_time, cgl_ctx, RXEngineGetBool(@"rendering.frame_stats"));
+
   // we need an inner pool within the scope of that lock, or we run the risk
   // of autoreleased enumerators causing objects that should be deallocated on
   // the main thread not to be
@@ -2154,6 +2440,7 @@ init_failure:
 
   // end credits mode
   if (_render_credits) {
+    frame_stats->SetFlags(RX::kFrameFlagCredits);
     [self _renderCredits:cgl_ctx];
     goto exit_render;
   }
@@ -2163,6 +2450,9 @@ init_failure:
     goto exit_render;
 
   // transition priming
+  if (_front_render_state->transition)
+    frame_stats->SetFlags(RX::kFrameFlagTransition);
+  frame_stats->BeginPhase(RX::kFramePhaseComposite);
   if (_front_render_state->transition && ![_front_render_state->transition isPrimed]) {
     // bind the transition source texture
     [_transition_source_texture bindWithContext:cgl_ctx lock:NO];
@@ -2178,11 +2468,13 @@ init_failure:
     // give ownership of that texture to the transition
     [_front_render_state->transition primeWithSourceTexture:_transition_source_texture];
   }
+  frame_stats->EndPhase(RX::kFramePhaseComposite);
 
   // render the front card
   render_card_imp(self, render_card_sel, output_time, cgl_ctx);
 
   // final composite (active card + transitions + other special effects)
+  frame_stats->BeginPhase(RX::kFramePhaseComposite);
   glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
   glReportError();
   glClear(GL_COLOR_BUFFER_BIT);
@@ -2212,23 +2504,8 @@ init_failure:
       glReportError();
     } else {
       // determine which transition shading program to use based on the transition type
-      struct rx_transition_program* transition = NULL;
-      switch (_front_render_state->transition->type) {
-      case RXTransitionDissolve:
-        transition = &_dissolve;
-        break;
-
-      case RXTransitionSlide:
-        if (_front_render_state->transition->pushOld && _front_render_state->transition->pushNew)
-          transition = _push + _front_render_state->transition->direction;
-        else if (_front_render_state->transition->pushOld)
-          transition = _slide_out + _front_render_state->transition->direction;
-        else if (_front_render_state->transition->pushNew)
-          transition = _slide_in + _front_render_state->transition->direction;
-        else
-          transition = _swipe + _front_render_state->transition->direction;
-        break;
-      }
+      NSString* shader_name;
+      struct rx_transition_program* transition = [self _transitionProgramForTransition:_front_render_state->transition shaderName:&shader_name];
 
       // use the transition's program and update its t and margin uniforms
       glUseProgram(transition->program);
@@ -2257,6 +2534,7 @@ init_failure:
   // draw the card composite
   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
   glReportError();
+  frame_stats->EndPhase(RX::kFramePhaseComposite);
 
 #if defined(DEBUG)
   if (RXEngineGetBool(@"rendering.marble_lines")) {
@@ -2293,9 +2571,32 @@ exit_render:
 
 - (void)renderInMainRT:(CGLContextObj)cgl_ctx
 {
+  RX::FrameStatistics* frame_stats = reinterpret_cast<RX::FrameStatistics*>(_frame_statistics);
+
   // draw the inventory
+  frame_stats->BeginPhase(RX::kFramePhaseInventory);
   [self _renderInventory:cgl_ctx];
+  frame_stats->EndPhase(RX::kFramePhaseInventory);
+
+  frame_stats->BeginPhase(RX::kFramePhaseDebug);
+  [self _renderDebugInMainRT:cgl_ctx];
+
+  // draw the frame statistics graph in the top left corner
+  if (RXEngineGetBool(@"rendering.frame_stats")) {
+    rx_size_t viewport_size = [g_worldView viewportSize];
+    frame_stats->RenderGraph(cgl_ctx, 10.0f, viewport_size.height - 10.0f);
+  }
+  frame_stats->EndPhase(RX::kFramePhaseDebug);
+
+  // everything the GPU does for this frame has been submitted, save for the world view's fade
+  frame_stats->EndGPUTiming(cgl_ctx);
+
+  // the world view swaps buffers before calling performPostFlushTasks:
+  frame_stats->BeginPhase(RX::kFramePhaseSwap);
+}
 
+- (void)_renderDebugInMainRT:(CGLContextObj)cgl_ctx
+{
 #if defined(DEBUG)
   // alias the render context state object pointer
   NSObject<RXOpenGLStateProtocol>* gl_state = RXGetContextState(cgl_ctx);
@@ -2628,6 +2929,9 @@ exit_render:
   // WARNING: MUST RUN IN THE CORE VIDEO RENDER THREAD
   OSSpinLockLock(&_render_lock);
 
+  RX::FrameStatistics* frame_stats = reinterpret_cast<RX::FrameStatistics*>(_frame_statistics);
+  frame_stats->EndPhase(RX::kFramePhaseSwap);
+
   // we need an inner pool within the scope of that lock, or we run the risk of
   // autoreleased enumerators causing objects that should be deallocated on the
   // main thread not to be
@@ -2637,10 +2941,20 @@ exit_render:
   if (!_front_render_state->card)
     goto exit_flush_tasks;
 
+  frame_stats->BeginPhase(RX::kFramePhasePostFlush);
   post_flush_card_imp(self, post_flush_card_sel, outputTime);
+  frame_stats->EndPhase(RX::kFramePhasePostFlush);
+
+  // the first card frame on screen marks the end of startup
+  if (!_first_frame_presented) {
+    _first_frame_presented = YES;
+    RXOLog2(kRXLoggingEngine, kRXLoggingLevelMessage, @"time to first frame: %.2f ms",
+            RXTimingTimestampDelta(RXTimingNow(), [g_world startupTimestamp]) * 1000.0);
+  }
 
 exit_flush_tasks:
   [p release];
+  frame_stats->EndFrame();
   OSSpinLockUnlock(&_render_lock);
 }
 
@@ -2682,6 +2996,27 @@ exit_flush_tasks:
   [image_rep release];
 }
 
+- (void)exportFrameStatistics
+{
+  NSString* csv_name = [NSString stringWithFormat:@"frame statistics %ld", (long)time(NULL)];
+  NSString* csv_path = [[[NSSearchPathForDirectoriesInDomains(NSDesktopDirectory, NSUserDomainMask, YES) objectAtIndex:0]
+      stringByAppendingPathComponent:csv_name] stringByAppendingPathExtension:@"csv"];
+
+  FILE* file = fopen([csv_path fileSystemRepresentation], "w");
+  if (!file) {
+    RXOLog2(kRXLoggingGraphics, kRXLoggingLevelError, @"failed to open %@ to export frame statistics: %s", csv_path, strerror(errno));
+    return;
+  }
+
+  bool written = reinterpret_cast<RX::FrameStatistics*>(_frame_statistics)->WriteCSV(file);
+  fclose(file);
+
+  if (written)
+    RXOLog2(kRXLoggingGraphics, kRXLoggingLevelMessage, @"exported frame statistics to %@", csv_path);
+  else
+    RXOLog2(kRXLoggingGraphics, kRXLoggingLevelError, @"failed to export frame statistics to %@", csv_path);
+}
+
 #pragma mark -
 #pragma mark user event handling
 
@@ -2796,21 +3131,14 @@ exit_flush_tasks:
   // get the mouse vector using the getter since it will take the spin lock and return a copy
   NSRect mouse_vector = [self mouseVector];
 
-  // get the front card's active hotspots
-  NSArray* active_hotspots = [sengine activeHotspots];
-
   // update the active status of the inventory based on the position of the mouse
   if (NSMouseInRect(mouse_vector.origin, [(NSView*)g_worldView bounds], NO) && mouse_vector.origin.y < kRXInventorySize.height)
     _inventory_has_focus = YES;
   else
     _inventory_has_focus = NO;
 
-  // find over which hotspot the mouse is
-  RXHotspot* hotspot = nil;
-  for (hotspot in active_hotspots) {
-    if (NSMouseInRect(mouse_vector.origin, [hotspot worldFrame], NO))
-      break;
-  }
+  // find over which hotspot the mouse is; the script engine looks it up in its hotspot grid without copying the active hotspots
+  RXHotspot* hotspot = [sengine activeHotspotAtWorldPoint:mouse_vector.origin];
 
   // now check if we're over one of the inventory regions
   if (!hotspot) {
@@ -2846,14 +3174,14 @@ exit_flush_tasks:
     [hotspot setEvent:event];
 
     // let the script engine run mouse up scripts
-    [sengine performSelector:@selector(mouseUpInHotspot:) withObject:hotspot inThread:[g_world scriptThread]];
+    [sengine postHotspotEvent:RX_HOTSPOT_EVENT_MOUSE_UP hotspot:hotspot];
   }
 
   // if the old current hotspot is valid, doesn't match the new current hotspot and is still active, we need to send the old
   // current hotspot a mouse exited message
-  if (_current_hotspot >= (RXHotspot*)0x1000 && _current_hotspot != hotspot && [active_hotspots indexOfObjectIdenticalTo:_current_hotspot] != NSNotFound) {
+  if (_current_hotspot >= (RXHotspot*)0x1000 && _current_hotspot != hotspot && [sengine isHotspotActive:_current_hotspot]) {
     // note that we DO NOT disable hotspot handling for "exited hotspot" messages
-    [sengine performSelector:@selector(mouseExitedHotspot:) withObject:_current_hotspot inThread:[g_world scriptThread]];
+    [sengine postHotspotEvent:RX_HOTSPOT_EVENT_MOUSE_EXITED hotspot:_current_hotspot];
   }
 
   // handle cursor changes here so we don't ping-pong across 2 threads (at least for a hotspot's cursor, the inventory item
@@ -2866,9 +3194,9 @@ exit_flush_tasks:
     [g_worldView setCursor:[g_world cursorForID:[hotspot cursorID]]];
 
     // valid hotspots receive periodic "inside hotspot" messages when the mouse is not dragging; note that we do NOT disable
-    // hotspot handling for "inside hotspot" messages
+    // hotspot handling for "inside hotspot" messages, and that the script engine coalesces those the script thread is behind on
     if (isinf(mouse_vector.size.width))
-      [sengine performSelector:@selector(mouseInsideHotspot:) withObject:hotspot inThread:[g_world scriptThread]];
+      [sengine postHotspotEvent:RX_HOTSPOT_EVENT_MOUSE_INSIDE hotspot:hotspot];
   }
 
   // update the current hotspot to the new current hotspot
@@ -3006,7 +3334,7 @@ exit_flush_tasks:
     [self disableHotspotHandling];
 
     // let the script engine run mouse down scripts
-    [sengine performSelector:@selector(mouseDownInHotspot:) withObject:_current_hotspot inThread:[g_world scriptThread]];
+    [sengine postHotspotEvent:RX_HOTSPOT_EVENT_MOUSE_DOWN hotspot:_current_hotspot];
   } else if (_current_hotspot) {
     [self _handleInventoryMouseDownWithItemIndex:(uintptr_t)_current_hotspot - 1];
   }
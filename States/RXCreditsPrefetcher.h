@@ -0,0 +1,53 @@
+//
+//  RXCreditsPrefetcher.h
+//  rivenx
+//
+
+#import "Base/RXBase.h"
+
+#import <dispatch/dispatch.h>
+
+#import <MHKKit/MHKArchive.h>
+
+// size of a credits page, in pixels; a spread is two pages on top of each other, which is what the credits texture holds
+#define RX_CREDITS_PAGE_WIDTH 360
+#define RX_CREDITS_PAGE_HEIGHT 392
+#define RX_CREDITS_PAGE_SIZE (RX_CREDITS_PAGE_WIDTH * RX_CREDITS_PAGE_HEIGHT * 4)
+#define RX_CREDITS_SPREAD_SIZE (RX_CREDITS_PAGE_SIZE * 2)
+
+// number of spreads the credits go through: 302 and 303 on their own, then 304 over 305, then every page over the next one up to the
+// last page over an empty page
+#define RX_CREDITS_SPREAD_COUNT 19
+
+// number of spread buffers the decoder can run ahead of the render thread
+#define RX_CREDITS_SLOT_COUNT 2
+
+// Decodes the end credits spreads in order on a background queue, ahead of the render thread. Every spread is decoded into the next
+// buffer of a small ring and published through that buffer's slot with a release store; the render thread polls the slot of the spread
+// it needs with an acquire load and never waits, so no decoding happens inside the display link callback. Handing a buffer back signals
+// the decoder that it can move on to the next spread.
+@interface RXCreditsPrefetcher : NSObject {
+  MHKArchive* _archive;
+  dispatch_queue_t _decode_queue;
+  dispatch_semaphore_t _free_slots;
+
+  void* _spread_buffers[RX_CREDITS_SLOT_COUNT];
+  int32_t _slot_spreads[RX_CREDITS_SLOT_COUNT];
+
+  // the bottom page of the last decoded spread, which is the top page of the next one
+  void* _previous_page;
+
+  int32_t _cancelled;
+}
+
+- (id)initWithArchive:(MHKArchive*)archive;
+
+// render thread; returns the pixels of a spread, or NULL if the decoder has not finished it yet; every spread is acquired once, in
+// order, and must be handed back with relinquishSpread: before the next one can be acquired
+- (const void*)acquireSpread:(uint32_t)spread;
+- (void)relinquishSpread:(uint32_t)spread;
+
+// stops the decoder and waits for it to exit; must be called before the prefetcher is released
+- (void)cancel;
+
+@end
@@ -0,0 +1,153 @@
+//
+//  RXCreditsPrefetcher.m
+//  rivenx
+//
+
+#import "States/RXCreditsPrefetcher.h"
+
+// slot value for a buffer that holds no published spread
+#define RX_CREDITS_SLOT_EMPTY -1
+
+@interface RXCreditsPrefetcher ()
+- (void)_decodeSpreads;
+@end
+
+// bitmaps of the top and bottom pages of a spread, 0 for an empty page; from the fourth spread on, the top page is the previous bottom
+// page and is not decoded again
+static void rx_credits_spread_bitmaps(uint32_t spread, uint16_t* top, uint16_t* bottom)
+{
+  if (spread == 0) {
+    *top = 302;
+    *bottom = 0;
+  } else if (spread == 1) {
+    *top = 303;
+    *bottom = 0;
+  } else if (spread == 2) {
+    *top = 304;
+    *bottom = 305;
+  } else {
+    *top = 0;
+    *bottom = (spread < 18) ? 303 + spread : 0;
+  }
+}
+
+@implementation RXCreditsPrefetcher
+
+- (id)init
+{
+  [self doesNotRecognizeSelector:_cmd];
+  [self release];
+  return nil;
+}
+
+- (id)initWithArchive:(MHKArchive*)archive
+{
+  self = [super init];
+  if (!self)
+    return nil;
+
+  _archive = [archive retain];
+
+  for (uint32_t i = 0; i < RX_CREDITS_SLOT_COUNT; i++) {
+    _spread_buffers[i] = malloc(RX_CREDITS_SPREAD_SIZE);
+    _slot_spreads[i] = RX_CREDITS_SLOT_EMPTY;
+  }
+  _previous_page = malloc(RX_CREDITS_PAGE_SIZE);
+
+  // libdispatch refuses to release a semaphore whose value is below its initial value, which would be the case if the prefetcher was
+  // cancelled while the render thread holds slots; start from 0 and hand out the slots with signals instead
+  _free_slots = dispatch_semaphore_create(0);
+  for (uint32_t i = 0; i < RX_CREDITS_SLOT_COUNT; i++)
+    dispatch_semaphore_signal(_free_slots);
+  _decode_queue = dispatch_queue_create("org.macstorm.rivenx.credits.decode", DISPATCH_QUEUE_SERIAL);
+
+  // the decode block retains the prefetcher until it has decoded every spread or has been cancelled
+  dispatch_async(_decode_queue, ^(void) { [self _decodeSpreads]; });
+
+  return self;
+}
+
+- (void)dealloc
+{
+  dispatch_release(_decode_queue);
+  dispatch_release(_free_slots);
+
+  for (uint32_t i = 0; i < RX_CREDITS_SLOT_COUNT; i++)
+    free(_spread_buffers[i]);
+  free(_previous_page);
+
+  [_archive release];
+
+  [super dealloc];
+}
+
+- (void)_loadPage:(uint16_t)bitmap_id buffer:(void*)buffer
+{
+  if (bitmap_id == 0) {
+    memset(buffer, 0, RX_CREDITS_PAGE_SIZE);
+    return;
+  }
+
+  NSError* error = nil;
+  if (![_archive loadBitmapWithID:bitmap_id buffer:buffer format:MHK_BGRA_UNSIGNED_INT_8_8_8_8_REV_PACKED error:&error]) {
+    RXOLog2(kRXLoggingGraphics, kRXLoggingLevelError, @"failed to load credits bitmap %hu: %@", bitmap_id, error);
+    memset(buffer, 0, RX_CREDITS_PAGE_SIZE);
+  }
+}
+
+- (void)_decodeSpreads
+{
+  for (uint32_t spread = 0; spread < RX_CREDITS_SPREAD_COUNT; spread++) {
+    dispatch_semaphore_wait(_free_slots, DISPATCH_TIME_FOREVER);
+    if (__atomic_load_n(&_cancelled, __ATOMIC_ACQUIRE))
+      return;
+
+    NSAutoreleasePool* p = [NSAutoreleasePool new];
+
+    uint32_t slot = spread % RX_CREDITS_SLOT_COUNT;
+    void* buffer = _spread_buffers[slot];
+    void* bottom_page = BUFFER_OFFSET(buffer, RX_CREDITS_PAGE_SIZE);
+
+    uint16_t top_id, bottom_id;
+    rx_credits_spread_bitmaps(spread, &top_id, &bottom_id);
+
+    if (top_id)
+      [self _loadPage:top_id buffer:buffer];
+    else
+      memcpy(buffer, _previous_page, RX_CREDITS_PAGE_SIZE);
+
+    [self _loadPage:bottom_id buffer:bottom_page];
+    memcpy(_previous_page, bottom_page, RX_CREDITS_PAGE_SIZE);
+
+    [p release];
+
+    // publish the spread; the release store orders the pixel writes before the slot update
+    __atomic_store_n(&_slot_spreads[slot], (int32_t)spread, __ATOMIC_RELEASE);
+  }
+}
+
+- (const void*)acquireSpread:(uint32_t)spread
+{
+  uint32_t slot = spread % RX_CREDITS_SLOT_COUNT;
+  if (__atomic_load_n(&_slot_spreads[slot], __ATOMIC_ACQUIRE) != (int32_t)spread)
+    return NULL;
+  return _spread_buffers[slot];
+}
+
+- (void)relinquishSpread:(uint32_t)spread
+{
+  uint32_t slot = spread % RX_CREDITS_SLOT_COUNT;
+  __atomic_store_n(&_slot_spreads[slot], RX_CREDITS_SLOT_EMPTY, __ATOMIC_RELEASE);
+  dispatch_semaphore_signal(_free_slots);
+}
+
+- (void)cancel
+{
+  __atomic_store_n(&_cancelled, 1, __ATOMIC_RELEASE);
+
+  // wake the decoder if it is waiting for a slot, then wait for it to exit
+  dispatch_semaphore_signal(_free_slots);
+  dispatch_sync(_decode_queue, ^(void) {});
+}
+
+@end
@@ -0,0 +1,220 @@
+//
+//  MHKMovieDecoder_test.m
+//  rivenx
+//
+//  Decodes every tMOV movie of the given archives with MHKMovieDecoder, without QuickTime or a display, checks that frames come out in
+//  order and that seeks and selections land on exact frames, and reports decode throughput and per-frame latency.
+//
+//  usage: MHKMovieDecoder_test [--lookahead N] [--no-seek-check] archive.MHK [...]
+//
+
+#import <Foundation/Foundation.h>
+
+#import <mach/mach_time.h>
+#import <sysexits.h>
+
+#import <MHKKit/MHKKit.h>
+
+static uint64_t now_ns(void)
+{
+  static mach_timebase_info_data_t timebase = {0, 0};
+  if (timebase.denom == 0)
+    mach_timebase_info(&timebase);
+  return mach_absolute_time() * timebase.numer / timebase.denom;
+}
+
+static int compare_uint64(const void* a, const void* b)
+{
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+struct movie_stats {
+  uint32_t frame_count;
+  uint64_t wall_ns;
+  uint64_t* decode_ns; // per-frame decoder thread time
+  uint64_t* wait_ns;   // per-frame time the consumer waited in dequeueFrame:
+  int64_t* pts;
+};
+
+// decodes the whole movie, checking that presentation times increase; returns NO on failure
+static BOOL decode_movie(MHKMovieDecoder* decoder, struct movie_stats* stats, uint32_t capacity)
+{
+  stats->frame_count = 0;
+  int64_t previous_pts = INT64_MIN;
+
+  uint64_t start = now_ns();
+  for (;;) {
+    uint64_t wait_start = now_ns();
+    const mhk_movie_frame_t* frame = [decoder dequeueFrame:YES];
+    uint64_t wait_end = now_ns();
+    if (!frame)
+      break;
+
+    if (frame->pts <= previous_pts) {
+      fprintf(stderr, "    frame %u: pts %lld does not follow %lld\n", stats->frame_count, frame->pts, previous_pts);
+      [decoder relinquishFrame:frame];
+      return NO;
+    }
+    previous_pts = frame->pts;
+
+    if (stats->frame_count < capacity) {
+      stats->decode_ns[stats->frame_count] = frame->decode_ns;
+      stats->wait_ns[stats->frame_count] = wait_end - wait_start;
+      stats->pts[stats->frame_count] = frame->pts;
+    }
+    stats->frame_count++;
+
+    [decoder relinquishFrame:frame];
+  }
+  stats->wall_ns = now_ns() - start;
+
+  if ([decoder error]) {
+    fprintf(stderr, "    decoding failed: %s\n", [[[decoder error] localizedDescription] UTF8String]);
+    return NO;
+  }
+  return stats->frame_count > 0;
+}
+
+// seeks to a few frames and checks that the first dequeued frame is the one displayed at the target, then checks that a selection
+// yields exactly the frames inside of it
+static BOOL check_seeks(MHKMovieDecoder* decoder, const struct movie_stats* stats)
+{
+  uint32_t count = stats->frame_count;
+  uint32_t targets[] = {count / 2, count / 3, count - 1, 1, 0};
+  for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+    uint32_t target = targets[i];
+
+    // aim in the middle of the frame, so that the seek has to find the frame that contains the time rather than one that starts at it
+    int64_t time = stats->pts[target];
+    if (target + 1 < count)
+      time += (stats->pts[target + 1] - stats->pts[target]) / 2;
+
+    [decoder seekToTime:time timeScale:[decoder timeScale]];
+    const mhk_movie_frame_t* frame = [decoder dequeueFrame:YES];
+    if (!frame || frame->pts != stats->pts[target]) {
+      fprintf(stderr, "    seek to %lld landed on pts %lld instead of %lld\n", time, frame ? frame->pts : -1, stats->pts[target]);
+      if (frame)
+        [decoder relinquishFrame:frame];
+      return NO;
+    }
+    [decoder relinquishFrame:frame];
+  }
+
+  if (count < 4)
+    return YES;
+
+  uint32_t first = count / 4, last = count / 2;
+  [decoder setSelectionStart:stats->pts[first] duration:stats->pts[last] - stats->pts[first] timeScale:[decoder timeScale]];
+  for (uint32_t expected = first; expected < last; expected++) {
+    const mhk_movie_frame_t* frame = [decoder dequeueFrame:YES];
+    if (!frame || frame->pts != stats->pts[expected]) {
+      fprintf(stderr, "    selection frame %u has pts %lld instead of %lld\n", expected, frame ? frame->pts : -1, stats->pts[expected]);
+      if (frame)
+        [decoder relinquishFrame:frame];
+      return NO;
+    }
+    [decoder relinquishFrame:frame];
+  }
+  if ([decoder dequeueFrame:YES]) {
+    fprintf(stderr, "    selection did not end at pts %lld\n", stats->pts[last]);
+    return NO;
+  }
+
+  return YES;
+}
+
+int main(int argc, char* const argv[])
+{
+  NSAutoreleasePool* pool = [NSAutoreleasePool new];
+
+  uint32_t lookahead = 8;
+  BOOL seek_check = YES;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (strcmp(argv[arg], "--lookahead") == 0 && arg + 1 < argc)
+      lookahead = (uint32_t)strtoul(argv[++arg], NULL, 10);
+    else if (strcmp(argv[arg], "--no-seek-check") == 0)
+      seek_check = NO;
+    else
+      break;
+  }
+  if (arg >= argc) {
+    fprintf(stderr, "usage: %s [--lookahead N] [--no-seek-check] archive.MHK [...]\n", argv[0]);
+    return EX_USAGE;
+  }
+
+  int failures = 0;
+  uint64_t total_frames = 0, total_ns = 0;
+
+  for (; arg < argc; arg++) {
+    NSError* error = nil;
+    MHKArchive* archive = [[MHKArchive alloc] initWithPath:[NSString stringWithUTF8String:argv[arg]] error:&error];
+    if (!archive) {
+      fprintf(stderr, "%s: %s\n", argv[arg], [[error localizedDescription] UTF8String]);
+      failures++;
+      continue;
+    }
+
+    fprintf(stderr, "%s\n", argv[arg]);
+    for (NSDictionary* descriptor in [archive valueForKey:@"tMOV"]) {
+      NSAutoreleasePool* p = [NSAutoreleasePool new];
+      uint16_t movie_id = [[descriptor objectForKey:@"ID"] unsignedShortValue];
+
+      MHKMovieDecoder* decoder = [[MHKMovieDecoder alloc] initWithArchive:archive movieID:movie_id lookahead:lookahead error:&error];
+      if (!decoder) {
+        fprintf(stderr, "  tMOV %hu: %s\n", movie_id, [[error localizedDescription] UTF8String]);
+        failures++;
+        [p release];
+        continue;
+      }
+
+      // QuickTime movies in Riven are short; size the statistics for the worst case of one frame per time unit
+      uint32_t capacity = (uint32_t)MIN([decoder duration] + 1, 1 << 20);
+      struct movie_stats stats;
+      stats.decode_ns = malloc(capacity * sizeof(uint64_t));
+      stats.wait_ns = malloc(capacity * sizeof(uint64_t));
+      stats.pts = malloc(capacity * sizeof(int64_t));
+
+      BOOL ok = decode_movie(decoder, &stats, capacity);
+      if (ok && seek_check && stats.frame_count <= capacity)
+        ok = check_seeks(decoder, &stats);
+
+      if (ok) {
+        uint32_t n = MIN(stats.frame_count, capacity);
+        uint64_t decode_total = 0;
+        for (uint32_t i = 0; i < n; i++)
+          decode_total += stats.decode_ns[i];
+        qsort(stats.decode_ns, n, sizeof(uint64_t), compare_uint64);
+        qsort(stats.wait_ns, n, sizeof(uint64_t), compare_uint64);
+
+        double seconds = (double)stats.wall_ns / 1.0e9;
+        fprintf(stderr, "  tMOV %5hu %3ux%-3u %5u frames: %8.1f fps, decode avg %6.2f ms p95 %6.2f ms max %6.2f ms, consumer wait p95 %6.2f ms\n",
+                movie_id, [decoder width], [decoder height], stats.frame_count, stats.frame_count / seconds, decode_total / (n * 1.0e6),
+                stats.decode_ns[(n * 95) / 100] / 1.0e6, stats.decode_ns[n - 1] / 1.0e6, stats.wait_ns[(n * 95) / 100] / 1.0e6);
+
+        total_frames += stats.frame_count;
+        total_ns += stats.wall_ns;
+      } else {
+        fprintf(stderr, "  tMOV %5hu: FAILED\n", movie_id);
+        failures++;
+      }
+
+      free(stats.decode_ns);
+      free(stats.wait_ns);
+      free(stats.pts);
+      [decoder release];
+      [p release];
+    }
+
+    [archive release];
+  }
+
+  if (total_ns > 0)
+    fprintf(stderr, "-- %llu frames at %.1f fps overall, lookahead %u --\n", total_frames, total_frames / (total_ns / 1.0e9), lookahead);
+  if (failures)
+    fprintf(stderr, "-- %d movies failed --\n", failures);
+
+  [pool release];
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,227 @@
+/*
+ *  RXBitfield_test.c
+ *  rivenx
+ *
+ *  Checks the word-parallel bitfield operations against a bit-at-a-time reference on random patterns, then benchmarks finding the
+ *  first clear bit, counting set bits and iterating over set bits at sizes from 64 to 1M bits.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+#include "Base/RXBitfield.h"
+
+static uint64_t now_ns(void)
+{
+#if defined(__APPLE__)
+  static mach_timebase_info_data_t timebase = {0, 0};
+  if (timebase.denom == 0)
+    mach_timebase_info(&timebase);
+  return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// bit-at-a-time reference implementations, shaped like the loops the bitfield consumers used to run
+static uintptr_t reference_find_next_set(const rx_bitfield_t* bf, uintptr_t from)
+{
+  for (uintptr_t i = from; i < rx_bitfield_capacity(bf); i++) {
+    if (rx_bitfield_is_set(bf, i))
+      return i;
+  }
+  return RX_BITFIELD_NOT_FOUND;
+}
+
+static uintptr_t reference_find_next_clear(const rx_bitfield_t* bf, uintptr_t from)
+{
+  uintptr_t i = from;
+  for (; i < rx_bitfield_capacity(bf); i++) {
+    if (!rx_bitfield_is_set(bf, i))
+      return i;
+  }
+  return i;
+}
+
+static uintptr_t reference_popcount(const rx_bitfield_t* bf)
+{
+  uintptr_t count = 0;
+  for (uintptr_t i = 0; i < rx_bitfield_capacity(bf); i++)
+    count += rx_bitfield_is_set(bf, i);
+  return count;
+}
+
+static int check(int condition, const char* what, uintptr_t a, uintptr_t b)
+{
+  if (!condition)
+    fprintf(stderr, "%s: %lu != %lu\n", what, (unsigned long)a, (unsigned long)b);
+  return condition;
+}
+
+static int test_correctness(void)
+{
+  srand(1);
+  for (int round = 0; round < 2000; round++) {
+    rx_bitfield_t bf;
+    rx_bitfield_init(&bf, 1 + rand() % 8);
+    uintptr_t capacity = rx_bitfield_capacity(&bf);
+
+    // random density, from nearly empty to nearly full
+    int density = rand() % 101;
+    for (uintptr_t i = 0; i < capacity; i++) {
+      if (rand() % 100 < density)
+        rx_bitfield_set(&bf, i);
+    }
+
+    // random range operations, some of which run past the end
+    uintptr_t start = rand() % (capacity + 16), length = rand() % (capacity / 2 + 1);
+    char* expected = (char*)calloc(capacity + start + length + RX_BITFIELD_SEGMENT_BITS, 1);
+    for (uintptr_t i = 0; i < capacity; i++)
+      expected[i] = rx_bitfield_is_set(&bf, i);
+    if (round & 1) {
+      rx_bitfield_set_range(&bf, start, length);
+      memset(expected + start, 1, length);
+    } else {
+      rx_bitfield_clear_range(&bf, start, length);
+      memset(expected + start, 0, length);
+    }
+    for (uintptr_t i = 0; i < rx_bitfield_capacity(&bf); i++) {
+      if (!check(rx_bitfield_is_set(&bf, i) == expected[i], "range operation", i, expected[i]))
+        return 0;
+    }
+    free(expected);
+
+    if (!check(rx_bitfield_popcount(&bf) == reference_popcount(&bf), "popcount", rx_bitfield_popcount(&bf), reference_popcount(&bf)))
+      return 0;
+
+    for (uintptr_t from = 0; from <= rx_bitfield_capacity(&bf); from += 1 + rand() % 7) {
+      uintptr_t a = rx_bitfield_find_next_set(&bf, from), b = reference_find_next_set(&bf, from);
+      if (!check(a == b, "find_next_set", a, b))
+        return 0;
+      a = rx_bitfield_find_next_clear(&bf, from);
+      b = reference_find_next_clear(&bf, from);
+      if (!check(a == b, "find_next_clear", a, b))
+        return 0;
+    }
+
+    uintptr_t visited = 0, previous = 0;
+    rx_bitfield_foreach_set(&bf, index)
+    {
+      if (!check(rx_bitfield_is_set(&bf, index) && (visited == 0 || index > previous), "foreach order", index, previous))
+        return 0;
+      previous = index;
+      visited++;
+    }
+    if (!check(visited == rx_bitfield_popcount(&bf), "foreach count", visited, rx_bitfield_popcount(&bf)))
+      return 0;
+
+    rx_bitfield_destroy(&bf);
+  }
+
+  // setting a bit past the end grows the bitfield, and the first clear bit of a full bitfield is its capacity
+  rx_bitfield_t bf;
+  rx_bitfield_init(&bf, 1);
+  rx_bitfield_set_range(&bf, 0, RX_BITFIELD_SEGMENT_BITS);
+  if (!check(rx_bitfield_find_first_clear(&bf) == RX_BITFIELD_SEGMENT_BITS, "full find_first_clear", rx_bitfield_find_first_clear(&bf),
+             RX_BITFIELD_SEGMENT_BITS))
+    return 0;
+  rx_bitfield_set(&bf, 3 * RX_BITFIELD_SEGMENT_BITS + 5);
+  if (!check(bf.segment_count == 4, "growth", bf.segment_count, 4))
+    return 0;
+  rx_bitfield_destroy(&bf);
+
+  // atomic claims hand out every bit exactly once, in order, and fail once the bitfield is full
+  rx_bitfield_init(&bf, 4);
+  for (uintptr_t i = 0; i < rx_bitfield_capacity(&bf); i++) {
+    uintptr_t claimed = rx_bitfield_atomic_claim_first_clear(&bf);
+    if (!check(claimed == i, "atomic claim", claimed, i))
+      return 0;
+  }
+  if (!check(rx_bitfield_atomic_claim_first_clear(&bf) == RX_BITFIELD_NOT_FOUND, "atomic claim when full", 0, 0))
+    return 0;
+  rx_bitfield_atomic_clear(&bf, 70);
+  if (!check(rx_bitfield_atomic_claim_first_clear(&bf) == 70, "atomic claim after clear", 0, 70))
+    return 0;
+  uintptr_t exchanged = rx_bitfield_atomic_exchange_segment(&bf, 1, 0);
+  if (!check(exchanged == UINTPTR_MAX && rx_bitfield_find_first_clear(&bf) == RX_BITFIELD_SEGMENT_BITS, "atomic exchange", exchanged, UINTPTR_MAX))
+    return 0;
+  rx_bitfield_destroy(&bf);
+
+  return 1;
+}
+
+static volatile uintptr_t sink;
+
+static void benchmark(uintptr_t bits)
+{
+  rx_bitfield_t bf;
+  rx_bitfield_init(&bf, (bits + RX_BITFIELD_SEGMENT_BITS - 1) / RX_BITFIELD_SEGMENT_BITS);
+
+  // worst case for an allocator: every bit but the last is set
+  rx_bitfield_set_range(&bf, 0, bits - 1);
+
+  uint64_t iterations = (64ull * 1024 * 1024) / bits;
+  if (iterations > 1000000)
+    iterations = 1000000;
+  if (iterations < 4)
+    iterations = 4;
+
+  uint64_t start = now_ns();
+  for (uint64_t i = 0; i < iterations; i++)
+    sink = reference_find_next_clear(&bf, 0);
+  double reference_ns = (double)(now_ns() - start) / iterations;
+
+  start = now_ns();
+  for (uint64_t i = 0; i < iterations; i++)
+    sink = rx_bitfield_find_first_clear(&bf);
+  double clear_ns = (double)(now_ns() - start) / iterations;
+
+  start = now_ns();
+  for (uint64_t i = 0; i < iterations; i++)
+    sink = rx_bitfield_popcount(&bf);
+  double popcount_ns = (double)(now_ns() - start) / iterations;
+
+  // sparse iteration: one bit in 64 set
+  rx_bitfield_clear_range(&bf, 0, bits);
+  for (uintptr_t i = 0; i < bits; i += 64)
+    rx_bitfield_set(&bf, i);
+  start = now_ns();
+  for (uint64_t i = 0; i < iterations; i++) {
+    uintptr_t sum = 0;
+    rx_bitfield_foreach_set(&bf, index) sum += index;
+    sink = sum;
+  }
+  double foreach_ns = (double)(now_ns() - start) / iterations;
+
+  fprintf(stderr, "%8lu bits: find first clear %10.1f ns (bit loop %12.1f ns, %6.1fx), popcount %9.1f ns, sparse foreach %9.1f ns\n", (unsigned long)bits,
+          clear_ns, reference_ns, reference_ns / clear_ns, popcount_ns, foreach_ns);
+
+  rx_bitfield_destroy(&bf);
+}
+
+int main(int argc, char* const argv[])
+{
+  if (!test_correctness()) {
+    fprintf(stderr, "bitfield operations do not match the reference\n");
+    return 1;
+  }
+  fprintf(stderr, "-- bitfield operations match the reference --\n");
+
+  if (argc > 1 && strcmp(argv[1], "--no-benchmark") == 0)
+    return 0;
+
+  for (uintptr_t bits = 64; bits <= 1024 * 1024; bits *= 4)
+    benchmark(bits);
+
+  return 0;
+}
@@ -0,0 +1,317 @@
+/*
+ *  RXCardCompositor_test.m
+ *  rivenx
+ *
+ *  Composes every card of the given archives the way it looks before its scripts run (its first PLST picture and its first water
+ *  effect) with the software compositor, and compares the hashes against a golden file. Resources are searched in the archives in
+ *  order, like the archives of a stack. The timings are in microseconds, like the static picture and water phases of the frame
+ *  statistics the OpenGL renderer logs, so that the two can be compared card for card.
+ *
+ *  The game data cannot be checked in, so neither can the golden file. Generate it from a known good build, and keep it next to the
+ *  archives it was made from:
+ *    RXCardCompositor_test --card-golden cards.golden --update-card-golden aspit.MHK bspit.MHK ...
+ *  --dump directory also writes every composed card as a TGA file for inspection.
+ *
+ */
+
+#include "Tests/rx_test.h"
+#include "Tests/rx_soft_test.h"
+
+#import <Foundation/Foundation.h>
+
+#import <MHKKit/MHKKit.h>
+
+enum { kWaterNone = 0, kWaterLoaded, kWaterInvalid };
+
+static int compare_uint64(const void* a, const void* b)
+{
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static MHKArchive* archive_with_resource(NSArray* archives, NSString* type, uint16_t resource_id)
+{
+  for (MHKArchive* archive in archives) {
+    if ([archive resourceDescriptorWithResourceType:type ID:resource_id])
+      return archive;
+  }
+  return nil;
+}
+
+static NSData* resource_data(NSArray* archives, NSString* type, uint16_t resource_id)
+{ return [archive_with_resource(archives, type, resource_id) dataWithResourceType:type ID:resource_id]; }
+
+static bool load_picture(NSArray* archives, uint16_t bitmap_id, rx_soft_surface_t* surface)
+{
+  MHKArchive* archive = archive_with_resource(archives, @"tBMP", bitmap_id);
+  NSDictionary* descriptor = [archive bitmapDescriptorWithID:bitmap_id error:NULL];
+  if (!descriptor)
+    return false;
+
+  if (!make_surface(surface, [[descriptor objectForKey:@"Width"] unsignedIntValue], [[descriptor objectForKey:@"Height"] unsignedIntValue]))
+    return false;
+  if (![archive loadBitmapWithID:bitmap_id buffer:surface->pixels format:MHK_BGRA_UNSIGNED_INT_8_8_8_8_REV_PACKED error:NULL]) {
+    free(surface->pixels);
+    surface->pixels = NULL;
+    return false;
+  }
+  return true;
+}
+
+// loads the SFXE record of the card's first FLST record, byte swaps it like RXCard does and compiles it
+static int load_water(NSArray* archives, uint16_t card_id, rx_card_sfxe* water)
+{
+  NSData* flst = resource_data(archives, @"FLST", card_id);
+  if ([flst length] < sizeof(uint16_t) + sizeof(struct rx_flst_record) || CFSwapInt16BigToHost(*(const uint16_t*)[flst bytes]) == 0)
+    return kWaterNone;
+  const struct rx_flst_record* flst_record = (const struct rx_flst_record*)((const uint8_t*)[flst bytes] + sizeof(uint16_t));
+
+  NSData* sfxe = resource_data(archives, @"SFXE", CFSwapInt16BigToHost(flst_record->sfxe_id));
+  size_t size = [sfxe length];
+
+  memset(water, 0, sizeof(rx_card_sfxe));
+  water->record = (struct rx_sfxe_record*)malloc(size ? size : 1);
+  memcpy(water->record, [sfxe bytes], size);
+  if (rx_sfxe_swap_record(water, size) && rx_sfxe_compile(water, size, RX_SOFT_CARD_WIDTH, RX_SOFT_CARD_HEIGHT))
+    return kWaterLoaded;
+
+  free(water->record);
+  water->record = NULL;
+  return kWaterInvalid;
+}
+
+struct card_result {
+  uint64_t hash;
+  uint64_t refresh_ns; // first frame: static card refresh and water frame 0
+  uint64_t water_ns;   // mean of the following water frames, 0 for cards without water
+};
+
+// composes the card as it looks before its scripts run: PLST record 1, which the engine activates when no script does, under the
+// card's first water effect, run through every frame of the effect
+static bool compose_card(NSArray* archives, uint16_t card_id, rx_soft_compositor_t* compositor, rx_soft_surface_t* frame,
+                         struct card_result* result)
+{
+  NSData* plst = resource_data(archives, @"PLST", card_id);
+  if ([plst length] < sizeof(uint16_t)) {
+    fprintf(stderr, "    card %hu: no PLST resource\n", card_id);
+    return false;
+  }
+
+  rx_soft_surface_t picture_surface = {NULL, 0, 0, 0};
+  rx_soft_picture_t picture;
+  uint32_t picture_count = 0;
+  if (CFSwapInt16BigToHost(*(const uint16_t*)[plst bytes]) > 0 && [plst length] >= sizeof(uint16_t) + sizeof(struct rx_plst_record)) {
+    const struct rx_plst_record* plst_record = (const struct rx_plst_record*)((const uint8_t*)[plst bytes] + sizeof(uint16_t));
+    uint16_t bitmap_id = CFSwapInt16BigToHost(plst_record->bitmap_id);
+    if (!load_picture(archives, bitmap_id, &picture_surface)) {
+      fprintf(stderr, "    card %hu: could not load tBMP %hu\n", card_id, bitmap_id);
+      return false;
+    }
+
+    // pictures are anchored to the top-left corner of their rect and clipped to their size, never scaled
+    rx_core_rect_t rect = {CFSwapInt16BigToHost(plst_record->rect.left), CFSwapInt16BigToHost(plst_record->rect.top),
+                           CFSwapInt16BigToHost(plst_record->rect.right), CFSwapInt16BigToHost(plst_record->rect.bottom)};
+    if (rect.right - rect.left > (int32_t)picture_surface.width)
+      rect.right = rect.left + picture_surface.width;
+    if (rect.bottom - rect.top > (int32_t)picture_surface.height)
+      rect.bottom = rect.top + picture_surface.height;
+
+    picture.source = &picture_surface;
+    picture.sampling_rect = make_rect(0, 0, rect.right - rect.left, rect.bottom - rect.top);
+    picture.render_rect = rect;
+    picture_count = 1;
+  }
+
+  rx_card_sfxe water;
+  int water_status = load_water(archives, card_id, &water);
+  if (water_status == kWaterInvalid) {
+    fprintf(stderr, "    card %hu: invalid water effect\n", card_id);
+    free(picture_surface.pixels);
+    return false;
+  }
+
+  rx_soft_card_frame_t card_frame = {&picture, picture_count, true, NULL, 0, NULL, 0, NULL, 0};
+  uint32_t frame_count = 1;
+  if (water_status == kWaterLoaded) {
+    card_frame.water = &water;
+    frame_count = water.record->frame_count;
+  }
+
+  rx_soft_compositor_destroy(compositor);
+  rx_soft_compositor_init(compositor);
+
+  uint64_t start = rx_test_now_ns();
+  rx_soft_compose_card_frame(compositor, &card_frame, frame);
+  result->refresh_ns = rx_test_now_ns() - start;
+
+  card_frame.refresh_static = false;
+  start = rx_test_now_ns();
+  for (uint32_t i = 1; i < frame_count; i++) {
+    card_frame.water_frame = i;
+    rx_soft_compose_card_frame(compositor, &card_frame, frame);
+  }
+  result->water_ns = (frame_count > 1) ? (rx_test_now_ns() - start) / (frame_count - 1) : 0;
+  result->hash = hash_surface(frame);
+
+  if (water_status == kWaterLoaded) {
+    rx_sfxe_free_compiled(&water);
+    free(water.record);
+  }
+  free(picture_surface.pixels);
+  return true;
+}
+
+// golden file lines are "<archive> <card ID> <hash>"
+static NSMutableDictionary* read_card_golden(const char* path)
+{
+  NSMutableDictionary* golden = [NSMutableDictionary dictionary];
+  NSString* contents = [NSString stringWithContentsOfFile:[NSString stringWithUTF8String:path] encoding:NSUTF8StringEncoding error:NULL];
+  for (NSString* line in [contents componentsSeparatedByString:@"\n"]) {
+    char name[256];
+    unsigned int card_id;
+    unsigned long long hash;
+    if (sscanf([line UTF8String], "%255s %u %llx", name, &card_id, &hash) == 3)
+      [golden setObject:[NSNumber numberWithUnsignedLongLong:hash] forKey:[NSString stringWithFormat:@"%s %u", name, card_id]];
+  }
+  return golden;
+}
+
+static double percentile_us(uint64_t* values, uint32_t count, uint32_t percent)
+{
+  if (count == 0)
+    return 0.0;
+  qsort(values, count, sizeof(uint64_t), compare_uint64);
+  return values[((count - 1) * percent) / 100] / 1000.0;
+}
+
+static int run_card_suite(const char* const* archive_paths, int archive_count, const char* golden_path, bool update_golden,
+                          const char* dump_directory)
+{
+  NSAutoreleasePool* pool = [NSAutoreleasePool new];
+  int failures = 0;
+
+  NSMutableArray* archives = [NSMutableArray array];
+  for (int i = 0; i < archive_count; i++) {
+    NSError* error = nil;
+    MHKArchive* archive = [[MHKArchive alloc] initWithPath:[NSString stringWithUTF8String:archive_paths[i]] error:&error];
+    if (!archive) {
+      fprintf(stderr, "%s: %s\n", archive_paths[i], [[error localizedDescription] UTF8String]);
+      [pool release];
+      return 1;
+    }
+    [archives addObject:archive];
+    [archive release];
+  }
+
+  NSMutableDictionary* golden = (golden_path && !update_golden) ? read_card_golden(golden_path) : nil;
+  NSMutableString* new_golden = [NSMutableString string];
+
+  uint32_t card_capacity = 0;
+  for (MHKArchive* archive in archives)
+    card_capacity += (uint32_t)[[archive valueForKey:@"CARD"] count];
+  uint64_t* refresh_ns = (uint64_t*)malloc((card_capacity + 1) * sizeof(uint64_t));
+  uint64_t* water_ns = (uint64_t*)malloc((card_capacity + 1) * sizeof(uint64_t));
+  uint32_t card_count = 0, water_count = 0, unmatched = 0;
+
+  rx_soft_compositor_t compositor;
+  rx_soft_surface_t frame;
+  if (!rx_soft_compositor_init(&compositor) || !make_surface(&frame, RX_SOFT_FRAME_WIDTH, RX_SOFT_FRAME_HEIGHT)) {
+    fprintf(stderr, "failed to allocate the compositor\n");
+    [pool release];
+    return 1;
+  }
+
+  for (MHKArchive* archive in archives) {
+    NSString* archive_name = [[[archive url] path] lastPathComponent];
+    fprintf(stderr, "%s\n", [archive_name UTF8String]);
+
+    for (NSDictionary* descriptor in [archive valueForKey:@"CARD"]) {
+      NSAutoreleasePool* p = [NSAutoreleasePool new];
+      uint16_t card_id = [[descriptor objectForKey:@"ID"] unsignedShortValue];
+      NSString* key = [NSString stringWithFormat:@"%@ %hu", archive_name, card_id];
+
+      struct card_result result;
+      if (!compose_card(archives, card_id, &compositor, &frame, &result)) {
+        failures++;
+        [p release];
+        continue;
+      }
+
+      refresh_ns[card_count++] = result.refresh_ns;
+      if (result.water_ns)
+        water_ns[water_count++] = result.water_ns;
+      [new_golden appendFormat:@"%@ 0x%016llx\n", key, (unsigned long long)result.hash];
+
+      if (dump_directory) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s-%hu.tga", dump_directory, [[archive_name stringByDeletingPathExtension] UTF8String], card_id);
+        if (!write_tga(path, &frame))
+          fprintf(stderr, "failed to write %s\n", path);
+      }
+
+      if (golden) {
+        NSNumber* expected = [golden objectForKey:key];
+        if (!expected) {
+          fprintf(stderr, "    card %hu: no golden hash\n", card_id);
+          unmatched++;
+        } else if ([expected unsignedLongLongValue] != result.hash) {
+          fprintf(stderr, "    card %hu: hash 0x%016llx does not match the golden hash 0x%016llx\n", card_id, (unsigned long long)result.hash,
+                  [expected unsignedLongLongValue]);
+          failures++;
+        }
+      }
+
+      [p release];
+    }
+  }
+
+  if (update_golden) {
+    NSError* error = nil;
+    if (![new_golden writeToFile:[NSString stringWithUTF8String:golden_path] atomically:YES encoding:NSUTF8StringEncoding error:&error]) {
+      fprintf(stderr, "failed to write %s: %s\n", golden_path, [[error localizedDescription] UTF8String]);
+      failures++;
+    } else
+      fprintf(stderr, "wrote the golden hashes of %u cards to %s\n", card_count, golden_path);
+  } else if (!golden)
+    fprintf(stderr, "no card golden file, %u cards were composed but not compared\n", card_count);
+
+  // the OpenGL renderer's frame statistics report the same two costs as its static pictures and water phases
+  fprintf(stderr, "%u cards: static card refresh p50 %.1f us p99 %.1f us max %.1f us\n", card_count, percentile_us(refresh_ns, card_count, 50),
+          percentile_us(refresh_ns, card_count, 99), percentile_us(refresh_ns, card_count, 100));
+  fprintf(stderr, "%u cards with water: water frame p50 %.1f us p99 %.1f us max %.1f us\n", water_count, percentile_us(water_ns, water_count, 50),
+          percentile_us(water_ns, water_count, 99), percentile_us(water_ns, water_count, 100));
+
+  if (failures || unmatched)
+    fprintf(stderr, "-- %d cards failed, %u cards have no golden hash --\n", failures, unmatched);
+  else if (golden)
+    fprintf(stderr, "-- every card matches its golden image --\n");
+
+  rx_soft_compositor_destroy(&compositor);
+  free(frame.pixels);
+  free(refresh_ns);
+  free(water_ns);
+  [pool release];
+  return (failures || unmatched) ? 1 : 0;
+}
+int main(int argc, char* const argv[])
+{
+  bool update_golden = rx_test_has_flag(argc, argv, "--update-card-golden");
+  const char* golden_path = NULL;
+  const char* dump_directory = NULL;
+  const char* archive_paths[argc];
+  int archive_count = 0;
+  for (int arg = 1; arg < argc; arg++) {
+    if (strcmp(argv[arg], "--card-golden") == 0 && arg + 1 < argc)
+      golden_path = argv[++arg];
+    else if (strcmp(argv[arg], "--dump") == 0 && arg + 1 < argc)
+      dump_directory = argv[++arg];
+    else if (argv[arg][0] != '-')
+      archive_paths[archive_count++] = argv[arg];
+  }
+  if (archive_count == 0 || (update_golden && !golden_path)) {
+    fprintf(stderr, "usage: %s [--card-golden file [--update-card-golden]] [--dump directory] archive.MHK ...\n", argv[0]);
+    return 1;
+  }
+
+  return run_card_suite(archive_paths, archive_count, golden_path, update_golden, dump_directory);
+}
@@ -0,0 +1,258 @@
+/*
+ *  RXHotspotEventQueue_test.c
+ *  rivenx
+ *
+ */
+
+#include "Tests/rx_test.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include "Engine/RXHotspotEventQueue.h"
+
+static const uint32_t kProducers = 3;
+static const uint32_t kEventsPerProducer = 200000;
+static const uint32_t kBenchmarkEvents = 1000000;
+
+static int test_coalescing(void)
+{
+  rx_hotspot_event_queue_t queue;
+  rx_hotspot_event_queue_init(&queue);
+  int a, b;
+
+  // repeated inside events for the same hotspot fold into the first one, until another event is posted
+  int results[] = {
+      rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_INSIDE, &a), rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_INSIDE, &a),
+      rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_INSIDE, &b), rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_INSIDE, &b),
+      rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_DOWN, &b),   rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_INSIDE, &b),
+  };
+  int expected_results[] = {RX_HOTSPOT_EVENT_QUEUED, RX_HOTSPOT_EVENT_COALESCED, RX_HOTSPOT_EVENT_QUEUED,
+                            RX_HOTSPOT_EVENT_COALESCED, RX_HOTSPOT_EVENT_QUEUED, RX_HOTSPOT_EVENT_QUEUED};
+  for (size_t i = 0; i < sizeof(results) / sizeof(int); i++) {
+    if (results[i] != expected_results[i]) {
+      fprintf(stderr, "push %lu returned %d, expected %d\n", (unsigned long)i, results[i], expected_results[i]);
+      return 0;
+    }
+  }
+
+  rx_hotspot_event_t expected_events[] = {
+      {&a, RX_HOTSPOT_EVENT_MOUSE_INSIDE}, {&b, RX_HOTSPOT_EVENT_MOUSE_INSIDE}, {&b, RX_HOTSPOT_EVENT_MOUSE_DOWN}, {&b, RX_HOTSPOT_EVENT_MOUSE_INSIDE}};
+  rx_hotspot_event_t event;
+  for (size_t i = 0; i < sizeof(expected_events) / sizeof(rx_hotspot_event_t); i++) {
+    if (!rx_hotspot_event_queue_pop(&queue, &event) || event.hotspot != expected_events[i].hotspot || event.type != expected_events[i].type) {
+      fprintf(stderr, "event %lu is wrong\n", (unsigned long)i);
+      return 0;
+    }
+  }
+  if (rx_hotspot_event_queue_pop(&queue, &event)) {
+    fprintf(stderr, "the queue has extra events\n");
+    return 0;
+  }
+
+  // once the consumer popped an inside event, the next one for the same hotspot is queued again
+  if (rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_INSIDE, &b) != RX_HOTSPOT_EVENT_QUEUED) {
+    fprintf(stderr, "an inside event was coalesced into a popped event\n");
+    return 0;
+  }
+  rx_hotspot_event_queue_pop(&queue, &event);
+
+  // a full queue drops inside events without coalescing into them, and overflows the other events in order
+  for (uint32_t i = 0; i < RX_HOTSPOT_EVENT_QUEUE_CAPACITY; i++) {
+    if (rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_EXITED, &a) != RX_HOTSPOT_EVENT_QUEUED) {
+      fprintf(stderr, "the queue filled up after %u events\n", i);
+      return 0;
+    }
+  }
+  if (rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_INSIDE, &a) != RX_HOTSPOT_EVENT_QUEUE_FULL ||
+      rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_INSIDE, &a) != RX_HOTSPOT_EVENT_QUEUE_FULL) {
+    fprintf(stderr, "a full queue accepted an inside event\n");
+    return 0;
+  }
+  if (rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_DOWN, &b) != RX_HOTSPOT_EVENT_QUEUED ||
+      rx_hotspot_event_queue_pop(&queue, &event) == 0 ||
+      rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_INSIDE, &b) != RX_HOTSPOT_EVENT_QUEUE_FULL ||
+      rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_UP, &b) != RX_HOTSPOT_EVENT_QUEUED) {
+    fprintf(stderr, "a full queue did not overflow\n");
+    return 0;
+  }
+
+  // the down and up events come out after the events that were already queued, even though a cell was freed before the up event
+  for (uint32_t i = 1; i < RX_HOTSPOT_EVENT_QUEUE_CAPACITY; i++) {
+    if (!rx_hotspot_event_queue_pop(&queue, &event) || event.type != RX_HOTSPOT_EVENT_MOUSE_EXITED) {
+      fprintf(stderr, "queued event %u is wrong\n", i);
+      return 0;
+    }
+  }
+  if (!rx_hotspot_event_queue_pop(&queue, &event) || event.type != RX_HOTSPOT_EVENT_MOUSE_DOWN ||
+      !rx_hotspot_event_queue_pop(&queue, &event) || event.type != RX_HOTSPOT_EVENT_MOUSE_UP || rx_hotspot_event_queue_pop(&queue, &event)) {
+    fprintf(stderr, "overflowed events are out of order\n");
+    return 0;
+  }
+  if (rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_INSIDE, &b) != RX_HOTSPOT_EVENT_QUEUED) {
+    fprintf(stderr, "the queue did not recover from overflowing\n");
+    return 0;
+  }
+
+  rx_hotspot_event_queue_destroy(&queue);
+  return 1;
+}
+
+// producer p posts events for the hotspots (void*)(p * kEventsPerProducer + i + 1), so that inside events are never coalesced, except
+// for every eighth one which repeats the previous inside event
+struct producer_state {
+  rx_hotspot_event_queue_t* queue;
+  uint32_t index;
+  uint32_t coalesced;
+  uint32_t dropped;
+};
+
+static void* producer_main(void* context)
+{
+  struct producer_state* state = (struct producer_state*)context;
+  uintptr_t base = (uintptr_t)state->index * kEventsPerProducer + 1;
+  for (uint32_t i = 0; i < kEventsPerProducer; i++) {
+    uint32_t type = (i % 3 == 0) ? RX_HOTSPOT_EVENT_MOUSE_EXITED : RX_HOTSPOT_EVENT_MOUSE_INSIDE;
+    uintptr_t hotspot = base + ((i % 8 == 7) ? i - 1 : i);
+    // only inside events are ever dropped
+    int result = rx_hotspot_event_queue_push(state->queue, type, (void*)hotspot);
+    if (result == RX_HOTSPOT_EVENT_QUEUE_FULL)
+      __atomic_add_fetch(&state->dropped, 1, __ATOMIC_RELAXED);
+    else if (result == RX_HOTSPOT_EVENT_COALESCED)
+      __atomic_add_fetch(&state->coalesced, 1, __ATOMIC_RELAXED);
+  }
+  return NULL;
+}
+
+static int test_concurrent(void)
+{
+  rx_hotspot_event_queue_t* queue = NULL;
+  posix_memalign((void**)&queue, 64, sizeof(rx_hotspot_event_queue_t));
+  rx_hotspot_event_queue_init(queue);
+
+  struct producer_state states[kProducers];
+  pthread_t threads[kProducers];
+  for (uint32_t p = 0; p < kProducers; p++) {
+    states[p] = (struct producer_state){queue, p, 0, 0};
+    pthread_create(threads + p, NULL, producer_main, states + p);
+  }
+
+  // events must arrive in order per producer, and every event must be delivered, coalesced or dropped
+  uintptr_t last[kProducers];
+  memset(last, 0, sizeof(last));
+  uint32_t delivered = 0;
+  uint32_t expected = 0;
+  for (uint32_t p = 0; p < kProducers; p++)
+    expected += kEventsPerProducer;
+
+  int ok = 1;
+  uint32_t idle = 0;
+  while (ok) {
+    rx_hotspot_event_t event;
+    if (!rx_hotspot_event_queue_pop(queue, &event)) {
+      uint32_t accounted = delivered;
+      for (uint32_t p = 0; p < kProducers; p++)
+        accounted += __atomic_load_n(&states[p].coalesced, __ATOMIC_RELAXED) + __atomic_load_n(&states[p].dropped, __ATOMIC_RELAXED);
+      if (accounted == expected && ++idle > 1)
+        break;
+      sched_yield();
+      continue;
+    }
+    idle = 0;
+
+    uintptr_t hotspot = (uintptr_t)event.hotspot;
+    uint32_t p = (uint32_t)((hotspot - 1) / kEventsPerProducer);
+    if (p >= kProducers || hotspot < last[p]) {
+      fprintf(stderr, "event for %lu arrived after %lu\n", (unsigned long)hotspot, (unsigned long)last[p]);
+      ok = 0;
+    }
+    last[p] = hotspot;
+    delivered++;
+  }
+
+  uint32_t coalesced = 0, dropped = 0;
+  for (uint32_t p = 0; p < kProducers; p++) {
+    pthread_join(threads[p], NULL);
+    coalesced += states[p].coalesced;
+    dropped += states[p].dropped;
+  }
+  if (ok && delivered + coalesced + dropped != expected) {
+    fprintf(stderr, "%u delivered, %u coalesced and %u dropped out of %u events\n", delivered, coalesced, dropped, expected);
+    ok = 0;
+  }
+  if (ok)
+    fprintf(stderr, "%u producers: %u events delivered, %u coalesced, %u dropped\n", kProducers, delivered, coalesced, dropped);
+
+  rx_hotspot_event_queue_destroy(queue);
+  free(queue);
+  return ok;
+}
+
+struct locked_message {
+  struct locked_message* next;
+  void* hotspot;
+  uint32_t type;
+};
+
+static void benchmark(void)
+{
+  rx_hotspot_event_queue_t queue;
+  rx_hotspot_event_queue_init(&queue);
+  rx_hotspot_event_t event;
+  int hotspot;
+
+  uint64_t start = rx_test_now_ns();
+  for (uint32_t i = 0; i < kBenchmarkEvents; i++) {
+    rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_EXITED, &hotspot);
+    rx_hotspot_event_queue_pop(&queue, &event);
+  }
+  double queue_ns = (double)(rx_test_now_ns() - start) / kBenchmarkEvents;
+
+  start = rx_test_now_ns();
+  for (uint32_t i = 0; i < kBenchmarkEvents; i++)
+    rx_hotspot_event_queue_push(&queue, RX_HOTSPOT_EVENT_MOUSE_INSIDE, &hotspot);
+  double coalesce_ns = (double)(rx_test_now_ns() - start) / kBenchmarkEvents;
+  rx_hotspot_event_queue_pop(&queue, &event);
+  rx_hotspot_event_queue_destroy(&queue);
+
+  // a heap-allocated message on a locked list, the least an inter-thread message has to do
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  struct locked_message* head = NULL;
+  start = rx_test_now_ns();
+  for (uint32_t i = 0; i < kBenchmarkEvents; i++) {
+    struct locked_message* message = malloc(sizeof(struct locked_message));
+    message->hotspot = &hotspot;
+    message->type = RX_HOTSPOT_EVENT_MOUSE_EXITED;
+    pthread_mutex_lock(&mutex);
+    message->next = head;
+    head = message;
+    pthread_mutex_unlock(&mutex);
+
+    pthread_mutex_lock(&mutex);
+    message = head;
+    head = message->next;
+    pthread_mutex_unlock(&mutex);
+    free(message);
+  }
+  double locked_ns = (double)(rx_test_now_ns() - start) / kBenchmarkEvents;
+
+  rx_test_report("push and pop", queue_ns, "malloc'd message under a mutex", locked_ns);
+  rx_test_report("coalesced push", coalesce_ns, NULL, 0.0);
+}
+
+int main(int argc, char* const argv[])
+{
+  if (!test_coalescing() || !test_concurrent()) {
+    fprintf(stderr, "hotspot event queue failed\n");
+    return 1;
+  }
+  fprintf(stderr, "-- hotspot event queue passed --\n");
+
+  if (!rx_test_should_benchmark(argc, argv))
+    return 0;
+
+  benchmark();
+
+  return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ *  RXHotspotIndex_test.c
+ *  rivenx
+ *
+ */
+
+#include "Tests/rx_test.h"
+
+#include <stdlib.h>
+
+#include "Engine/RXHotspotIndex.h"
+
+static const uint32_t kCardWidth = 608;
+static const uint32_t kCardHeight = 392;
+
+// the linear scan _updateHotspotState_nolock used to run
+static uint32_t reference_hit_test(const rx_hotspot_index_t* index, float x, float y)
+{
+  for (uint32_t i = 0; i < index->item_count; i++) {
+    rx_core_rect_t rect = index->rects[i];
+    if (x >= rect.left && x < rect.right && y >= rect.top && y < rect.bottom)
+      return i;
+  }
+  return RX_HOTSPOT_INDEX_NOT_FOUND;
+}
+
+static void random_card(rx_hotspot_index_t* index, uint32_t hotspot_count)
+{
+  rx_hotspot_index_resize(index, hotspot_count);
+  for (uint32_t i = 0; i < hotspot_count; i++) {
+    rx_core_rect_t rect;
+    if (rand() % 10 == 0) {
+      // some hotspots cover most of the card, some are degenerate or hang off the card
+      rect.left = rand() % 64;
+      rect.top = rand() % 64;
+      rect.right = rect.left + rand() % (kCardWidth + 64);
+      rect.bottom = rect.top + rand() % (kCardHeight + 64);
+    } else {
+      rect.left = rand() % kCardWidth;
+      rect.top = rand() % kCardHeight;
+      rect.right = rect.left + 1 + rand() % 120;
+      rect.bottom = rect.top + 1 + rand() % 120;
+    }
+    index->rects[i] = rect;
+    index->items[i] = (void*)(uintptr_t)(i + 1);
+  }
+  rx_hotspot_index_build(index);
+}
+
+static int test_correctness(void)
+{
+  rx_hotspot_index_t index;
+  rx_hotspot_index_init(&index);
+
+  srand(1);
+  for (int round = 0; round < 500; round++) {
+    random_card(&index, rand() % 48);
+
+    for (int probe = 0; probe < 2000; probe++) {
+      float x = (float)(rand() % ((kCardWidth + 40) * 4)) / 4.0f - 20.0f;
+      float y = (float)(rand() % ((kCardHeight + 40) * 4)) / 4.0f - 20.0f;
+      uint32_t a = rx_hotspot_index_hit_test(&index, x, y), b = reference_hit_test(&index, x, y);
+      if (a != b) {
+        fprintf(stderr, "round %d: hit test at (%.2f, %.2f) returned %u instead of %u\n", round, x, y, a, b);
+        return 0;
+      }
+    }
+
+    for (uint32_t i = 0; i < index.item_count; i++) {
+      if (rx_hotspot_index_find(&index, index.items[i]) != i) {
+        fprintf(stderr, "round %d: item %u not found\n", round, i);
+        return 0;
+      }
+    }
+  }
+
+  // an index resized for a new card is empty until it is built
+  rx_hotspot_index_resize(&index, 4);
+  const uint16_t* candidates;
+  if (rx_hotspot_index_candidates(&index, 100.0f, 100.0f, &candidates) != 0) {
+    fprintf(stderr, "resized index is not empty\n");
+    return 0;
+  }
+
+  rx_hotspot_index_destroy(&index);
+  return 1;
+}
+
+static volatile uint32_t sink;
+
+static void benchmark(uint32_t hotspot_count)
+{
+  rx_hotspot_index_t index;
+  rx_hotspot_index_init(&index);
+  random_card(&index, hotspot_count);
+
+  // a mouse path across the card
+  enum { kProbeCount = 4096 };
+  float probes[kProbeCount][2];
+  for (uint32_t i = 0; i < kProbeCount; i++) {
+    probes[i][0] = (float)(rand() % kCardWidth) + 0.5f;
+    probes[i][1] = (float)(rand() % kCardHeight) + 0.5f;
+  }
+
+  const uint32_t iterations = 200;
+  uint64_t start = rx_test_now_ns();
+  for (uint32_t n = 0; n < iterations; n++) {
+    for (uint32_t i = 0; i < kProbeCount; i++)
+      sink = reference_hit_test(&index, probes[i][0], probes[i][1]);
+  }
+  double reference_ns = (double)(rx_test_now_ns() - start) / (iterations * kProbeCount);
+
+  start = rx_test_now_ns();
+  for (uint32_t n = 0; n < iterations; n++) {
+    for (uint32_t i = 0; i < kProbeCount; i++)
+      sink = rx_hotspot_index_hit_test(&index, probes[i][0], probes[i][1]);
+  }
+  double grid_ns = (double)(rx_test_now_ns() - start) / (iterations * kProbeCount);
+
+  start = rx_test_now_ns();
+  for (uint32_t n = 0; n < 10000; n++)
+    rx_hotspot_index_build(&index);
+  double build_ns = (double)(rx_test_now_ns() - start) / 10000;
+
+  char name[64];
+  snprintf(name, sizeof(name), "%u hotspots: grid hit test", hotspot_count);
+  rx_test_report(name, grid_ns, "linear scan", reference_ns);
+  snprintf(name, sizeof(name), "%u hotspots: grid rebuild", hotspot_count);
+  rx_test_report(name, build_ns, NULL, 0.0);
+
+  rx_hotspot_index_destroy(&index);
+}
+
+int main(int argc, char* const argv[])
+{
+  if (!test_correctness()) {
+    fprintf(stderr, "grid hit-testing does not match the linear scan\n");
+    return 1;
+  }
+  fprintf(stderr, "-- grid hit-testing matches the linear scan --\n");
+
+  if (!rx_test_should_benchmark(argc, argv))
+    return 0;
+
+  benchmark(8);
+  benchmark(24);
+  benchmark(64);
+
+  return 0;
+}
@@ -0,0 +1,232 @@
+/*
+ *  RXLogRing_test.c
+ *  rivenx
+ *
+ */
+
+#include "Tests/rx_test.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Base/RXLogRing.h"
+
+static const size_t kRingCapacity = 4096;
+static const uint32_t kRecords = 1000000;
+static const uint32_t kBenchmarkRecords = 1000000;
+
+// the payload of record i is derived from i, so the consumer can check it without sharing anything else with the producer
+static size_t payload_length(uint32_t i, size_t max_payload) { return (i * 2654435761u) % (max_payload + 1); }
+
+static uint8_t payload_byte(uint32_t i, size_t offset) { return (uint8_t)(i * 31u + offset * 7u); }
+
+struct test_state {
+  rx_log_ring_t ring;
+  uint32_t produced;
+  uint32_t dropped;
+  bool done;
+};
+
+static void* producer_main(void* context)
+{
+  struct test_state* state = (struct test_state*)context;
+  size_t max_payload = rx_log_ring_max_payload(&state->ring);
+
+  for (uint32_t i = 0; i < kRecords; i++) {
+    size_t length = payload_length(i, max_payload);
+    uint8_t* payload = rx_log_ring_reserve(&state->ring, length);
+
+    // drop every other record that finds the ring full, and wait for the consumer to make room for the rest
+    if (!payload && (i & 1)) {
+      state->dropped++;
+      continue;
+    }
+    while (!payload) {
+      sched_yield();
+      payload = rx_log_ring_reserve(&state->ring, length);
+    }
+    for (size_t b = 0; b < length; b++)
+      payload[b] = payload_byte(i, b);
+    rx_log_ring_commit(&state->ring, i, RX_LOG_RECORD_MESSAGE, (uint8_t)(i & 7), (uint8_t)(i % 5), length);
+    state->produced++;
+  }
+
+  __atomic_store_n(&state->done, true, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static int test_concurrent(void)
+{
+  struct test_state state;
+  memset(&state, 0, sizeof(state));
+  if (!rx_log_ring_init(&state.ring, kRingCapacity)) {
+    fprintf(stderr, "could not create the ring\n");
+    return 0;
+  }
+  size_t max_payload = rx_log_ring_max_payload(&state.ring);
+
+  pthread_t producer;
+  pthread_create(&producer, NULL, producer_main, &state);
+
+  uint32_t consumed = 0;
+  int64_t last = -1;
+  int ok = 1;
+  for (;;) {
+    bool done = __atomic_load_n(&state.done, __ATOMIC_ACQUIRE);
+    const rx_log_record_t* record;
+    while ((record = rx_log_ring_peek(&state.ring))) {
+      uint32_t i = (uint32_t)record->timestamp;
+      if ((int64_t)i <= last || record->kind != RX_LOG_RECORD_MESSAGE || record->level != (i & 7) || record->facility != i % 5 ||
+          record->length != payload_length(i, max_payload)) {
+        fprintf(stderr, "record %u after record %lld has a bad header\n", i, (long long)last);
+        ok = 0;
+        break;
+      }
+      for (size_t b = 0; b < record->length; b++) {
+        if (record->payload[b] != payload_byte(i, b)) {
+          fprintf(stderr, "record %u has a bad payload byte at %lu\n", i, (unsigned long)b);
+          ok = 0;
+          break;
+        }
+      }
+      if (!ok)
+        break;
+      last = i;
+      consumed++;
+      rx_log_ring_pop(&state.ring);
+    }
+    if (!ok || done)
+      break;
+    sched_yield();
+  }
+
+  pthread_join(producer, NULL);
+  if (ok && consumed != state.produced) {
+    fprintf(stderr, "consumed %u records, produced %u\n", consumed, state.produced);
+    ok = 0;
+  }
+  if (ok && state.produced + state.dropped != kRecords) {
+    fprintf(stderr, "produced %u and dropped %u records out of %u\n", state.produced, state.dropped, kRecords);
+    ok = 0;
+  }
+  if (ok)
+    fprintf(stderr, "%u records through a %lu byte ring, %u dropped\n", consumed, (unsigned long)kRingCapacity, state.dropped);
+
+  rx_log_ring_destroy(&state.ring);
+  return ok;
+}
+
+static int test_full(void)
+{
+  rx_log_ring_t ring;
+  if (!rx_log_ring_init(&ring, kRingCapacity))
+    return 0;
+
+  if (rx_log_ring_reserve(&ring, rx_log_ring_max_payload(&ring) + 1)) {
+    fprintf(stderr, "a reservation larger than the largest payload succeeded\n");
+    return 0;
+  }
+
+  // fill the ring with records that leave no room for another; 28 of them leave 64 bytes before the end of the ring
+  size_t length = 120;
+  uint32_t count = 0;
+  uint8_t* payload;
+  while ((payload = rx_log_ring_reserve(&ring, length))) {
+    memset(payload, (int)count, length);
+    rx_log_ring_commit(&ring, count, RX_LOG_RECORD_MESSAGE, 0, 0, length);
+    count++;
+  }
+  if (count != kRingCapacity / rx_log_record_size(length)) {
+    fprintf(stderr, "a full ring holds %u records, expected %lu\n", count, (unsigned long)(kRingCapacity / rx_log_record_size(length)));
+    return 0;
+  }
+
+  // popping one record makes room for exactly one more, after a skip to the start of the ring
+  if (rx_log_ring_peek(&ring)->timestamp != 0)
+    return 0;
+  rx_log_ring_pop(&ring);
+  payload = rx_log_ring_reserve(&ring, length);
+  if (!payload) {
+    fprintf(stderr, "a reservation failed after popping a record\n");
+    return 0;
+  }
+  memset(payload, (int)count, length);
+  rx_log_ring_commit(&ring, count, RX_LOG_RECORD_MESSAGE, 0, 0, length);
+  count++;
+  if (rx_log_ring_reserve(&ring, 0)) {
+    fprintf(stderr, "a reservation succeeded in a full ring\n");
+    return 0;
+  }
+
+  uint32_t expected = 1;
+  const rx_log_record_t* record;
+  while ((record = rx_log_ring_peek(&ring))) {
+    if (record->timestamp != expected || record->payload[0] != (uint8_t)expected) {
+      fprintf(stderr, "drained record %llu, expected %u\n", (unsigned long long)record->timestamp, expected);
+      return 0;
+    }
+    expected++;
+    rx_log_ring_pop(&ring);
+  }
+  if (expected != count || rx_log_ring_used(&ring) != 0) {
+    fprintf(stderr, "drained up to record %u of %u\n", expected, count);
+    return 0;
+  }
+
+  rx_log_ring_destroy(&ring);
+  return 1;
+}
+
+static void benchmark(void)
+{
+  static const char message[] = "2012-06-01 12:00:00 +0000 [org.macstorm.rivenx.script] [SCRIPT] executing command 17 for hotspot 42";
+  size_t length = sizeof(message) - 1;
+
+  rx_log_ring_t ring;
+  rx_log_ring_init(&ring, 0x10000);
+
+  // the producer side of a message, with the ring drained whenever it fills up as the writer would
+  uint64_t start = rx_test_now_ns();
+  for (uint32_t i = 0; i < kBenchmarkRecords; i++) {
+    uint8_t* payload = rx_log_ring_reserve(&ring, length);
+    if (!payload) {
+      while (rx_log_ring_peek(&ring))
+        rx_log_ring_pop(&ring);
+      payload = rx_log_ring_reserve(&ring, length);
+    }
+    memcpy(payload, message, length);
+    rx_log_ring_commit(&ring, i, RX_LOG_RECORD_MESSAGE, 0, 0, length);
+  }
+  double ring_ns = (double)(rx_test_now_ns() - start) / kBenchmarkRecords;
+
+  // a write per message, which is what logging used to cost the calling thread
+  int fd = open("/dev/null", O_WRONLY);
+  start = rx_test_now_ns();
+  for (uint32_t i = 0; i < kBenchmarkRecords; i++)
+    write(fd, message, length);
+  double write_ns = (double)(rx_test_now_ns() - start) / kBenchmarkRecords;
+  close(fd);
+
+  rx_test_report("message into the ring", ring_ns, "write to /dev/null", write_ns);
+
+  rx_log_ring_destroy(&ring);
+}
+
+int main(int argc, char* const argv[])
+{
+  if (!test_full() || !test_concurrent()) {
+    fprintf(stderr, "log ring failed\n");
+    return 1;
+  }
+  fprintf(stderr, "-- log ring passed --\n");
+
+  if (!rx_test_should_benchmark(argc, argv))
+    return 0;
+
+  benchmark();
+
+  return 0;
+}
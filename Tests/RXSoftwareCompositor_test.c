@@ -0,0 +1,298 @@
+/*
+ *  RXSoftwareCompositor_test.c
+ *  rivenx
+ *
+ *  Every scene is a synthetic card frame exercising one stage of the renderer; the composited frames are hashed and compared against
+ *  known good hashes. --print-golden prints the hash table for the current output, to paste below after an intended rendering change,
+ *  and --dump directory writes every composited frame as a TGA file. RXCardCompositor_test runs the same compositor over the cards of
+ *  the game archives.
+ *
+ */
+
+#include "Tests/rx_test.h"
+#include "Tests/rx_soft_test.h"
+
+static const uint16_t kEffectTop = 96;
+static const uint16_t kEffectRows = 160;
+static const uint16_t kEffectFrameCount = 8;
+static const uint32_t kIterations = 500;
+
+// builds a host-endian SFXE record for the card surface; each frame shifts the rows of a band by a small, frame-dependent amount
+static struct rx_sfxe_record* build_water_record(size_t* record_size)
+{
+  size_t max_program_words = kEffectRows * (1 + (RX_SOFT_CARD_WIDTH / 16) * 5) + 1;
+  size_t header_size = sizeof(struct rx_sfxe_record) + kEffectFrameCount * sizeof(uint32_t);
+  size_t size = header_size + kEffectFrameCount * max_program_words * sizeof(uint16_t);
+
+  struct rx_sfxe_record* record = (struct rx_sfxe_record*)calloc(1, size);
+  record->frame_count = kEffectFrameCount;
+  record->offset_table = sizeof(struct rx_sfxe_record);
+  record->rect.left = 0;
+  record->rect.top = kEffectTop;
+  record->rect.right = RX_SOFT_CARD_WIDTH;
+  record->rect.bottom = kEffectTop + kEffectRows;
+  record->fps = 15;
+
+  uint32_t* offsets = (uint32_t*)((uint8_t*)record + record->offset_table);
+  uint16_t* mp = (uint16_t*)((uint8_t*)record + header_size);
+  uint32_t state = 0x5f8e;
+
+  for (uint16_t frame = 0; frame < kEffectFrameCount; frame++) {
+    offsets[frame] = (uint32_t)((uint8_t*)mp - (uint8_t*)record);
+    for (uint16_t row = 0; row < kEffectRows; row++) {
+      uint16_t x = 8 + (next_random(&state) % 24);
+      while (x < RX_SOFT_CARD_WIDTH - 64) {
+        uint16_t length = 8 + (next_random(&state) % 40);
+        int shift = (int)((frame + row) % 7) - 3;
+        *mp++ = 3;
+        *mp++ = x;
+        *mp++ = (uint16_t)(x + shift);
+        *mp++ = (uint16_t)(kEffectTop + row + ((row + frame) % 3) - 1);
+        *mp++ = length;
+        x += length + (next_random(&state) % 16);
+      }
+      *mp++ = 1;
+    }
+    *mp++ = 4;
+  }
+
+  *record_size = size;
+  return record;
+}
+
+// a scene composites a number of frames; only the last one is hashed, so that state kept between frames (the static card and the
+// water surface) is covered
+struct scene {
+  const char* name;
+  uint64_t golden;
+  rx_soft_card_frame_t card_frame;
+  uint32_t frame_count;
+};
+
+#define SCENE_COUNT 6
+
+static uint64_t const kGoldenHashes[SCENE_COUNT] = {
+  0xe97c75809cf0506bull, // static
+  0xc3b6a95f5875e7fbull, // scaled-clipped
+  0x985f1f2b764e5757ull, // water
+  0x3d319334edcb0099ull, // movie
+  0xfd4eeb2e496577b6ull, // inventory
+  0x96e51abe9f18a94cull, // everything
+};
+
+static void compose_scene(rx_soft_compositor_t* compositor, struct scene* scene, rx_soft_surface_t* frame)
+{
+  rx_soft_card_frame_t card_frame = scene->card_frame;
+  for (uint32_t i = 0; i < scene->frame_count; i++) {
+    card_frame.refresh_static = (i == 0);
+    card_frame.water_frame = i % kEffectFrameCount;
+    rx_soft_compose_card_frame(compositor, &card_frame, frame);
+  }
+}
+
+// plain C reference for rx_soft_blend with an unscaled source
+static void reference_blend(rx_soft_surface_t* dst, int32_t x, int32_t y, const rx_soft_surface_t* src, float alpha)
+{
+  uint32_t a = (alpha >= 1.0f) ? 256 : (uint32_t)(alpha * 256.0f + 0.5f);
+  for (uint32_t sy = 0; sy < src->height; sy++) {
+    for (uint32_t sx = 0; sx < src->width; sx++) {
+      int32_t dx = x + (int32_t)sx, dy = y + (int32_t)sy;
+      if (dx < 0 || dy < 0 || dx >= (int32_t)dst->width || dy >= (int32_t)dst->height)
+        continue;
+      uint32_t s = src->pixels[sy * src->stride + sx];
+      uint32_t* d = dst->pixels + (size_t)dy * dst->stride + dx;
+      uint32_t out = 0;
+      for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t c = (((s >> shift) & 0xff) * a + ((*d >> shift) & 0xff) * (256 - a)) >> 8;
+        out |= c << shift;
+      }
+      *d = out;
+    }
+  }
+}
+
+static bool check_blend(void)
+{
+  rx_soft_surface_t dst, expected, src;
+  if (!make_surface(&dst, 61, 23) || !make_surface(&expected, 61, 23) || !make_surface(&src, 37, 11))
+    return false;
+  paint_surface(&src, 7);
+
+  // odd sizes and offsets, including clipping on every side, so that both the vector loop and the scalar tail run
+  static const float alphas[] = {0.0f, 0.1f, 0.25f, 0.5f, 0.77f, 0.999f, 1.0f};
+  static const int32_t positions[][2] = {{0, 0}, {3, 5}, {-5, -3}, {40, 17}, {-20, 10}, {30, -8}};
+  bool ok = true;
+  for (size_t ai = 0; ai < sizeof(alphas) / sizeof(alphas[0]) && ok; ai++) {
+    for (size_t pi = 0; pi < sizeof(positions) / sizeof(positions[0]) && ok; pi++) {
+      paint_surface(&dst, 11);
+      paint_surface(&expected, 11);
+      rx_soft_blend(&dst, positions[pi][0], positions[pi][1], (int32_t)src.width, (int32_t)src.height, &src, alphas[ai]);
+      reference_blend(&expected, positions[pi][0], positions[pi][1], &src, alphas[ai]);
+      if (memcmp(dst.pixels, expected.pixels, dst.width * dst.height * sizeof(uint32_t)) != 0) {
+        fprintf(stderr, "blend at %d, %d with alpha %.3f does not match the reference\n", positions[pi][0], positions[pi][1], alphas[ai]);
+        ok = false;
+      }
+    }
+  }
+
+  free(dst.pixels);
+  free(expected.pixels);
+  free(src.pixels);
+  return ok;
+}
+
+int main(int argc, char* const argv[])
+{
+  bool print_golden = rx_test_has_flag(argc, argv, "--print-golden");
+  const char* dump_directory = NULL;
+  for (int arg = 1; arg + 1 < argc; arg++) {
+    if (strcmp(argv[arg], "--dump") == 0)
+      dump_directory = argv[arg + 1];
+  }
+
+  if (!check_blend())
+    return 1;
+  fprintf(stderr, "-- blend kernel matches the reference --\n");
+
+  // sources: a full card picture, a few smaller pictures, two movie frames and the inventory books
+  rx_soft_surface_t card_picture, small_picture, wide_picture, movie, small_movie, books[3];
+  bool allocated = make_surface(&card_picture, RX_SOFT_CARD_WIDTH, RX_SOFT_CARD_HEIGHT) && make_surface(&small_picture, 160, 120) &&
+                   make_surface(&wide_picture, 400, 60) && make_surface(&movie, 320, 240) && make_surface(&small_movie, 97, 61);
+  for (int i = 0; i < 3; i++)
+    allocated = allocated && make_surface(books + i, 64 + i * 8, 48 + i * 4);
+  if (!allocated) {
+    fprintf(stderr, "failed to allocate the scene surfaces\n");
+    return 1;
+  }
+  paint_surface(&card_picture, 1);
+  paint_surface(&small_picture, 2);
+  paint_surface(&wide_picture, 3);
+  paint_surface(&movie, 4);
+  paint_surface(&small_movie, 5);
+  for (int i = 0; i < 3; i++)
+    paint_surface(books + i, 6 + i);
+
+  size_t record_size;
+  rx_card_sfxe water;
+  water.record = build_water_record(&record_size);
+  water.offsets = (uint32_t*)((uint8_t*)water.record + water.record->offset_table);
+  if (!rx_sfxe_compile(&water, record_size, RX_SOFT_CARD_WIDTH, RX_SOFT_CARD_HEIGHT)) {
+    fprintf(stderr, "failed to compile the synthetic water effect\n");
+    return 1;
+  }
+
+  const rx_soft_picture_t static_pictures[] = {
+    {&card_picture, make_rect(0, 0, RX_SOFT_CARD_WIDTH, RX_SOFT_CARD_HEIGHT), make_rect(0, 0, RX_SOFT_CARD_WIDTH, RX_SOFT_CARD_HEIGHT)},
+    {&small_picture, make_rect(0, 0, 160, 120), make_rect(40, 200, 200, 320)},
+    {&wide_picture, make_rect(10, 5, 390, 55), make_rect(150, 20, 530, 70)},
+  };
+
+  // scaled up, scaled down, clipped by the card edges, and a sub-rect of a source
+  const rx_soft_picture_t scaled_pictures[] = {
+    {&small_picture, make_rect(0, 0, 160, 120), make_rect(0, 0, 400, 300)},
+    {&wide_picture, make_rect(0, 0, 400, 60), make_rect(300, 250, 500, 280)},
+    {&small_picture, make_rect(20, 10, 140, 110), make_rect(520, 330, 700, 480)},
+    {&card_picture, make_rect(100, 100, 200, 150), make_rect(500, 0, 650, 75)},
+  };
+
+  const rx_soft_picture_t movie_overlays[] = {
+    {&movie, make_rect(0, 0, 320, 240), make_rect(144, 76, 464, 316)},
+    {&small_movie, make_rect(0, 0, 97, 61), make_rect(20, 300, 214, 422)},
+  };
+
+  const rx_soft_inventory_item_t inventory_items[] = {
+    {books + 0, 180, 400, 64, 48, 1.0f},
+    {books + 1, 270, 398, 72, 52, 0.5f},
+    {books + 2, 370, 396, 100, 70, 0.3f},
+  };
+
+  struct scene scenes[SCENE_COUNT] = {
+    {"static", 0, {static_pictures, 3, true, NULL, 0, NULL, 0, NULL, 0}, 1},
+    {"scaled-clipped", 0, {scaled_pictures, 4, true, NULL, 0, NULL, 0, NULL, 0}, 1},
+    {"water", 0, {static_pictures, 3, true, &water, 0, NULL, 0, NULL, 0}, kEffectFrameCount + 3},
+    {"movie", 0, {static_pictures, 3, true, NULL, 0, movie_overlays, 2, NULL, 0}, 2},
+    {"inventory", 0, {static_pictures, 1, true, NULL, 0, NULL, 0, inventory_items, 3}, 1},
+    {"everything", 0, {scaled_pictures, 4, true, &water, 0, movie_overlays, 2, inventory_items, 3}, kEffectFrameCount / 2},
+  };
+  for (int i = 0; i < SCENE_COUNT; i++)
+    scenes[i].golden = kGoldenHashes[i];
+
+  rx_soft_compositor_t compositor;
+  rx_soft_surface_t frame;
+  if (!rx_soft_compositor_init(&compositor) || !make_surface(&frame, RX_SOFT_FRAME_WIDTH, RX_SOFT_FRAME_HEIGHT)) {
+    fprintf(stderr, "failed to allocate the compositor\n");
+    return 1;
+  }
+
+  int failures = 0;
+  for (int i = 0; i < SCENE_COUNT; i++) {
+    // every scene starts from a fresh compositor, as if the card had just been loaded
+    rx_soft_compositor_destroy(&compositor);
+    rx_soft_compositor_init(&compositor);
+    compose_scene(&compositor, scenes + i, &frame);
+    uint64_t hash = hash_surface(&frame);
+
+    if (dump_directory) {
+      char path[1024];
+      snprintf(path, sizeof(path), "%s/%s.tga", dump_directory, scenes[i].name);
+      if (!write_tga(path, &frame))
+        fprintf(stderr, "failed to write %s\n", path);
+    }
+
+    if (print_golden) {
+      printf("  0x%016llxull, // %s\n", (unsigned long long)hash, scenes[i].name);
+    } else if (hash != scenes[i].golden) {
+      fprintf(stderr, "scene %s: hash 0x%016llx does not match the golden hash 0x%016llx\n", scenes[i].name, (unsigned long long)hash,
+              (unsigned long long)scenes[i].golden);
+      failures++;
+    }
+  }
+  if (print_golden)
+    return 0;
+  if (failures) {
+    fprintf(stderr, "-- %d scenes do not match their golden images --\n", failures);
+    return 1;
+  }
+  fprintf(stderr, "-- every scene matches its golden image --\n");
+
+  if (rx_test_should_benchmark(argc, argv)) {
+    for (int i = 0; i < SCENE_COUNT; i++) {
+      // steady state: the static card only refreshes on the first frame, like a card being displayed
+      rx_soft_card_frame_t card_frame = scenes[i].card_frame;
+      compose_scene(&compositor, scenes + i, &frame);
+      card_frame.refresh_static = false;
+
+      uint64_t start = rx_test_now_ns();
+      for (uint32_t n = 0; n < kIterations; n++) {
+        card_frame.water_frame = n % kEffectFrameCount;
+        rx_soft_compose_card_frame(&compositor, &card_frame, &frame);
+      }
+      uint64_t steady_ns = rx_test_now_ns() - start;
+
+      card_frame.refresh_static = true;
+      start = rx_test_now_ns();
+      for (uint32_t n = 0; n < kIterations; n++) {
+        card_frame.water_frame = n % kEffectFrameCount;
+        rx_soft_compose_card_frame(&compositor, &card_frame, &frame);
+      }
+      uint64_t refresh_ns = rx_test_now_ns() - start;
+
+      char name[64];
+      snprintf(name, sizeof(name), "%s frame", scenes[i].name);
+      rx_test_report(name, (double)steady_ns / kIterations, "with a static card refresh", (double)refresh_ns / kIterations);
+    }
+  }
+
+  rx_soft_compositor_destroy(&compositor);
+  rx_sfxe_free_compiled(&water);
+  free(water.record);
+  free(frame.pixels);
+  free(card_picture.pixels);
+  free(small_picture.pixels);
+  free(wide_picture.pixels);
+  free(movie.pixels);
+  free(small_movie.pixels);
+  for (int i = 0; i < 3; i++)
+    free(books[i].pixels);
+  return 0;
+}
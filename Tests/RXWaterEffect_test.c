@@ -0,0 +1,209 @@
+/*
+ *  RXWaterEffect_test.c
+ *  rivenx
+ *
+ *  Checks that compiled water effect frames render exactly like the microprogram interpreter and benchmarks the span copy kernel
+ *  against it on a synthetic effect shaped like the ones in the game (a band of rows made of short horizontal copies).
+ *
+ */
+
+#include "Tests/rx_test.h"
+
+#include <stdlib.h>
+
+#include "Rendering/Graphics/RXWaterEffect.h"
+
+static const uint32_t kSurfaceWidth = 608;
+static const uint32_t kSurfaceHeight = 392;
+
+static const uint16_t kEffectTop = 120;
+static const uint16_t kEffectRows = 220;
+static const uint16_t kEffectFrameCount = 16;
+static const uint32_t kIterations = 2000;
+
+// builds a host-endian SFXE record; each frame shifts every row by a small, frame-dependent amount in short segments
+static struct rx_sfxe_record* build_record(size_t* record_size)
+{
+  size_t max_program_words = kEffectRows * (1 + (kSurfaceWidth / 16) * 5) + 1;
+  size_t header_size = sizeof(struct rx_sfxe_record) + kEffectFrameCount * sizeof(uint32_t);
+  size_t size = header_size + kEffectFrameCount * max_program_words * sizeof(uint16_t);
+
+  struct rx_sfxe_record* record = (struct rx_sfxe_record*)calloc(1, size);
+  record->frame_count = kEffectFrameCount;
+  record->offset_table = sizeof(struct rx_sfxe_record);
+  record->rect.left = 0;
+  record->rect.top = kEffectTop;
+  record->rect.right = kSurfaceWidth;
+  record->rect.bottom = kEffectTop + kEffectRows;
+  record->fps = 15;
+
+  uint32_t* offsets = (uint32_t*)((uint8_t*)record + record->offset_table);
+  uint16_t* mp = (uint16_t*)((uint8_t*)record + header_size);
+  srand(1);
+
+  for (uint16_t frame = 0; frame < kEffectFrameCount; frame++) {
+    offsets[frame] = (uint32_t)((uint8_t*)mp - (uint8_t*)record);
+    for (uint16_t row = 0; row < kEffectRows; row++) {
+      uint16_t x = 8 + (rand() % 24);
+      while (x < kSurfaceWidth - 64) {
+        uint16_t length = 8 + (rand() % 40);
+        int shift = (int)((frame + row) % 7) - 3;
+        *mp++ = 3;
+        *mp++ = x;
+        *mp++ = (uint16_t)(x + shift);
+        *mp++ = (uint16_t)(kEffectTop + row + ((row + frame) % 3) - 1);
+        *mp++ = length;
+        x += length + (rand() % 16);
+      }
+      *mp++ = 1;
+    }
+    *mp++ = 4;
+  }
+
+  *record_size = size;
+  return record;
+}
+
+static void store_be16(uint8_t* p, uint16_t value)
+{
+  p[0] = value >> 8;
+  p[1] = value & 0xff;
+}
+
+// a one frame record the way the archives store it, big-endian, copying 8 pixels of row 1 into row 0
+static int check_swap(void)
+{
+  uint8_t bytes[sizeof(struct rx_sfxe_record) + 4 + 7 * 2] = {0};
+  store_be16(bytes + 2, 1);
+  store_be16(bytes + 6, sizeof(struct rx_sfxe_record));
+  store_be16(bytes + 12, kSurfaceWidth);
+  store_be16(bytes + 14, 1);
+  store_be16(bytes + sizeof(struct rx_sfxe_record) + 2, sizeof(struct rx_sfxe_record) + 4);
+  static const uint16_t program[] = {3, 4, 2, 1, 8, 1, 4};
+  for (int i = 0; i < 7; i++)
+    store_be16(bytes + sizeof(struct rx_sfxe_record) + 4 + i * 2, program[i]);
+
+  rx_card_sfxe sfxe;
+  sfxe.record = (struct rx_sfxe_record*)bytes;
+  if (!rx_sfxe_swap_record(&sfxe, sizeof(bytes)) || sfxe.record->frame_count != 1 || sfxe.record->rect.right != kSurfaceWidth ||
+      !rx_sfxe_compile(&sfxe, sizeof(bytes), kSurfaceWidth, kSurfaceHeight)) {
+    fprintf(stderr, "failed to swap a big-endian water effect\n");
+    return 0;
+  }
+  int ok = sfxe.span_count == 1 && sfxe.spans[0].dst_offset == 4 && sfxe.spans[0].src_offset == kSurfaceWidth + 2 && sfxe.spans[0].length == 8;
+  if (!ok)
+    fprintf(stderr, "the swapped water effect does not copy the right span\n");
+  rx_sfxe_free_compiled(&sfxe);
+
+  // a truncated program must be rejected
+  sfxe.record = (struct rx_sfxe_record*)bytes;
+  store_be16(bytes + 2, 1);
+  if (ok && rx_sfxe_swap_record(&sfxe, sizeof(bytes) - 2)) {
+    fprintf(stderr, "a truncated water effect was not rejected\n");
+    ok = 0;
+  }
+  return ok;
+}
+
+int main(int argc, char* const argv[])
+{
+  if (!check_swap())
+    return 1;
+
+  size_t record_size;
+  rx_card_sfxe sfxe;
+  sfxe.record = build_record(&record_size);
+  sfxe.offsets = (uint32_t*)((uint8_t*)sfxe.record + sfxe.record->offset_table);
+
+  if (!rx_sfxe_compile(&sfxe, record_size, kSurfaceWidth, kSurfaceHeight)) {
+    fprintf(stderr, "failed to compile the synthetic water effect\n");
+    return 1;
+  }
+
+  size_t surface_size = kSurfaceWidth * kSurfaceHeight * sizeof(uint32_t);
+  uint32_t* source = (uint32_t*)malloc(surface_size);
+  uint32_t* interpreted = (uint32_t*)malloc(surface_size);
+  uint32_t* compiled = (uint32_t*)malloc(surface_size);
+  for (uint32_t i = 0; i < kSurfaceWidth * kSurfaceHeight; i++)
+    source[i] = i * 2654435761u;
+
+  // every frame must produce identical surfaces, and nothing may change outside of the frame's dirty rect
+  uint64_t span_count = 0, dirty_pixels = 0;
+  for (uint32_t frame = 0; frame < kEffectFrameCount; frame++) {
+    memcpy(interpreted, source, surface_size);
+    memcpy(compiled, source, surface_size);
+    rx_sfxe_interpret_frame(&sfxe, frame, interpreted, source, kSurfaceWidth);
+    rx_sfxe_execute_frame(&sfxe, frame, compiled, source);
+
+    if (memcmp(interpreted, compiled, surface_size) != 0) {
+      fprintf(stderr, "compiled frame %u does not match the interpreter\n", frame);
+      return 1;
+    }
+
+    const struct rx_sfxe_frame* f = sfxe.frames + frame;
+    for (uint32_t y = 0; y < kSurfaceHeight; y++) {
+      for (uint32_t x = 0; x < kSurfaceWidth; x++) {
+        int inside = x >= f->dirty_rect.left && x < f->dirty_rect.right && y >= f->dirty_rect.top && y < f->dirty_rect.bottom;
+        if (!inside && compiled[y * kSurfaceWidth + x] != source[y * kSurfaceWidth + x]) {
+          fprintf(stderr, "frame %u wrote outside of its dirty rect at %u, %u\n", frame, x, y);
+          return 1;
+        }
+      }
+    }
+
+    span_count += f->span_count;
+    dirty_pixels += (uint64_t)(f->dirty_rect.right - f->dirty_rect.left) * (f->dirty_rect.bottom - f->dirty_rect.top);
+  }
+  fprintf(stderr, "-- compiled water effect matches the interpreter (%llu spans, %.1f%% of the surface uploaded per frame) --\n",
+          (unsigned long long)span_count / kEffectFrameCount, 100.0 * dirty_pixels / ((double)kEffectFrameCount * kSurfaceWidth * kSurfaceHeight));
+
+  // the span quads must sample the same texels as the spans when rasterized with nearest filtering at pixel centers
+  struct rx_sfxe_quad_vertex* quads = (struct rx_sfxe_quad_vertex*)malloc(sizeof(struct rx_sfxe_quad_vertex) * 4 * sfxe.span_count);
+  rx_sfxe_build_quads(&sfxe, kSurfaceWidth, kSurfaceHeight, quads);
+  for (uint32_t frame = 0; frame < kEffectFrameCount; frame++) {
+    memcpy(interpreted, source, surface_size);
+    memcpy(compiled, source, surface_size);
+    rx_sfxe_interpret_frame(&sfxe, frame, interpreted, source, kSurfaceWidth);
+
+    const struct rx_sfxe_frame* f = sfxe.frames + frame;
+    for (uint32_t span_i = f->first_span; span_i < f->first_span + f->span_count; span_i++) {
+      const struct rx_sfxe_quad_vertex* q = quads + span_i * 4;
+      for (int16_t x = q[0].x; x < q[1].x; x++) {
+        // the quad covers one surface row; interpolate the texture coordinates at the pixel center
+        double y_center = (q[0].y + q[3].y) * 0.5;
+        double s = q[0].s + (x + 0.5 - q[0].x) * (double)(q[1].s - q[0].s) / (double)(q[1].x - q[0].x);
+        double t = q[0].t + (q[0].y - y_center) * (double)(q[3].t - q[0].t) / (double)(q[0].y - q[3].y);
+        uint32_t row = kSurfaceHeight - (uint32_t)q[0].y;
+        compiled[row * kSurfaceWidth + x] = source[(uint32_t)t * kSurfaceWidth + (uint32_t)s];
+      }
+    }
+
+    if (memcmp(interpreted, compiled, surface_size) != 0) {
+      fprintf(stderr, "span quads of frame %u do not match the interpreter\n", frame);
+      return 1;
+    }
+  }
+  free(quads);
+  fprintf(stderr, "-- span quads match the interpreter --\n");
+
+  // benchmark
+  uint64_t start = rx_test_now_ns();
+  for (uint32_t i = 0; i < kIterations; i++)
+    rx_sfxe_interpret_frame(&sfxe, i % kEffectFrameCount, interpreted, source, kSurfaceWidth);
+  uint64_t interpreter_ns = rx_test_now_ns() - start;
+
+  start = rx_test_now_ns();
+  for (uint32_t i = 0; i < kIterations; i++)
+    rx_sfxe_execute_frame(&sfxe, i % kEffectFrameCount, compiled, source);
+  uint64_t compiled_ns = rx_test_now_ns() - start;
+
+  fprintf(stderr, "interpreter: %8.2f us/frame\n", interpreter_ns / 1000.0 / kIterations);
+  fprintf(stderr, "compiled:    %8.2f us/frame (%.2fx)\n", compiled_ns / 1000.0 / kIterations, (double)interpreter_ns / (double)compiled_ns);
+
+  rx_sfxe_free_compiled(&sfxe);
+  free(sfxe.record);
+  free(source);
+  free(interpreted);
+  free(compiled);
+  return 0;
+}
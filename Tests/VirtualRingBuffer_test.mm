@@ -0,0 +1,633 @@
+/*
+ *  VirtualRingBuffer_test.mm
+ *  rivenx
+ *
+ *  Created by Jean-Francois Roy on 17/03/2006.
+ *  Copyright 2005-2012 MacStorm. All rights reserved.
+ *
+ *  The rx::mirrored_ring_buffer and rx::mirrored_ring_buffer_pool tests and the producer / consumer benchmarks are portable C++; outside
+ *  of Xcode, build them with
+ *  c++ -std=c++11 -O2 -I. -x c++ Tests/VirtualRingBuffer_test.mm Utilities/mirrored_ring_buffer.cpp -pthread
+ *  Pass --no-benchmark to only run the tests.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#endif
+
+#include "Utilities/mirrored_ring_buffer.h"
+
+#if defined(__OBJC__)
+#import "Base/RXBufferMacros.h"
+#import "Utilities/VirtualRingBuffer.h"
+
+#import <Foundation/NSAutoreleasePool.h>
+
+static int test_normal_buffer()
+{
+  VirtualRingBuffer* buffer;
+
+  const uint32_t data = 0xDECAFBAD;
+  uint32_t read_data = 0x0;
+
+  void* read_pointer;
+  void* write_pointer;
+
+  UInt32 available_read;
+  UInt32 available_write;
+
+  UInt32 old_available_read;
+  UInt32 old_available_write;
+
+  UInt32 copy_count_for_fill;
+  UInt32 copy_counter;
+  UInt32 copy_byte_count;
+
+  // test normal ring buffer
+  NSLog(@"-- Testing a normal ring buffer --");
+
+  buffer = [[VirtualRingBuffer alloc] initWithLength:1];
+  if (!buffer) {
+    NSLog(@"Could not allocate and init the buffer!");
+    return 1;
+  }
+
+  NSLog(@"%@", buffer);
+
+  // buffer should be empty
+  if (![buffer isEmpty]) {
+    NSLog(@"Buffer wasn't empty after initialization.");
+    return 1;
+  }
+
+  // buffer should have 0 bytes available for reading
+  available_read = [buffer lengthAvailableToReadReturningPointer:&read_pointer];
+  if (available_read != 0) {
+    NSLog(@"Buffer reported bytes available for reading before after initialization.");
+    return 1;
+  }
+
+  // buffer should have one VM page of free space
+  available_write = [buffer lengthAvailableToWriteReturningPointer:&write_pointer];
+  if (available_write != 0x1000) {
+    NSLog(@"Buffer reported an incorrect number of bytes available for writing after initialization.");
+  }
+
+  // buffer should still have 0 bytes available for reading
+  available_read = [buffer lengthAvailableToReadReturningPointer:&read_pointer];
+  if (available_read != 0) {
+    NSLog(@"Buffer reported bytes available for reading before first write was committed.");
+    return 1;
+  }
+
+  // write some bytes and commit
+  memcpy(write_pointer, &data, sizeof(data));
+  [buffer didWriteLength:sizeof(data)];
+
+  // buffer should not be empty
+  if ([buffer isEmpty]) {
+    NSLog(@"Buffer reported empty after first write was committed.");
+    return 1;
+  }
+
+  // buffer should have sizeof(data) bytes available for reading
+  available_read = [buffer lengthAvailableToReadReturningPointer:&read_pointer];
+  if (available_read != sizeof(data)) {
+    NSLog(@"Buffer reported an incorrect number of bytes available for reading after first write was committed.");
+    return 1;
+  }
+
+  // buffer should have sizeof(data) less bytes available for writing
+  old_available_write = available_write;
+  available_write = [buffer lengthAvailableToWriteReturningPointer:&write_pointer];
+  if (available_write != old_available_write - sizeof(data)) {
+    NSLog(@"Buffer reported an incorrect number of bytes available for writing after first write was committed.");
+    return 1;
+  }
+
+  // read some bytes
+  memcpy(&read_data, read_pointer, sizeof(data));
+  [buffer didReadLength:sizeof(data)];
+
+  // check for data integrity
+  if (read_data != data) {
+    NSLog(@"Incorrect data read back from the buffer.");
+    return 1;
+  }
+
+  // buffer should be empty again
+  if (![buffer isEmpty]) {
+    NSLog(@"Buffer reported not empty after first read was committed.");
+    return 1;
+  }
+
+  // buffers should have sizeof(read_data) less bytes available for reading
+  old_available_read = available_read;
+  available_read = [buffer lengthAvailableToReadReturningPointer:&read_pointer];
+  if (available_read != old_available_read - sizeof(data)) {
+    NSLog(@"Buffer reported an incorrect number of bytes available for reading after first read was committed.");
+    return 1;
+  }
+
+  // buffer should have sizeof(data) more bytes available for writing
+  old_available_write = available_write;
+  available_write = [buffer lengthAvailableToWriteReturningPointer:&write_pointer];
+  if (available_write != old_available_write + sizeof(data)) {
+    NSLog(@"Buffer reported an incorrect number of bytes available for writing after first read was committed.");
+    return 1;
+  }
+
+  // write some bytes and commit
+  memcpy(write_pointer, &data, sizeof(data));
+  [buffer didWriteLength:sizeof(data)];
+
+  // test empty
+  [buffer empty];
+
+  // buffer should be empty again
+  if (![buffer isEmpty]) {
+    NSLog(@"Buffer reported not empty after explicit empty.");
+    return 1;
+  }
+
+  // let's fill the buffer
+  available_write = [buffer lengthAvailableToWriteReturningPointer:&write_pointer];
+  if (available_write != 0x1000) {
+    NSLog(@"Buffer reported an incorrect number of bytes available for writing after empty.");
+  }
+
+  copy_count_for_fill = 0x1000 / sizeof(data);
+  copy_byte_count = 0;
+
+  // write!
+  for (copy_counter = 0; copy_counter < copy_count_for_fill; copy_counter++) {
+    memcpy(write_pointer, &data, sizeof(data));
+    write_pointer = BUFFER_OFFSET(write_pointer, sizeof(data));
+    copy_byte_count += sizeof(data);
+  }
+
+  // remainder
+  copy_counter = available_write % sizeof(data);
+  if (copy_counter > 0) {
+    memcpy(write_pointer, &data, copy_counter);
+    copy_byte_count += copy_counter;
+  }
+
+  // sanity check...
+  if (copy_byte_count != 0x1000) {
+    NSLog(@"Did not copy nominal buffer length bytes!");
+    return 1;
+  }
+
+  // commit write
+  [buffer didWriteLength:copy_byte_count];
+
+  // buffer should not have any space left for writing
+  available_write = [buffer lengthAvailableToWriteReturningPointer:&write_pointer];
+  if (available_write != 0) {
+    NSLog(@"Buffer reported bytes available for writing after buffer fill was committed.");
+    return 1;
+  }
+
+  // buffer should have full buffer size available for reading
+  available_read = [buffer lengthAvailableToReadReturningPointer:&read_pointer];
+  if (available_read != 0x1000) {
+    NSLog(@"Buffer reported an incorrect number of bytes available for reading after buffer fill was committed.");
+    return 1;
+  }
+
+  /*
+      let's test wrap around
+      method:
+              - read half the fill bytes (puts the read pointer halfway through the nominal length)
+              - write half the nominal length (puts the write pointer at the read pointer)
+              - read the nominal length of bytes
+              - test for data coherency
+  */
+
+  // read half the fill bytes
+  [buffer didReadLength:0x800];
+
+  // buffer should have 0x800 bytes available for reading and writing
+  available_read = [buffer lengthAvailableToReadReturningPointer:&read_pointer];
+  if (available_read != 0x800) {
+    NSLog(@"Buffer reported an incorrect number of bytes available for reading after reading half the buffer fill bytes. 0x%x bytes",
+          (unsigned int)available_read);
+    return 1;
+  }
+
+  // buffer should have one VM page of free space
+  available_write = [buffer lengthAvailableToWriteReturningPointer:&write_pointer];
+  if (available_write != 0x800) {
+    NSLog(@"Buffer reported an incorrect number of bytes available for writing after reading half the buffer fill bytes.");
+  }
+
+  // write half the nominal length
+  copy_count_for_fill = 0x800 / sizeof(data);
+  copy_byte_count = 0;
+
+  // write!
+  for (copy_counter = 0; copy_counter < copy_count_for_fill; copy_counter++) {
+    memcpy(write_pointer, &data, sizeof(data));
+    write_pointer = BUFFER_OFFSET(write_pointer, sizeof(data));
+    copy_byte_count += sizeof(data);
+  }
+
+  // remainder
+  copy_counter = available_write % sizeof(data);
+  if (copy_counter > 0) {
+    memcpy(write_pointer, &data, copy_counter);
+    copy_byte_count += copy_counter;
+  }
+
+  // sanity check...
+  if (copy_byte_count != 0x800) {
+    NSLog(@"Did not copy half the nominal buffer length bytes!");
+    return 1;
+  }
+
+  // commit write
+  [buffer didWriteLength:copy_byte_count];
+
+  // buffer should have nominal length bytes available
+  available_read = [buffer lengthAvailableToReadReturningPointer:&read_pointer];
+  if (available_read != 0x1000) {
+    NSLog(@"Buffer reported an incorrect number of bytes available for reading after wrap around write was committed.");
+    return 1;
+  }
+
+  // sample first value and check that it's sane
+  memcpy(&read_data, read_pointer, sizeof(data));
+  if (read_data != data) {
+    NSLog(@"Incorrect data read back from the buffer after wrap around write.");
+    return 1;
+  }
+
+  // commit read
+  [buffer didReadLength:0x1000];
+
+  // buffer should be empty
+  if (![buffer isEmpty]) {
+    NSLog(@"Buffer reported not empty after reading all wrap around bytes.");
+    return 1;
+  }
+
+  // test successful
+  [buffer release];
+  NSLog(@"-- Normal ring buffer test passed --\n");
+  return 0;
+}
+#endif // __OBJC__
+
+static int test_mirrored_ring_buffer()
+{
+  fprintf(stderr, "-- Testing a mirrored ring buffer --\n");
+
+  rx::mirrored_ring_buffer<uint32_t> buffer(1);
+  const size_t capacity = buffer.capacity();
+  const uint32_t data = 0xDECAFBAD;
+
+  const uint32_t* read_pointer;
+  uint32_t* write_pointer;
+
+  // buffer should be empty and have one page of free space
+  if (!buffer.empty() || buffer.read_available(&read_pointer) != 0) {
+    fprintf(stderr, "Buffer wasn't empty after initialization.\n");
+    return 1;
+  }
+  if (capacity != rx::mirrored_mapping::page_size() / sizeof(uint32_t) || buffer.write_available(&write_pointer) != capacity) {
+    fprintf(stderr, "Buffer reported an incorrect capacity after initialization.\n");
+    return 1;
+  }
+
+  // write and read back one element
+  write_pointer[0] = data;
+  buffer.did_write(1);
+  if (buffer.read_available(&read_pointer) != 1 || buffer.write_available(&write_pointer) != capacity - 1) {
+    fprintf(stderr, "Buffer reported incorrect lengths after first write was committed.\n");
+    return 1;
+  }
+  if (read_pointer[0] != data) {
+    fprintf(stderr, "Incorrect data read back from the buffer.\n");
+    return 1;
+  }
+  buffer.did_read(1);
+  if (!buffer.empty() || buffer.write_available(&write_pointer) != capacity) {
+    fprintf(stderr, "Buffer reported incorrect lengths after first read was committed.\n");
+    return 1;
+  }
+
+  // fill the buffer from the current (unaligned) position; the write span must be contiguous across the mirror boundary
+  size_t available = buffer.write_available(&write_pointer);
+  for (size_t i = 0; i < available; i++)
+    write_pointer[i] = static_cast<uint32_t>(i);
+  buffer.did_write(available);
+  if (buffer.write_available(&write_pointer) != 0 || buffer.read_available(&read_pointer) != capacity) {
+    fprintf(stderr, "Buffer reported incorrect lengths after buffer fill was committed.\n");
+    return 1;
+  }
+
+  // read half, write half again so the data wraps around, then check the whole span in one go
+  buffer.did_read(capacity / 2);
+  available = buffer.write_available(&write_pointer);
+  if (available != capacity / 2) {
+    fprintf(stderr, "Buffer reported an incorrect number of elements available for writing after reading half the buffer.\n");
+    return 1;
+  }
+  for (size_t i = 0; i < available; i++)
+    write_pointer[i] = static_cast<uint32_t>(capacity + i);
+  buffer.did_write(available);
+
+  if (buffer.read_available(&read_pointer) != capacity) {
+    fprintf(stderr, "Buffer reported an incorrect number of elements available for reading after wrap around write was committed.\n");
+    return 1;
+  }
+  for (size_t i = 0; i < capacity; i++) {
+    if (read_pointer[i] != static_cast<uint32_t>(capacity / 2 + i)) {
+      fprintf(stderr, "Incorrect data read back from the buffer after wrap around write at element %zu.\n", i);
+      return 1;
+    }
+  }
+  buffer.did_read(capacity);
+
+  // clear must reset the indices
+  buffer.did_write(3);
+  buffer.clear();
+  if (!buffer.empty() || buffer.write_available(&write_pointer) != capacity) {
+    fprintf(stderr, "Buffer reported not empty after clear.\n");
+    return 1;
+  }
+
+  fprintf(stderr, "-- Mirrored ring buffer test passed --\n\n");
+  return 0;
+}
+
+static int test_mirrored_ring_buffer_pool()
+{
+  fprintf(stderr, "-- Testing a mirrored ring buffer pool --\n");
+
+  const size_t page_elements = rx::mirrored_mapping::page_size() / sizeof(uint32_t);
+  rx::mirrored_ring_buffer_pool<uint32_t> pool(2);
+
+  // a recycled buffer comes back cleared for a request that rounds up to its capacity, and not for any other capacity
+  rx::mirrored_ring_buffer<uint32_t>* buffer = pool.acquire(page_elements);
+  uint32_t* write_pointer;
+  buffer->write_available(&write_pointer);
+  write_pointer[0] = 1;
+  buffer->did_write(1);
+  pool.recycle(buffer);
+
+  rx::mirrored_ring_buffer<uint32_t>* other = pool.acquire(2 * page_elements);
+  if (other == buffer || other->capacity() != 2 * page_elements) {
+    fprintf(stderr, "Pool handed out a buffer of the wrong capacity.\n");
+    return 1;
+  }
+  rx::mirrored_ring_buffer<uint32_t>* recycled = pool.acquire(page_elements - 1);
+  if (recycled != buffer || !recycled->empty() || pool.hit_count() != 1 || pool.miss_count() != 2) {
+    fprintf(stderr, "Pool did not hand back the recycled buffer, cleared.\n");
+    return 1;
+  }
+
+  // the pool keeps at most its limit of idle buffers
+  rx::mirrored_ring_buffer<uint32_t>* third = pool.acquire(page_elements);
+  pool.recycle(recycled);
+  pool.recycle(other);
+  pool.recycle(third);
+  pool.recycle(NULL);
+  if (pool.idle_count() != 2) {
+    fprintf(stderr, "Pool holds %zu idle buffers, expected 2.\n", pool.idle_count());
+    return 1;
+  }
+
+  fprintf(stderr, "-- Mirrored ring buffer pool test passed --\n\n");
+  return 0;
+}
+
+// adapters giving both ring buffers the same byte-oriented interface for the benchmarks
+struct mirrored_ring_adapter {
+  static const char* name() { return "rx::mirrored_ring_buffer"; }
+
+  explicit mirrored_ring_adapter(size_t length) : ring(length) {}
+
+  size_t read_available(const uint8_t** ptr) { return ring.read_available(ptr); }
+  void did_read(size_t length) { ring.did_read(length); }
+  size_t write_available(uint8_t** ptr) { return ring.write_available(ptr); }
+  void did_write(size_t length) { ring.did_write(length); }
+  bool empty() { return ring.empty(); }
+
+  rx::mirrored_ring_buffer<uint8_t> ring;
+};
+
+#if defined(__OBJC__)
+struct virtual_ring_adapter {
+  static const char* name() { return "VirtualRingBuffer"; }
+
+  explicit virtual_ring_adapter(size_t length) { ring = [[VirtualRingBuffer alloc] initWithLength:length]; }
+  ~virtual_ring_adapter() { [ring release]; }
+
+  size_t read_available(const uint8_t** ptr) { return [ring lengthAvailableToReadReturningPointer:(void**)ptr]; }
+  void did_read(size_t length) { [ring didReadLength:length]; }
+  size_t write_available(uint8_t** ptr) { return [ring lengthAvailableToWriteReturningPointer:(void**)ptr]; }
+  void did_write(size_t length) { [ring didWriteLength:length]; }
+  bool empty() { return [ring isEmpty]; }
+
+  VirtualRingBuffer* ring;
+};
+#endif
+
+// pins the calling thread to a core; on Darwin, distinct affinity tags ask the scheduler to keep the threads on different L2 caches
+static void pin_current_thread(unsigned int core)
+{
+#if defined(__linux__)
+  unsigned int core_count = std::max(1u, std::thread::hardware_concurrency());
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core % core_count, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(__APPLE__)
+  thread_affinity_policy_data_t policy = {static_cast<integer_t>(core + 1)};
+  thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY, (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT);
+#else
+  (void)core;
+#endif
+}
+
+// yields so that the benchmarks still make progress when both threads end up sharing a core
+static inline void spin_wait() { std::this_thread::yield(); }
+
+static uint64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const size_t kBenchmarkRingLength = 64 * 1024;
+static const uint64_t kThroughputByteCount = 256ull * 1024 * 1024;
+static const size_t kLatencyMessageCount = 100000;
+
+// streams a sequence of 64-bit counters through the ring in chunks of chunk_length bytes; the consumer checks every counter
+template <typename Ring>
+static int benchmark_throughput(size_t chunk_length)
+{
+  Ring ring(kBenchmarkRingLength);
+  const uint64_t word_count = kThroughputByteCount / sizeof(uint64_t);
+  const size_t chunk_words = chunk_length / sizeof(uint64_t);
+  std::atomic<bool> corrupted(false);
+
+  uint64_t start = now_ns();
+
+  std::thread consumer([&] {
+    pin_current_thread(1);
+    uint64_t expected = 0;
+    while (expected < word_count) {
+      const uint8_t* read_pointer;
+      size_t available = ring.read_available(&read_pointer) / sizeof(uint64_t);
+      if (available == 0) {
+        spin_wait();
+        continue;
+      }
+      available = std::min(available, chunk_words);
+
+      const uint64_t* words = reinterpret_cast<const uint64_t*>(read_pointer);
+      for (size_t i = 0; i < available; i++) {
+        if (words[i] != expected + i)
+          corrupted.store(true, std::memory_order_relaxed);
+      }
+      expected += available;
+      ring.did_read(available * sizeof(uint64_t));
+    }
+  });
+
+  pin_current_thread(0);
+  uint64_t next = 0;
+  while (next < word_count) {
+    uint8_t* write_pointer;
+    size_t available = ring.write_available(&write_pointer) / sizeof(uint64_t);
+    if (available < chunk_words) {
+      spin_wait();
+      continue;
+    }
+    available = std::min<uint64_t>(chunk_words, word_count - next);
+
+    uint64_t* words = reinterpret_cast<uint64_t*>(write_pointer);
+    for (size_t i = 0; i < available; i++)
+      words[i] = next + i;
+    next += available;
+    ring.did_write(available * sizeof(uint64_t));
+  }
+  consumer.join();
+
+  double seconds = (now_ns() - start) / 1e9;
+  if (corrupted.load()) {
+    fprintf(stderr, "%s: data corruption detected with %zu byte chunks!\n", Ring::name(), chunk_length);
+    return 1;
+  }
+
+  fprintf(stderr, "%s: throughput with %5zu byte chunks: %8.1f MB/s\n", Ring::name(), chunk_length, kThroughputByteCount / seconds / (1024.0 * 1024.0));
+  return 0;
+}
+
+// sends one timestamp at a time and waits for the consumer to drain it, so this measures the hand-off latency rather than queueing
+template <typename Ring>
+static int benchmark_latency()
+{
+  Ring ring(kBenchmarkRingLength);
+  std::vector<uint64_t> latencies(kLatencyMessageCount);
+
+  std::thread consumer([&] {
+    pin_current_thread(1);
+    for (size_t i = 0; i < kLatencyMessageCount; i++) {
+      const uint8_t* read_pointer;
+      while (ring.read_available(&read_pointer) < sizeof(uint64_t))
+        spin_wait();
+      uint64_t sent;
+      memcpy(&sent, read_pointer, sizeof(sent));
+      latencies[i] = now_ns() - sent;
+      ring.did_read(sizeof(uint64_t));
+    }
+  });
+
+  pin_current_thread(0);
+  for (size_t i = 0; i < kLatencyMessageCount; i++) {
+    uint8_t* write_pointer;
+    while (!ring.empty())
+      spin_wait();
+    ring.write_available(&write_pointer);
+    uint64_t sent = now_ns();
+    memcpy(write_pointer, &sent, sizeof(sent));
+    ring.did_write(sizeof(uint64_t));
+  }
+  consumer.join();
+
+  std::sort(latencies.begin(), latencies.end());
+  fprintf(stderr, "%s: hand-off latency p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n", Ring::name(),
+          (unsigned long long)latencies[kLatencyMessageCount / 2], (unsigned long long)latencies[kLatencyMessageCount * 99 / 100],
+          (unsigned long long)latencies[kLatencyMessageCount * 999 / 1000], (unsigned long long)latencies.back());
+  return 0;
+}
+
+template <typename Ring>
+static int run_benchmarks()
+{
+  static const size_t chunk_lengths[] = {64, 512, 4096, 16384};
+  for (size_t i = 0; i < sizeof(chunk_lengths) / sizeof(chunk_lengths[0]); i++) {
+    if (benchmark_throughput<Ring>(chunk_lengths[i]) != 0)
+      return 1;
+  }
+  return benchmark_latency<Ring>();
+}
+
+int main(int argc, char* const argv[])
+{
+#if defined(__OBJC__)
+  NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+#endif
+  int result = 0;
+
+  bool benchmark = true;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--no-benchmark") == 0)
+      benchmark = false;
+  }
+
+#if defined(__OBJC__)
+  result = test_normal_buffer();
+  if (result != 0)
+    return result;
+#endif
+
+  result = test_mirrored_ring_buffer();
+  if (result != 0)
+    return result;
+
+  result = test_mirrored_ring_buffer_pool();
+  if (result != 0)
+    return result;
+
+  if (benchmark) {
+    fprintf(stderr, "-- Benchmarking single producer / single consumer transfers on %u cores --\n", std::thread::hardware_concurrency());
+    result = run_benchmarks<mirrored_ring_adapter>();
+#if defined(__OBJC__)
+    if (result == 0)
+      result = run_benchmarks<virtual_ring_adapter>();
+#endif
+  }
+
+#if defined(__OBJC__)
+  [pool release];
+#endif
+  return result;
+}
@@ -0,0 +1,212 @@
+/*
+ *  mohawk_inno_source_test.c
+ *  rivenx
+ *
+ *  The synthetic installer and its block store are written to the directory given on the command line, /tmp by default.
+ *
+ */
+
+#include "Tests/rx_test.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <lzma.h>
+
+#include <MHKKit/mohawk_inno_source.h>
+
+static const uint64_t kSetupPrefixSize = 12345;
+static const uint64_t kFileSize = 13 * MHK_INNO_BLOCK_SIZE + 4321;
+static const uint32_t kReaderThreads = 4;
+static const uint32_t kReadsPerThread = 400;
+static const uint32_t kBenchmarkReads = 20000;
+
+static uint32_t next_random(uint32_t* state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+// alternating stretches of compressible and incompressible data, like an archive of scripts and already compressed media
+static uint8_t* make_payload(void)
+{
+  uint8_t* payload = (uint8_t*)malloc(kFileSize);
+  uint32_t state = 0x1234567;
+  for (uint64_t i = 0; i < kFileSize; i++) {
+    if ((i / 100000) % 2 == 0)
+      payload[i] = (uint8_t)("the quick brown fox jumps over the lazy dog "[i % 44] ^ ((i / 4096) & 1));
+    else
+      payload[i] = (uint8_t)next_random(&state);
+  }
+  return payload;
+}
+
+// writes an installer-like file: some leading bytes, then the zlb\x1A magic, the LZMA properties and dictionary size, and raw LZMA1 data
+static bool write_setup(const char* path, const uint8_t* payload, uint64_t* compressed_size)
+{
+  lzma_options_lzma options;
+  lzma_lzma_preset(&options, 6);
+  options.dict_size = 1 << 20;
+  lzma_filter filters[2] = {{LZMA_FILTER_LZMA1, &options}, {LZMA_VLI_UNKNOWN, NULL}};
+
+  size_t capacity = kFileSize + kFileSize / 8 + 65536;
+  uint8_t* data = (uint8_t*)malloc(capacity);
+  size_t data_size = 0;
+  if (lzma_raw_buffer_encode(filters, NULL, payload, kFileSize, data, &data_size, capacity) != LZMA_OK)
+    return false;
+
+  FILE* fp = fopen(path, "wb");
+  if (!fp)
+    return false;
+
+  uint32_t state = 42;
+  for (uint64_t i = 0; i < kSetupPrefixSize; i++)
+    fputc((int)(next_random(&state) & 0xff), fp);
+
+  uint8_t header[9] = {0x7a, 0x6c, 0x62, 0x1a, (uint8_t)((options.pb * 5 + options.lp) * 9 + options.lc)};
+  memcpy(header + 5, &options.dict_size, sizeof(uint32_t));
+  fwrite(header, sizeof(header), 1, fp);
+  fwrite(data, data_size, 1, fp);
+  free(data);
+
+  // like in the installer, the compressed size counts the magic and the LZMA data but not the LZMA header
+  *compressed_size = data_size + 4;
+  return fclose(fp) == 0;
+}
+
+struct reader_context {
+  mhk_data_source_t* source;
+  const uint8_t* payload;
+  uint32_t seed;
+  uint32_t failures;
+};
+
+static void* reader(void* context)
+{
+  struct reader_context* c = (struct reader_context*)context;
+  uint8_t* buffer = (uint8_t*)malloc(3 * MHK_INNO_BLOCK_SIZE);
+
+  for (uint32_t i = 0; i < kReadsPerThread; i++) {
+    // mostly small reads, some spanning several blocks, some running past the end of the file
+    uint64_t offset = next_random(&c->seed) % kFileSize;
+    ByteCount length = (i % 10 == 0) ? 1 + next_random(&c->seed) % (3 * MHK_INNO_BLOCK_SIZE) : 1 + next_random(&c->seed) % 8192;
+    if (i % 50 == 0)
+      offset = kFileSize - (next_random(&c->seed) % 100);
+
+    ByteCount actual = 0;
+    OSStatus err = mhk_data_source_read(c->source, (SInt64)offset, length, buffer, &actual);
+    ByteCount expected = (offset + length > kFileSize) ? (ByteCount)(kFileSize - offset) : length;
+    OSStatus expected_err = (expected < length) ? eofErr : noErr;
+
+    if (err != expected_err || actual != expected || memcmp(buffer, c->payload + offset, expected) != 0) {
+      fprintf(stderr, "read of %lu bytes at %llu returned %d with %lu bytes, expected %d with %lu bytes\n", (unsigned long)length,
+              (unsigned long long)offset, (int)err, (unsigned long)actual, (int)expected_err, (unsigned long)expected);
+      c->failures++;
+    }
+  }
+
+  free(buffer);
+  return NULL;
+}
+
+static uint32_t read_concurrently(mhk_data_source_t* source, const uint8_t* payload)
+{
+  pthread_t threads[kReaderThreads];
+  struct reader_context contexts[kReaderThreads];
+  for (uint32_t i = 0; i < kReaderThreads; i++) {
+    contexts[i] = (struct reader_context){source, payload, 0x9e3779b9u * (i + 1), 0};
+    pthread_create(threads + i, NULL, reader, contexts + i);
+  }
+
+  uint32_t failures = 0;
+  for (uint32_t i = 0; i < kReaderThreads; i++) {
+    pthread_join(threads[i], NULL);
+    failures += contexts[i].failures;
+  }
+  return failures;
+}
+
+int main(int argc, char* const argv[])
+{
+  const char* directory = "/tmp";
+  for (int arg = 1; arg < argc; arg++) {
+    if (argv[arg][0] != '-')
+      directory = argv[arg];
+  }
+
+  char setup_path[1024], store_path[1024], index_path[1100];
+  snprintf(setup_path, sizeof(setup_path), "%s/mohawk_inno_source_test.%d.exe", directory, (int)getpid());
+  snprintf(store_path, sizeof(store_path), "%s/mohawk_inno_source_test.%d.blocks", directory, (int)getpid());
+  snprintf(index_path, sizeof(index_path), "%s.index", store_path);
+
+  uint8_t* payload = make_payload();
+  uint64_t compressed_size;
+  if (!write_setup(setup_path, payload, &compressed_size)) {
+    fprintf(stderr, "failed to write the synthetic installer\n");
+    return 1;
+  }
+
+  int failures = 0;
+
+  // reads while the source re-chunks the stream
+  OSStatus err;
+  uint64_t start = rx_test_now_ns();
+  mhk_data_source_t* source = mhk_inno_data_source_create(setup_path, kSetupPrefixSize, compressed_size, kFileSize, store_path, &err);
+  if (!source) {
+    fprintf(stderr, "failed to create the data source: %d\n", (int)err);
+    return 1;
+  }
+  failures += read_concurrently(source, payload);
+  while (mhk_inno_data_source_progress(source) < 1.0f)
+    usleep(1000);
+  uint64_t rechunk_ns = rx_test_now_ns() - start;
+  mhk_data_source_close(source);
+  fprintf(stderr, "-- re-chunked %.1f MB in %.1f ms while reading from %u threads --\n", kFileSize / 1.0e6, rechunk_ns / 1.0e6, kReaderThreads);
+
+  // a new source must find the complete store and not decode anything
+  source = mhk_inno_data_source_create(setup_path, kSetupPrefixSize, compressed_size, kFileSize, store_path, &err);
+  if (!source || mhk_inno_data_source_progress(source) < 1.0f) {
+    fprintf(stderr, "the completed block store was not reused\n");
+    return 1;
+  }
+  failures += read_concurrently(source, payload);
+
+  if (rx_test_should_benchmark(argc, argv)) {
+    uint8_t buffer[4096];
+    uint32_t state = 7;
+    start = rx_test_now_ns();
+    for (uint32_t i = 0; i < kBenchmarkReads; i++)
+      mhk_data_source_read(source, (SInt64)(next_random(&state) % (kFileSize - sizeof(buffer))), sizeof(buffer), buffer, NULL);
+    rx_test_report("random 4 KB read from the block store", (double)(rx_test_now_ns() - start) / kBenchmarkReads, NULL, 0.0);
+  }
+  mhk_data_source_close(source);
+
+  // a source over a bad stream must fail reads instead of blocking them
+  unlink(index_path);
+  source = mhk_inno_data_source_create(setup_path, kSetupPrefixSize + 1, compressed_size, kFileSize, store_path, &err);
+  if (source) {
+    uint8_t byte;
+    if (mhk_data_source_read(source, (SInt64)(kFileSize - 1), 1, &byte, NULL) == noErr) {
+      fprintf(stderr, "a read from a corrupt stream succeeded\n");
+      failures++;
+    }
+    mhk_data_source_close(source);
+  }
+
+  unlink(setup_path);
+  unlink(store_path);
+  unlink(index_path);
+  free(payload);
+
+  if (failures) {
+    fprintf(stderr, "-- %d reads failed --\n", failures);
+    return 1;
+  }
+  fprintf(stderr, "-- every read matches the original file --\n");
+  return 0;
+}
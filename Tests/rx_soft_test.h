@@ -0,0 +1,96 @@
+/*
+ *  rx_soft_test.h
+ *  rivenx
+ *
+ *  Surface helpers shared by the software compositor tests.
+ *
+ */
+
+#if !defined(RX_SOFT_TEST_H)
+#define RX_SOFT_TEST_H
+
+#include <stdlib.h>
+
+#include "Rendering/Graphics/RXSoftwareCompositor.h"
+
+// the C library's rand() differs between platforms, and the scenes must not
+static inline uint32_t next_random(uint32_t* state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+static inline uint64_t hash_surface(const rx_soft_surface_t* surface)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (uint32_t y = 0; y < surface->height; y++) {
+    const uint8_t* row = (const uint8_t*)(surface->pixels + (size_t)y * surface->stride);
+    for (uint32_t i = 0; i < surface->width * 4; i++)
+      hash = (hash ^ row[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static inline bool make_surface(rx_soft_surface_t* surface, uint32_t width, uint32_t height)
+{
+  surface->pixels = (uint32_t*)malloc((size_t)width * height * sizeof(uint32_t));
+  surface->width = width;
+  surface->height = height;
+  surface->stride = width;
+  return surface->pixels != NULL;
+}
+
+// gradients with a bit of noise, so that any misplaced, missing or mis-scaled pixel changes the hash
+static inline void paint_surface(rx_soft_surface_t* surface, uint32_t seed)
+{
+  uint32_t state = seed;
+  for (uint32_t y = 0; y < surface->height; y++) {
+    for (uint32_t x = 0; x < surface->width; x++) {
+      uint32_t noise = next_random(&state) & 0x0f;
+      uint32_t b = ((x * 255) / surface->width + noise) & 0xff;
+      uint32_t g = ((y * 255) / surface->height + noise) & 0xff;
+      uint32_t r = ((x ^ y) + seed) & 0xff;
+      surface->pixels[(size_t)y * surface->stride + x] = 0xff000000 | (r << 16) | (g << 8) | b;
+    }
+  }
+}
+
+static inline bool write_tga(const char* path, const rx_soft_surface_t* surface)
+{
+  FILE* fp = fopen(path, "wb");
+  if (!fp)
+    return false;
+
+  // uncompressed true color, 32 bits per pixel with 8 bits of alpha, top-left origin; TGA pixels are BGRA like ours
+  uint8_t header[18] = {0};
+  header[2] = 2;
+  header[12] = surface->width & 0xff;
+  header[13] = (surface->width >> 8) & 0xff;
+  header[14] = surface->height & 0xff;
+  header[15] = (surface->height >> 8) & 0xff;
+  header[16] = 32;
+  header[17] = 0x28;
+  fwrite(header, sizeof(header), 1, fp);
+
+  for (uint32_t y = 0; y < surface->height; y++) {
+    const uint32_t* row = surface->pixels + (size_t)y * surface->stride;
+    for (uint32_t x = 0; x < surface->width; x++) {
+      uint8_t bgra[4] = {row[x] & 0xff, (row[x] >> 8) & 0xff, (row[x] >> 16) & 0xff, row[x] >> 24};
+      fwrite(bgra, 4, 1, fp);
+    }
+  }
+
+  return fclose(fp) == 0;
+}
+
+static inline rx_core_rect_t make_rect(uint16_t left, uint16_t top, uint16_t right, uint16_t bottom)
+{
+  rx_core_rect_t rect = {left, top, right, bottom};
+  return rect;
+}
+
+#endif // RX_SOFT_TEST_H
@@ -0,0 +1,63 @@
+/*
+ *  rx_test.h
+ *  rivenx
+ *
+ *  Helpers shared by the command line tests, which are plain C so that they also build outside of Xcode. Include this header before
+ *  any other, since it asks the C library for the POSIX clock on other platforms.
+ *
+ */
+
+#if !defined(RX_TEST_H)
+#define RX_TEST_H
+
+#if !defined(__APPLE__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+static inline uint64_t rx_test_now_ns(void)
+{
+#if defined(__APPLE__)
+  static mach_timebase_info_data_t timebase = {0, 0};
+  if (timebase.denom == 0)
+    mach_timebase_info(&timebase);
+  return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static inline bool rx_test_has_flag(int argc, char* const argv[], const char* flag)
+{
+  for (int arg = 1; arg < argc; arg++) {
+    if (strcmp(argv[arg], flag) == 0)
+      return true;
+  }
+  return false;
+}
+
+// benchmarks run unless --no-benchmark is given
+static inline bool rx_test_should_benchmark(int argc, char* const argv[]) { return !rx_test_has_flag(argc, argv, "--no-benchmark"); }
+
+// prints the cost of one operation, and of what it replaces when baseline_name is not NULL
+static inline void rx_test_report(const char* name, double ns, const char* baseline_name, double baseline_ns)
+{
+  if (baseline_name)
+    fprintf(stderr, "%-36s %9.1f ns   %-24s %9.1f ns  %5.1fx\n", name, ns, baseline_name, baseline_ns, baseline_ns / ns);
+  else
+    fprintf(stderr, "%-36s %9.1f ns\n", name, ns);
+}
+
+#endif // RX_TEST_H
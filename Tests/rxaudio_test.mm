@@ -28,6 +28,7 @@ const int VERSION = 3;
 #define BASE_TESTS 1
 #define RAMP_TESTS 0
 #define ENABLED_TESTS 0
+#define VIRTUAL_TESTS 0
 
 using namespace RX;
 
@@ -171,7 +172,7 @@ bool AudioFileSource::Enable() noexcept(false) { return true; }
 bool AudioFileSource::Disable() noexcept(false) { return true; }
 }
 
-#if RAMP_TESTS
+#if RAMP_TESTS || VIRTUAL_TESTS
 static const void* AudioFileSourceArrayRetain(CFAllocatorRef allocator, const void* value) { return value; }
 
 static void AudioFileSourceArrayRelease(CFAllocatorRef allocator, const void* value) {}
@@ -537,6 +538,66 @@ int main(int argc, char* const argv[])
   }
 #endif // RAMP_TESTS
 
+#if VIRTUAL_TESTS
+#pragma mark VIRTUAL TESTS
+  printf("\n-->  testing virtual sources and bus stealing\n");
+  try
+  {
+    AudioRenderer renderer;
+    renderer.Initialize();
+
+    // attach twice as many sources as there are mixer busses; the second half should become virtual
+    const int source_count = 32;
+    std::vector<AudioFileSource*> file_sources;
+    CFMutableArrayRef virtual_sources = CFArrayCreateMutable(NULL, 0, &g_weakAudioFileSourceArrayCallbacks);
+    for (int i = 0; i < source_count; i++) {
+      AudioFileSource* source = new AudioFileSource(argv[1 + (i & 1)]);
+      file_sources.push_back(source);
+      CFArrayAppendValue(virtual_sources, source);
+    }
+    printf("attached %u sources\n", renderer.AttachSources(virtual_sources));
+    printf("%u busses available, %u virtual sources\n", renderer.AvailableMixerBusCount(), renderer.VirtualSourceCount());
+
+    renderer.Start();
+    usleep(PLAYBACK_SECONDS * 1000000);
+
+    // a higher priority source should take the bus of one of the others
+    AudioFileSource priority_source(argv[2]);
+    priority_source.SetPriority(1);
+    renderer.AttachSource(priority_source);
+    printf("priority source is virtual: %d, %u virtual sources\n", renderer.IsSourceVirtual(priority_source), renderer.VirtualSourceCount());
+    usleep(PLAYBACK_SECONDS * 1000000);
+
+    // detaching sources with a bus should promote virtual sources to the freed busses
+    printf("detaching the first 8 sources...\n");
+    CFMutableArrayRef detached_sources = CFArrayCreateMutable(NULL, 0, &g_weakAudioFileSourceArrayCallbacks);
+    for (int i = 0; i < 8; i++)
+      CFArrayAppendValue(detached_sources, file_sources[i]);
+    renderer.DetachSources(detached_sources);
+    printf("%u busses available, %u virtual sources\n", renderer.AvailableMixerBusCount(), renderer.VirtualSourceCount());
+    usleep(PLAYBACK_SECONDS * 1000000);
+
+    renderer.Stop();
+    renderer.LogStatistics();
+
+    renderer.DetachSource(priority_source);
+    CFArrayRemoveAllValues(detached_sources);
+    for (int i = 8; i < source_count; i++)
+      CFArrayAppendValue(detached_sources, file_sources[i]);
+    renderer.DetachSources(detached_sources);
+    CFRelease(detached_sources);
+    CFRelease(virtual_sources);
+
+    for (AudioFileSource* source : file_sources)
+      delete source;
+  }
+  catch (CAXException c)
+  {
+    char errorString[256];
+    printf("error %s in %s\n", c.FormatError(errorString), c.mOperation);
+  }
+#endif // VIRTUAL_TESTS
+
 #if ENABLED_TESTS
 #pragma mark ENABLED TESTS
   printf("\n-->  testing source enabling and disabling\n");
@@ -0,0 +1,137 @@
+//
+//  mirrored_ring_buffer.cpp
+//  rivenx
+//
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "Utilities/mirrored_ring_buffer.h"
+
+#include <new>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+namespace rx {
+
+// number of attempts at mapping the mirror before giving up
+static const int kMirrorMapAttempts = 3;
+
+size_t mirrored_mapping::page_size() noexcept
+{
+  static size_t page_size = 0;
+  if (page_size == 0)
+    page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return page_size;
+}
+
+#if defined(__APPLE__)
+
+// reserve both halves in one allocation, then remap the first half over the second; vm_remap with VM_FLAGS_OVERWRITE replaces the
+// upper half atomically, so no other thread can grab the address range in between
+static void* map_mirror(size_t length) noexcept
+{
+  vm_address_t base = 0;
+  if (vm_allocate(mach_task_self(), &base, 2 * length, VM_FLAGS_ANYWHERE) != KERN_SUCCESS)
+    return NULL;
+
+  vm_address_t mirror = base + length;
+  vm_prot_t cur_protection, max_protection;
+  kern_return_t kr = vm_remap(mach_task_self(), &mirror, length, 0, VM_FLAGS_FIXED | VM_FLAGS_OVERWRITE, mach_task_self(), base, FALSE, &cur_protection,
+                              &max_protection, VM_INHERIT_DEFAULT);
+  if (kr != KERN_SUCCESS || mirror != base + length) {
+    vm_deallocate(mach_task_self(), base, 2 * length);
+    return NULL;
+  }
+
+  return reinterpret_cast<void*>(base);
+}
+
+static void unmap_mirror(void* base, size_t length) noexcept { vm_deallocate(mach_task_self(), reinterpret_cast<vm_address_t>(base), 2 * length); }
+
+#else
+
+static int create_backing_file(size_t length) noexcept
+{
+#if defined(__linux__)
+  int fd = memfd_create("rx_mirrored_ring_buffer", MFD_CLOEXEC);
+#else
+  char name[64];
+  snprintf(name, sizeof(name), "/rx_mirrored_ring_buffer.%d.%p", (int)getpid(), (void*)&name);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd != -1)
+    shm_unlink(name);
+#endif
+  if (fd == -1)
+    return -1;
+
+  if (ftruncate(fd, static_cast<off_t>(length)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// reserve both halves with an inaccessible anonymous mapping, then map the backing file twice on top of it with MAP_FIXED; since the
+// reservation is ours, the fixed mappings cannot clobber anything else
+static void* map_mirror(size_t length) noexcept
+{
+  int fd = create_backing_file(length);
+  if (fd == -1)
+    return NULL;
+
+  uint8_t* base = static_cast<uint8_t*>(mmap(NULL, 2 * length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (base == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+
+  void* lower = mmap(base, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+  void* upper = mmap(base + length, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+
+  // the mappings keep the file alive
+  close(fd);
+
+  if (lower != base || upper != base + length) {
+    munmap(base, 2 * length);
+    return NULL;
+  }
+
+  return base;
+}
+
+static void unmap_mirror(void* base, size_t length) noexcept { munmap(base, 2 * length); }
+
+#endif
+
+size_t mirrored_mapping::rounded_length(size_t length) noexcept
+{
+  size_t page = page_size();
+  if (length == 0)
+    length = page;
+  return (length + page - 1) & ~(page - 1);
+}
+
+mirrored_mapping::mirrored_mapping(size_t length) : _base(NULL), _length(0)
+{
+  length = rounded_length(length);
+
+  for (int attempt = 0; attempt < kMirrorMapAttempts && !_base; attempt++)
+    _base = map_mirror(length);
+  if (!_base)
+    throw std::bad_alloc();
+
+  _length = length;
+}
+
+mirrored_mapping::~mirrored_mapping() { unmap_mirror(_base, _length); }
+
+} // namespace rx
@@ -0,0 +1,193 @@
+//
+//  mirrored_ring_buffer.h
+//  rivenx
+//
+
+#pragma once
+
+#if !defined(__cplusplus)
+#error "This file requires C++"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace rx {
+
+// A region of virtual memory whose second half maps the same physical pages as its first half, so that any span of up to length()
+// bytes starting inside the first half is contiguous. The mapping is created with memfd_create on Linux, vm_remap on Darwin and a
+// POSIX shared memory object elsewhere. The length is rounded up to the page size. Throws std::bad_alloc if the mapping fails.
+class mirrored_mapping {
+public:
+  explicit mirrored_mapping(size_t length);
+  ~mirrored_mapping();
+
+  void* base() const noexcept { return _base; }
+  size_t length() const noexcept { return _length; }
+
+  static size_t page_size() noexcept;
+
+  // the length of a mapping created with the given length
+  static size_t rounded_length(size_t length) noexcept;
+
+private:
+  mirrored_mapping(const mirrored_mapping&) = delete;
+  mirrored_mapping& operator=(const mirrored_mapping&) = delete;
+
+  void* _base;
+  size_t _length;
+};
+
+// Single-producer / single-consumer ring buffer on top of a mirrored mapping. Readers and writers always get a contiguous span, no
+// matter where the indices are in the ring. The indices are free-running and published with release stores, so the data written
+// before did_write is visible to the reader after it observes the new write index (and symmetrically for did_read). The element size
+// must be a power of 2 no larger than a page so that the mirror boundary falls on an element boundary.
+template <typename T>
+class mirrored_ring_buffer {
+  static_assert(std::is_trivially_copyable<T>::value, "mirrored_ring_buffer elements must be trivially copyable");
+  static_assert(sizeof(T) <= 4096 && (sizeof(T) & (sizeof(T) - 1)) == 0, "mirrored_ring_buffer element size must be a power of 2");
+
+public:
+  // the capacity is rounded up to fill a whole number of pages
+  explicit mirrored_ring_buffer(size_t min_capacity)
+      : _mapping(min_capacity * sizeof(T)), _data(static_cast<T*>(_mapping.base())), _capacity(_mapping.length() / sizeof(T)), _read(0), _write(0)
+  {
+  }
+
+  size_t capacity() const noexcept { return _capacity; }
+
+  // consumer side; returns the number of elements available and a pointer to the first one
+  size_t read_available(const T** ptr) const noexcept
+  {
+    size_t read = _read.load(std::memory_order_relaxed);
+    size_t available = _write.load(std::memory_order_acquire) - read;
+    *ptr = _data + (read % _capacity);
+    return available;
+  }
+
+  void did_read(size_t count) noexcept { _read.store(_read.load(std::memory_order_relaxed) + count, std::memory_order_release); }
+
+  // producer side; returns the number of free elements and a pointer to the first one
+  size_t write_available(T** ptr) const noexcept
+  {
+    size_t write = _write.load(std::memory_order_relaxed);
+    size_t available = _capacity - (write - _read.load(std::memory_order_acquire));
+    *ptr = _data + (write % _capacity);
+    return available;
+  }
+
+  void did_write(size_t count) noexcept { _write.store(_write.load(std::memory_order_relaxed) + count, std::memory_order_release); }
+
+  // approximate when called concurrently with the producer or the consumer
+  size_t size() const noexcept { return _write.load(std::memory_order_acquire) - _read.load(std::memory_order_acquire); }
+  bool empty() const noexcept { return size() == 0; }
+
+  // not safe to call concurrently with the producer or the consumer
+  void clear() noexcept
+  {
+    _read.store(0, std::memory_order_relaxed);
+    _write.store(0, std::memory_order_release);
+  }
+
+private:
+  enum { kCacheLineSize = 64 };
+
+  mirrored_ring_buffer(const mirrored_ring_buffer&) = delete;
+  mirrored_ring_buffer& operator=(const mirrored_ring_buffer&) = delete;
+
+  mirrored_mapping _mapping;
+  T* const _data;
+  const size_t _capacity;
+
+  // keep the indices on separate cache lines so the producer and consumer do not false share; this uses padding rather than alignas,
+  // since buffers are allocated with plain new, which does not honor over-alignment before C++17
+  char _pad0[kCacheLineSize];
+  std::atomic<size_t> _read;
+  char _pad1[kCacheLineSize - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> _write;
+  char _pad2[kCacheLineSize - sizeof(std::atomic<size_t>)];
+};
+
+// A bounded cache of idle ring buffers. Creating a mirrored mapping costs a few system calls and the first write to every page faults,
+// which is a poor fit for code that creates and deletes ring buffers of the same few sizes over and over; acquire hands out a cleared
+// buffer of the requested capacity from the cache when it has one, and recycle puts a buffer back unless the cache is full. Both are
+// thread safe, but not real-time safe. acquire throws std::bad_alloc if it has to create a buffer and the mapping fails.
+template <typename T>
+class mirrored_ring_buffer_pool {
+public:
+  explicit mirrored_ring_buffer_pool(size_t max_idle_buffers) : _max_idle_buffers(max_idle_buffers), _hit_count(0), _miss_count(0) {}
+
+  ~mirrored_ring_buffer_pool()
+  {
+    for (mirrored_ring_buffer<T>* buffer : _idle_buffers)
+      delete buffer;
+  }
+
+  mirrored_ring_buffer<T>* acquire(size_t min_capacity)
+  {
+    size_t capacity = mirrored_mapping::rounded_length(min_capacity * sizeof(T)) / sizeof(T);
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      for (auto iterator = _idle_buffers.begin(); iterator != _idle_buffers.end(); ++iterator) {
+        if ((*iterator)->capacity() == capacity) {
+          mirrored_ring_buffer<T>* buffer = *iterator;
+          _idle_buffers.erase(iterator);
+          _hit_count++;
+          return buffer;
+        }
+      }
+      _miss_count++;
+    }
+    return new mirrored_ring_buffer<T>(min_capacity);
+  }
+
+  // the buffer must no longer be in use by its producer or consumer; NULL is ignored
+  void recycle(mirrored_ring_buffer<T>* buffer)
+  {
+    if (!buffer)
+      return;
+    buffer->clear();
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_idle_buffers.size() < _max_idle_buffers) {
+        _idle_buffers.push_back(buffer);
+        return;
+      }
+    }
+    delete buffer;
+  }
+
+  size_t idle_count() const
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _idle_buffers.size();
+  }
+
+  // number of acquisitions served from the cache and with a new buffer
+  uint64_t hit_count() const
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _hit_count;
+  }
+  uint64_t miss_count() const
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _miss_count;
+  }
+
+private:
+  mirrored_ring_buffer_pool(const mirrored_ring_buffer_pool&) = delete;
+  mirrored_ring_buffer_pool& operator=(const mirrored_ring_buffer_pool&) = delete;
+
+  const size_t _max_idle_buffers;
+  mutable std::mutex _mutex;
+  std::vector<mirrored_ring_buffer<T>*> _idle_buffers;
+  uint64_t _hit_count;
+  uint64_t _miss_count;
+};
+
+} // namespace rx
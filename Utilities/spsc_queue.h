@@ -0,0 +1,71 @@
+//
+//  spsc_queue.h
+//  rivenx
+//
+
+#pragma once
+
+#if !defined(__cplusplus)
+#error "This file requires C++"
+#endif
+
+#include <stddef.h>
+#include <atomic>
+
+namespace rx {
+
+// Fixed-capacity single-producer / single-consumer queue. Storage is embedded in the object, so push and pop never allocate, lock or
+// block, which makes the queue suitable to hand messages to (or from) a real-time thread. Capacity must be a power of 2.
+template <typename T, size_t Capacity>
+class spsc_queue {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "spsc_queue capacity must be a power of 2");
+
+public:
+  spsc_queue() noexcept : _head(0), _tail(0) {}
+
+  // producer side; returns false if the queue is full
+  bool push(const T& value) noexcept
+  {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) == Capacity)
+      return false;
+    _slots[tail & (Capacity - 1)] = value;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side; returns false if the queue is empty
+  bool pop(T& value) noexcept
+  {
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire))
+      return false;
+    value = _slots[head & (Capacity - 1)];
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // approximate when called concurrently with push or pop
+  size_t size() const noexcept { return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire); }
+  bool empty() const noexcept { return size() == 0; }
+
+  static constexpr size_t capacity() noexcept { return Capacity; }
+
+private:
+  spsc_queue(const spsc_queue&) = delete;
+  spsc_queue& operator=(const spsc_queue&) = delete;
+
+  enum { kCacheLineSize = 64 };
+
+  T _slots[Capacity];
+
+  // keep the indices on separate cache lines so the producer and consumer do not false share; this uses padding rather than alignas,
+  // since queues are embedded in objects allocated with plain new, which does not honor over-alignment before C++17
+  char _pad0[kCacheLineSize];
+  std::atomic<size_t> _head;
+  char _pad1[kCacheLineSize - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> _tail;
+  char _pad2[kCacheLineSize - sizeof(std::atomic<size_t>)];
+};
+
+} // namespace rx
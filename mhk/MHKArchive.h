@@ -14,6 +14,7 @@
 
 #import <MHKKit/mohawk_core.h>
 #import <MHKKit/mohawk_bitmap.h>
+#import <MHKKit/mohawk_data_source.h>
 
 #import <MHKKit/MHKFileHandle.h>
 #import <MHKKit/MHKAudioDecompression.h>
@@ -22,6 +23,7 @@
   NSURL* mhk_url;
 
   FSIORefNum forkRef;
+  mhk_data_source_t* data_source;
   uint32_t archive_size;
 
   BOOL initialized;
@@ -37,7 +39,9 @@
   uint32_t file_table_count;
   MHK_file_table_entry* file_table;
 
-  // processed information
+  // processed information; the descriptors of a resource type are built the first time the type is used, under the type tables lock
+  NSDictionary* type_indexes;
+  pthread_rwlock_t type_tables_rwlock;
   NSMutableDictionary* file_descriptor_arrays;
   NSMutableDictionary* file_descriptor_trees;
   NSMutableDictionary* file_descriptor_name_maps;
@@ -47,12 +51,26 @@
   NSMutableDictionary* __cached_sound_descriptors;
 }
 
-// designated initializer
+// designated initializers
 - (id)initWithURL:(NSURL*)url error:(NSError**)errorPtr;
 
+// reads the archive from a data source instead of a file; the archive takes ownership of the source, even if initialization fails.
+// url is only used to identify the archive
+- (id)initWithURL:(NSURL*)url dataSource:(mhk_data_source_t*)source error:(NSError**)errorPtr;
+
 // convenience initializers
 - (id)initWithPath:(NSString*)path error:(NSError**)errorPtr;
 
+// reads an archive stored in a GOG installer; see mohawk_inno_source.h for the location parameters and the block store. movieWithID:
+// does not work on such archives, which is why Riven X still unpacks the installer
+- (id)initWithURL:(NSURL*)url
+      innoSetupURL:(NSURL*)setupURL
+        dataOffset:(uint64_t)dataOffset
+    compressedSize:(uint64_t)compressedSize
+              size:(uint64_t)size
+     blockStoreURL:(NSURL*)blockStoreURL
+             error:(NSError**)errorPtr;
+
 // accessors
 - (NSURL*)url;
 - (NSArray*)resourceTypes;
@@ -15,6 +15,7 @@
 
 #import "MHKFileHandle.h"
 #import "MHKErrors.h"
+#import "mohawk_inno_source.h"
 #import "Base/RXErrorMacros.h"
 
 struct descriptor_binary_tree {
@@ -55,7 +56,7 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
 }
 
 @interface MHKFileHandle (Private)
-- (id)_initWithArchive:(MHKArchive*)archive fork:(SInt16)fork descriptor:(NSDictionary*)desc;
+- (id)_initWithArchive:(MHKArchive*)archive source:(mhk_data_source_t*)source descriptor:(NSDictionary*)desc;
 @end
 
 @implementation MHKArchive
@@ -147,24 +148,16 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
 
 - (BOOL)load_mhk_type:(uint32_t)type_index
 {
+  // WARNING: MUST BE CALLED WITH THE TYPE TABLES LOCK HELD FOR WRITING
   OSStatus err = noErr;
 
-  // if we've already been initialzed, return
-  if (initialized)
-    return YES;
-
-  // get the type table entry and swap it
+  // get the type table entry (swapped by load_mhk)
   MHK_type_table_entry* type_table_entry = type_table + type_index;
-  MHK_type_table_entry_fton(type_table_entry);
-
-  // seek to the resource table
-  err = FSSetForkPosition(forkRef, fsFromStart, resource_directory_absolute_offset + type_table_entry->rsrc_table_rsrc_dir_offset);
-  if (err)
-    return NO;
 
   // read the resource table header
+  SInt64 offset = resource_directory_absolute_offset + type_table_entry->rsrc_table_rsrc_dir_offset;
   MHK_rsrc_table_header rsrc_table_header;
-  err = FSReadFork(forkRef, fsAtMark, 0, sizeof(MHK_rsrc_table_header), &rsrc_table_header, NULL);
+  err = mhk_data_source_read(data_source, offset, sizeof(MHK_rsrc_table_header), &rsrc_table_header, NULL);
   if (err)
     return NO;
   MHK_rsrc_table_header_fton(&rsrc_table_header);
@@ -187,22 +180,17 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
     return NO;
 
   // read the resource table
-  err = FSReadFork(forkRef, fsAtMark, 0, sizeof(MHK_rsrc_table_entry) * rsrc_table_header.count, rsrc_table, NULL);
-  if (err) {
-    free(rsrc_table);
-    return NO;
-  }
-
-  // seek to the name table
-  err = FSSetForkPosition(forkRef, fsFromStart, resource_directory_absolute_offset + type_table_entry->name_table_rsrc_dir_offset);
+  offset += sizeof(MHK_rsrc_table_header);
+  err = mhk_data_source_read(data_source, offset, sizeof(MHK_rsrc_table_entry) * rsrc_table_header.count, rsrc_table, NULL);
   if (err) {
     free(rsrc_table);
     return NO;
   }
 
   // read the name table header
+  offset = resource_directory_absolute_offset + type_table_entry->name_table_rsrc_dir_offset;
   MHK_name_table_header name_table_header;
-  err = FSReadFork(forkRef, fsAtMark, 0, sizeof(MHK_name_table_header), &name_table_header, NULL);
+  err = mhk_data_source_read(data_source, offset, sizeof(MHK_name_table_header), &name_table_header, NULL);
   if (err) {
     free(rsrc_table);
     return NO;
@@ -220,7 +208,8 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
     }
 
     // read the name table
-    err = FSReadFork(forkRef, fsAtMark, 0, sizeof(MHK_name_table_entry) * name_table_header.count, name_table, NULL);
+    err = mhk_data_source_read(data_source, offset + sizeof(MHK_name_table_header), sizeof(MHK_name_table_entry) * name_table_header.count,
+                               name_table, NULL);
     if (err) {
       free(name_table);
       free(rsrc_table);
@@ -283,14 +272,19 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
     NSNumber* file_id_number = [[NSNumber alloc] initWithUnsignedShort:rsrc_entry->id];
     NSNumber* file_offset_number = [[NSNumber alloc] initWithUnsignedLong:file_entry->absolute_offset];
 
-    NSMutableDictionary* file_descriptor = [[NSMutableDictionary alloc]
-        initWithObjectsAndKeys:file_index_number, @"Index", file_id_number, @"ID", file_offset_number, @"Offset", file_name, @"Name", nil];
+    // the file lengths have been fixed up when the archive was opened, so the length can be stored right away
+    NSNumber* file_length_number = [[NSNumber alloc] initWithUnsignedInt:compute_file_table_entry_length(file_entry)];
+
+    NSMutableDictionary* file_descriptor = [[NSMutableDictionary alloc] initWithObjectsAndKeys:file_index_number, @"Index", file_id_number, @"ID",
+                                                                                              file_offset_number, @"Offset", file_length_number,
+                                                                                              @"Length", file_name, @"Name", nil];
     file_descriptors[resource_index] = file_descriptor;
 
     // release objects
     [file_index_number release];
     [file_id_number release];
     [file_offset_number release];
+    [file_length_number release];
     [file_name release];
 
     // generate a descriptor binary tree entry
@@ -355,14 +349,9 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
   fprintf(stderr, "loading %s\n", [[[self url] path] UTF8String]);
 #endif
 
-  // seek to start
-  err = FSSetForkPosition(forkRef, fsFromStart, 0);
-  if (err)
-    return NO;
-
   // read the MHWK header
   MHK_chunk_header header;
-  err = FSReadFork(forkRef, fsAtMark, 0, sizeof(MHK_chunk_header), &header, NULL);
+  err = mhk_data_source_read(data_source, 0, sizeof(MHK_chunk_header), &header, NULL);
   if (err)
     return NO;
   MHK_chunk_header_fton(&header);
@@ -373,7 +362,7 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
 
   // read the rsrc header
   MHK_RSRC_header rsrc_header;
-  err = FSReadFork(forkRef, fsAtMark, 0, sizeof(MHK_RSRC_header), &rsrc_header, NULL);
+  err = mhk_data_source_read(data_source, sizeof(MHK_chunk_header), sizeof(MHK_RSRC_header), &rsrc_header, NULL);
   if (err)
     return NO;
   MHK_RSRC_header_fton(&rsrc_header);
@@ -385,14 +374,9 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
   // cache the information we'll really need
   resource_directory_absolute_offset = rsrc_header.rsrc_dir_absolute_offset;
 
-  // seek to the type table, which is always at the beginning of the resource directory
-  err = FSSetForkPosition(forkRef, fsFromStart, resource_directory_absolute_offset);
-  if (err)
-    return NO;
-
-  // read the type table header
+  // read the type table header; the type table is always at the beginning of the resource directory
   MHK_type_table_header type_table_header;
-  err = FSReadFork(forkRef, fsAtMark, 0, sizeof(MHK_type_table_header), &type_table_header, NULL);
+  err = mhk_data_source_read(data_source, resource_directory_absolute_offset, sizeof(MHK_type_table_header), &type_table_header, NULL);
   if (err)
     return NO;
   MHK_type_table_header_fton(&type_table_header);
@@ -404,10 +388,22 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
     return NO;
 
   // read the type table
-  err = FSReadFork(forkRef, fsAtMark, 0, sizeof(MHK_type_table_entry) * type_table_count, type_table, NULL);
+  err = mhk_data_source_read(data_source, resource_directory_absolute_offset + sizeof(MHK_type_table_header),
+                             sizeof(MHK_type_table_entry) * type_table_count, type_table, NULL);
   if (err)
     return NO;
 
+  // swap the type table entries and index them by type name
+  NSMutableDictionary* indexes = [[NSMutableDictionary alloc] initWithCapacity:type_table_count];
+  for (table_iterator = 0; table_iterator < type_table_count; table_iterator++) {
+    MHK_type_table_entry_fton(type_table + table_iterator);
+
+    NSString* type_key = [[NSString alloc] initWithBytes:type_table[table_iterator].name length:4 encoding:NSASCIIStringEncoding];
+    [indexes setObject:[NSNumber numberWithUnsignedInt:table_iterator] forKey:type_key];
+    [type_key release];
+  }
+  type_indexes = indexes;
+
   // check if we have a resource name list
   if (type_table_header.rsrc_name_list_rsrc_dir_offset < rsrc_header.file_table_rsrc_dir_offset) {
     uint32_t name_list_length = rsrc_header.file_table_rsrc_dir_offset - type_table_header.rsrc_name_list_rsrc_dir_offset;
@@ -416,26 +412,18 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
     if (!name_list)
       return NO;
 
-    // seek to the resource name list
-    err = FSSetForkPosition(forkRef, fsFromStart, resource_directory_absolute_offset + type_table_header.rsrc_name_list_rsrc_dir_offset);
-    if (err)
-      return NO;
-
     // read the resource name list
-    err = FSReadFork(forkRef, fsAtMark, 0, name_list_length, name_list, NULL);
+    err = mhk_data_source_read(data_source, resource_directory_absolute_offset + type_table_header.rsrc_name_list_rsrc_dir_offset,
+                               name_list_length, name_list, NULL);
     if (err)
       return NO;
   } else
     name_list = NULL;
 
-  // seek to the file table
-  err = FSSetForkPosition(forkRef, fsFromStart, resource_directory_absolute_offset + rsrc_header.file_table_rsrc_dir_offset);
-  if (err)
-    return NO;
-
   // read the file table header
+  SInt64 file_table_offset = resource_directory_absolute_offset + rsrc_header.file_table_rsrc_dir_offset;
   MHK_file_table_header file_table_header;
-  err = FSReadFork(forkRef, fsAtMark, 0, sizeof(MHK_file_table_header), &file_table_header, NULL);
+  err = mhk_data_source_read(data_source, file_table_offset, sizeof(MHK_file_table_header), &file_table_header, NULL);
   if (err)
     return NO;
   MHK_file_table_header_fton(&file_table_header);
@@ -451,7 +439,8 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
     return NO;
 
   // read the file table
-  err = FSReadFork(forkRef, fsAtMark, 0, sizeof(MHK_file_table_entry) * file_table_count, file_table, NULL);
+  err = mhk_data_source_read(data_source, file_table_offset + sizeof(MHK_file_table_header), sizeof(MHK_file_table_entry) * file_table_count,
+                             file_table, NULL);
   if (err)
     return NO;
 
@@ -474,22 +463,51 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
   if (!file_descriptor_name_maps)
     return NO;
 
-  // process each type in the archive
-  for (table_iterator = 0; table_iterator < type_table_count; table_iterator++) {
-    if (![self load_mhk_type:table_iterator])
-      return NO;
-  }
-
   // compute the file lengths since MHK have bogus values
   [self compute_file_lengths];
 
-  // we don't need the global tables anymore
-  free(name_list);
-  name_list = NULL;
+  // the resource types are processed when they are first used (see _tablesForType:), which is why the type table and the name list are
+  // kept around; stacks only ever use a handful of the types in their archives, and a type can hold thousands of resources
+  return YES;
+}
 
-  free(type_table);
-  type_table = NULL;
+- (BOOL)_tablesForType:(NSString*)type descriptors:(NSArray**)descriptors tree:(NSData**)tree nameMap:(NSDictionary**)name_map
+{
+  // the tables are never removed once built, so they can be used after the lock is released
+  pthread_rwlock_rdlock(&type_tables_rwlock);
+  NSArray* type_descriptors = [file_descriptor_arrays objectForKey:type];
+  if (type_descriptors) {
+    if (tree)
+      *tree = [file_descriptor_trees objectForKey:type];
+    if (name_map)
+      *name_map = [file_descriptor_name_maps objectForKey:type];
+  }
+  pthread_rwlock_unlock(&type_tables_rwlock);
+
+  if (!type_descriptors) {
+    NSNumber* type_index = [type_indexes objectForKey:type];
+    if (!type_index)
+      return NO;
 
+    // another thread may have built the tables while this one was waiting for the lock
+    pthread_rwlock_wrlock(&type_tables_rwlock);
+    type_descriptors = [file_descriptor_arrays objectForKey:type];
+    if (!type_descriptors && [self load_mhk_type:[type_index unsignedIntValue]])
+      type_descriptors = [file_descriptor_arrays objectForKey:type];
+    if (type_descriptors) {
+      if (tree)
+        *tree = [file_descriptor_trees objectForKey:type];
+      if (name_map)
+        *name_map = [file_descriptor_name_maps objectForKey:type];
+    }
+    pthread_rwlock_unlock(&type_tables_rwlock);
+
+    if (!type_descriptors)
+      return NO;
+  }
+
+  if (descriptors)
+    *descriptors = type_descriptors;
   return YES;
 }
 
@@ -511,17 +529,35 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
   return archive;
 }
 
-- (id)initWithURL:(NSURL*)url error:(NSError**)errorPtr
+- (id)initWithURL:(NSURL*)url
+      innoSetupURL:(NSURL*)setupURL
+        dataOffset:(uint64_t)dataOffset
+    compressedSize:(uint64_t)compressedSize
+              size:(uint64_t)size
+     blockStoreURL:(NSURL*)blockStoreURL
+             error:(NSError**)errorPtr
+{
+  OSStatus err = noErr;
+  mhk_data_source_t* source = mhk_inno_data_source_create([[setupURL path] fileSystemRepresentation], dataOffset, compressedSize, size,
+                                                          [[blockStoreURL path] fileSystemRepresentation], &err);
+  if (!source) {
+    [self release];
+    ReturnValueWithError(nil, NSOSStatusErrorDomain, err, nil, errorPtr);
+  }
+
+  return [self initWithURL:url dataSource:source error:errorPtr];
+}
+
+- (id)_initWithURL:(NSURL*)url
 {
   self = [super init];
   if (!self)
     return nil;
 
-  OSStatus err = noErr;
-
   // secure clean up
   file_descriptor_arrays = nil;
   file_descriptor_trees = nil;
+  pthread_rwlock_init(&type_tables_rwlock, NULL);
 
   // when this is YES, the load methods will just exit
   initialized = NO;
@@ -529,6 +565,52 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
   // cache the file url
   mhk_url = [url copy];
 
+  return self;
+}
+
+- (id)_loadWithError:(NSError**)errorPtr
+{
+  // we only support 32 bits for archive sizes
+  if (data_source->size > UINT_MAX) {
+    [self release];
+    ReturnValueWithError(nil, MHKErrorDomain, errFileTooLarge, nil, errorPtr);
+  }
+  archive_size = (uint32_t)data_source->size;
+
+  // process the archive
+  if (![self load_mhk]) {
+    [self release];
+    ReturnValueWithError(nil, MHKErrorDomain, errBadArchive, nil, errorPtr);
+  }
+
+  // allocate the sound descriptor cache and its rw lock
+  pthread_rwlock_init(&__cached_sound_descriptors_rwlock, NULL);
+  __cached_sound_descriptors = [[NSMutableDictionary alloc] init];
+
+  initialized = YES;
+  return self;
+}
+
+- (id)initWithURL:(NSURL*)url dataSource:(mhk_data_source_t*)source error:(NSError**)errorPtr
+{
+  self = [self _initWithURL:url];
+  if (!self) {
+    mhk_data_source_close(source);
+    return nil;
+  }
+
+  data_source = source;
+  return [self _loadWithError:errorPtr];
+}
+
+- (id)initWithURL:(NSURL*)url error:(NSError**)errorPtr
+{
+  self = [self _initWithURL:url];
+  if (!self)
+    return nil;
+
+  OSStatus err = noErr;
+
   // get the data fork name
   HFSUniStr255 dataForkName;
   err = FSGetDataForkName(&dataForkName);
@@ -560,25 +642,14 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
     ReturnValueWithError(nil, NSOSStatusErrorDomain, err, nil, errorPtr);
   }
 
-  // we only support 32 bits for archive sizes
-  if (fork_size > UINT_MAX) {
-    [self release];
-    ReturnValueWithError(nil, MHKErrorDomain, errFileTooLarge, nil, errorPtr);
-  }
-  archive_size = (uint32_t)fork_size;
-
-  // process the archive
-  if (![self load_mhk]) {
+  // read the fork through a data source, like any other archive
+  data_source = mhk_fork_data_source_create(forkRef, fork_size);
+  if (!data_source) {
     [self release];
-    ReturnValueWithError(nil, MHKErrorDomain, errBadArchive, nil, errorPtr);
+    ReturnValueWithError(nil, NSOSStatusErrorDomain, memFullErr, nil, errorPtr);
   }
 
-  // allocate the sound descriptor cache and its rw lock
-  pthread_rwlock_init(&__cached_sound_descriptors_rwlock, NULL);
-  __cached_sound_descriptors = [[NSMutableDictionary alloc] initWithCapacity:[[file_descriptor_arrays objectForKey:@"tWAV"] count]];
-
-  initialized = YES;
-  return self;
+  return [self _loadWithError:errorPtr];
 }
 
 - (void)dealloc
@@ -590,6 +661,8 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
   [file_descriptor_trees release];
   [file_descriptor_arrays release];
   [file_descriptor_name_maps release];
+  [type_indexes release];
+  pthread_rwlock_destroy(&type_tables_rwlock);
 
   if (file_table)
     free(file_table);
@@ -600,7 +673,8 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
 
   [mhk_url release];
 
-  // close the file
+  // close the data source, then the file it may be reading from
+  mhk_data_source_close(data_source);
   if (forkRef)
     FSCloseFork(forkRef);
 
@@ -613,33 +687,27 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
 
 - (NSDictionary*)resourceDescriptorWithResourceType:(NSString*)type ID:(uint16_t)resourceID
 {
-  NSMutableData* binary_tree_data = [file_descriptor_trees objectForKey:type];
-  if (!binary_tree_data)
+  NSArray* descriptors;
+  NSData* binary_tree_data;
+  if (![self _tablesForType:type descriptors:&descriptors tree:&binary_tree_data nameMap:NULL])
     return nil;
 
-  uint16_t n = (uint16_t)[[file_descriptor_arrays objectForKey:type] count];
-  struct descriptor_binary_tree* binary_tree = [binary_tree_data mutableBytes];
-
+  // types without resources have no tree data
+  uint16_t n = (uint16_t)[descriptors count];
   if (n == 0)
     return nil;
 
+  const struct descriptor_binary_tree* binary_tree = [binary_tree_data bytes];
+
   uint16_t l = 0;
   uint16_t r = n - 1;
 
   // binary search for the requested ID
   while (l <= r) {
     uint16_t m = l + (r - l) / 2;
-    if (resourceID == binary_tree[m].resource_id) {
-      NSMutableDictionary* descriptor = binary_tree[m].descriptor;
-
-      if (![descriptor objectForKey:@"Length"]) {
-        MHK_file_table_entry* file_entry = file_table + [[descriptor objectForKey:@"Index"] unsignedIntValue] - 1;
-        uint32_t file_size = compute_file_table_entry_length(file_entry);
-        [descriptor setObject:[NSNumber numberWithUnsignedInt:file_size] forKey:@"Length"];
-      }
-
-      return [[descriptor copy] autorelease];
-    } else if (resourceID < binary_tree[m].resource_id) {
+    if (resourceID == binary_tree[m].resource_id)
+      return [[binary_tree[m].descriptor copy] autorelease];
+    else if (resourceID < binary_tree[m].resource_id) {
       if (m == 0)
         return nil;
       else
@@ -657,7 +725,7 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
   if (!descriptor)
     return nil;
 
-  return [[[MHKFileHandle alloc] _initWithArchive:self fork:forkRef descriptor:descriptor] autorelease];
+  return [[[MHKFileHandle alloc] _initWithArchive:self source:data_source descriptor:descriptor] autorelease];
 }
 
 - (NSData*)dataWithResourceType:(NSString*)type ID:(uint16_t)resourceID
@@ -666,7 +734,7 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
   if (!descriptor)
     return nil;
 
-  MHKFileHandle* fh = [[MHKFileHandle alloc] _initWithArchive:self fork:forkRef descriptor:descriptor];
+  MHKFileHandle* fh = [[MHKFileHandle alloc] _initWithArchive:self source:data_source descriptor:descriptor];
   if (!fh)
     return nil;
 
@@ -689,7 +757,12 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
 }
 
 - (NSDictionary*)resourceDescriptorWithResourceType:(NSString*)type name:(NSString*)name
-{ return [[file_descriptor_name_maps objectForKey:type] objectForKey:[name lowercaseString]]; }
+{
+  NSDictionary* name_map;
+  if (![self _tablesForType:type descriptors:NULL tree:NULL nameMap:&name_map])
+    return nil;
+  return [name_map objectForKey:[name lowercaseString]];
+}
 
 - (MHKFileHandle*)openResourceWithResourceType:(NSString*)type name:(NSString*)name
 {
@@ -697,7 +770,7 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
   if (!descriptor)
     return nil;
 
-  return [[[MHKFileHandle alloc] _initWithArchive:self fork:forkRef descriptor:descriptor] autorelease];
+  return [[[MHKFileHandle alloc] _initWithArchive:self source:data_source descriptor:descriptor] autorelease];
 }
 
 - (NSData*)dataWithResourceType:(NSString*)type name:(NSString*)name
@@ -723,8 +796,14 @@ MHK_INLINE uint32_t compute_file_table_entry_length(MHK_file_table_entry* s)
 
 - (NSURL*)url { return mhk_url; }
 
-- (NSArray*)resourceTypes { return [file_descriptor_arrays allKeys]; }
+- (NSArray*)resourceTypes { return [type_indexes allKeys]; }
 
-- (id)valueForUndefinedKey:(NSString*)key { return [file_descriptor_arrays objectForKey:key]; }
+- (id)valueForUndefinedKey:(NSString*)key
+{
+  NSArray* descriptors;
+  if (![self _tablesForType:key descriptors:&descriptors tree:NULL nameMap:NULL])
+    return nil;
+  return descriptors;
+}
 
 @end
@@ -29,7 +29,7 @@
   // read the bitmap header
   MHK_BITMAP_header bitmap_header;
   ByteCount bytes_read = 0;
-  OSStatus err = FSReadFork(forkRef, fsFromStart, resource_offset, sizeof(MHK_BITMAP_header), &bitmap_header, &bytes_read);
+  OSStatus err = mhk_data_source_read(data_source, resource_offset, sizeof(MHK_BITMAP_header), &bitmap_header, &bytes_read);
   if (err)
     ReturnValueWithError(nil, NSOSStatusErrorDomain, err, nil, errorPtr);
   MHK_BITMAP_header_fton(&bitmap_header);
@@ -55,13 +55,13 @@
   // read the bitmap header
   MHK_BITMAP_header bitmap_header;
   ByteCount bytes_read = 0;
-  OSStatus err = FSReadFork(forkRef, fsFromStart, resource_offset, sizeof(MHK_BITMAP_header), &bitmap_header, &bytes_read);
+  OSStatus err = mhk_data_source_read(data_source, resource_offset, sizeof(MHK_BITMAP_header), &bitmap_header, &bytes_read);
   if (err)
     ReturnValueWithError(NO, NSOSStatusErrorDomain, err, nil, errorPtr);
   MHK_BITMAP_header_fton(&bitmap_header);
 
   if (bitmap_header.truecolor_flag == 4) {
-    err = read_raw_bgr_pixels(forkRef, resource_offset + bytes_read, &bitmap_header, pixels, format);
+    err = read_raw_bgr_pixels(data_source, resource_offset + bytes_read, &bitmap_header, pixels, format);
     if (err)
       ReturnValueWithError(NO, NSOSStatusErrorDomain, err, nil, errorPtr);
     return YES;
@@ -72,9 +72,9 @@
 
   // process the pixels
   if (bitmap_header.compression_flag == MHK_BITMAP_PLAIN)
-    err = read_raw_indexed_pixels(forkRef, resource_offset, &bitmap_header, pixels, format);
+    err = read_raw_indexed_pixels(data_source, resource_offset, &bitmap_header, pixels, format);
   else if (bitmap_header.compression_flag == MHK_BITMAP_COMPRESSED)
-    err = read_compressed_indexed_pixels(forkRef, resource_offset, &bitmap_header, pixels, format);
+    err = read_compressed_indexed_pixels(data_source, resource_offset, &bitmap_header, pixels, format);
   else
     ReturnValueWithError(NO, MHKErrorDomain, errInvalidBitmapCompression, nil, errorPtr);
   if (err)
@@ -21,6 +21,10 @@
   if (!descriptor)
     ReturnValueWithError(NULL, MHKErrorDomain, errResourceNotFound, nil, errorPtr);
 
+  // QuickTime can only read movies out of a file; archives read from another data source must use MHKMovieDecoder
+  if (!forkRef)
+    ReturnValueWithError(NULL, MHKErrorDomain, errInvalidMovie, nil, errorPtr);
+
   // store the movie offset in a variable
   SInt64 qt_offset = [[descriptor objectForKey:@"Offset"] longLongValue];
 
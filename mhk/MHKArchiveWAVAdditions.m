@@ -15,7 +15,7 @@
 #import "Base/RXErrorMacros.h"
 
 @interface MHKFileHandle (Private)
-- (id)_initWithArchive:(MHKArchive*)archive fork:(SInt16)fork soundDescriptor:(NSDictionary*)sdesc;
+- (id)_initWithArchive:(MHKArchive*)archive source:(mhk_data_source_t*)source soundDescriptor:(NSDictionary*)sdesc;
 @end
 
 @implementation MHKArchive (MHKArchiveWAVAdditions)
@@ -53,7 +53,7 @@
   MHK_chunk_header chunk_header;
 
   // we need to have a standard MHWK chunk first
-  err = FSReadFork(forkRef, fsFromStart, file_offset, sizeof(MHK_chunk_header), &chunk_header, &bytes_read);
+  err = mhk_data_source_read(data_source, file_offset, sizeof(MHK_chunk_header), &chunk_header, &bytes_read);
   if (err)
     ReturnValueWithError(nil, NSOSStatusErrorDomain, err, nil, error);
   file_offset += bytes_read;
@@ -81,7 +81,7 @@
 
   // must have the WAVE signature next
   uint32_t wave_signature;
-  err = FSReadFork(forkRef, fsFromStart, file_offset, sizeof(uint32_t), &wave_signature, &bytes_read);
+  err = mhk_data_source_read(data_source, file_offset, sizeof(uint32_t), &wave_signature, &bytes_read);
   if (err)
     ReturnValueWithError(nil, NSOSStatusErrorDomain, err, nil, error);
   file_offset += bytes_read;
@@ -94,7 +94,7 @@
   // loop until we find the Data chunk of we exceed the limits of this resource
   do {
     // read a chunk header structure
-    err = FSReadFork(forkRef, fsFromStart, file_offset, sizeof(MHK_chunk_header), &chunk_header, &bytes_read);
+    err = mhk_data_source_read(data_source, file_offset, sizeof(MHK_chunk_header), &chunk_header, &bytes_read);
     if (err)
       ReturnValueWithError(nil, NSOSStatusErrorDomain, err, nil, error);
     file_offset += bytes_read;
@@ -114,7 +114,7 @@
 
   // read the Data chunk content header
   MHK_WAVE_Data_chunk_header data_header;
-  err = FSReadFork(forkRef, fsFromStart, file_offset, sizeof(MHK_WAVE_Data_chunk_header), &data_header, &bytes_read);
+  err = mhk_data_source_read(data_source, file_offset, sizeof(MHK_WAVE_Data_chunk_header), &data_header, &bytes_read);
   if (err)
     ReturnValueWithError(nil, NSOSStatusErrorDomain, err, nil, error);
   file_offset += bytes_read;
@@ -142,7 +142,7 @@
     // let's verify if it's a proper MP2 file by checking the first packet
     uint32_t mpeg_header = 0;
     for (unsigned char packet_index = 0; packet_index < 3; packet_index++) {
-      err = FSReadFork(forkRef, fsFromStart, file_offset, sizeof(uint32_t), &mpeg_header, NULL);
+      err = mhk_data_source_read(data_source, file_offset, sizeof(uint32_t), &mpeg_header, NULL);
       if (err)
         ReturnValueWithError(nil, NSOSStatusErrorDomain, err, nil, error);
 
@@ -202,7 +202,7 @@
   if (!soundDescriptor)
     return nil;
 
-  return [[[MHKFileHandle alloc] _initWithArchive:self fork:forkRef soundDescriptor:soundDescriptor] autorelease];
+  return [[[MHKFileHandle alloc] _initWithArchive:self source:data_source soundDescriptor:soundDescriptor] autorelease];
 }
 
 - (id<MHKAudioDecompression>)decompressorWithSoundID:(uint16_t)soundID error:(NSError**)error
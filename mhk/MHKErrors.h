@@ -25,7 +25,8 @@ enum {
   errLibavNotAvailable,
   errInvalidSoundDescriptor,
   errInvalidBitmapCompression,
-  errInvalidBitmapCompressorInstruction
+  errInvalidBitmapCompressorInstruction,
+  errInvalidMovie
 };
 
 #if defined(__OBJC__)
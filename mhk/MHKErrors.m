@@ -42,6 +42,8 @@ NSString* const MHKErrorDomain = @"MHKErrorDomain";
       return @"Invalid bitmap compression.";
     case errInvalidBitmapCompressorInstruction:
       return @"Invalid bitmap compression instruction.";
+    case errInvalidMovie:
+      return @"Invalid or unsupported movie.";
 
     default:
       return [NSString stringWithFormat:@"Unknown error code (%u).", code];
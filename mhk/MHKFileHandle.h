@@ -8,10 +8,12 @@
 
 #import "Base/RXBase.h"
 
+#import <MHKKit/mohawk_data_source.h>
+
 @class MHKArchive;
 
 @interface MHKFileHandle : NSObject {
-  int16_t __forkRef;
+  mhk_data_source_t* __source;
   MHKArchive* __owner;
 
   off_t __offset;
@@ -20,14 +20,14 @@
   return nil;
 }
 
-- (id)_initWithArchive:(MHKArchive*)archive fork:(SInt16)forkRef descriptor:(NSDictionary*)desc
+- (id)_initWithArchive:(MHKArchive*)archive source:(mhk_data_source_t*)source descriptor:(NSDictionary*)desc
 {
   self = [super init];
   if (!self)
     return nil;
 
   __owner = [archive retain];
-  __forkRef = forkRef;
+  __source = source;
 
   __offset = [[desc objectForKey:@"Offset"] longLongValue];
   __position = 0;
@@ -36,14 +36,14 @@
   return self;
 }
 
-- (id)_initWithArchive:(MHKArchive*)archive fork:(SInt16)forkRef soundDescriptor:(NSDictionary*)sdesc
+- (id)_initWithArchive:(MHKArchive*)archive source:(mhk_data_source_t*)source soundDescriptor:(NSDictionary*)sdesc
 {
   self = [super init];
   if (!self)
     return nil;
 
   __owner = [archive retain];
-  __forkRef = forkRef;
+  __source = source;
 
   __offset = [[sdesc objectForKey:@"Samples Absolute Offset"] longLongValue];
   __position = 0;
@@ -85,9 +85,9 @@
   if (__length - __position < length)
     length = __length - __position;
 
-  // read the data from the file
+  // read the data from the archive; resources are mostly read once, so ask the source not to cache them
   ByteCount bytes_read = 0;
-  OSStatus err = FSReadFork(__forkRef, fsFromStart | forceReadMask, __offset + __position, length, buffer, &bytes_read);
+  OSStatus err = __source->read(__source, __offset + __position, length, buffer, &bytes_read, MHK_DATA_SOURCE_NO_CACHE);
   if (err && err != eofErr)
     ReturnValueWithError(-1, NSOSStatusErrorDomain, err, nil, error);
 
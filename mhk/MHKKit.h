@@ -12,9 +12,12 @@
 #import <MHKKit/mohawk_core.h>
 #import <MHKKit/mohawk_bitmap.h>
 #import <MHKKit/mohawk_wave.h>
+#import <MHKKit/mohawk_data_source.h>
+#import <MHKKit/mohawk_inno_source.h>
 
 #import <MHKKit/MHKArchive.h>
 #import <MHKKit/MHKErrors.h>
 #import <MHKKit/MHKFileHandle.h>
 
 #import <MHKKit/MHKAudioDecompression.h>
+#import <MHKKit/MHKMovieDecoder.h>
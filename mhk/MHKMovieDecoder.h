@@ -0,0 +1,102 @@
+//
+//  MHKMovieDecoder.h
+//  MHKKit
+//
+
+#import "Base/RXBase.h"
+
+#import <pthread.h>
+
+@class MHKArchive;
+@class MHKFileHandle;
+
+struct AVFormatContext;
+struct AVIOContext;
+struct AVCodecContext;
+struct AVFrame;
+
+// A decoded video frame. Pixels are 32-bit BGRA with opaque alpha, top row first. Times are in the movie's video time scale.
+struct mhk_movie_frame {
+  int64_t pts;
+  int64_t duration;
+  uint64_t decode_ns; // time the decoder thread spent reading, decoding and converting the frame, in nanoseconds
+  uint32_t width;
+  uint32_t height;
+  uint32_t bytes_per_row;
+  void* pixels;
+};
+typedef struct mhk_movie_frame mhk_movie_frame_t;
+
+// Decodes the video track of a tMOV resource with libav, without QuickTime. The decoder runs on its own thread and keeps a queue of up
+// to lookahead decoded frames ahead of the consumer, which dequeues frames in presentation order and hands each one back once it is done
+// with its pixels. Seeks are precise: after a seek, the first dequeued frame is the one displayed at the target time, even if the
+// decoder had to start from an earlier key frame. A selection limits decoding to a range of the movie, like a QuickTime playback
+// selection, and the decoder wraps around to the start of the selection (or the movie) when looping.
+@interface MHKMovieDecoder : NSObject {
+  MHKFileHandle* _data_source;
+  off_t _resource_offset;
+
+  struct AVIOContext* _io_context;
+  struct AVFormatContext* _format_context;
+  struct AVCodecContext* _codec_context;
+  struct AVFrame* _av_frame;
+  int _stream_index;
+
+  int32_t _time_scale;
+  int64_t _duration;
+  uint32_t _width;
+  uint32_t _height;
+
+  // the frame queue, a ring of lookahead frames with preallocated pixel buffers
+  pthread_mutex_t _queue_lock;
+  pthread_cond_t _queue_cond;
+  mhk_movie_frame_t* _frames;
+  uint32_t _frame_capacity;
+  uint32_t _frame_head;
+  uint32_t _frame_count;
+  BOOL _head_dequeued;
+
+  // decoder thread requests and state, protected by the queue lock
+  pthread_t _decoder_thread;
+  uint32_t _generation;
+  int64_t _seek_target;
+  BOOL _seek_pending;
+  int64_t _selection_start;
+  int64_t _selection_end;
+  BOOL _looping;
+  BOOL _at_end;
+  BOOL _terminate;
+
+  NSError* _error;
+}
+
+// lookahead is the number of decoded frames the decoder can hold ahead of the consumer
+- (id)initWithArchive:(MHKArchive*)archive movieID:(uint16_t)movieID lookahead:(uint32_t)lookahead error:(NSError**)errorPtr;
+
+- (int32_t)timeScale;
+- (int64_t)duration;
+- (uint32_t)width;
+- (uint32_t)height;
+
+- (BOOL)looping;
+- (void)setLooping:(BOOL)flag;
+
+// restricts decoding to [start, start + duration) in the given time scale and seeks to the start of the selection
+- (void)setSelectionStart:(int64_t)start duration:(int64_t)duration timeScale:(int32_t)time_scale;
+- (void)clearSelection;
+
+// discards queued frames and makes the frame displayed at the given time, in the given time scale, the next dequeued frame
+- (void)seekToTime:(int64_t)time timeScale:(int32_t)time_scale;
+
+// returns the next frame, or NULL if there is none; if wait is YES, blocks until a frame is decoded or the decoder reaches the end of the
+// movie or selection; the frame stays valid until it is handed back with relinquishFrame:, which must happen before the next dequeue
+- (const mhk_movie_frame_t*)dequeueFrame:(BOOL)wait;
+- (void)relinquishFrame:(const mhk_movie_frame_t*)frame;
+
+// YES once every frame of the movie or selection has been dequeued and the decoder is not looping
+- (BOOL)isAtEnd;
+
+// the error that stopped the decoder, if any
+- (NSError*)error;
+
+@end
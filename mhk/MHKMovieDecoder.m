@@ -0,0 +1,567 @@
+//
+//  MHKMovieDecoder.m
+//  MHKKit
+//
+
+#import "MHKMovieDecoder.h"
+
+#import "Base/RXErrorMacros.h"
+#import "Base/RXTiming.h"
+
+#import "MHKArchive.h"
+#import "MHKErrors.h"
+#import "MHKFileHandle.h"
+#import "mohawk_libav.h"
+
+static const int IO_BUFFER_SIZE = 0x8000;
+
+@interface MHKMovieDecoder ()
+- (void)_decoderThreadMain;
+@end
+
+static void* MHKMovieDecoder_thread_main(void* context)
+{
+  pthread_setname_np("org.macstorm.rivenx.movie-decoder");
+  [(MHKMovieDecoder*)context _decoderThreadMain];
+  return NULL;
+}
+
+static int MHKMovieDecoder_read_packet(void* opaque, uint8_t* buffer, int size)
+{
+  MHKFileHandle* fh = (MHKFileHandle*)opaque;
+  if ([fh offsetInFile] >= [fh length])
+    return 0;
+  ssize_t bytes_read = [fh readDataOfLength:size inBuffer:buffer error:NULL];
+  return (bytes_read < 0) ? AVERROR(EIO) : (int)bytes_read;
+}
+
+static int64_t MHKMovieDecoder_seek(void* opaque, int64_t offset, int whence)
+{
+  MHKFileHandle* fh = (MHKFileHandle*)opaque;
+  if (whence & AVSEEK_SIZE)
+    return [fh length];
+
+  switch (whence & ~AVSEEK_FORCE) {
+  case SEEK_SET:
+    break;
+  case SEEK_CUR:
+    offset += [fh offsetInFile];
+    break;
+  case SEEK_END:
+    offset += [fh length];
+    break;
+  default:
+    return AVERROR(EINVAL);
+  }
+
+  if (offset < 0)
+    return AVERROR(EINVAL);
+  return [fh seekToFileOffset:offset];
+}
+
+static inline int64_t MHKMovieDecoder_rescale(int64_t time, int32_t from_scale, int32_t to_scale)
+{
+  if (from_scale == to_scale || time == INT64_MAX)
+    return time;
+  return (time * to_scale) / from_scale;
+}
+
+static inline uint8_t MHKMovieDecoder_clamp(int value) { return (value < 0) ? 0 : ((value > 255) ? 255 : (uint8_t)value); }
+
+// Cinepak stores its chroma in its own color space rather than BT.601, and libav hands it out unconverted as YUV 4:2:0, so this applies
+// the Cinepak transform: R = Y + 2V, G = Y - U/2 - V, B = Y + 2U, with U and V biased by 128
+static void MHKMovieDecoder_convert_cinepak_yuv420p(const struct AVFrame* frame, mhk_movie_frame_t* output)
+{
+  for (uint32_t y = 0; y < output->height; y++) {
+    const uint8_t* luma = frame->data[0] + y * frame->linesize[0];
+    const uint8_t* cb = frame->data[1] + (y >> 1) * frame->linesize[1];
+    const uint8_t* cr = frame->data[2] + (y >> 1) * frame->linesize[2];
+    uint8_t* pixels = BUFFER_OFFSET((uint8_t*)output->pixels, y * output->bytes_per_row);
+
+    for (uint32_t x = 0; x < output->width; x++) {
+      int l = luma[x];
+      int u = cb[x >> 1] - 128;
+      int v = cr[x >> 1] - 128;
+      pixels[0] = MHKMovieDecoder_clamp(l + 2 * u);
+      pixels[1] = MHKMovieDecoder_clamp(l - (u >> 1) - v);
+      pixels[2] = MHKMovieDecoder_clamp(l + 2 * v);
+      pixels[3] = 0xff;
+      pixels += 4;
+    }
+  }
+}
+
+static void MHKMovieDecoder_convert_pal8(const struct AVFrame* frame, mhk_movie_frame_t* output)
+{
+  // the palette is native endian 0xAARRGGBB, which is BGRA in memory on little endian hosts
+  const uint32_t* palette = (const uint32_t*)frame->data[1];
+  for (uint32_t y = 0; y < output->height; y++) {
+    const uint8_t* indices = frame->data[0] + y * frame->linesize[0];
+    uint32_t* pixels = BUFFER_OFFSET((uint32_t*)output->pixels, y * output->bytes_per_row);
+    for (uint32_t x = 0; x < output->width; x++)
+      pixels[x] = OSSwapHostToLittleInt32(palette[indices[x]] | 0xff000000);
+  }
+}
+
+static void MHKMovieDecoder_convert_rgb24(const struct AVFrame* frame, mhk_movie_frame_t* output)
+{
+  for (uint32_t y = 0; y < output->height; y++) {
+    const uint8_t* rgb = frame->data[0] + y * frame->linesize[0];
+    uint8_t* pixels = BUFFER_OFFSET((uint8_t*)output->pixels, y * output->bytes_per_row);
+    for (uint32_t x = 0; x < output->width; x++) {
+      pixels[0] = rgb[2];
+      pixels[1] = rgb[1];
+      pixels[2] = rgb[0];
+      pixels[3] = 0xff;
+      rgb += 3;
+      pixels += 4;
+    }
+  }
+}
+
+@implementation MHKMovieDecoder
+
++ (void)initialize { mhk_load_libav(); }
+
+- (id)init
+{
+  [self doesNotRecognizeSelector:_cmd];
+  [self release];
+  return nil;
+}
+
+- (id)initWithArchive:(MHKArchive*)archive movieID:(uint16_t)movieID lookahead:(uint32_t)lookahead error:(NSError**)errorPtr
+{
+  self = [super init];
+  if (!self)
+    return nil;
+
+  pthread_mutex_init(&_queue_lock, NULL);
+  pthread_cond_init(&_queue_cond, NULL);
+  _stream_index = -1;
+  _selection_end = INT64_MAX;
+
+  // we can't do anything without libav
+  if (!g_libav.avf_handle) {
+    [self release];
+    ReturnValueWithError(nil, MHKErrorDomain, errLibavNotAvailable, nil, errorPtr);
+  }
+
+  NSDictionary* descriptor = [archive resourceDescriptorWithResourceType:@"tMOV" ID:movieID];
+  _data_source = [[archive openResourceWithResourceType:@"tMOV" ID:movieID] retain];
+  if (!descriptor || !_data_source) {
+    [self release];
+    ReturnValueWithError(nil, MHKErrorDomain, errResourceNotFound, nil, errorPtr);
+  }
+  _resource_offset = [[descriptor objectForKey:@"Offset"] longLongValue];
+
+  // read the movie through the resource's file handle
+  unsigned char* io_buffer = g_libav.av_malloc(IO_BUFFER_SIZE);
+  _io_context = g_libav.avio_alloc_context(io_buffer, IO_BUFFER_SIZE, 0, _data_source, MHKMovieDecoder_read_packet, NULL, MHKMovieDecoder_seek);
+  _format_context = g_libav.avformat_alloc_context();
+  if (!_io_context || !_format_context) {
+    [self release];
+    ReturnValueWithError(nil, NSPOSIXErrorDomain, ENOMEM, nil, errorPtr);
+  }
+  _format_context->pb = _io_context;
+
+  AVInputFormat* mov_format = NULL;
+  while ((mov_format = g_libav.av_iformat_next(mov_format))) {
+    if (strncmp(mov_format->name, "mov", 3) == 0)
+      break;
+  }
+
+  // avformat_open_input frees the format context on failure
+  if (g_libav.avformat_open_input(&_format_context, "", mov_format, NULL) < 0) {
+    [self release];
+    ReturnValueWithError(nil, MHKErrorDomain, errInvalidMovie, nil, errorPtr);
+  }
+
+  AVStream* stream = NULL;
+  for (unsigned int i = 0; i < _format_context->nb_streams; i++) {
+    if (_format_context->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
+      _stream_index = (int)i;
+      stream = _format_context->streams[i];
+      break;
+    }
+  }
+  if (!stream || stream->time_base.num != 1 || stream->nb_index_entries == 0) {
+    [self release];
+    ReturnValueWithError(nil, MHKErrorDomain, errInvalidMovie, nil, errorPtr);
+  }
+
+  // the chunk offsets of the movies stored in Riven archives are relative to the archive rather than to the movie, which is what the
+  // QuickTime file offset resource locator papers over; rebase the sample index onto the resource if any sample lies past its end
+  off_t resource_length = [_data_source length];
+  BOOL archive_relative = NO;
+  for (unsigned int i = 0; i < _format_context->nb_streams && !archive_relative; i++) {
+    AVStream* s = _format_context->streams[i];
+    for (int entry = 0; entry < s->nb_index_entries; entry++) {
+      if (s->index_entries[entry].pos >= resource_length) {
+        archive_relative = YES;
+        break;
+      }
+    }
+  }
+  if (archive_relative) {
+    for (unsigned int i = 0; i < _format_context->nb_streams; i++) {
+      AVStream* s = _format_context->streams[i];
+      for (int entry = 0; entry < s->nb_index_entries; entry++)
+        s->index_entries[entry].pos -= _resource_offset;
+    }
+  }
+
+  // only decode the video stream; the sample description has everything the decoder needs, so there is no need to probe packets with
+  // avformat_find_stream_info
+  for (unsigned int i = 0; i < _format_context->nb_streams; i++) {
+    if ((int)i != _stream_index)
+      _format_context->streams[i]->discard = AVDISCARD_ALL;
+  }
+
+  _codec_context = stream->codec;
+  AVCodec* codec = g_libav.avcodec_find_decoder(_codec_context->codec_id);
+  if (!codec || g_libav.avcodec_open2(_codec_context, codec, NULL) < 0) {
+    _codec_context = NULL;
+    [self release];
+    ReturnValueWithError(nil, MHKErrorDomain, errInvalidMovie, nil, errorPtr);
+  }
+  _av_frame = g_libav.avcodec_alloc_frame();
+
+  _time_scale = stream->time_base.den;
+  _duration = stream->duration;
+  if (_duration == AV_NOPTS_VALUE) {
+    AVIndexEntry* last = &stream->index_entries[stream->nb_index_entries - 1];
+    _duration = last->timestamp + 1;
+  }
+  _width = (uint32_t)_codec_context->width;
+  _height = (uint32_t)_codec_context->height;
+
+  // allocate the frame queue
+  _frame_capacity = (lookahead > 0) ? lookahead : 1;
+  _frames = calloc(_frame_capacity, sizeof(mhk_movie_frame_t));
+  for (uint32_t i = 0; i < _frame_capacity; i++) {
+    _frames[i].width = _width;
+    _frames[i].height = _height;
+    _frames[i].bytes_per_row = _width * 4;
+    _frames[i].pixels = malloc(_width * _height * 4);
+    if (!_frames[i].pixels) {
+      [self release];
+      ReturnValueWithError(nil, NSPOSIXErrorDomain, ENOMEM, nil, errorPtr);
+    }
+  }
+
+  // start decoding; the thread does not retain the decoder, which stops and joins it in dealloc
+  if (pthread_create(&_decoder_thread, NULL, MHKMovieDecoder_thread_main, self) != 0) {
+    _decoder_thread = NULL;
+    [self release];
+    ReturnValueWithError(nil, NSPOSIXErrorDomain, errno, nil, errorPtr);
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  if (_decoder_thread) {
+    pthread_mutex_lock(&_queue_lock);
+    _terminate = YES;
+    pthread_cond_broadcast(&_queue_cond);
+    pthread_mutex_unlock(&_queue_lock);
+    pthread_join(_decoder_thread, NULL);
+  }
+
+  if (_av_frame)
+    g_libav.avcodec_free_frame(&_av_frame);
+  if (_codec_context)
+    g_libav.avcodec_close(_codec_context);
+  if (_format_context)
+    g_libav.avformat_close_input(&_format_context);
+  if (_io_context) {
+    g_libav.av_freep(&_io_context->buffer);
+    g_libav.av_freep(&_io_context);
+  }
+
+  if (_frames) {
+    for (uint32_t i = 0; i < _frame_capacity; i++)
+      free(_frames[i].pixels);
+    free(_frames);
+  }
+
+  pthread_cond_destroy(&_queue_cond);
+  pthread_mutex_destroy(&_queue_lock);
+
+  [_data_source release];
+  [_error release];
+
+  [super dealloc];
+}
+
+- (int32_t)timeScale { return _time_scale; }
+
+- (int64_t)duration { return _duration; }
+
+- (uint32_t)width { return _width; }
+
+- (uint32_t)height { return _height; }
+
+- (BOOL)looping
+{
+  pthread_mutex_lock(&_queue_lock);
+  BOOL looping = _looping;
+  pthread_mutex_unlock(&_queue_lock);
+  return looping;
+}
+
+- (void)setLooping:(BOOL)flag
+{
+  pthread_mutex_lock(&_queue_lock);
+  _looping = flag;
+
+  // the decoder may have stopped at the end already
+  if (_looping && _at_end) {
+    _at_end = NO;
+    _seek_target = _selection_start;
+    _seek_pending = YES;
+  }
+  pthread_cond_broadcast(&_queue_cond);
+  pthread_mutex_unlock(&_queue_lock);
+}
+
+- (void)_seekToTime_nolock:(int64_t)time
+{
+  // WARNING: the caller must hold the queue lock
+
+  // frames decoded before the seek are stale; a frame the consumer has dequeued stays valid until it is handed back
+  _generation++;
+  _frame_count = _head_dequeued ? 1 : 0;
+  _seek_target = time;
+  _seek_pending = YES;
+  _at_end = NO;
+  pthread_cond_broadcast(&_queue_cond);
+}
+
+- (void)setSelectionStart:(int64_t)start duration:(int64_t)duration timeScale:(int32_t)time_scale
+{
+  pthread_mutex_lock(&_queue_lock);
+  _selection_start = MHKMovieDecoder_rescale(start, time_scale, _time_scale);
+  _selection_end = MHKMovieDecoder_rescale(start + duration, time_scale, _time_scale);
+  [self _seekToTime_nolock:_selection_start];
+  pthread_mutex_unlock(&_queue_lock);
+}
+
+- (void)clearSelection
+{
+  pthread_mutex_lock(&_queue_lock);
+  _selection_start = 0;
+  _selection_end = INT64_MAX;
+  pthread_mutex_unlock(&_queue_lock);
+}
+
+- (void)seekToTime:(int64_t)time timeScale:(int32_t)time_scale
+{
+  pthread_mutex_lock(&_queue_lock);
+  [self _seekToTime_nolock:MHKMovieDecoder_rescale(time, time_scale, _time_scale)];
+  pthread_mutex_unlock(&_queue_lock);
+}
+
+- (const mhk_movie_frame_t*)dequeueFrame:(BOOL)wait
+{
+  pthread_mutex_lock(&_queue_lock);
+  uint32_t available = _frame_count - (_head_dequeued ? 1 : 0);
+  while (available == 0 && wait && !_at_end && !_terminate) {
+    pthread_cond_wait(&_queue_cond, &_queue_lock);
+    available = _frame_count - (_head_dequeued ? 1 : 0);
+  }
+
+  mhk_movie_frame_t* frame = NULL;
+  if (available > 0) {
+    // a frame that was dequeued before a seek is still at the head of the queue until it is handed back
+    debug_assert(!_head_dequeued);
+    frame = &_frames[_frame_head];
+    _head_dequeued = YES;
+  }
+  pthread_mutex_unlock(&_queue_lock);
+  return frame;
+}
+
+- (void)relinquishFrame:(const mhk_movie_frame_t*)frame
+{
+  pthread_mutex_lock(&_queue_lock);
+  if (_head_dequeued && frame == &_frames[_frame_head]) {
+    _frame_head = (_frame_head + 1) % _frame_capacity;
+    _frame_count--;
+    _head_dequeued = NO;
+    pthread_cond_broadcast(&_queue_cond);
+  }
+  pthread_mutex_unlock(&_queue_lock);
+}
+
+- (BOOL)isAtEnd
+{
+  pthread_mutex_lock(&_queue_lock);
+  BOOL at_end = _at_end && _frame_count == 0;
+  pthread_mutex_unlock(&_queue_lock);
+  return at_end;
+}
+
+- (NSError*)error
+{
+  pthread_mutex_lock(&_queue_lock);
+  NSError* error = [[_error retain] autorelease];
+  pthread_mutex_unlock(&_queue_lock);
+  return error;
+}
+
+#pragma mark -
+#pragma mark decoder thread
+
+// reads packets until the decoder outputs a frame; returns 1 for a frame, 0 at the end of the movie and a libav error code on failure
+- (int)_decodeNextFrame:(int64_t*)pts duration:(int64_t*)duration
+{
+  AVPacket packet;
+  for (;;) {
+    if (g_libav.av_read_frame(_format_context, &packet) < 0)
+      return 0;
+
+    if (packet.stream_index != _stream_index) {
+      g_libav.av_free_packet(&packet);
+      continue;
+    }
+
+    // the decoders tMOV movies use have no reordering delay, so a frame belongs to the packet that produced it
+    int got_frame = 0;
+    int result = g_libav.avcodec_decode_video2(_codec_context, _av_frame, &got_frame, &packet);
+    int64_t packet_pts = (packet.pts != AV_NOPTS_VALUE) ? packet.pts : packet.dts;
+    int64_t packet_duration = packet.duration;
+    g_libav.av_free_packet(&packet);
+
+    if (result < 0)
+      return result;
+    if (got_frame) {
+      *pts = (_av_frame->pkt_pts != AV_NOPTS_VALUE) ? _av_frame->pkt_pts : packet_pts;
+      *duration = packet_duration;
+      return 1;
+    }
+  }
+}
+
+- (BOOL)_convertFrame:(mhk_movie_frame_t*)output
+{
+  switch (_codec_context->pix_fmt) {
+  case AV_PIX_FMT_YUV420P:
+    MHKMovieDecoder_convert_cinepak_yuv420p(_av_frame, output);
+    return YES;
+  case AV_PIX_FMT_PAL8:
+    MHKMovieDecoder_convert_pal8(_av_frame, output);
+    return YES;
+  case AV_PIX_FMT_RGB24:
+    MHKMovieDecoder_convert_rgb24(_av_frame, output);
+    return YES;
+  default:
+    return NO;
+  }
+}
+
+- (void)_stopWithError:(NSError*)error
+{
+  pthread_mutex_lock(&_queue_lock);
+  if (!_error)
+    _error = [error retain];
+  _at_end = YES;
+  pthread_cond_broadcast(&_queue_cond);
+  pthread_mutex_unlock(&_queue_lock);
+}
+
+- (void)_decoderThreadMain
+{
+  // frames that end at or before this time are decoded but not queued, which is what makes seeks land on the exact frame
+  int64_t skip_until = INT64_MIN;
+
+  for (;;) {
+    NSAutoreleasePool* p = [NSAutoreleasePool new];
+
+    pthread_mutex_lock(&_queue_lock);
+    while (!_terminate && !_seek_pending && (_frame_count == _frame_capacity || _at_end))
+      pthread_cond_wait(&_queue_cond, &_queue_lock);
+    if (_terminate) {
+      pthread_mutex_unlock(&_queue_lock);
+      [p release];
+      break;
+    }
+
+    int64_t seek_target = _seek_target;
+    BOOL seek = _seek_pending;
+    _seek_pending = NO;
+    uint32_t generation = _generation;
+    pthread_mutex_unlock(&_queue_lock);
+
+    // seek to the key frame at or before the target, then decode forward to it
+    if (seek) {
+      g_libav.av_seek_frame(_format_context, _stream_index, seek_target, AVSEEK_FLAG_BACKWARD);
+      g_libav.avcodec_flush_buffers(_codec_context);
+      skip_until = seek_target;
+    }
+
+    uint64_t start_time = RXTimingNow();
+    int64_t pts = 0, duration = 0;
+    int result = [self _decodeNextFrame:&pts duration:&duration];
+    if (result < 0) {
+      [self _stopWithError:[MHKError errorWithDomain:MHKErrorDomain code:errInvalidMovie userInfo:nil]];
+      [p release];
+      continue;
+    }
+
+    pthread_mutex_lock(&_queue_lock);
+
+    // drop the frame if the consumer seeked while it was decoding
+    if (generation != _generation) {
+      pthread_mutex_unlock(&_queue_lock);
+      [p release];
+      continue;
+    }
+
+    // at the end of the movie or selection, either loop back to the start of the selection or stop
+    if (result == 0 || pts >= _selection_end) {
+      if (_looping) {
+        _seek_target = _selection_start;
+        _seek_pending = YES;
+      } else {
+        _at_end = YES;
+        pthread_cond_broadcast(&_queue_cond);
+      }
+      pthread_mutex_unlock(&_queue_lock);
+      [p release];
+      continue;
+    }
+
+    if (pts + MAX(duration, 1) <= skip_until) {
+      pthread_mutex_unlock(&_queue_lock);
+      [p release];
+      continue;
+    }
+
+    // the tail slot belongs to the decoder until the frame is queued
+    mhk_movie_frame_t* frame = &_frames[(_frame_head + _frame_count) % _frame_capacity];
+    pthread_mutex_unlock(&_queue_lock);
+
+    if (![self _convertFrame:frame]) {
+      [self _stopWithError:[MHKError errorWithDomain:MHKErrorDomain code:errInvalidMovie userInfo:nil]];
+      [p release];
+      continue;
+    }
+
+    pthread_mutex_lock(&_queue_lock);
+    if (generation == _generation) {
+      frame->pts = pts;
+      frame->duration = duration;
+      frame->decode_ns = RXTimingHostDeltaToNanoseconds(RXTimingNow() - start_time);
+      _frame_count++;
+      pthread_cond_broadcast(&_queue_cond);
+    }
+    pthread_mutex_unlock(&_queue_lock);
+
+    [p release];
+  }
+}
+
+@end
@@ -23,18 +23,18 @@ typedef struct {
   void* data;
   ByteCount data_size;
 
-  SInt16 fork;
-  uint64_t fork_offset;
-} MHK_fork_io_buffer;
+  mhk_data_source_t* source;
+  uint64_t source_offset;
+} MHK_source_io_buffer;
 
-static void _allocate_fork_io_buffer(const SInt16 fork_ref, const uint64_t offset, const uint32_t max_size, MHK_fork_io_buffer* io_buffer)
+static void _allocate_source_io_buffer(mhk_data_source_t* source, const uint64_t offset, const uint32_t max_size, MHK_source_io_buffer* io_buffer)
 {
   if (!io_buffer)
     return;
-  memset(io_buffer, 0, sizeof(MHK_fork_io_buffer));
+  memset(io_buffer, 0, sizeof(MHK_source_io_buffer));
 
-  io_buffer->fork = fork_ref;
-  io_buffer->fork_offset = offset;
+  io_buffer->source = source;
+  io_buffer->source_offset = offset;
 
   io_buffer->data_base_size = max_size;
   io_buffer->data_base = malloc(max_size);
@@ -42,7 +42,7 @@ static void _allocate_fork_io_buffer(const SInt16 fork_ref, const uint64_t offse
   io_buffer->data = io_buffer->data_base;
 }
 
-static void _free_fork_io_buffer(MHK_fork_io_buffer* io_buffer)
+static void _free_source_io_buffer(MHK_source_io_buffer* io_buffer)
 {
   if (!io_buffer)
     return;
@@ -52,7 +52,7 @@ static void _free_fork_io_buffer(MHK_fork_io_buffer* io_buffer)
   io_buffer->data = NULL;
 }
 
-static OSStatus _buffered_linear_read_fork(MHK_fork_io_buffer* io_buffer, const ByteCount requested, void* buffer, ByteCount* actual)
+static OSStatus _buffered_linear_read_source(MHK_source_io_buffer* io_buffer, const ByteCount requested, void* buffer, ByteCount* actual)
 {
   OSStatus err = noErr;
   ByteCount local_actual = 0;
@@ -65,14 +65,14 @@ static OSStatus _buffered_linear_read_fork(MHK_fork_io_buffer* io_buffer, const
   while (size_left > 0) {
     // if the IO buffer is empty, attempt to fill it
     if (io_buffer->data_size == 0) {
-      err = FSReadFork(io_buffer->fork, fsFromStart, io_buffer->fork_offset, io_buffer->data_base_size, io_buffer->data_base, &available_from_buffer);
+      err = mhk_data_source_read(io_buffer->source, io_buffer->source_offset, io_buffer->data_base_size, io_buffer->data_base, &available_from_buffer);
       if (err && err != eofErr)
         return err;
       if (available_from_buffer == 0)
         return err;
 
       // update the IO buffer's state
-      io_buffer->fork_offset += available_from_buffer;
+      io_buffer->source_offset += available_from_buffer;
       io_buffer->data_size = available_from_buffer;
       io_buffer->data = io_buffer->data_base;
     }
@@ -96,7 +96,7 @@ static OSStatus _buffered_linear_read_fork(MHK_fork_io_buffer* io_buffer, const
   return noErr;
 }
 
-OSStatus read_raw_bgr_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITMAP_header* header, void* pixels, MHK_BITMAP_FORMAT format)
+OSStatus read_raw_bgr_pixels(mhk_data_source_t* source, SInt64 offset, MHK_BITMAP_header* header, void* pixels, MHK_BITMAP_FORMAT format)
 {
   OSStatus err = noErr;
 
@@ -112,7 +112,7 @@ OSStatus read_raw_bgr_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITMAP_header*
   }
 
   // read the pixels
-  err = FSReadFork(fork_ref, fsFromStart, offset, file_buffer.rowBytes * file_buffer.height, file_buffer.data, NULL);
+  err = mhk_data_source_read(source, offset, file_buffer.rowBytes * file_buffer.height, file_buffer.data, NULL);
   if (err)
     goto AbortReadBGRPixels;
 
@@ -172,7 +172,7 @@ AbortReadBGRPixels:
   return err;
 }
 
-OSStatus read_raw_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITMAP_header* header, void* pixels, MHK_BITMAP_FORMAT format)
+OSStatus read_raw_indexed_pixels(mhk_data_source_t* source, SInt64 offset, MHK_BITMAP_header* header, void* pixels, MHK_BITMAP_FORMAT format)
 {
   OSStatus err = noErr;
 
@@ -202,7 +202,7 @@ OSStatus read_raw_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITMAP_head
 
   // read the color table
   ByteCount bytes_read;
-  err = FSReadFork(fork_ref, fsFromStart, offset, fct_buffer.rowBytes, fct_buffer.data, &bytes_read);
+  err = mhk_data_source_read(source, offset, fct_buffer.rowBytes, fct_buffer.data, &bytes_read);
   if (err)
     goto AbortReadIndexedPixels;
 
@@ -258,7 +258,7 @@ OSStatus read_raw_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITMAP_head
   offset += bytes_read;
 
   // read the pixels
-  err = FSReadFork(fork_ref, fsFromStart, offset, file_buffer.rowBytes * file_buffer.height, file_buffer.data, &bytes_read);
+  err = mhk_data_source_read(source, offset, file_buffer.rowBytes * file_buffer.height, file_buffer.data, &bytes_read);
   if (err)
     goto AbortReadIndexedPixels;
 
@@ -282,7 +282,7 @@ AbortReadIndexedPixels:
   return err;
 }
 
-OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITMAP_header* header, void* pixels, MHK_BITMAP_FORMAT format)
+OSStatus read_compressed_indexed_pixels(mhk_data_source_t* source, SInt64 offset, MHK_BITMAP_header* header, void* pixels, MHK_BITMAP_FORMAT format)
 {
   OSStatus err = noErr;
 
@@ -301,7 +301,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
 
   // read the color table
   ByteCount bytes_read;
-  err = FSReadFork(fork_ref, fsFromStart, offset, fct_buffer.rowBytes, fct_buffer.data, &bytes_read);
+  err = mhk_data_source_read(source, offset, fct_buffer.rowBytes, fct_buffer.data, &bytes_read);
   if (err)
     goto AbortReadCompressedIndexedPixels;
 
@@ -375,13 +375,13 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
   Pixel_8* file_pixels = file_buffer.data;
 
   // file IO buffer
-  MHK_fork_io_buffer ioBuffer;
-  _allocate_fork_io_buffer(fork_ref, offset, READ_BUFFER_SIZE, &ioBuffer);
+  MHK_source_io_buffer ioBuffer;
+  _allocate_source_io_buffer(source, offset, READ_BUFFER_SIZE, &ioBuffer);
 
   // decompress the indexed pixels
   while (pixel_index < pixel_count) {
     // read an instruction
-    err = _buffered_linear_read_fork(&ioBuffer, 1, &instruction, NULL);
+    err = _buffered_linear_read_source(&ioBuffer, 1, &instruction, NULL);
     if (err)
       goto AbortReadCompressedIndexedPixels;
 
@@ -395,7 +395,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
 
     // execute the instruction
     if (instruction == 0) {
-      err = _buffered_linear_read_fork(&ioBuffer, operand * 2, file_pixels + pixel_index, &bytes_read);
+      err = _buffered_linear_read_source(&ioBuffer, operand * 2, file_pixels + pixel_index, &bytes_read);
       if (err)
         goto AbortReadCompressedIndexedPixels;
       pixel_index += bytes_read;
@@ -430,7 +430,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
       uint8_t n = operand;
       for (; i < n; i++) {
         // read an instruction
-        err = _buffered_linear_read_fork(&ioBuffer, 1, &instruction, NULL);
+        err = _buffered_linear_read_source(&ioBuffer, 1, &instruction, NULL);
         if (err)
           goto AbortReadCompressedIndexedPixels;
 
@@ -447,7 +447,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
         } else if (instruction == 0x10 && operand == 0) {
           // repeat last duplet then change second pixel to pixel from stream
           file_pixels[pixel_index] = file_pixels[pixel_index - 2];
-          err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index + 1, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index + 1, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
         } else if (instruction == 0x10) {
@@ -464,7 +464,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
           file_pixels[pixel_index + 1] = file_pixels[pixel_index - 1] - operand;
         } else if (instruction == 0x40 && operand == 0) {
           // repeat last duplet then change first pixel to pixel from stream
-          err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
           file_pixels[pixel_index + 1] = file_pixels[pixel_index - 1];
@@ -474,32 +474,32 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
           file_pixels[pixel_index + 1] = file_pixels[pixel_index - 1];
         } else if (instruction == 0x50 && operand == 0) {
           // output 2 pixels from stream
-          err = _buffered_linear_read_fork(&ioBuffer, 2, file_pixels + pixel_index, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 2, file_pixels + pixel_index, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
         } else if (instruction == 0x50 && operand < 8) {
           // output pixel at offset operand then pixel from stream
           operand &= 0x07;
           file_pixels[pixel_index] = file_pixels[pixel_index - operand];
-          err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index + 1, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index + 1, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
         } else if (instruction == 0x50) {
           // output pixel from stream then pixel at offset operand
           operand &= 0x07;
-          err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
           file_pixels[pixel_index + 1] = file_pixels[pixel_index - operand + 1];
         } else if (instruction == 0x60) {
           // output pixel from stream then second pixel of last duplet + operand
-          err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
           file_pixels[pixel_index + 1] = file_pixels[pixel_index - 1] + operand;
         } else if (instruction == 0x70) {
           // output pixel from stream then second pixel of last duplet - operand
-          err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
           file_pixels[pixel_index + 1] = file_pixels[pixel_index - 1] - operand;
@@ -510,12 +510,12 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
         } else if (instruction == 0x90) {
           // output first pixel of last duplet + operand then pixel from stream
           file_pixels[pixel_index] = file_pixels[pixel_index - 2] + operand;
-          err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index + 1, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index + 1, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
         } else if (instruction == 0xa0 && operand == 0) {
           // repeat last duplet then add next nibble to first pixel and next nibble to second pixel
-          err = _buffered_linear_read_fork(&ioBuffer, 1, &operand, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, &operand, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
           file_pixels[pixel_index] = file_pixels[pixel_index - 2] + ((operand >> 4) & 0x0f);
@@ -523,7 +523,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
         } else if (instruction == 0xa0) {
           // copy n bytes from large offset + extra optional pixel instruction
           uint8_t pixel_offset_low = 0;
-          err = _buffered_linear_read_fork(&ioBuffer, 1, &pixel_offset_low, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, &pixel_offset_low, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
 
@@ -539,7 +539,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
             file_pixels[pixel_index + 1] = file_pixels[pixel_index - pixel_offset + 1];
             file_pixels[pixel_index + 2] = file_pixels[pixel_index - pixel_offset + 2];
 
-            err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index + 3, NULL);
+            err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index + 3, NULL);
             if (err)
               goto AbortReadCompressedIndexedPixels;
 
@@ -560,7 +560,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
             file_pixels[pixel_index + 3] = file_pixels[pixel_index - pixel_offset + 3];
             file_pixels[pixel_index + 4] = file_pixels[pixel_index - pixel_offset + 4];
 
-            err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index + 5, NULL);
+            err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index + 5, NULL);
             if (err)
               goto AbortReadCompressedIndexedPixels;
 
@@ -568,7 +568,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
           }
         } else if (instruction == 0xb0 && operand == 0) {
           // repeat last duplet then add next nibble to first pixel then subtract next nibble from second pixel
-          err = _buffered_linear_read_fork(&ioBuffer, 1, &operand, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, &operand, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
           file_pixels[pixel_index] = file_pixels[pixel_index - 2] + ((operand >> 4) & 0x0f);
@@ -576,7 +576,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
         } else if (instruction == 0xb0) {
           // copy n bytes from large offset + extra optional pixel instruction
           uint8_t pixel_offset_low = 0;
-          err = _buffered_linear_read_fork(&ioBuffer, 1, &pixel_offset_low, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, &pixel_offset_low, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
 
@@ -603,7 +603,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
               file_pixels[pixel_index + i_pixel] = file_pixels[pixel_index - pixel_offset + i_pixel];
             }
 
-            err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index + 7, NULL);
+            err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index + 7, NULL);
             if (err)
               goto AbortReadCompressedIndexedPixels;
 
@@ -623,12 +623,12 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
         } else if (instruction == 0xd0) {
           // output first pixel of last duplet - operand then pixel from stream
           file_pixels[pixel_index] = file_pixels[pixel_index - 2] - operand;
-          err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index + 1, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index + 1, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
         } else if (instruction == 0xe0 && operand == 0) {
           // repeat last duplet then subtract next nibble from first pixel then add next nibble to second pixel
-          err = _buffered_linear_read_fork(&ioBuffer, 1, &operand, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, &operand, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
           file_pixels[pixel_index] = file_pixels[pixel_index - 2] - ((operand >> 4) & 0x0f);
@@ -636,7 +636,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
         } else if (instruction == 0xe0) {
           // copy n bytes from large offset + extra optional pixel instruction
           uint8_t pixel_offset_low = 0;
-          err = _buffered_linear_read_fork(&ioBuffer, 1, &pixel_offset_low, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, &pixel_offset_low, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
 
@@ -656,7 +656,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
               file_pixels[pixel_index + i_pixel] = file_pixels[pixel_index - pixel_offset + i_pixel];
             }
 
-            err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index + 9, NULL);
+            err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index + 9, NULL);
             if (err)
               goto AbortReadCompressedIndexedPixels;
 
@@ -674,7 +674,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
               file_pixels[pixel_index + i_pixel] = file_pixels[pixel_index - pixel_offset + i_pixel];
             }
 
-            err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index + 11, NULL);
+            err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index + 11, NULL);
             if (err)
               goto AbortReadCompressedIndexedPixels;
 
@@ -682,7 +682,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
           }
         } else if (instruction == 0xf0 && operand == 0) {
           // repeat last duplet then subtract next nibble from first pixel and next nibble from second pixel
-          err = _buffered_linear_read_fork(&ioBuffer, 1, &operand, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, &operand, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
           file_pixels[pixel_index] = file_pixels[pixel_index - 2] - ((operand >> 4) & 0x0f);
@@ -690,7 +690,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
         } else if (instruction == 0xf0 && operand < 0x0c) {
           // copy n bytes from large offset + extra optional pixel instruction
           uint8_t pixel_offset_low = 0;
-          err = _buffered_linear_read_fork(&ioBuffer, 1, &pixel_offset_low, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 1, &pixel_offset_low, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
 
@@ -717,7 +717,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
               file_pixels[pixel_index + i_pixel] = file_pixels[pixel_index - pixel_offset + i_pixel];
             }
 
-            err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index + 13, NULL);
+            err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index + 13, NULL);
             if (err)
               goto AbortReadCompressedIndexedPixels;
 
@@ -726,7 +726,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
         } else if (instruction == 0xf0 && operand >= 0x0c) {
           // fancy copy n bytes from large offset + extra optional pixel instruction
           uint16_t pixel_offset = 0;
-          err = _buffered_linear_read_fork(&ioBuffer, 2, &pixel_offset, NULL);
+          err = _buffered_linear_read_source(&ioBuffer, 2, &pixel_offset, NULL);
           if (err)
             goto AbortReadCompressedIndexedPixels;
 
@@ -747,7 +747,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
 
           // check if we need to read an extra pixel from stream
           if ((n_pixel & 0x01)) {
-            err = _buffered_linear_read_fork(&ioBuffer, 1, file_pixels + pixel_index + i_pixel, NULL);
+            err = _buffered_linear_read_source(&ioBuffer, 1, file_pixels + pixel_index + i_pixel, NULL);
             if (err)
               goto AbortReadCompressedIndexedPixels;
             pixel_index++;
@@ -764,7 +764,7 @@ OSStatus read_compressed_indexed_pixels(SInt16 fork_ref, SInt64 offset, MHK_BITM
   }
 
   // we do not need the IO buffer anymore
-  _free_fork_io_buffer(&ioBuffer);
+  _free_source_io_buffer(&ioBuffer);
 
   // storage for the final ARGB8888 image
   vImage_Buffer client_buffer;
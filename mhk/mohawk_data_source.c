@@ -0,0 +1,45 @@
+/*
+ *  mohawk_data_source.c
+ *  MHKKit
+ *
+ */
+
+#include <stdlib.h>
+
+#include "mohawk_data_source.h"
+
+struct mhk_fork_data_source {
+  mhk_data_source_t base;
+  SInt16 fork_ref;
+};
+
+static OSStatus mhk_fork_data_source_read(mhk_data_source_t* source, SInt64 offset, ByteCount length, void* buffer, ByteCount* actual,
+                                          uint32_t flags)
+{
+  struct mhk_fork_data_source* fork_source = (struct mhk_fork_data_source*)source;
+  UInt16 position_mode = fsFromStart;
+  if (flags & MHK_DATA_SOURCE_NO_CACHE)
+    position_mode |= forceReadMask;
+  return FSReadFork(fork_source->fork_ref, position_mode, offset, length, buffer, actual);
+}
+
+static void mhk_fork_data_source_close(mhk_data_source_t* source) { free(source); }
+
+mhk_data_source_t* mhk_fork_data_source_create(SInt16 fork_ref, SInt64 size)
+{
+  struct mhk_fork_data_source* fork_source = (struct mhk_fork_data_source*)calloc(1, sizeof(struct mhk_fork_data_source));
+  if (!fork_source)
+    return NULL;
+
+  fork_source->base.size = size;
+  fork_source->base.read = mhk_fork_data_source_read;
+  fork_source->base.close = mhk_fork_data_source_close;
+  fork_source->fork_ref = fork_ref;
+  return &fork_source->base;
+}
+
+void mhk_data_source_close(mhk_data_source_t* source)
+{
+  if (source)
+    source->close(source);
+}
@@ -0,0 +1,39 @@
+/*
+ *  mohawk_data_source.h
+ *  MHKKit
+ *
+ */
+
+#if !defined(mohawk_data_source_h)
+#define mohawk_data_source_h 1
+
+#include <CoreServices/CoreServices.h>
+
+#include <MHKKit/mohawk_core.h>
+
+__BEGIN_DECLS
+
+// A data source supplies the bytes of an archive. Reads work like FSReadFork from the start of the data: a read that runs past the end
+// returns eofErr along with the number of bytes it could read. Sources can be read from several threads at once.
+typedef struct mhk_data_source mhk_data_source_t;
+
+// hint that the data will not be read again soon, for streamed resources
+#define MHK_DATA_SOURCE_NO_CACHE (1u << 0)
+
+struct mhk_data_source {
+  SInt64 size;
+  OSStatus (*read)(mhk_data_source_t* source, SInt64 offset, ByteCount length, void* buffer, ByteCount* actual, uint32_t flags);
+  void (*close)(mhk_data_source_t* source);
+};
+
+MHK_INLINE OSStatus mhk_data_source_read(mhk_data_source_t* source, SInt64 offset, ByteCount length, void* buffer, ByteCount* actual)
+{ return source->read(source, offset, length, buffer, actual, 0); }
+
+void mhk_data_source_close(mhk_data_source_t* source);
+
+// a source over an open data fork; the fork stays owned by the caller and must outlive the source
+mhk_data_source_t* mhk_fork_data_source_create(SInt16 fork_ref, SInt64 size);
+
+__END_DECLS
+
+#endif // mohawk_data_source_h
@@ -0,0 +1,554 @@
+/*
+ *  mohawk_inno_source.c
+ *  MHKKit
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <lzma.h>
+#include <zlib.h>
+
+#include "mohawk_inno_source.h"
+
+#define MHK_INNO_CACHE_SLOTS 8
+#define MHK_INNO_INPUT_BUFFER_SIZE 0x10000
+
+static const uint32_t MHK_INNO_FILE_DATA_MAGIC = 0x1A626C7A; // zlb\1A
+static const uint32_t MHK_INNO_INDEX_MAGIC = 0x4B4C424D;     // MBLK
+static const uint32_t MHK_INNO_INDEX_VERSION = 1;
+
+#pragma pack(push, 1)
+struct mhk_inno_lzma_header {
+  uint8_t properties;
+  uint32_t dict_size;
+};
+
+struct mhk_inno_index_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t block_size;
+  uint32_t block_count;
+  uint64_t data_offset;
+  uint64_t compressed_size;
+  uint64_t size;
+};
+#pragma pack(pop)
+
+// where a block is in the store; blocks that do not compress (most media already is) are stored as is
+struct mhk_inno_block {
+  uint64_t store_offset;
+  uint32_t stored_size;
+  uint32_t compressed;
+};
+
+// decompressed blocks, shared by readers; a slot being loaded or copied from cannot be recycled
+struct mhk_inno_cache_slot {
+  int64_t block;
+  uint32_t users;
+  bool loading;
+  uint64_t last_use;
+  uint8_t* data;
+};
+
+struct mhk_inno_data_source {
+  mhk_data_source_t base;
+
+  int setup_fd;
+  int store_fd;
+  uint64_t data_offset;
+  uint64_t compressed_size;
+  char* index_path;
+
+  uint32_t block_count;
+  struct mhk_inno_block* blocks;
+
+  // protected by the lock; blocks [0, blocks_ready) are in the store and their entries are immutable
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint32_t blocks_ready;
+  bool failed;
+  bool cancelled;
+  struct mhk_inno_cache_slot cache[MHK_INNO_CACHE_SLOTS];
+  uint64_t cache_clock;
+
+  pthread_t rechunk_thread;
+  bool rechunk_thread_running;
+};
+
+static uint32_t mhk_inno_block_length(struct mhk_inno_data_source* source, uint32_t block)
+{
+  uint64_t start = (uint64_t)block * MHK_INNO_BLOCK_SIZE;
+  uint64_t length = (uint64_t)source->base.size - start;
+  return (length < MHK_INNO_BLOCK_SIZE) ? (uint32_t)length : MHK_INNO_BLOCK_SIZE;
+}
+
+static bool mhk_inno_pread(int fd, void* buffer, size_t length, uint64_t offset)
+{
+  while (length > 0) {
+    ssize_t n = pread(fd, buffer, length, (off_t)offset);
+    if (n <= 0) {
+      if (n == -1 && errno == EINTR)
+        continue;
+      return false;
+    }
+    buffer = (uint8_t*)buffer + n;
+    length -= (size_t)n;
+    offset += (uint64_t)n;
+  }
+  return true;
+}
+
+static bool mhk_inno_pwrite(int fd, const void* buffer, size_t length, uint64_t offset)
+{
+  while (length > 0) {
+    ssize_t n = pwrite(fd, buffer, length, (off_t)offset);
+    if (n <= 0) {
+      if (n == -1 && errno == EINTR)
+        continue;
+      return false;
+    }
+    buffer = (const uint8_t*)buffer + n;
+    length -= (size_t)n;
+    offset += (uint64_t)n;
+  }
+  return true;
+}
+
+// must be called with the lock held; returns NULL if every slot is in use
+static struct mhk_inno_cache_slot* mhk_inno_cache_victim(struct mhk_inno_data_source* source)
+{
+  struct mhk_inno_cache_slot* victim = NULL;
+  for (int i = 0; i < MHK_INNO_CACHE_SLOTS; i++) {
+    struct mhk_inno_cache_slot* slot = source->cache + i;
+    if (slot->users > 0 || slot->loading)
+      continue;
+    if (!victim || slot->block < 0 || (victim->block >= 0 && slot->last_use < victim->last_use))
+      victim = slot;
+  }
+  return victim;
+}
+
+static void mhk_inno_write_index(struct mhk_inno_data_source* source)
+{
+  size_t path_length = strlen(source->index_path);
+  char* temporary_path = (char*)malloc(path_length + 2);
+  if (!temporary_path)
+    return;
+  memcpy(temporary_path, source->index_path, path_length);
+  memcpy(temporary_path + path_length, "~", 2);
+
+  struct mhk_inno_index_header header = {MHK_INNO_INDEX_MAGIC,   MHK_INNO_INDEX_VERSION,  MHK_INNO_BLOCK_SIZE,       source->block_count,
+                                         source->data_offset, source->compressed_size, (uint64_t)source->base.size};
+
+  // write a temporary index and rename it, so that an index is either complete or missing
+  int fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd != -1) {
+    bool ok = fsync(source->store_fd) == 0 && mhk_inno_pwrite(fd, &header, sizeof(header), 0) &&
+              mhk_inno_pwrite(fd, source->blocks, source->block_count * sizeof(struct mhk_inno_block), sizeof(header));
+    close(fd);
+    if (!ok || rename(temporary_path, source->index_path) != 0)
+      unlink(temporary_path);
+  }
+  free(temporary_path);
+}
+
+static bool mhk_inno_read_index(struct mhk_inno_data_source* source)
+{
+  int fd = open(source->index_path, O_RDONLY);
+  if (fd == -1)
+    return false;
+
+  struct mhk_inno_index_header header;
+  bool ok = mhk_inno_pread(fd, &header, sizeof(header), 0) && header.magic == MHK_INNO_INDEX_MAGIC &&
+            header.version == MHK_INNO_INDEX_VERSION && header.block_size == MHK_INNO_BLOCK_SIZE && header.block_count == source->block_count &&
+            header.data_offset == source->data_offset && header.compressed_size == source->compressed_size &&
+            header.size == (uint64_t)source->base.size &&
+            mhk_inno_pread(fd, source->blocks, source->block_count * sizeof(struct mhk_inno_block), sizeof(header));
+  close(fd);
+  if (!ok)
+    return false;
+
+  // the store must hold every block the index points at
+  off_t store_size = lseek(source->store_fd, 0, SEEK_END);
+  for (uint32_t i = 0; i < source->block_count; i++) {
+    if (source->blocks[i].store_offset + source->blocks[i].stored_size > (uint64_t)store_size)
+      return false;
+  }
+  return true;
+}
+
+static void* mhk_inno_rechunk(void* context)
+{
+  struct mhk_inno_data_source* source = (struct mhk_inno_data_source*)context;
+  bool ok = false;
+
+  uLong packed_capacity = compressBound(MHK_INNO_BLOCK_SIZE);
+  uint8_t* input = (uint8_t*)malloc(MHK_INNO_INPUT_BUFFER_SIZE);
+  uint8_t* block = (uint8_t*)malloc(MHK_INNO_BLOCK_SIZE);
+  uint8_t* packed = (uint8_t*)malloc(packed_capacity);
+
+  lzma_stream stream = LZMA_STREAM_INIT;
+  bool stream_initialized = false;
+
+  if (!input || !block || !packed)
+    goto done;
+
+  // the chunk is the zlb\x1A magic, the LZMA properties and dictionary size, then raw LZMA data
+  uint64_t input_offset = source->data_offset;
+  uint64_t input_left = source->compressed_size + sizeof(struct mhk_inno_lzma_header);
+
+  uint32_t magic;
+  struct mhk_inno_lzma_header lzma_header;
+  if (!mhk_inno_pread(source->setup_fd, &magic, sizeof(magic), input_offset) || magic != MHK_INNO_FILE_DATA_MAGIC)
+    goto done;
+  input_offset += sizeof(magic);
+  input_left -= sizeof(magic);
+
+  if (!mhk_inno_pread(source->setup_fd, &lzma_header, sizeof(lzma_header), input_offset) || lzma_header.properties >= 9 * 5 * 5)
+    goto done;
+  input_offset += sizeof(lzma_header);
+  input_left -= sizeof(lzma_header);
+
+  lzma_options_lzma lzma_options;
+  memset(&lzma_options, 0, sizeof(lzma_options_lzma));
+  uint8_t properties = lzma_header.properties;
+  lzma_options.dict_size = lzma_header.dict_size;
+  lzma_options.lc = properties % 9;
+  properties /= 9;
+  lzma_options.pb = properties / 5;
+  lzma_options.lp = properties % 5;
+
+  lzma_filter filters[2] = {{LZMA_FILTER_LZMA1, &lzma_options}, {LZMA_VLI_UNKNOWN, NULL}};
+  if (lzma_raw_decoder(&stream, filters) != LZMA_OK)
+    goto done;
+  stream_initialized = true;
+
+  uint64_t store_offset = 0;
+  for (uint32_t block_index = 0; block_index < source->block_count; block_index++) {
+    uint32_t block_length = mhk_inno_block_length(source, block_index);
+    stream.next_out = block;
+    stream.avail_out = block_length;
+
+    while (stream.avail_out > 0) {
+      if (__atomic_load_n(&source->cancelled, __ATOMIC_RELAXED))
+        goto done;
+
+      if (stream.avail_in == 0 && input_left > 0) {
+        size_t n = (input_left < MHK_INNO_INPUT_BUFFER_SIZE) ? (size_t)input_left : MHK_INNO_INPUT_BUFFER_SIZE;
+        if (!mhk_inno_pread(source->setup_fd, input, n, input_offset))
+          goto done;
+        input_offset += n;
+        input_left -= n;
+        stream.next_in = input;
+        stream.avail_in = n;
+      }
+
+      size_t avail_out = stream.avail_out;
+      lzma_ret ret = lzma_code(&stream, (input_left > 0) ? LZMA_RUN : LZMA_FINISH);
+      if (ret == LZMA_STREAM_END)
+        break;
+      if (ret != LZMA_OK || (stream.avail_out == avail_out && stream.avail_in == 0 && input_left == 0))
+        goto done;
+    }
+    if (stream.avail_out > 0)
+      goto done;
+
+    // deflate the block on its own, at the fastest level since the point is to make blocks independent rather than small; keep the
+    // block as is if that does not help
+    const uint8_t* stored = packed;
+    uLongf stored_size = packed_capacity;
+    uint32_t compressed = 1;
+    if (compress2(packed, &stored_size, block, block_length, Z_BEST_SPEED) != Z_OK || stored_size >= block_length) {
+      stored = block;
+      stored_size = block_length;
+      compressed = 0;
+    }
+    if (!mhk_inno_pwrite(source->store_fd, stored, stored_size, store_offset))
+      goto done;
+
+    pthread_mutex_lock(&source->lock);
+    source->blocks[block_index].store_offset = store_offset;
+    source->blocks[block_index].stored_size = (uint32_t)stored_size;
+    source->blocks[block_index].compressed = compressed;
+    source->blocks_ready = block_index + 1;
+
+    // a reader may well be waiting for this very block, so keep it around decompressed
+    struct mhk_inno_cache_slot* slot = mhk_inno_cache_victim(source);
+    if (slot) {
+      memcpy(slot->data, block, block_length);
+      slot->block = block_index;
+      slot->last_use = ++source->cache_clock;
+    }
+
+    pthread_cond_broadcast(&source->cond);
+    pthread_mutex_unlock(&source->lock);
+
+    store_offset += stored_size;
+  }
+
+  mhk_inno_write_index(source);
+  ok = true;
+
+done:
+  if (stream_initialized)
+    lzma_end(&stream);
+  free(input);
+  free(block);
+  free(packed);
+
+  if (!ok) {
+    pthread_mutex_lock(&source->lock);
+    if (!source->cancelled)
+      fprintf(stderr, "mohawk_inno_source: failed to decode the installer stream at offset %llu\n", (unsigned long long)source->data_offset);
+    source->failed = true;
+    pthread_cond_broadcast(&source->cond);
+    pthread_mutex_unlock(&source->lock);
+  }
+
+  return NULL;
+}
+
+static OSStatus mhk_inno_load_block(struct mhk_inno_data_source* source, struct mhk_inno_block info, uint32_t block_length, uint8_t* data)
+{
+  if (!info.compressed)
+    return (info.stored_size == block_length && mhk_inno_pread(source->store_fd, data, block_length, info.store_offset)) ? noErr : ioErr;
+
+  uint8_t* packed = (uint8_t*)malloc(info.stored_size);
+  if (!packed)
+    return memFullErr;
+
+  OSStatus err = ioErr;
+  uLongf data_size = block_length;
+  if (mhk_inno_pread(source->store_fd, packed, info.stored_size, info.store_offset) &&
+      uncompress(data, &data_size, packed, info.stored_size) == Z_OK && data_size == block_length)
+    err = noErr;
+
+  free(packed);
+  return err;
+}
+
+static OSStatus mhk_inno_copy_from_block(struct mhk_inno_data_source* source, uint32_t block, uint32_t offset, uint32_t length, void* buffer)
+{
+  pthread_mutex_lock(&source->lock);
+
+  // wait for the background decoder to get to the block
+  while (block >= source->blocks_ready && !source->failed)
+    pthread_cond_wait(&source->cond, &source->lock);
+  if (block >= source->blocks_ready) {
+    pthread_mutex_unlock(&source->lock);
+    return ioErr;
+  }
+
+  struct mhk_inno_cache_slot* slot;
+  for (;;) {
+    slot = NULL;
+    for (int i = 0; i < MHK_INNO_CACHE_SLOTS; i++) {
+      if (source->cache[i].block == (int64_t)block) {
+        slot = source->cache + i;
+        break;
+      }
+    }
+
+    if (slot) {
+      // another reader may be loading the block
+      if (slot->loading) {
+        pthread_cond_wait(&source->cond, &source->lock);
+        continue;
+      }
+      slot->users++;
+      slot->last_use = ++source->cache_clock;
+      break;
+    }
+
+    slot = mhk_inno_cache_victim(source);
+    if (!slot) {
+      pthread_cond_wait(&source->cond, &source->lock);
+      continue;
+    }
+
+    // load the block without holding the lock, so that readers of other blocks are not held up
+    struct mhk_inno_block info = source->blocks[block];
+    slot->block = block;
+    slot->loading = true;
+    slot->users = 1;
+    pthread_mutex_unlock(&source->lock);
+
+    OSStatus err = mhk_inno_load_block(source, info, mhk_inno_block_length(source, block), slot->data);
+
+    pthread_mutex_lock(&source->lock);
+    slot->loading = false;
+    slot->last_use = ++source->cache_clock;
+    if (err) {
+      slot->block = -1;
+      slot->users--;
+      pthread_cond_broadcast(&source->cond);
+      pthread_mutex_unlock(&source->lock);
+      return err;
+    }
+    pthread_cond_broadcast(&source->cond);
+    break;
+  }
+  pthread_mutex_unlock(&source->lock);
+
+  memcpy(buffer, slot->data + offset, length);
+
+  pthread_mutex_lock(&source->lock);
+  slot->users--;
+  pthread_cond_broadcast(&source->cond);
+  pthread_mutex_unlock(&source->lock);
+  return noErr;
+}
+
+static OSStatus mhk_inno_data_source_read(mhk_data_source_t* base, SInt64 offset, ByteCount length, void* buffer, ByteCount* actual, uint32_t flags)
+{
+  struct mhk_inno_data_source* source = (struct mhk_inno_data_source*)base;
+  (void)flags;
+
+  if (actual)
+    *actual = 0;
+  if (offset < 0)
+    return paramErr;
+  if (offset >= base->size)
+    return eofErr;
+
+  ByteCount available = (ByteCount)(base->size - offset);
+  if (available > length)
+    available = length;
+
+  ByteCount copied = 0;
+  while (copied < available) {
+    uint64_t position = (uint64_t)offset + copied;
+    uint32_t block = (uint32_t)(position / MHK_INNO_BLOCK_SIZE);
+    uint32_t block_offset = (uint32_t)(position % MHK_INNO_BLOCK_SIZE);
+    uint32_t n = mhk_inno_block_length(source, block) - block_offset;
+    if (n > available - copied)
+      n = (uint32_t)(available - copied);
+
+    OSStatus err = mhk_inno_copy_from_block(source, block, block_offset, n, (uint8_t*)buffer + copied);
+    if (err) {
+      if (actual)
+        *actual = copied;
+      return err;
+    }
+    copied += n;
+  }
+
+  if (actual)
+    *actual = copied;
+  return (copied < length) ? eofErr : noErr;
+}
+
+static void mhk_inno_data_source_close(mhk_data_source_t* base)
+{
+  struct mhk_inno_data_source* source = (struct mhk_inno_data_source*)base;
+
+  if (source->rechunk_thread_running) {
+    pthread_mutex_lock(&source->lock);
+    __atomic_store_n(&source->cancelled, true, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&source->lock);
+    pthread_join(source->rechunk_thread, NULL);
+  }
+
+  if (source->setup_fd != -1)
+    close(source->setup_fd);
+  if (source->store_fd != -1)
+    close(source->store_fd);
+  for (int i = 0; i < MHK_INNO_CACHE_SLOTS; i++)
+    free(source->cache[i].data);
+  free(source->blocks);
+  free(source->index_path);
+  pthread_cond_destroy(&source->cond);
+  pthread_mutex_destroy(&source->lock);
+  free(source);
+}
+
+mhk_data_source_t* mhk_inno_data_source_create(const char* setup_path, uint64_t data_offset, uint64_t compressed_size, uint64_t size,
+                                               const char* block_store_path, OSStatus* error)
+{
+  OSStatus err = memFullErr;
+  struct mhk_inno_data_source* source = (struct mhk_inno_data_source*)calloc(1, sizeof(struct mhk_inno_data_source));
+  if (!source)
+    goto fail;
+
+  source->base.size = (SInt64)size;
+  source->base.read = mhk_inno_data_source_read;
+  source->base.close = mhk_inno_data_source_close;
+  source->setup_fd = -1;
+  source->store_fd = -1;
+  source->data_offset = data_offset;
+  source->compressed_size = compressed_size;
+  pthread_mutex_init(&source->lock, NULL);
+  pthread_cond_init(&source->cond, NULL);
+
+  source->block_count = (uint32_t)((size + MHK_INNO_BLOCK_SIZE - 1) / MHK_INNO_BLOCK_SIZE);
+  source->blocks = (struct mhk_inno_block*)calloc(source->block_count ? source->block_count : 1, sizeof(struct mhk_inno_block));
+  if (!source->blocks)
+    goto fail;
+  for (int i = 0; i < MHK_INNO_CACHE_SLOTS; i++) {
+    source->cache[i].block = -1;
+    source->cache[i].data = (uint8_t*)malloc(MHK_INNO_BLOCK_SIZE);
+    if (!source->cache[i].data)
+      goto fail;
+  }
+
+  size_t store_path_length = strlen(block_store_path);
+  source->index_path = (char*)malloc(store_path_length + sizeof(".index"));
+  if (!source->index_path)
+    goto fail;
+  memcpy(source->index_path, block_store_path, store_path_length);
+  memcpy(source->index_path + store_path_length, ".index", sizeof(".index"));
+
+  err = fnfErr;
+  source->setup_fd = open(setup_path, O_RDONLY);
+  if (source->setup_fd == -1)
+    goto fail;
+
+  // reuse a complete store, otherwise start over
+  err = ioErr;
+  source->store_fd = open(block_store_path, O_RDWR);
+  if (source->store_fd != -1 && mhk_inno_read_index(source)) {
+    source->blocks_ready = source->block_count;
+  } else {
+    if (source->store_fd != -1)
+      close(source->store_fd);
+    unlink(source->index_path);
+    source->store_fd = open(block_store_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (source->store_fd == -1)
+      goto fail;
+
+    if (pthread_create(&source->rechunk_thread, NULL, mhk_inno_rechunk, source) != 0)
+      goto fail;
+    source->rechunk_thread_running = true;
+  }
+
+  if (error)
+    *error = noErr;
+  return &source->base;
+
+fail:
+  if (source)
+    mhk_inno_data_source_close(&source->base);
+  if (error)
+    *error = err;
+  return NULL;
+}
+
+float mhk_inno_data_source_progress(mhk_data_source_t* base)
+{
+  struct mhk_inno_data_source* source = (struct mhk_inno_data_source*)base;
+  if (source->block_count == 0)
+    return 1.0f;
+
+  pthread_mutex_lock(&source->lock);
+  float progress = (float)source->blocks_ready / source->block_count;
+  pthread_mutex_unlock(&source->lock);
+  return progress;
+}
@@ -0,0 +1,33 @@
+/*
+ *  mohawk_inno_source.h
+ *  MHKKit
+ *
+ */
+
+#if !defined(mohawk_inno_source_h)
+#define mohawk_inno_source_h 1
+
+#include <MHKKit/mohawk_data_source.h>
+
+__BEGIN_DECLS
+
+// A data source over a file stored inside a GOG Inno Setup installer, so that its archives can be used before (or without) extracting
+// them. A file in the installer is a single LZMA stream that can only be decoded front to back, so the source re-chunks it once: a
+// background thread decodes the stream and appends it to a block store as independently deflated blocks of MHK_INNO_BLOCK_SIZE bytes.
+// A read of blocks that are in the store only decompresses those blocks; a read past the background decoder waits for it to get there.
+// Once the store is complete, an index is written next to it, and later sources over the same file start with every block available.
+//
+// data_offset is the offset of the file's compressed chunk in the installer, i.e. the installer's file data offset plus the start offset
+// of the file's location entry; compressed_size and size also come from the location entry.
+
+#define MHK_INNO_BLOCK_SIZE (256u * 1024u)
+
+mhk_data_source_t* mhk_inno_data_source_create(const char* setup_path, uint64_t data_offset, uint64_t compressed_size, uint64_t size,
+                                               const char* block_store_path, OSStatus* error);
+
+// the fraction of the file that is in the block store
+float mhk_inno_data_source_progress(mhk_data_source_t* source);
+
+__END_DECLS
+
+#endif // mohawk_inno_source_h
@@ -38,6 +38,9 @@ struct mhk_libav {
   AVFrame* (*avcodec_alloc_frame)(void);
   void (*avcodec_free_frame)(AVFrame**);
   int (*avcodec_decode_audio4)(AVCodecContext*, AVFrame*, int*, AVPacket*);
+  int (*avcodec_decode_video2)(AVCodecContext*, AVFrame*, int*, const AVPacket*);
+  void (*avcodec_flush_buffers)(AVCodecContext*);
+  void (*av_free_packet)(AVPacket*);
 
   void (*av_register_all)(void);
   AVInputFormat* (*av_iformat_next)(AVInputFormat*);
@@ -46,6 +49,7 @@ struct mhk_libav {
   int (*avformat_open_input)(AVFormatContext**, const char*, AVInputFormat*, AVDictionary**);
   int (*avformat_find_stream_info)(AVFormatContext*, AVDictionary**);
   int (*av_read_frame)(AVFormatContext*, AVPacket*);
+  int (*av_seek_frame)(AVFormatContext*, int, int64_t, int);
   void (*avformat_close_input)(AVFormatContext**);
 
   AVIOContext* (*avio_alloc_context)(unsigned char*, int, int, void*,
@@ -41,6 +41,9 @@ static void init_libav()
   LOADFN(avc_handle, avcodec_alloc_frame);
   LOADFN(avc_handle, avcodec_free_frame);
   LOADFN(avc_handle, avcodec_decode_audio4);
+  LOADFN(avc_handle, avcodec_decode_video2);
+  LOADFN(avc_handle, avcodec_flush_buffers);
+  LOADFN(avc_handle, av_free_packet);
 
   LOADFN(avf_handle, av_register_all);
   LOADFN(avf_handle, av_iformat_next);
@@ -49,6 +52,7 @@ static void init_libav()
   LOADFN(avf_handle, avformat_open_input);
   LOADFN(avf_handle, avformat_find_stream_info);
   LOADFN(avf_handle, av_read_frame);
+  LOADFN(avf_handle, av_seek_frame);
   LOADFN(avf_handle, avformat_close_input);
 
   LOADFN(avf_handle, avio_alloc_context);
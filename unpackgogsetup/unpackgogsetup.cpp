@@ -6,9 +6,13 @@
 //  Copyright (c) 2012. All rights reserved.
 //
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 #include <cassert>
@@ -16,13 +20,15 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <Block.h>
+#include <CommonCrypto/CommonDigest.h>
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wdocumentation"
 #include <lzma.h>
 #pragma clang diagnostic pop
-#include <zlib.h>
 
 // magic constants
 
@@ -124,128 +130,193 @@ struct StoredLzmaHeader {
 
 // functional (runtime) classes
 
+// CRC-32 (zlib polynomial) eight bytes at a time with slice-by-8 tables; setup data is checksummed every 4 KB, so this is on the
+// critical path of reading the setup header
+class Crc32 {
+public:
+  static uint32_t compute(const void* data, size_t length)
+  {
+    static const Crc32 tables;
+    const uint32_t(*t)[256] = tables._tables;
+
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint32_t crc = 0xFFFFFFFFu;
+    for (; length >= 8; p += 8, length -= 8) {
+      // the tables are for little-endian words
+      uint32_t one, two;
+      memcpy(&one, p, sizeof(uint32_t));
+      memcpy(&two, p + 4, sizeof(uint32_t));
+      one ^= crc;
+      crc = t[7][one & 0xFF] ^ t[6][(one >> 8) & 0xFF] ^ t[5][(one >> 16) & 0xFF] ^ t[4][one >> 24] ^ t[3][two & 0xFF] ^
+            t[2][(two >> 8) & 0xFF] ^ t[1][(two >> 16) & 0xFF] ^ t[0][two >> 24];
+    }
+    for (; length > 0; ++p, --length)
+      crc = t[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+  }
+
+private:
+  Crc32()
+  {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit)
+        crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+      _tables[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+      for (int slice = 1; slice < 8; ++slice)
+        _tables[slice][i] = (_tables[slice - 1][i] >> 8) ^ _tables[0][_tables[slice - 1][i] & 0xFF];
+    }
+  }
+
+  uint32_t _tables[8][256];
+};
+
+// read-only mapping of the setup file
+class FileMapping {
+public:
+  explicit FileMapping(int fd) : _data(nullptr), _size(0ul)
+  {
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0)
+      return;
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+      return;
+    _data = static_cast<const uint8_t*>(data);
+    _size = static_cast<size_t>(st.st_size);
+  }
+  ~FileMapping()
+  {
+    if (_data)
+      munmap(const_cast<uint8_t*>(_data), _size);
+  }
+  FileMapping(FileMapping const& rhs) = delete;
+  FileMapping& operator=(FileMapping const& rhs) = delete;
+
+  const uint8_t* data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  const uint8_t* _data;
+  size_t _size;
+};
+
+// decompressed block, in an anonymous mapping so that a buffer reserved for a block of unknown size only costs the pages it uses
 class BlockBuffer {
 public:
-  BlockBuffer(void* buffer, size_t size) : _buffer(buffer), _size(size) {}
-  BlockBuffer(BlockBuffer&& rhs) : _buffer(rhs._buffer), _size(rhs._size)
+  explicit BlockBuffer(size_t capacity) : _buffer(nullptr), _size(0ul), _capacity(capacity)
+  {
+    void* buffer = mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    assert(buffer != MAP_FAILED);
+    _buffer = buffer;
+  }
+  BlockBuffer(BlockBuffer&& rhs) : _buffer(rhs._buffer), _size(rhs._size), _capacity(rhs._capacity)
   {
     rhs._buffer = nullptr;
     rhs._size = 0ul;
+    rhs._capacity = 0ul;
   }
   ~BlockBuffer()
   {
     if (_buffer)
-      free(_buffer);
+      munmap(_buffer, _capacity);
   }
   BlockBuffer(BlockBuffer const& rhs) = delete;
   BlockBuffer& operator=(BlockBuffer const& rhs) = delete;
 
   void* data() { return _buffer; }
   size_t size() const { return _size; }
+  size_t capacity() const { return _capacity; }
+  void set_size(size_t size) { _size = size; }
 
 private:
   void* _buffer;
   size_t _size;
+  size_t _capacity;
 };
 
-class BlockReaderLzma;
-
-class Chunk {
-  friend class BlockReaderLzma;
-
+class BlockReaderLzma {
 public:
-  void advance(size_t s)
+  BlockReaderLzma(const FileMapping& mapping, off_t offset)
+      : _mapping(mapping), _ioOffset(offset), _ioBytesLeft(0ul), _chunkPayload(nullptr), _chunkSize(0ul), _header()
   {
-    _available -= s;
-    _offset += s;
   }
-  uint32_t available() const { return _available; }
 
-  uint8_t* read_ptr() { return _chunk.payload + _offset; }
-  uint8_t* read_advance(size_t s)
-  {
-    assert(available() >= s);
-    uint8_t* p = _chunk.payload + _offset;
-    advance(s);
-    return p;
-  }
-
-private:
-  uint32_t _available;
-  uint32_t _offset;
-  StoredChunk _chunk;
-};
-
-class BlockReaderLzma {
-public:
-  BlockReaderLzma(int fd, off_t offset) : _fd(fd), _ioOffset(offset), _ioBytesRead(0l), _ioBytesLeft(0ul), _chunk(), _header() {}
-
-  BlockBuffer read();
+  // decompresses the block at the reader's offset; outputSize is the size of the decompressed block if the caller knows it, or 0
+  BlockBuffer read(size_t outputSize);
   StoredBlockHeader header() const { return _header; }
 
 private:
+  // blocks of unknown size get this many times their stored size of address space, which must never run out
+  static const size_t UNKNOWN_SIZE_EXPANSION = 64ul;
+  static const size_t UNKNOWN_SIZE_MIN_CAPACITY = 0x1000000ul;
+
   void _read_header();
-  void _read_chunk();
+  void _next_chunk();
 
   void _init_lzma();
-  void _grow_lzma_output_buffer();
 
   // --
 
-  int _fd;
+  const FileMapping& _mapping;
   off_t _ioOffset;
-  ssize_t _ioBytesRead;
-  ssize_t _ioBytesLeft;
+  size_t _ioBytesLeft;
+
+  const uint8_t* _chunkPayload;
+  size_t _chunkSize;
 
   lzma_stream _lzmaStream;
 
-  Chunk _chunk;
   StoredBlockHeader _header;
 };
 
 void BlockReaderLzma::_read_header()
 {
-  _ioBytesRead = pread(_fd, &_header, sizeof(StoredBlockHeader), _ioOffset);
-  assert(_ioBytesRead == sizeof(StoredBlockHeader));
-  _ioOffset += _ioBytesRead;
+  assert(_ioOffset + sizeof(StoredBlockHeader) <= _mapping.size());
+  memcpy(&_header, _mapping.data() + _ioOffset, sizeof(StoredBlockHeader));
+  _ioOffset += sizeof(StoredBlockHeader);
 
-  uint32_t checksum = static_cast<uint32_t>(crc32(crc32(0L, Z_NULL, 0), (uint8_t*)&_header.innerHeader, sizeof(StoredBlockInnerHeader)));
+  uint32_t checksum = Crc32::compute(&_header.innerHeader, sizeof(StoredBlockInnerHeader));
   assert(checksum == _header.innerHeaderCrc32);
 
   _ioBytesLeft = _header.innerHeader.blockPayloadStoreSize;
+  assert(_ioOffset + _ioBytesLeft <= _mapping.size());
 }
 
-void BlockReaderLzma::_read_chunk()
+void BlockReaderLzma::_next_chunk()
 {
-  assert(_chunk.available() == 0u);
-
-  _chunk._available = static_cast<uint32_t>(std::min<ssize_t>(StoredChunk::MAX_CHUNK_PAYLOAD_SIZE, _ioBytesLeft - sizeof(uint32_t)));
-  size_t bytesToRead = _chunk._available + sizeof(uint32_t);
-  assert(bytesToRead >= sizeof(uint32_t));
-
-  _ioBytesRead = pread(_fd, &_chunk._chunk, bytesToRead, _ioOffset);
-  assert(_ioBytesRead == static_cast<ssize_t>(bytesToRead));
-  _ioOffset += _ioBytesRead;
-  _ioBytesLeft -= _ioBytesRead;
-
-  uint32_t checksum = static_cast<uint32_t>(crc32(crc32(0L, Z_NULL, 0), (uint8_t*)_chunk._chunk.payload, static_cast<uint32_t>(_chunk._available)));
-  assert(checksum == _chunk._chunk.payloadCrc32);
-
-  _chunk._offset = 0;
+  // a block's payload is a sequence of CRC-prefixed chunks of at most 4 KB; check the chunk in the mapping and decode it from there
+  assert(_ioBytesLeft > sizeof(uint32_t));
+  const uint8_t* chunk = _mapping.data() + _ioOffset;
+  _chunkPayload = chunk + sizeof(uint32_t);
+  _chunkSize = std::min<size_t>(StoredChunk::MAX_CHUNK_PAYLOAD_SIZE, _ioBytesLeft - sizeof(uint32_t));
+  _ioOffset += sizeof(uint32_t) + _chunkSize;
+  _ioBytesLeft -= sizeof(uint32_t) + _chunkSize;
+
+  uint32_t storedChecksum;
+  memcpy(&storedChecksum, chunk, sizeof(uint32_t));
+  uint32_t checksum = Crc32::compute(_chunkPayload, _chunkSize);
+  assert(checksum == storedChecksum);
 }
 
 void BlockReaderLzma::_init_lzma()
 {
-  _read_chunk();
+  _next_chunk();
 
-  StoredLzmaHeader* lh = (StoredLzmaHeader*)_chunk.read_advance(sizeof(StoredLzmaHeader));
-  assert(lh->properties < (9 * 5 * 5));
+  assert(_chunkSize >= sizeof(StoredLzmaHeader));
+  StoredLzmaHeader lh;
+  memcpy(&lh, _chunkPayload, sizeof(StoredLzmaHeader));
+  _chunkPayload += sizeof(StoredLzmaHeader);
+  _chunkSize -= sizeof(StoredLzmaHeader);
+  assert(lh.properties < (9 * 5 * 5));
 
   lzma_options_lzma lzma_options;
   memset(&lzma_options, 0, sizeof(lzma_options_lzma));
 
-  uint8_t properties = lh->properties;
-  lzma_options.dict_size = lh->dictSize;
+  uint8_t properties = lh.properties;
+  lzma_options.dict_size = lh.dictSize;
   lzma_options.lc = properties % 9;
   properties /= 9;
   lzma_options.pb = properties / 5;
@@ -258,18 +329,7 @@ void BlockReaderLzma::_init_lzma()
   assert(r == LZMA_OK);
 }
 
-void BlockReaderLzma::_grow_lzma_output_buffer()
-{
-  uint8_t* buffer = _lzmaStream.next_out - _lzmaStream.total_out;
-
-  size_t increment = std::max((size_t)(_ioBytesLeft * 1.25), 0x10000ul);
-  buffer = (uint8_t*)reallocf(buffer, _lzmaStream.total_out + increment);
-
-  _lzmaStream.next_out = buffer + _lzmaStream.total_out;
-  _lzmaStream.avail_out += increment;
-}
-
-BlockBuffer BlockReaderLzma::read()
+BlockBuffer BlockReaderLzma::read(size_t outputSize)
 {
   // read header
   _read_header();
@@ -277,41 +337,40 @@ BlockBuffer BlockReaderLzma::read()
   // init lzma decompression
   _init_lzma();
 
-  // read everything
-  _lzmaStream.avail_out = _header.innerHeader.blockPayloadStoreSize * 1.25;
-  _lzmaStream.next_out = (uint8_t*)malloc(_lzmaStream.avail_out);
+  // decompress straight into the final buffer; the extra page leaves the decoder room to see the end of the stream after the last byte
+  size_t pageSize = static_cast<size_t>(getpagesize());
+  size_t capacity = (outputSize > 0ul) ? outputSize : std::max(_header.innerHeader.blockPayloadStoreSize * UNKNOWN_SIZE_EXPANSION, UNKNOWN_SIZE_MIN_CAPACITY);
+  capacity = (capacity + pageSize - 1) / pageSize * pageSize + pageSize;
+  BlockBuffer buffer(capacity);
+
+  _lzmaStream.next_out = static_cast<uint8_t*>(buffer.data());
+  _lzmaStream.avail_out = buffer.capacity();
 
   lzma_ret ret = LZMA_OK;
 
-  do {
-    if (_lzmaStream.avail_in == 0) {
-      if (_chunk.available() == 0)
-        _read_chunk();
+  while (true) {
+    _lzmaStream.next_in = _chunkPayload;
+    _lzmaStream.avail_in = _chunkSize;
 
-      _lzmaStream.avail_in = _chunk.available();
-      _lzmaStream.next_in = _chunk.read_ptr();
+    while (_lzmaStream.avail_in > 0 && ret == LZMA_OK) {
+      ret = lzma_code(&_lzmaStream, LZMA_RUN);
+      assert(ret == LZMA_OK || ret == LZMA_STREAM_END);
+      assert(_lzmaStream.avail_out > 0);
     }
 
-    ret = lzma_code(&_lzmaStream, LZMA_RUN);
-    assert(ret == LZMA_OK);
-
-    if (_lzmaStream.avail_out == 0) {
-      _grow_lzma_output_buffer();
-    }
-
-    _chunk.advance(_chunk.available() - _lzmaStream.avail_in);
-  } while (_ioBytesLeft > 0u);
+    if (_ioBytesLeft == 0u || ret != LZMA_OK)
+      break;
+    _next_chunk();
+  }
 
-  do {
+  while (ret == LZMA_OK) {
     ret = lzma_code(&_lzmaStream, LZMA_FINISH);
     assert(ret == LZMA_OK || ret == LZMA_STREAM_END);
+    assert(_lzmaStream.avail_out > 0);
+  }
 
-    if (_lzmaStream.avail_out == 0 && ret == LZMA_OK) {
-      _grow_lzma_output_buffer();
-    }
-  } while (ret == LZMA_OK);
-
-  BlockBuffer buffer(_lzmaStream.next_out - _lzmaStream.total_out, _lzmaStream.total_out);
+  assert(_lzmaStream.total_out >= outputSize);
+  buffer.set_size(_lzmaStream.total_out);
   lzma_end(&_lzmaStream);
 
   return buffer;
@@ -332,6 +391,9 @@ public:
   size_t decompress();
   lzma_stream& get_stream() { return _lzmaStream; }
 
+  // MD5 of the decompressed output, valid once decompress returns
+  const uint8_t* md5() const { return _md5; }
+
 private:
   static const size_t INPUT_BUFFER_SIZE = 0x8000;
   static const size_t OUTPUT_BUFFER_SIZE = 0x10000;
@@ -357,6 +419,9 @@ private:
 
   lzma_stream _lzmaStream;
 
+  CC_MD5_CTX _md5Context;
+  uint8_t _md5[CC_MD5_DIGEST_LENGTH];
+
   uint8_t _lzmaInputBuffer[INPUT_BUFFER_SIZE];
   uint8_t _lzmaOutputBuffer[OUTPUT_BUFFER_SIZE];
 };
@@ -411,6 +476,9 @@ void CompressedFileDecompressorLzma::_write_output_buffer()
   if (bytesToWrite == 0ul)
     return;
 
+  // hash the output on its way to the file, while it is still in cache
+  CC_MD5_Update(&_md5Context, _lzmaOutputBuffer, static_cast<CC_LONG>(bytesToWrite));
+
   ssize_t bytesWritten = write(_outputFD, _lzmaOutputBuffer, bytesToWrite);
   assert((size_t)bytesWritten == bytesToWrite);
 
@@ -429,6 +497,7 @@ size_t CompressedFileDecompressorLzma::decompress()
 
   // init lzma decompression
   _init_lzma();
+  CC_MD5_Init(&_md5Context);
 
   // stream everything
   _lzmaStream.avail_out = OUTPUT_BUFFER_SIZE;
@@ -462,6 +531,7 @@ size_t CompressedFileDecompressorLzma::decompress()
   } while (ret == LZMA_OK);
 
   _write_output_buffer();
+  CC_MD5_Final(_md5, &_md5Context);
 
   size_t totalOut = _lzmaStream.total_out;
   lzma_end(&_lzmaStream);
@@ -499,27 +569,151 @@ static void* parse_setup_buffer(void* buffer, size_t size, size_t nStrings, void
   return readBuffer + extraSize;
 }
 
+struct UnpackJob {
+  std::string outputFilename;
+  const StoredInnoFileLocationEntry* fle;
+};
+
+// returns true if the output of a job already exists with the right size and MD5, which is how resume mode skips files
+static bool output_matches(UnpackJob const& job)
+{
+  int outputFD = open(job.outputFilename.c_str(), O_RDONLY);
+  if (outputFD == -1)
+    return false;
+
+  struct stat outputStat;
+  if (fstat(outputFD, &outputStat) == -1 || (uint64_t)outputStat.st_size != job.fle->originalSize) {
+    close(outputFD);
+    return false;
+  }
+
+  static const size_t READ_BUFFER_SIZE = 0x100000;
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[READ_BUFFER_SIZE]);
+
+  CC_MD5_CTX md5Context;
+  CC_MD5_Init(&md5Context);
+  ssize_t bytesRead;
+  while ((bytesRead = read(outputFD, buffer.get(), READ_BUFFER_SIZE)) > 0)
+    CC_MD5_Update(&md5Context, buffer.get(), static_cast<CC_LONG>(bytesRead));
+  close(outputFD);
+  if (bytesRead == -1)
+    return false;
+
+  uint8_t md5[CC_MD5_DIGEST_LENGTH];
+  CC_MD5_Final(md5, &md5Context);
+  return memcmp(md5, job.fle->md5Sum, CC_MD5_DIGEST_LENGTH) == 0;
+}
+
+// decompresses a job and verifies its MD5; a file that fails verification is removed
+static bool unpack_file(int fd, UnpackJob const& job, CompressedFileDecompressorLzma::ProgressBlock progress)
+{
+  const StoredInnoFileLocationEntry& fle = *job.fle;
+
+  assert(job.outputFilename.size() > 0);
+  assert(fle.chunkSubOffset == 0);
+  assert(fle.flags & StoredInnoFileLocationEntry::Flags::chunkCompressed);
+  assert((fle.flags & StoredInnoFileLocationEntry::Flags::callInstructionOptimized) == 0);
+  assert((fle.flags & StoredInnoFileLocationEntry::Flags::chunkEncrypted) == 0);
+
+  int outputFD = open(job.outputFilename.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0664);
+  assert(outputFD != -1);
+
+  auto decompressor = std::unique_ptr<CompressedFileDecompressorLzma>(
+      new CompressedFileDecompressorLzma(fd, INNO_SETUP_FILE_DATA_OFFSET + fle.startOffset, fle.chunkCompressedSize, outputFD, progress));
+
+  ssize_t bytesWritten = decompressor->decompress();
+  assert((uint64_t)bytesWritten == fle.originalSize);
+  close(outputFD);
+
+  if (memcmp(decompressor->md5(), fle.md5Sum, CC_MD5_DIGEST_LENGTH) != 0) {
+    std::cerr << "MD5 mismatch for '" << job.outputFilename << "'" << std::endl;
+    unlink(job.outputFilename.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+// progress of a parallel unpack, for all the files together since they no longer complete one after another
+class AggregateProgress {
+public:
+  AggregateProgress(uint64_t totalSize) : _totalSize(totalSize), _totalOut(0), _nextThreshold(0.01f) {}
+
+  void add(uint64_t bytes)
+  {
+    uint64_t totalOut = _totalOut.fetch_add(bytes) + bytes;
+    float progress = std::min(1.0f, (float)totalOut / _totalSize);
+
+    std::lock_guard<std::mutex> lock(_outputMutex);
+    if (progress >= _nextThreshold) {
+      std::cout << "<<= " << progress << std::endl;
+      _nextThreshold = std::min(1.0f, progress + 0.01f);
+    }
+  }
+
+  void print_line(std::string const& line)
+  {
+    std::lock_guard<std::mutex> lock(_outputMutex);
+    std::cout << line << std::endl;
+  }
+
+private:
+  uint64_t _totalSize;
+  std::atomic<uint64_t> _totalOut;
+  std::mutex _outputMutex;
+  float _nextThreshold;
+};
+
 int main(int argc, const char* argv[])
 {
-  if (argc < 2) {
-    std::cerr << "usage: << " << argv[0] << " <setup exe>" << std::endl;
+  // -j N decompresses up to N files at once; -j 0 uses one job per core
+  // -r resumes an interrupted unpack, skipping outputs that already have the right size and MD5
+  // -l lists where each file is stored in the setup instead of unpacking, for reading archives out of the setup with MHKKit
+  unsigned jobCount = 1;
+  bool resume = false;
+  bool list = false;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+    if (strcmp(argv[arg], "-j") == 0 && arg + 1 < argc) {
+      jobCount = static_cast<unsigned>(strtoul(argv[++arg], nullptr, 10));
+      if (jobCount == 0)
+        jobCount = std::max(1u, std::thread::hardware_concurrency());
+    } else if (strcmp(argv[arg], "-r") == 0) {
+      resume = true;
+    } else if (strcmp(argv[arg], "-l") == 0) {
+      list = true;
+    } else {
+      break;
+    }
+  }
+
+  if (arg >= argc) {
+    std::cerr << "usage: " << argv[0] << " [-j jobs] [-r] [-l] <setup exe>" << std::endl;
     exit(1);
   }
 
-  int fd = open(argv[1], O_RDONLY);
+  const char* setupPath = argv[arg];
+  int fd = open(setupPath, O_RDONLY);
   if (fd == -1) {
-    std::cerr << "failed to open '" << argv[1] << "': " << strerror(errno) << std::endl;
+    std::cerr << "failed to open '" << setupPath << "': " << strerror(errno) << std::endl;
+    exit(1);
+  }
+
+  // the setup header blocks are read out of a mapping of the setup; files are streamed with pread
+  FileMapping mapping(fd);
+  if (!mapping.data() || mapping.size() < INNO_SETUP_SETUP_DATA_BANNER_OFFSET + INNO_SETUP_SETUP_DATA_BANNER_SIZE) {
+    std::cerr << "failed to map '" << setupPath << "': " << strerror(errno) << std::endl;
     exit(1);
   }
 
   // check the inno setup header
   char banner[INNO_SETUP_SETUP_DATA_BANNER_SIZE];
-  pread(fd, &banner, sizeof(banner), INNO_SETUP_SETUP_DATA_BANNER_OFFSET);
+  memcpy(banner, mapping.data() + INNO_SETUP_SETUP_DATA_BANNER_OFFSET, sizeof(banner));
   assert(strcmp(banner, INNO_SETUP_SETUP_DATA_BANNER) == 0);
 
-  // read the setup header
-  auto br = std::unique_ptr<BlockReaderLzma>(new BlockReaderLzma(fd, INNO_SETUP_SETUP_DATA_BANNER_OFFSET + sizeof(banner)));
-  auto setupBlockBuffer = br->read();
+  // read the setup header; its size is not known until it is parsed
+  auto br = std::unique_ptr<BlockReaderLzma>(new BlockReaderLzma(mapping, INNO_SETUP_SETUP_DATA_BANNER_OFFSET + sizeof(banner)));
+  auto setupBlockBuffer = br->read(0ul);
   StoredBlockHeader setupBlockHeader = br->header();
 
   // process the setup header up to the file entries
@@ -566,8 +760,8 @@ int main(int argc, const char* argv[])
   // read the file location block
   off_t fileLocationBlockOffset =
       INNO_SETUP_SETUP_DATA_BANNER_OFFSET + sizeof(banner) + sizeof(StoredBlockHeader) + setupBlockHeader.innerHeader.blockPayloadStoreSize;
-  br = std::unique_ptr<BlockReaderLzma>(new BlockReaderLzma(fd, fileLocationBlockOffset));
-  auto fileLocationBlockBuffer = br->read();
+  br = std::unique_ptr<BlockReaderLzma>(new BlockReaderLzma(mapping, fileLocationBlockOffset));
+  auto fileLocationBlockBuffer = br->read(setupHeader.numFileLocationEntries * sizeof(StoredInnoFileLocationEntry));
   br.reset();
 
   StoredInnoFileLocationEntry* fileLocationEntries = new StoredInnoFileLocationEntry[setupHeader.numFileLocationEntries];
@@ -611,44 +805,112 @@ int main(int argc, const char* argv[])
 
   std::cout << fileEntryIndicesToUnpack.size() << std::endl;
 
+  std::vector<UnpackJob> jobs;
   for (auto i : fileEntryIndicesToUnpack) {
     StoredInnoFileEntry& fe = fileEntries[i];
     std::string& filename = fileEntriesStrings[i][1];
-    StoredInnoFileLocationEntry& fle = fileLocationEntries[fe.locationEntry];
 
     // use the last component of the filename for the output
-    auto outputFilename = filename.substr(filename.find_last_of('\\') + 1);
-
-    assert(outputFilename.size() > 0);
-    assert(fle.chunkSubOffset == 0);
-    assert(fle.flags & StoredInnoFileLocationEntry::Flags::chunkCompressed);
-    assert((fle.flags & StoredInnoFileLocationEntry::Flags::callInstructionOptimized) == 0);
-    assert((fle.flags & StoredInnoFileLocationEntry::Flags::chunkEncrypted) == 0);
-
-    std::cout << outputFilename << std::endl;
-
-    int outputFD = open(outputFilename.c_str(), O_CREAT | O_WRONLY, 0664);
-    assert(outputFD != -1);
-
-    __block float nextThreshold = 0.1f;
-    CompressedFileDecompressorLzma::ProgressBlock outputProgress = ^(CompressedFileDecompressorLzma & decompressor)
-    {
-      float progress = std::min(1.0f, (float)decompressor.get_stream().total_out / fle.originalSize);
-      if (progress >= nextThreshold) {
-        std::cout << "<< " << progress << std::endl;
-        nextThreshold = std::min(1.0f, progress + 0.1f);
+    jobs.push_back(UnpackJob{filename.substr(filename.find_last_of('\\') + 1), &fileLocationEntries[fe.locationEntry]});
+  }
+
+  // one line per file: name, offset of its compressed chunk in the setup, compressed size and size, which is what
+  // mhk_inno_data_source_create needs
+  if (list) {
+    for (auto& job : jobs)
+      std::cout << job.outputFilename << "\t" << INNO_SETUP_FILE_DATA_OFFSET + job.fle->startOffset << "\t" << job.fle->chunkCompressedSize
+                << "\t" << job.fle->originalSize << std::endl;
+    return 0;
+  }
+
+  if (jobCount > jobs.size())
+    jobCount = static_cast<unsigned>(jobs.size());
+
+  std::atomic<uint32_t> failures(0);
+
+  if (jobCount <= 1) {
+    for (auto& job : jobs) {
+      const StoredInnoFileLocationEntry& fle = *job.fle;
+      std::cout << job.outputFilename << std::endl;
+
+      if (resume && output_matches(job)) {
+        std::cout << "<< " << 1.0f << std::endl;
+        continue;
       }
-    };
 
-    auto decompressor = std::unique_ptr<CompressedFileDecompressorLzma>(
-        new CompressedFileDecompressorLzma(fd, INNO_SETUP_FILE_DATA_OFFSET + fle.startOffset, fle.chunkCompressedSize, outputFD, outputProgress));
+      __block float nextThreshold = 0.1f;
+      CompressedFileDecompressorLzma::ProgressBlock outputProgress = ^(CompressedFileDecompressorLzma & decompressor)
+      {
+        float progress = std::min(1.0f, (float)decompressor.get_stream().total_out / fle.originalSize);
+        if (progress >= nextThreshold) {
+          std::cout << "<< " << progress << std::endl;
+          nextThreshold = std::min(1.0f, progress + 0.1f);
+        }
+      };
+
+      if (!unpack_file(fd, job, outputProgress))
+        ++failures;
+    }
+  } else {
+    // every file is an independent LZMA stream read with pread, so files decompress in parallel on a shared fd; hand out the largest
+    // files first so that no worker is left with a big file at the end while the others sit idle
+    std::sort(jobs.begin(), jobs.end(),
+              [](UnpackJob const& a, UnpackJob const& b) { return a.fle->chunkCompressedSize > b.fle->chunkCompressedSize; });
+
+    uint64_t totalSize = 0;
+    for (auto& job : jobs)
+      totalSize += job.fle->originalSize;
+
+    AggregateProgress aggregateProgress(totalSize);
+    std::atomic<size_t> nextJob(0);
+
+    AggregateProgress* aggregateProgressPtr = &aggregateProgress;
+    std::atomic<size_t>* nextJobPtr = &nextJob;
+    std::atomic<uint32_t>* failuresPtr = &failures;
+    std::vector<UnpackJob>* jobsPtr = &jobs;
+
+    std::cout << "<<= " << 0.0f << std::endl;
+
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w != jobCount; ++w) {
+      workers.push_back(std::thread([=]() {
+        for (;;) {
+          size_t jobIndex = nextJobPtr->fetch_add(1);
+          if (jobIndex >= jobsPtr->size())
+            break;
+          UnpackJob& job = (*jobsPtr)[jobIndex];
+
+          aggregateProgressPtr->print_line(job.outputFilename);
+
+          if (resume && output_matches(job)) {
+            aggregateProgressPtr->add(job.fle->originalSize);
+            continue;
+          }
+
+          __block uint64_t lastOut = 0;
+          CompressedFileDecompressorLzma::ProgressBlock outputProgress = ^(CompressedFileDecompressorLzma & decompressor)
+          {
+            uint64_t out = decompressor.get_stream().total_out;
+            aggregateProgressPtr->add(out - lastOut);
+            lastOut = out;
+          };
+
+          if (!unpack_file(fd, job, outputProgress))
+            failuresPtr->fetch_add(1);
+        }
+      }));
+    }
 
-    ssize_t bytesWritten = decompressor->decompress();
-    assert((uint64_t)bytesWritten == fle.originalSize);
-    close(outputFD);
+    for (auto& worker : workers)
+      worker.join();
   }
 
   close(fd);
 
+  if (failures > 0) {
+    std::cerr << failures.load() << " files failed verification" << std::endl;
+    return 1;
+  }
+
   return 0;
 }